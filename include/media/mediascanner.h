@@ -24,8 +24,6 @@
 #include <utils/String8.h>
 #include <pthread.h>
 
-struct dirent;
-
 namespace android {
 
 class MediaScannerClient;
@@ -85,19 +83,35 @@ struct MediaScanner {
 protected:
     const char *locale() const;
 
+    // If a scan worker already extracted the tags of "path" during
+    // processDirectory(), passes them on to "client" and returns true.
+    bool takePrefetchedFile(
+            const char *path, MediaScannerClient &client,
+            MediaScanResult *result);
+
 private:
+    struct DirectoryEntry;
+    struct DirectoryListing;
+    struct RecordingClient;
+    struct ScanPool;
+
     // current locale (like "ja_JP"), created/destroyed with strdup()/free()
     char *mLocale;
     char *mSkipList;
     int *mSkipIndex;
 
+    // Only set during processDirectory() in parallel scan mode.
+    ScanPool *mPool;
+
     MediaScanResult doProcessDirectory(
             char *path, int pathRemaining, MediaScannerClient &client, bool noMedia);
     MediaScanResult doProcessDirectoryEntry(
             char *path, int pathRemaining, MediaScannerClient &client, bool noMedia,
-            struct dirent* entry, char* fileSpot);
+            const DirectoryEntry &entry, char* fileSpot);
     void loadSkipList();
-    bool shouldSkipDirectory(char *path);
+    bool shouldSkipDirectory(const char *path);
+
+    static void ListDirectory(const char *path, DirectoryListing *listing);
 
 
     MediaScanner(const MediaScanner &);
@@ -30,6 +30,7 @@
 
 namespace android {
 
+struct ABuffer;
 struct AMessage;
 struct AString;
 struct IMediaHTTPService;
@@ -91,6 +92,16 @@ public:
 
     virtual ssize_t readAt(off64_t offset, void *data, size_t size) = 0;
 
+    // Returns in *view a buffer referencing the size bytes at offset
+    // without copying them, if the source keeps that range in memory.
+    // The view holds a reference to the underlying storage and stays
+    // valid after the source is destroyed. Returns ERROR_UNSUPPORTED
+    // if views are not available, callers then fall back to readAt().
+    virtual status_t getReadView(
+            off64_t /* offset */, size_t /* size */, sp<ABuffer> * /* view */) {
+        return ERROR_UNSUPPORTED;
+    }
+
     // Convenience methods:
     bool getUInt16(off64_t offset, uint16_t *x);
     bool getUInt24(off64_t offset, uint32_t *x); // 3 byte int, returned as a 32-bit int
@@ -131,6 +142,14 @@ public:
         return String8();
     }
 
+    // Fills in *id with a string identifying the local file backing this
+    // source and its version (e.g. inode, size and modification time),
+    // suitable for keying persistent caches. Returns ERROR_UNSUPPORTED if
+    // the source isn't backed by a local file.
+    virtual status_t getFileIdentity(String8 * /* id */) {
+        return ERROR_UNSUPPORTED;
+    }
+
     virtual String8 getMIMEType() const;
 
 protected:
@@ -27,6 +27,8 @@
 
 namespace android {
 
+struct ABuffer;
+
 class FileSource : public DataSource {
 public:
     FileSource(const char *filename);
@@ -37,8 +39,13 @@ public:
 
     virtual ssize_t readAt(off64_t offset, void *data, size_t size);
 
+    // Only available if the file is memory mapped.
+    virtual status_t getReadView(off64_t offset, size_t size, sp<ABuffer> *view);
+
     virtual status_t getSize(off64_t *size);
 
+    virtual status_t getFileIdentity(String8 *id);
+
     virtual sp<DecryptHandle> DrmInitialization(const char *mime);
 
     virtual void getDrmInfo(sp<DecryptHandle> &handle, DrmManagerClient **client);
@@ -47,11 +54,29 @@ protected:
     virtual ~FileSource();
 
 private:
+    enum {
+        // Reads that start within this distance of the previous read's end
+        // count as sequential; this tolerates interleaved audio/video reads.
+        kSequentialSlack = 256 * 1024,
+        // Number of consecutive sequential reads before we hint readahead.
+        kMinSequentialReads = 4,
+        // How far ahead of the read position the kernel is asked to fetch.
+        kReadAheadBytes = 2 * 1024 * 1024,
+    };
+
     int mFd;
     int64_t mOffset;
     int64_t mLength;
     Mutex mLock;
 
+    // Read-only mapping of [mOffset, mOffset + mLength), if enabled.
+    sp<ABuffer> mMapping;
+
+    // Access pattern tracking for readahead hints, protected by mLock.
+    off64_t mLastReadEnd;
+    size_t mNumSequentialReads;
+    off64_t mReadAheadEnd;
+
     /*for DRM*/
     sp<DecryptHandle> mDecryptHandle;
     DrmManagerClient *mDrmManagerClient;
@@ -59,6 +84,10 @@ private:
     size_t mDrmBufSize;
     unsigned char *mDrmBuf;
 
+    void init();
+    void mapFile();
+    void hintReadAhead(off64_t offset, size_t size);
+
     ssize_t readAtDRM(off64_t offset, void *data, size_t size);
 
     FileSource(const FileSource &);
@@ -20,10 +20,12 @@
 
 #include <media/stagefright/MediaBuffer.h>
 #include <utils/Errors.h>
+#include <utils/Vector.h>
 #include <utils/threads.h>
 
 namespace android {
 
+struct AString;
 class MediaBuffer;
 class MetaData;
 
@@ -39,7 +41,15 @@ public:
     // The returned buffer will have a reference count of 1.
     // If nonBlocking is true and a buffer is not immediately available,
     // buffer is set to NULL and it returns WOULD_BLOCK.
-    status_t acquire_buffer(MediaBuffer **buffer, bool nonBlocking = false);
+    // If requestedSize is nonzero, only buffers whose size() is at least
+    // requestedSize are considered and the smallest fitting one is used;
+    // BAD_VALUE is returned if no buffer in the group is large enough.
+    status_t acquire_buffer(
+            MediaBuffer **buffer, bool nonBlocking = false,
+            size_t requestedSize = 0);
+
+    // Appends acquisition and wait statistics to *out.
+    void dump(AString *out);
 
 protected:
     virtual void signalBufferReturned(MediaBuffer *buffer);
@@ -49,8 +59,20 @@ private:
 
     Mutex mLock;
     Condition mCondition;
+    size_t mNumWaiters;
 
     MediaBuffer *mFirstBuffer, *mLastBuffer;
+    size_t mMaxBufferSize;
+
+    // Buffers with a reference count of 0, most recently returned last.
+    Vector<MediaBuffer *> mFreeBuffers;
+
+    uint64_t mNumAcquired;
+    uint64_t mNumWaits;
+    int64_t mTotalWaitUs;
+    int64_t mMaxWaitUs;
+
+    ssize_t findFreeBuffer_l(size_t requestedSize) const;
 
     MediaBufferGroup(const MediaBufferGroup &);
     MediaBufferGroup &operator=(const MediaBufferGroup &);
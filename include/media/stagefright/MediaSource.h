@@ -26,6 +26,7 @@
 
 namespace android {
 
+struct AString;
 class MediaBuffer;
 class MetaData;
 
@@ -114,6 +115,10 @@ struct MediaSource : public virtual RefBase {
         return ERROR_UNSUPPORTED;
     }
 
+    // Appends a description of the source's internal state, such as the
+    // statistics of its MediaBufferGroup, to "out" for dumpsys.
+    virtual void dump(AString * /* out */) {}
+
 protected:
     virtual ~MediaSource();
 
@@ -51,6 +51,7 @@ enum {
     kKeyChannelCount      = '#chn',  // int32_t
     kKeyChannelMask       = 'chnm',  // int32_t
     kKeySampleRate        = 'srte',  // int32_t (audio sampling rate Hz)
+    kKeyPcmEncoding       = 'PCMe',  // int32_t (audio_format_t of raw audio)
     kKeyFrameRate         = 'frmR',  // int32_t (video frame rate fps)
     kKeyBitRate           = 'brte',  // int32_t (bps)
     kKeyESDS              = 'esds',  // raw data
@@ -258,9 +259,10 @@ private:
         uint32_t mType;
         size_t mSize;
 
+        // Large enough to keep int64_t, pointer and Rect values inline.
         union {
             void *ext_data;
-            float reservoir;
+            int64_t reservoir[2];
         } u;
 
         bool usesReservoir() const {
@@ -283,7 +285,17 @@ private:
         int32_t mLeft, mTop, mRight, mBottom;
     };
 
-    KeyedVector<uint32_t, typed_data> mItems;
+    struct Item;
+    struct Storage;
+
+    // Items sorted by key in a flat array. The array is shared with copies
+    // of this MetaData until either side modifies it, and clear() keeps
+    // its capacity so recycled buffers don't reallocate per sample.
+    Storage *mStorage;
+
+    ssize_t findIndex(uint32_t key, size_t *insertionPos) const;
+    void editStorage(size_t minCapacity);
+    void releaseStorage();
 
     // MetaData &operator=(const MetaData &);
 };
@@ -30,8 +30,32 @@ public:
     ABitReader(const uint8_t *data, size_t size);
     virtual ~ABitReader();
 
-    uint32_t getBits(size_t n);
-    void skipBits(size_t n);
+    // Reads n <= 32 bits. Requests that can be served from the reservoir
+    // are handled inline without any checks.
+    inline uint32_t getBits(size_t n) {
+        if (n - 1 < mNumBitsLeft && n <= 32) {
+            uint32_t result = (uint32_t)(mReservoir >> (64 - n));
+            mReservoir <<= n;
+            mNumBitsLeft -= n;
+            return result;
+        }
+
+        return getBitsSlow(n);
+    }
+
+    inline void skipBits(size_t n) {
+        if (n < mNumBitsLeft) {
+            mReservoir <<= n;
+            mNumBitsLeft -= n;
+            return;
+        }
+
+        skipBitsSlow(n);
+    }
+
+    // Exp-Golomb coded values as used by H.264/H.265 headers, ue(v) and se(v).
+    uint32_t getUE();
+    int32_t getSE();
 
     void putBits(uint32_t x, size_t n);
 
@@ -43,11 +67,14 @@ protected:
     const uint8_t *mData;
     size_t mSize;
 
-    uint32_t mReservoir;  // left-aligned bits
+    uint64_t mReservoir;  // left-aligned bits
     size_t mNumBitsLeft;
 
     virtual void fillReservoir();
 
+    uint32_t getBitsSlow(size_t n);
+    void skipBitsSlow(size_t n);
+
     DISALLOW_EVIL_CONSTRUCTORS(ABitReader);
 };
 
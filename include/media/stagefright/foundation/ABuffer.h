@@ -46,6 +46,12 @@ struct ABuffer : public RefBase {
     // create buffer from dup of some memory block
     static sp<ABuffer> CreateAsCopy(const void *data, size_t capacity);
 
+    // create buffer that views the range [offset, offset + size) relative to
+    // parent->data() without copying. The slice keeps the parent (and hence
+    // its storage) alive, but has its own range, meta and int32 data.
+    static sp<ABuffer> CreateAsSlice(
+            const sp<ABuffer> &parent, size_t offset, size_t size);
+
     void setInt32Data(int32_t data) { mInt32Data = data; }
     int32_t int32Data() const { return mInt32Data; }
 
@@ -58,6 +64,13 @@ protected:
     virtual ~ABuffer();
 
 private:
+    friend struct ABufferPool;
+
+    // Restores a recycled buffer to the state of a freshly allocated one,
+    // posting the farewell message of its previous user, if any.
+    void reset();
+
+    sp<ABuffer> mParent;
     sp<AMessage> mFarewell;
     sp<AMessage> mMeta;
 
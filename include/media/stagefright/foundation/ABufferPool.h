@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef A_BUFFER_POOL_H_
+
+#define A_BUFFER_POOL_H_
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+#include <utils/threads.h>
+
+namespace android {
+
+struct ABuffer;
+
+// A recycling allocator for ABuffers. Capacities are rounded up to a
+// power-of-two size class; a pooled buffer becomes available again as soon
+// as the pool holds the only remaining reference to it (i.e. every client
+// and every slice created from it has been released).
+//
+// A farewell message set on a pooled buffer is posted once the pool notices
+// the buffer is free again, i.e. when it is handed out anew, trimmed or the
+// pool goes away, rather than at the moment the last client lets go.
+struct ABufferPool : public RefBase {
+    ABufferPool(
+            size_t minCapacity = 256,
+            size_t maxCapacity = 65536,
+            size_t maxBuffersPerClass = 32);
+
+    // Returns a buffer of at least "capacity" bytes with its range set to
+    // [0, capacity). Requests larger than maxCapacity, or made while every
+    // buffer of the matching class is in use and the class is full, are
+    // served by a plain unpooled allocation.
+    sp<ABuffer> acquire(size_t capacity);
+
+    // Drops all buffers not currently in use.
+    void trim();
+
+protected:
+    virtual ~ABufferPool();
+
+private:
+    Mutex mLock;
+
+    size_t mMinCapacity;
+    size_t mMaxCapacity;
+    size_t mMaxBuffersPerClass;
+
+    Vector<Vector<sp<ABuffer> > > mClasses;
+
+    size_t classIndex(size_t capacity) const;
+
+    DISALLOW_EVIL_CONSTRUCTORS(ABufferPool);
+};
+
+}  // namespace android
+
+#endif  // A_BUFFER_POOL_H_
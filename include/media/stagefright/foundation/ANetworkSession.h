@@ -103,6 +103,7 @@ private:
     int32_t mNextSessionID;
 
     int mPipeFd[2];
+    int mEpollFd;
 
     KeyedVector<int32_t, sp<Session> > mSessions;
 
@@ -125,6 +126,11 @@ private:
     void threadLoop();
     void interrupt();
 
+    // Brings the session's epoll registration in line with whether it
+    // currently wants to read and/or write. Call with mLock held.
+    void updateSessionEvents_l(const sp<Session> &session);
+    void unregisterSession_l(const sp<Session> &session);
+
     static status_t MakeSocketNonBlocking(int s);
 
     DISALLOW_EVIL_CONSTRUCTORS(ANetworkSession);
@@ -36,6 +36,14 @@ struct AString {
     ~AString();
 
     AString &operator=(const AString &from);
+
+#if __cplusplus >= 201103L
+    AString(AString &&from);
+    AString &operator=(AString &&from);
+#endif
+
+    // Exchanges contents without copying heap-allocated data.
+    void swap(AString &other);
     void setTo(const char *s);
     void setTo(const char *s, size_t size);
     void setTo(const AString &from, size_t offset, size_t n);
@@ -93,13 +101,23 @@ struct AString {
     status_t writeToParcel(Parcel *parcel) const;
 
 private:
-    static const char *kEmptyString;
+    // Strings of up to kInlineSize - 1 characters are stored in mInline
+    // and never touch the heap.
+    enum {
+        kInlineSize = 24,
+    };
 
     char *mData;
     size_t mSize;
     size_t mAllocSize;
+    char mInline[kInlineSize];
+
+    bool isInline() const { return mData == mInline; }
+    void reserve(size_t allocSize);
 
-    void makeMutable();
+    // Takes over the contents of "from", which must be distinct from this
+    // string, and leaves "from" empty. The current contents must be empty.
+    void moveFrom(AString &from);
 };
 
 AString StringPrintf(const char *format, ...);
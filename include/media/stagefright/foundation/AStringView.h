@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef A_STRING_VIEW_H_
+
+#define A_STRING_VIEW_H_
+
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+
+#include <media/stagefright/foundation/AString.h>
+
+namespace android {
+
+// A non-owning reference to a run of characters, used by parsers to slice
+// their input without allocating. The referenced characters are not
+// necessarily NUL-terminated and must outlive the view.
+struct AStringView {
+    AStringView()
+        : mData(""),
+          mSize(0) {
+    }
+
+    AStringView(const char *s)
+        : mData(s),
+          mSize(strlen(s)) {
+    }
+
+    AStringView(const char *s, size_t size)
+        : mData(s),
+          mSize(size) {
+    }
+
+    AStringView(const AString &s)
+        : mData(s.c_str()),
+          mSize(s.size()) {
+    }
+
+    const char *data() const { return mData; }
+    size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+
+    char operator[](size_t index) const { return mData[index]; }
+
+    // Clamps "offset" and "n" to the extent of the view.
+    AStringView substr(size_t offset, size_t n = (size_t)-1) const {
+        if (offset > mSize) {
+            offset = mSize;
+        }
+        if (n > mSize - offset) {
+            n = mSize - offset;
+        }
+        return AStringView(mData + offset, n);
+    }
+
+    ssize_t find(char c, size_t start = 0) const {
+        for (size_t i = start; i < mSize; ++i) {
+            if (mData[i] == c) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    bool startsWith(const char *prefix) const {
+        size_t prefixLen = strlen(prefix);
+        return prefixLen <= mSize && !memcmp(mData, prefix, prefixLen);
+    }
+
+    bool startsWithIgnoreCase(const char *prefix) const {
+        size_t prefixLen = strlen(prefix);
+        return prefixLen <= mSize && !strncasecmp(mData, prefix, prefixLen);
+    }
+
+    bool operator==(const char *s) const {
+        return strlen(s) == mSize && !memcmp(mData, s, mSize);
+    }
+
+    bool operator!=(const char *s) const {
+        return !operator==(s);
+    }
+
+    // Returns the view without leading and trailing whitespace.
+    AStringView trimmed() const {
+        size_t i = 0;
+        while (i < mSize && isspace(mData[i])) {
+            ++i;
+        }
+
+        size_t j = mSize;
+        while (j > i && isspace(mData[j - 1])) {
+            --j;
+        }
+
+        return AStringView(mData + i, j - i);
+    }
+
+    AString toAString() const {
+        return AString(mData, mSize);
+    }
+
+private:
+    const char *mData;
+    size_t mSize;
+};
+
+}  // namespace android
+
+#endif  // A_STRING_VIEW_H_
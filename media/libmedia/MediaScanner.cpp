@@ -17,17 +17,198 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "MediaScanner"
 #include <cutils/properties.h>
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
+#include <utils/Vector.h>
 
 #include <media/mediascanner.h>
 
 #include <sys/stat.h>
 #include <dirent.h>
+#include <stdio.h>
+#include <unistd.h>
 
 namespace android {
 
+// Parallel scans are enabled by setting "media.scanner.threads" to the
+// number of worker threads to use.
+static const int kMaxScanThreads = 8;
+
+// Upper bound on the number of directories listed ahead of the walk.
+static const size_t kMaxListingsAhead = 256;
+
+struct MediaScanner::DirectoryEntry {
+    String8 mName;
+    int mType;  // DT_DIR or DT_REG
+    bool mHaveStat;
+    long long mLastModified;
+    long long mSize;
+};
+
+struct MediaScanner::DirectoryListing {
+    bool mDone;
+    bool mOpened;
+    int mErrno;
+    bool mHasNoMedia;
+    Vector<DirectoryEntry> mEntries;
+};
+
+// Records what processFile() reports about a file on a worker thread, so
+// that it can be passed on to the real client on the scanning thread.
+struct MediaScanner::RecordingClient : public MediaScannerClient {
+    virtual status_t scanFile(const char* /* path */, long long /* lastModified */,
+            long long /* fileSize */, bool /* isDirectory */, bool /* noMedia */) {
+        return OK;
+    }
+
+    virtual status_t handleStringTag(const char* name, const char* value) {
+        mEvents.push();
+        Event *event = &mEvents.editItemAt(mEvents.size() - 1);
+        event->mIsMimeType = false;
+        event->mName.setTo(name);
+        event->mValue.setTo(value);
+        return OK;
+    }
+
+    virtual status_t setMimeType(const char* mimeType) {
+        mEvents.push();
+        Event *event = &mEvents.editItemAt(mEvents.size() - 1);
+        event->mIsMimeType = true;
+        event->mValue.setTo(mimeType);
+        return OK;
+    }
+
+    status_t replay(MediaScannerClient &client) const {
+        for (size_t i = 0; i < mEvents.size(); ++i) {
+            const Event &event = mEvents.itemAt(i);
+
+            status_t status;
+            if (event.mIsMimeType) {
+                status = client.setMimeType(event.mValue.string());
+            } else {
+                status = client.addStringTag(
+                        event.mName.string(), event.mValue.string());
+            }
+
+            if (status != OK) {
+                return status;
+            }
+        }
+        return OK;
+    }
+
+private:
+    struct Event {
+        bool mIsMimeType;
+        String8 mName;
+        String8 mValue;
+    };
+
+    Vector<Event> mEvents;
+};
+
+// Lists directories ahead of the (single threaded) walk and extracts the
+// tags of the files in the directory being walked, on a pool of worker
+// threads. The client is still only ever called on the scanning thread.
+//
+// Each worker lists the subdirectories it finds itself, newest first, and
+// steals the oldest pending directory of another worker once it runs out.
+// Extracting files always takes precedence over listing further ahead.
+//
+// Files are only extracted speculatively if "media.scanner.skip-cache"
+// names a file. The size and modification time of every file scanned are
+// kept there, and only files that are new or changed since the last scan
+// are extracted ahead of the walk. Without the cache (and on the first scan
+// with it) nothing tells which files the client is going to process, so
+// the workers only list directories.
+struct MediaScanner::ScanPool {
+    ScanPool(MediaScanner *scanner, int numThreads);
+    ~ScanPool();
+
+    // Returns false if "path" hasn't been listed by a worker, in which
+    // case the caller lists it and should queueSubdirectories() after.
+    bool takeListing(const char *path, DirectoryListing *listing);
+    void queueSubdirectories(const char *path, const DirectoryListing &listing);
+
+    void prefetchFiles(const char *path, const DirectoryListing &listing);
+    void discardFiles(const char *path, const DirectoryListing &listing);
+    bool takeFile(
+            const char *path, MediaScannerClient &client,
+            MediaScanResult *result);
+
+    void noteFile(const char *path, const DirectoryEntry &entry);
+    void storeSkipCache(const char *root);
+
+private:
+    enum FileState {
+        QUEUED,
+        RUNNING,
+        DONE,
+    };
+
+    struct PrefetchedFile {
+        FileState mState;
+        bool mDiscarded;
+        MediaScanResult mResult;
+        RecordingClient mClient;
+    };
+
+    struct FileStamp {
+        long long mLastModified;
+        long long mSize;
+    };
+
+    struct ScannedFile {
+        String8 mPath;
+        FileStamp mStamp;
+    };
+
+    struct Worker {
+        ScanPool *mPool;
+        pthread_t mThread;
+        List<String8> mDirectories;
+    };
+
+    MediaScanner *mScanner;
+
+    Mutex mLock;
+    Condition mCondition;
+    bool mDone;
+
+    Worker *mWorkers;
+    int mNumWorkers;
+
+    // Listings in progress or done, but not taken yet.
+    KeyedVector<String8, DirectoryListing *> mListings;
+
+    // Directories the scanning thread listed itself.
+    KeyedVector<String8, bool> mClaimed;
+
+    List<String8> mFileQueue;
+    KeyedVector<String8, PrefetchedFile *> mFiles;
+
+    String8 mSkipCachePath;
+    bool mHaveLastScan;
+    KeyedVector<String8, FileStamp> mLastScan;
+    Vector<ScannedFile> mThisScan;
+
+    static void *ThreadWrapper(void *me);
+    void threadLoop(Worker *worker);
+
+    bool dequeueDirectory_l(Worker *worker, String8 *path);
+    void queueSubdirectories_l(
+            Worker *worker, const char *path, const DirectoryListing &listing);
+
+    void loadSkipCache();
+    static int CompareScannedFiles(
+            const ScannedFile *a, const ScannedFile *b);
+
+    ScanPool(const ScanPool &);
+    ScanPool &operator=(const ScanPool &);
+};
+
 MediaScanner::MediaScanner()
-    : mLocale(NULL), mSkipList(NULL), mSkipIndex(NULL) {
+    : mLocale(NULL), mSkipList(NULL), mSkipIndex(NULL), mPool(NULL) {
     loadSkipList();
 }
 
@@ -99,14 +280,33 @@ MediaScanResult MediaScanner::processDirectory(
 
     client.setLocale(locale());
 
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("media.scanner.threads", value, NULL)) {
+        int numThreads = atoi(value);
+        if (numThreads > kMaxScanThreads) {
+            numThreads = kMaxScanThreads;
+        }
+        if (numThreads > 1) {
+            mPool = new ScanPool(this, numThreads);
+        }
+    }
+
     MediaScanResult result = doProcessDirectory(pathBuffer, pathRemaining, client, false);
 
+    if (mPool) {
+        if (result == MEDIA_SCAN_RESULT_OK) {
+            mPool->storeSkipCache(pathBuffer);
+        }
+        delete mPool;
+        mPool = NULL;
+    }
+
     free(pathBuffer);
 
     return result;
 }
 
-bool MediaScanner::shouldSkipDirectory(char *path) {
+bool MediaScanner::shouldSkipDirectory(const char *path) {
     if (path && mSkipList && mSkipIndex) {
         int len = strlen(path);
         int idx = 0;
@@ -128,23 +328,32 @@ bool MediaScanner::shouldSkipDirectory(char *path) {
     return false;
 }
 
-MediaScanResult MediaScanner::doProcessDirectory(
-        char *path, int pathRemaining, MediaScannerClient &client, bool noMedia) {
-    // place to copy file or directory name
-    char* fileSpot = path + strlen(path);
-    struct dirent* entry;
+// static
+void MediaScanner::ListDirectory(const char *path, DirectoryListing *listing) {
+    listing->mOpened = false;
+    listing->mErrno = 0;
+    listing->mHasNoMedia = false;
+    listing->mEntries.clear();
 
-    if (shouldSkipDirectory(path)) {
-        ALOGD("Skipping: %s", path);
-        return MEDIA_SCAN_RESULT_OK;
+    char pathBuffer[PATH_MAX + 1];
+    int pathLength = strlen(path);
+    int pathRemaining = PATH_MAX - pathLength;
+    if (pathRemaining < 0) {
+        listing->mErrno = ENAMETOOLONG;
+        return;
     }
+    strcpy(pathBuffer, path);
+
+    // place to copy file or directory name
+    char* fileSpot = pathBuffer + pathLength;
+    struct dirent* entry;
 
     // Treat all files as non-media in directories that contain a  ".nomedia" file
     if (pathRemaining >= 8 /* strlen(".nomedia") */ ) {
         strcpy(fileSpot, ".nomedia");
-        if (access(path, F_OK) == 0) {
+        if (access(pathBuffer, F_OK) == 0) {
             ALOGV("found .nomedia, setting noMedia flag");
-            noMedia = true;
+            listing->mHasNoMedia = true;
         }
 
         // restore path
@@ -153,56 +362,118 @@ MediaScanResult MediaScanner::doProcessDirectory(
 
     DIR* dir = opendir(path);
     if (!dir) {
-        ALOGW("Error opening directory '%s', skipping: %s.", path, strerror(errno));
-        return MEDIA_SCAN_RESULT_SKIPPED;
+        listing->mErrno = errno;
+        return;
     }
+    listing->mOpened = true;
 
-    MediaScanResult result = MEDIA_SCAN_RESULT_OK;
     while ((entry = readdir(dir))) {
-        if (doProcessDirectoryEntry(path, pathRemaining, client, noMedia, entry, fileSpot)
-                == MEDIA_SCAN_RESULT_ERROR) {
-            result = MEDIA_SCAN_RESULT_ERROR;
-            break;
+        const char* name = entry->d_name;
+
+        // ignore "." and ".."
+        if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
+            continue;
         }
+
+        int nameLength = strlen(name);
+        if (nameLength + 1 > pathRemaining) {
+            // path too long!
+            continue;
+        }
+        strcpy(fileSpot, name);
+
+        int type = entry->d_type;
+        struct stat statbuf;
+        bool haveStat = false;
+        if (type == DT_UNKNOWN || type == DT_DIR || type == DT_REG) {
+            haveStat = (stat(pathBuffer, &statbuf) == 0);
+        }
+        if (type == DT_UNKNOWN) {
+            // If the type is unknown, use the stat() results instead.
+            // This is sometimes necessary when accessing NFS mounted filesystems, but
+            // could be needed in other cases well.
+            if (haveStat) {
+                if (S_ISREG(statbuf.st_mode)) {
+                    type = DT_REG;
+                } else if (S_ISDIR(statbuf.st_mode)) {
+                    type = DT_DIR;
+                }
+            } else {
+                ALOGD("stat() failed for %s: %s", pathBuffer, strerror(errno) );
+            }
+        }
+        if (type != DT_DIR && type != DT_REG) {
+            continue;
+        }
+
+        listing->mEntries.push();
+        DirectoryEntry *dirEntry =
+            &listing->mEntries.editItemAt(listing->mEntries.size() - 1);
+        dirEntry->mName.setTo(name);
+        dirEntry->mType = type;
+        dirEntry->mHaveStat = haveStat;
+        dirEntry->mLastModified = haveStat ? statbuf.st_mtime : 0;
+        dirEntry->mSize = haveStat ? statbuf.st_size : 0;
     }
     closedir(dir);
-    return result;
 }
 
-MediaScanResult MediaScanner::doProcessDirectoryEntry(
-        char *path, int pathRemaining, MediaScannerClient &client, bool noMedia,
-        struct dirent* entry, char* fileSpot) {
-    struct stat statbuf;
-    const char* name = entry->d_name;
+MediaScanResult MediaScanner::doProcessDirectory(
+        char *path, int pathRemaining, MediaScannerClient &client, bool noMedia) {
+    // place to copy file or directory name
+    char* fileSpot = path + strlen(path);
 
-    // ignore "." and ".."
-    if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
-        return MEDIA_SCAN_RESULT_SKIPPED;
+    if (shouldSkipDirectory(path)) {
+        ALOGD("Skipping: %s", path);
+        return MEDIA_SCAN_RESULT_OK;
+    }
+
+    DirectoryListing listing;
+    if (!mPool || !mPool->takeListing(path, &listing)) {
+        ListDirectory(path, &listing);
+        if (mPool) {
+            mPool->queueSubdirectories(path, listing);
+        }
+    }
+
+    if (listing.mHasNoMedia) {
+        noMedia = true;
     }
 
-    int nameLength = strlen(name);
-    if (nameLength + 1 > pathRemaining) {
-        // path too long!
+    if (!listing.mOpened) {
+        ALOGW("Error opening directory '%s', skipping: %s.", path, strerror(listing.mErrno));
         return MEDIA_SCAN_RESULT_SKIPPED;
     }
-    strcpy(fileSpot, name);
 
-    int type = entry->d_type;
-    if (type == DT_UNKNOWN) {
-        // If the type is unknown, stat() the file instead.
-        // This is sometimes necessary when accessing NFS mounted filesystems, but
-        // could be needed in other cases well.
-        if (stat(path, &statbuf) == 0) {
-            if (S_ISREG(statbuf.st_mode)) {
-                type = DT_REG;
-            } else if (S_ISDIR(statbuf.st_mode)) {
-                type = DT_DIR;
-            }
-        } else {
-            ALOGD("stat() failed for %s: %s", path, strerror(errno) );
+    if (mPool) {
+        mPool->prefetchFiles(path, listing);
+    }
+
+    MediaScanResult result = MEDIA_SCAN_RESULT_OK;
+    for (size_t i = 0; i < listing.mEntries.size(); ++i) {
+        if (doProcessDirectoryEntry(path, pathRemaining, client, noMedia,
+                listing.mEntries.itemAt(i), fileSpot) == MEDIA_SCAN_RESULT_ERROR) {
+            result = MEDIA_SCAN_RESULT_ERROR;
+            break;
         }
     }
-    if (type == DT_DIR) {
+
+    if (mPool) {
+        // restore path
+        fileSpot[0] = 0;
+        mPool->discardFiles(path, listing);
+    }
+    return result;
+}
+
+MediaScanResult MediaScanner::doProcessDirectoryEntry(
+        char *path, int pathRemaining, MediaScannerClient &client, bool noMedia,
+        const DirectoryEntry &entry, char* fileSpot) {
+    const char* name = entry.mName.string();
+    int nameLength = entry.mName.length();
+    strcpy(fileSpot, name);
+
+    if (entry.mType == DT_DIR) {
         bool childNoMedia = noMedia;
         // set noMedia flag on directories with a name that starts with '.'
         // for example, the Mac ".Trashes" directory
@@ -210,8 +481,8 @@ MediaScanResult MediaScanner::doProcessDirectoryEntry(
             childNoMedia = true;
 
         // report the directory to the client
-        if (stat(path, &statbuf) == 0) {
-            status_t status = client.scanFile(path, statbuf.st_mtime, 0,
+        if (entry.mHaveStat) {
+            status_t status = client.scanFile(path, entry.mLastModified, 0,
                     true /*isDirectory*/, childNoMedia);
             if (status) {
                 return MEDIA_SCAN_RESULT_ERROR;
@@ -225,9 +496,11 @@ MediaScanResult MediaScanner::doProcessDirectoryEntry(
         if (result == MEDIA_SCAN_RESULT_ERROR) {
             return MEDIA_SCAN_RESULT_ERROR;
         }
-    } else if (type == DT_REG) {
-        stat(path, &statbuf);
-        status_t status = client.scanFile(path, statbuf.st_mtime, statbuf.st_size,
+    } else if (entry.mType == DT_REG) {
+        if (mPool) {
+            mPool->noteFile(path, entry);
+        }
+        status_t status = client.scanFile(path, entry.mLastModified, entry.mSize,
                 false /*isDirectory*/, noMedia);
         if (status) {
             return MEDIA_SCAN_RESULT_ERROR;
@@ -237,6 +510,422 @@ MediaScanResult MediaScanner::doProcessDirectoryEntry(
     return MEDIA_SCAN_RESULT_OK;
 }
 
+bool MediaScanner::takePrefetchedFile(
+        const char *path, MediaScannerClient &client, MediaScanResult *result) {
+    return mPool && mPool->takeFile(path, client, result);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+MediaScanner::ScanPool::ScanPool(MediaScanner *scanner, int numThreads)
+    : mScanner(scanner),
+      mDone(false),
+      mWorkers(new Worker[numThreads]),
+      mNumWorkers(0),
+      mHaveLastScan(false) {
+    loadSkipCache();
+
+    Mutex::Autolock autoLock(mLock);
+    for (int i = 0; i < numThreads; ++i) {
+        Worker *worker = &mWorkers[mNumWorkers];
+        worker->mPool = this;
+        if (pthread_create(&worker->mThread, NULL, ThreadWrapper, worker)) {
+            ALOGW("Unable to start scan worker: %s", strerror(errno));
+            break;
+        }
+        ++mNumWorkers;
+    }
+}
+
+MediaScanner::ScanPool::~ScanPool() {
+    mLock.lock();
+    mDone = true;
+    mCondition.broadcast();
+    mLock.unlock();
+
+    for (int i = 0; i < mNumWorkers; ++i) {
+        pthread_join(mWorkers[i].mThread, NULL);
+    }
+    delete[] mWorkers;
+
+    for (size_t i = 0; i < mListings.size(); ++i) {
+        delete mListings.valueAt(i);
+    }
+    for (size_t i = 0; i < mFiles.size(); ++i) {
+        delete mFiles.valueAt(i);
+    }
+}
+
+// static
+void *MediaScanner::ScanPool::ThreadWrapper(void *me) {
+    Worker *worker = static_cast<Worker *>(me);
+    worker->mPool->threadLoop(worker);
+    return NULL;
+}
+
+void MediaScanner::ScanPool::threadLoop(Worker *worker) {
+    mLock.lock();
+    while (!mDone) {
+        if (!mFileQueue.empty()) {
+            String8 path = *mFileQueue.begin();
+            mFileQueue.erase(mFileQueue.begin());
+
+            ssize_t index = mFiles.indexOfKey(path);
+            if (index < 0) {
+                // Taken over by the scanning thread.
+                continue;
+            }
+
+            PrefetchedFile *file = mFiles.valueAt(index);
+            file->mState = RUNNING;
+
+            mLock.unlock();
+            MediaScanResult result =
+                mScanner->processFile(path.string(), NULL, file->mClient);
+            mLock.lock();
+
+            file->mResult = result;
+            file->mState = DONE;
+
+            if (file->mDiscarded) {
+                mFiles.removeItem(path);
+                delete file;
+            }
+
+            mCondition.broadcast();
+            continue;
+        }
+
+        String8 path;
+        if (mListings.size() < kMaxListingsAhead
+                && dequeueDirectory_l(worker, &path)) {
+            ssize_t index = mClaimed.indexOfKey(path);
+            if (index >= 0) {
+                mClaimed.removeItemsAt(index);
+                continue;
+            }
+
+            DirectoryListing *listing = new DirectoryListing;
+            listing->mDone = false;
+            mListings.add(path, listing);
+
+            mLock.unlock();
+            ListDirectory(path.string(), listing);
+            mLock.lock();
+
+            listing->mDone = true;
+            queueSubdirectories_l(worker, path.string(), *listing);
+
+            mCondition.broadcast();
+            continue;
+        }
+
+        mCondition.wait(mLock);
+    }
+    mLock.unlock();
+}
+
+bool MediaScanner::ScanPool::dequeueDirectory_l(Worker *worker, String8 *path) {
+    if (!worker->mDirectories.empty()) {
+        List<String8>::iterator it = --worker->mDirectories.end();
+        *path = *it;
+        worker->mDirectories.erase(it);
+        return true;
+    }
+
+    for (int i = 0; i < mNumWorkers; ++i) {
+        Worker *victim = &mWorkers[i];
+        if (!victim->mDirectories.empty()) {
+            *path = *victim->mDirectories.begin();
+            victim->mDirectories.erase(victim->mDirectories.begin());
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void MediaScanner::ScanPool::queueSubdirectories_l(
+        Worker *worker, const char *path, const DirectoryListing &listing) {
+    // Last in, first out: queue them in reverse so that the walk, which
+    // follows directory order, finds the first ones listed soonest.
+    for (size_t i = listing.mEntries.size(); i-- > 0;) {
+        const DirectoryEntry &entry = listing.mEntries.itemAt(i);
+        if (entry.mType != DT_DIR) {
+            continue;
+        }
+
+        String8 subdirectory(path);
+        subdirectory.append(entry.mName);
+        subdirectory.append("/");
+
+        if (mScanner->shouldSkipDirectory(subdirectory.string())) {
+            continue;
+        }
+
+        worker->mDirectories.push_back(subdirectory);
+    }
+}
+
+bool MediaScanner::ScanPool::takeListing(
+        const char *path, DirectoryListing *listing) {
+    Mutex::Autolock autoLock(mLock);
+
+    String8 key(path);
+    ssize_t index = mListings.indexOfKey(key);
+    if (index < 0) {
+        mClaimed.add(key, true);
+        return false;
+    }
+
+    DirectoryListing *pending = mListings.valueAt(index);
+    while (!pending->mDone) {
+        mCondition.wait(mLock);
+    }
+
+    *listing = *pending;
+    mListings.removeItem(key);
+    delete pending;
+
+    // There's room to list another directory now.
+    mCondition.broadcast();
+
+    return true;
+}
+
+void MediaScanner::ScanPool::queueSubdirectories(
+        const char *path, const DirectoryListing &listing) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mNumWorkers > 0) {
+        queueSubdirectories_l(&mWorkers[0], path, listing);
+        mCondition.broadcast();
+    }
+}
+
+void MediaScanner::ScanPool::prefetchFiles(
+        const char *path, const DirectoryListing &listing) {
+    if (!mHaveLastScan) {
+        return;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+
+    for (size_t i = 0; i < listing.mEntries.size(); ++i) {
+        const DirectoryEntry &entry = listing.mEntries.itemAt(i);
+        if (entry.mType != DT_REG) {
+            continue;
+        }
+
+        String8 filePath(path);
+        filePath.append(entry.mName);
+
+        if (entry.mHaveStat) {
+            ssize_t index = mLastScan.indexOfKey(filePath);
+            if (index >= 0) {
+                const FileStamp &stamp = mLastScan.valueAt(index);
+                if (stamp.mLastModified == entry.mLastModified
+                        && stamp.mSize == entry.mSize) {
+                    continue;
+                }
+            }
+        }
+
+        if (mFiles.indexOfKey(filePath) >= 0) {
+            continue;
+        }
+
+        PrefetchedFile *file = new PrefetchedFile;
+        file->mState = QUEUED;
+        file->mDiscarded = false;
+        file->mResult = MEDIA_SCAN_RESULT_SKIPPED;
+
+        mFiles.add(filePath, file);
+        mFileQueue.push_back(filePath);
+    }
+
+    mCondition.broadcast();
+}
+
+void MediaScanner::ScanPool::discardFiles(
+        const char *path, const DirectoryListing &listing) {
+    Mutex::Autolock autoLock(mLock);
+
+    for (size_t i = 0; i < listing.mEntries.size(); ++i) {
+        const DirectoryEntry &entry = listing.mEntries.itemAt(i);
+        if (entry.mType != DT_REG) {
+            continue;
+        }
+
+        String8 filePath(path);
+        filePath.append(entry.mName);
+
+        ssize_t index = mFiles.indexOfKey(filePath);
+        if (index < 0) {
+            continue;
+        }
+
+        PrefetchedFile *file = mFiles.valueAt(index);
+        if (file->mState == RUNNING) {
+            file->mDiscarded = true;
+        } else {
+            mFiles.removeItemsAt(index);
+            delete file;
+        }
+    }
+}
+
+bool MediaScanner::ScanPool::takeFile(
+        const char *path, MediaScannerClient &client, MediaScanResult *result) {
+    PrefetchedFile *file;
+
+    {
+        Mutex::Autolock autoLock(mLock);
+
+        String8 key(path);
+        ssize_t index = mFiles.indexOfKey(key);
+        if (index < 0) {
+            return false;
+        }
+
+        file = mFiles.valueAt(index);
+        if (&client == &file->mClient) {
+            // This is the worker extracting it.
+            return false;
+        }
+
+        if (file->mState == QUEUED) {
+            // Not started yet, the caller is just as fast doing it itself.
+            mFiles.removeItemsAt(index);
+            delete file;
+            return false;
+        }
+
+        while (file->mState != DONE) {
+            mCondition.wait(mLock);
+        }
+
+        mFiles.removeItem(key);
+    }
+
+    client.setLocale(mScanner->locale());
+    client.beginFile();
+    *result = file->mResult;
+    if (file->mClient.replay(client) != OK) {
+        *result = MEDIA_SCAN_RESULT_ERROR;
+    }
+    client.endFile();
+
+    delete file;
+
+    return true;
+}
+
+void MediaScanner::ScanPool::noteFile(
+        const char *path, const DirectoryEntry &entry) {
+    if (mSkipCachePath.isEmpty() || !entry.mHaveStat) {
+        return;
+    }
+
+    mThisScan.push();
+    ScannedFile *file = &mThisScan.editItemAt(mThisScan.size() - 1);
+    file->mPath.setTo(path);
+    file->mStamp.mLastModified = entry.mLastModified;
+    file->mStamp.mSize = entry.mSize;
+}
+
+void MediaScanner::ScanPool::loadSkipCache() {
+    char value[PROPERTY_VALUE_MAX];
+    if (!property_get("media.scanner.skip-cache", value, NULL)) {
+        return;
+    }
+    mSkipCachePath.setTo(value);
+
+    FILE *file = fopen(value, "r");
+    if (!file) {
+        return;
+    }
+
+    // One "<mtime> <size> <path>" line per file, sorted by path.
+    char line[PATH_MAX + 64];
+    while (fgets(line, sizeof(line), file)) {
+        size_t length = strlen(line);
+        if (length == 0 || line[length - 1] != '\n') {
+            break;
+        }
+        line[length - 1] = 0;
+
+        FileStamp stamp;
+        int pathOffset;
+        if (sscanf(line, "%lld %lld %n",
+                    &stamp.mLastModified, &stamp.mSize, &pathOffset) != 2) {
+            break;
+        }
+        mLastScan.add(String8(&line[pathOffset]), stamp);
+    }
+    fclose(file);
+    mHaveLastScan = true;
+
+    ALOGV("loaded %zu entries from skip cache", mLastScan.size());
+}
+
+// static
+int MediaScanner::ScanPool::CompareScannedFiles(
+        const ScannedFile *a, const ScannedFile *b) {
+    return strcmp(a->mPath.string(), b->mPath.string());
+}
+
+// Replaces the entries below "root" with the files seen by this scan and
+// keeps those of the other roots.
+void MediaScanner::ScanPool::storeSkipCache(const char *root) {
+    if (mSkipCachePath.isEmpty()) {
+        return;
+    }
+
+    size_t rootLength = strlen(root);
+    for (size_t i = 0; i < mLastScan.size(); ++i) {
+        const String8 &path = mLastScan.keyAt(i);
+        if (!strncmp(path.string(), root, rootLength)) {
+            continue;
+        }
+
+        mThisScan.push();
+        ScannedFile *file = &mThisScan.editItemAt(mThisScan.size() - 1);
+        file->mPath = path;
+        file->mStamp = mLastScan.valueAt(i);
+    }
+
+    mThisScan.sort(CompareScannedFiles);
+
+    String8 tmpPath(mSkipCachePath);
+    tmpPath.append(".tmp");
+
+    FILE *file = fopen(tmpPath.string(), "w");
+    if (!file) {
+        ALOGW("Unable to write skip cache '%s': %s", tmpPath.string(), strerror(errno));
+        return;
+    }
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < mThisScan.size(); ++i) {
+        const ScannedFile &scanned = mThisScan.itemAt(i);
+        if (strchr(scanned.mPath.string(), '\n')) {
+            continue;
+        }
+        ok = fprintf(file, "%lld %lld %s\n",
+                scanned.mStamp.mLastModified, scanned.mStamp.mSize,
+                scanned.mPath.string()) > 0;
+    }
+
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+
+    if (!ok || rename(tmpPath.string(), mSkipCachePath.string()) != 0) {
+        unlink(tmpPath.string());
+    }
+}
+
 MediaAlbumArt *MediaAlbumArt::clone() {
     size_t byte_size = this->size() + sizeof(MediaAlbumArt);
     MediaAlbumArt *result = reinterpret_cast<MediaAlbumArt *>(malloc(byte_size));
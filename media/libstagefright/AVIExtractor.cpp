@@ -183,7 +183,13 @@ status_t AVIExtractor::AVISource::read(
         }
 
         MediaBuffer *out;
-        CHECK_EQ(mBufferGroup->acquire_buffer(&out), (status_t)OK);
+        if (size > mTrack.mMaxSampleSize) {
+            // Only the first segment of an OpenDML index is scanned for
+            // the maximum sample size, larger samples get their own buffer.
+            out = new MediaBuffer(size);
+        } else {
+            CHECK_EQ(mBufferGroup->acquire_buffer(&out), (status_t)OK);
+        }
 
         ssize_t n = mExtractor->mDataSource->readAt(offset, out->data(), size);
 
@@ -416,7 +422,7 @@ status_t AVIExtractor::parseHeaders() {
         return ERROR_MALFORMED;
     }
 
-    return OK;
+    return finishIndex();
 }
 
 ssize_t AVIExtractor::parseChunk(off64_t offset, off64_t size, int depth) {
@@ -515,6 +521,12 @@ ssize_t AVIExtractor::parseChunk(off64_t offset, off64_t size, int depth) {
                 break;
             }
 
+            case FOURCC('i', 'n', 'd', 'x'):
+            {
+                err = parseSuperIndex(offset + 8, chunkSize);
+                break;
+            }
+
             default:
                 break;
         }
@@ -613,6 +625,7 @@ status_t AVIExtractor::parseStreamHeader(off64_t offset, size_t size) {
     uint32_t rate = U32LE_AT(&data[20]);
     uint32_t scale = U32LE_AT(&data[24]);
 
+    uint32_t suggestedBufferSize = U32LE_AT(&data[36]);
     uint32_t sampleSize = U32LE_AT(&data[44]);
 
     const char *mime = NULL;
@@ -652,16 +665,16 @@ status_t AVIExtractor::parseStreamHeader(off64_t offset, size_t size) {
     Track *track = &mTracks.editItemAt(mTracks.size() - 1);
 
     track->mMeta = meta;
+    track->mNumSamples = 0;
+    track->mNumBytes = 0;
+    track->mHasSuperIndex = false;
     track->mRate = rate;
     track->mScale = scale;
     track->mBytesPerSample = sampleSize;
     track->mKind = kind;
-    track->mNumSyncSamples = 0;
     track->mThumbnailSampleSize = 0;
     track->mThumbnailSampleIndex = -1;
-    track->mMaxSampleSize = 0;
-    track->mAvgChunkSize = 1.0;
-    track->mFirstChunkSize = 0;
+    track->mMaxSampleSize = suggestedBufferSize;
 
     return OK;
 }
@@ -764,11 +777,137 @@ bool AVIExtractor::IsCorrectChunkType(
     return true;
 }
 
+// Number of 'idx1' entries read at once, and covered by one segment.
+static const size_t kNumLegacyEntriesPerSegment = 4096;
+
 status_t AVIExtractor::parseIndex(off64_t offset, size_t size) {
     if ((size % 16) != 0) {
         return ERROR_MALFORMED;
     }
 
+    // Only count the samples of each track here, the entries are read
+    // again once a segment is actually needed.
+
+    Vector<size_t> numSamples;
+    numSamples.insertAt((size_t)0, 0, mTracks.size());
+
+    Vector<int64_t> numBytes;
+    numBytes.insertAt((int64_t)0, 0, mTracks.size());
+
+    sp<ABuffer> buffer = new ABuffer(kNumLegacyEntriesPerSegment * 16);
+
+    while (size > 0) {
+        size_t numEntries = size / 16;
+        if (numEntries > kNumLegacyEntriesPerSegment) {
+            numEntries = kNumLegacyEntriesPerSegment;
+        }
+
+        ssize_t n =
+            mDataSource->readAt(offset, buffer->data(), numEntries * 16);
+
+        if (n < (ssize_t)(numEntries * 16)) {
+            return n < 0 ? (status_t)n : ERROR_MALFORMED;
+        }
+
+        const uint8_t *data = buffer->data();
+
+        for (size_t i = 0; i < numEntries; ++i, data += 16) {
+            uint32_t chunkType = U32_AT(data);
+
+            uint8_t hi = chunkType >> 24;
+            uint8_t lo = (chunkType >> 16) & 0xff;
+
+            if (hi < '0' || hi > '9' || lo < '0' || lo > '9') {
+                return ERROR_MALFORMED;
+            }
+
+            size_t trackIndex = 10 * (hi - '0') + (lo - '0');
+
+            if (trackIndex >= mTracks.size()) {
+                return ERROR_MALFORMED;
+            }
+
+            Track *track = &mTracks.editItemAt(trackIndex);
+
+            if (!IsCorrectChunkType(-1, track->mKind, chunkType)) {
+                return ERROR_MALFORMED;
+            }
+
+            if (track->mKind == Track::OTHER || track->mHasSuperIndex) {
+                continue;
+            }
+
+            uint32_t chunkSize = U32LE_AT(&data[12]);
+
+            if (chunkSize & kSampleIsNotKey) {
+                return ERROR_MALFORMED;
+            }
+
+            if (chunkSize > track->mMaxSampleSize) {
+                track->mMaxSampleSize = chunkSize;
+            }
+
+            ++numSamples.editItemAt(trackIndex);
+            numBytes.editItemAt(trackIndex) += chunkSize;
+        }
+
+        for (size_t i = 0; i < mTracks.size(); ++i) {
+            if (numSamples.itemAt(i) == 0) {
+                continue;
+            }
+
+            Track *track = &mTracks.editItemAt(i);
+
+            track->mSegments.push();
+
+            IndexSegment *segment =
+                &track->mSegments.editItemAt(track->mSegments.size() - 1);
+
+            segment->mIsLegacy = true;
+            segment->mIndexOffset = offset;
+            segment->mNumEntries = numEntries;
+            segment->mBaseOffset = 0;
+            segment->mFirstSample = track->mNumSamples;
+            segment->mNumSamples = numSamples.itemAt(i);
+            segment->mStartBytes = track->mNumBytes;
+
+            track->mNumSamples += numSamples.itemAt(i);
+            track->mNumBytes += numBytes.itemAt(i);
+
+            numSamples.editItemAt(i) = 0;
+            numBytes.editItemAt(i) = 0;
+        }
+
+        offset += numEntries * 16;
+        size -= numEntries * 16;
+    }
+
+    mFoundIndex = true;
+
+    return OK;
+}
+
+// OpenDML index types.
+enum {
+    AVI_INDEX_OF_INDEXES = 0x00,
+    AVI_INDEX_OF_CHUNKS  = 0x01,
+};
+
+status_t AVIExtractor::parseSuperIndex(off64_t offset, size_t size) {
+    if (mTracks.isEmpty()) {
+        return ERROR_MALFORMED;
+    }
+
+    Track *track = &mTracks.editItemAt(mTracks.size() - 1);
+
+    if (track->mKind == Track::OTHER) {
+        return OK;
+    }
+
+    if (size < 24) {
+        return ERROR_MALFORMED;
+    }
+
     sp<ABuffer> buffer = new ABuffer(size);
     ssize_t n = mDataSource->readAt(offset, buffer->data(), buffer->size());
 
@@ -778,136 +917,208 @@ status_t AVIExtractor::parseIndex(off64_t offset, size_t size) {
 
     const uint8_t *data = buffer->data();
 
-    while (size > 0) {
-        uint32_t chunkType = U32_AT(data);
+    uint16_t longsPerEntry = U16LE_AT(data);
+    uint8_t indexSubType = data[2];
+    uint8_t indexType = data[3];
+    uint32_t numEntries = U32LE_AT(&data[4]);
 
-        uint8_t hi = chunkType >> 24;
-        uint8_t lo = (chunkType >> 16) & 0xff;
+    if (indexType == AVI_INDEX_OF_CHUNKS) {
+        // A standard index right in the stream header list.
+        status_t err = addStandardIndex(track, offset - 8, 0);
 
-        if (hi < '0' || hi > '9' || lo < '0' || lo > '9') {
+        if (err != OK) {
+            return err;
+        }
+    } else {
+        if (indexType != AVI_INDEX_OF_INDEXES
+                || indexSubType != 0
+                || longsPerEntry != 4
+                || numEntries > (size - 24) / 16) {
             return ERROR_MALFORMED;
         }
 
-        size_t trackIndex = 10 * (hi - '0') + (lo - '0');
+        int64_t startBytes = 0;
 
-        if (trackIndex >= mTracks.size()) {
-            return ERROR_MALFORMED;
-        }
+        for (size_t i = 0; i < numEntries; ++i) {
+            const uint8_t *entry = &data[24 + 16 * i];
 
-        Track *track = &mTracks.editItemAt(trackIndex);
+            off64_t chunkOffset = U64LE_AT(entry);
+            uint32_t duration = U32LE_AT(&entry[12]);
 
-        if (!IsCorrectChunkType(-1, track->mKind, chunkType)) {
-            return ERROR_MALFORMED;
-        }
+            status_t err = addStandardIndex(track, chunkOffset, startBytes);
 
-        if (track->mKind == Track::OTHER) {
-            data += 16;
-            size -= 16;
-            continue;
+            if (err != OK) {
+                return err;
+            }
+
+            // The duration is in stream ticks, i.e. blocks of
+            // mBytesPerSample bytes for those tracks that care.
+            startBytes += (int64_t)duration * track->mBytesPerSample;
         }
+    }
 
-        uint32_t flags = U32LE_AT(&data[4]);
-        uint32_t offset = U32LE_AT(&data[8]);
-        uint32_t chunkSize = U32LE_AT(&data[12]);
+    if (!track->mSegments.isEmpty()) {
+        track->mHasSuperIndex = true;
+        mFoundIndex = true;
+    }
 
-        if (chunkSize > track->mMaxSampleSize) {
-            track->mMaxSampleSize = chunkSize;
-        }
+    return OK;
+}
 
-        track->mSamples.push();
+status_t AVIExtractor::addStandardIndex(
+        Track *track, off64_t offset, int64_t startBytes) {
+    uint8_t header[32];
+    ssize_t n = mDataSource->readAt(offset, header, sizeof(header));
 
-        SampleInfo *info =
-            &track->mSamples.editItemAt(track->mSamples.size() - 1);
+    if (n < (ssize_t)sizeof(header)) {
+        return n < 0 ? (status_t)n : ERROR_MALFORMED;
+    }
 
-        info->mOffset = offset;
-        info->mIsKey = (flags & 0x10) != 0;
+    uint32_t chunkSize = U32LE_AT(&header[4]);
+    uint16_t longsPerEntry = U16LE_AT(&header[8]);
+    uint8_t indexSubType = header[10];
+    uint8_t indexType = header[11];
+    uint32_t numEntries = U32LE_AT(&header[12]);
 
-        if (info->mIsKey) {
-            static const size_t kMaxNumSyncSamplesToScan = 20;
+    if (chunkSize < 24
+            || longsPerEntry != 2
+            || indexSubType != 0
+            || indexType != AVI_INDEX_OF_CHUNKS
+            || numEntries > (chunkSize - 24) / 8) {
+        return ERROR_MALFORMED;
+    }
 
-            if (track->mNumSyncSamples < kMaxNumSyncSamplesToScan) {
-                if (chunkSize > track->mThumbnailSampleSize) {
-                    track->mThumbnailSampleSize = chunkSize;
+    if (numEntries == 0) {
+        return OK;
+    }
 
-                    track->mThumbnailSampleIndex =
-                        track->mSamples.size() - 1;
-                }
-            }
+    track->mSegments.push();
 
-            ++track->mNumSyncSamples;
-        }
+    IndexSegment *segment =
+        &track->mSegments.editItemAt(track->mSegments.size() - 1);
 
-        data += 16;
-        size -= 16;
-    }
+    segment->mIsLegacy = false;
+    segment->mIndexOffset = offset + sizeof(header);
+    segment->mNumEntries = numEntries;
+    segment->mBaseOffset = U64LE_AT(&header[20]);
+    segment->mFirstSample = track->mNumSamples;
+    segment->mNumSamples = numEntries;
+    segment->mStartBytes = startBytes;
 
-    if (!mTracks.isEmpty()) {
-        off64_t offset;
-        size_t size;
-        bool isKey;
-        int64_t timeUs;
-        status_t err = getSampleInfo(0, 0, &offset, &size, &isKey, &timeUs);
+    track->mNumSamples += numEntries;
 
-        if (err != OK) {
-            mOffsetsAreAbsolute = !mOffsetsAreAbsolute;
-            err = getSampleInfo(0, 0, &offset, &size, &isKey, &timeUs);
+    return OK;
+}
+
+status_t AVIExtractor::checkLegacyOffsets() {
+    for (size_t i = 0; i < mTracks.size(); ++i) {
+        const Track &track = mTracks.itemAt(i);
+
+        if (track.mSegments.isEmpty() || !track.mSegments.itemAt(0).mIsLegacy) {
+            continue;
+        }
+
+        for (size_t attempt = 0; attempt < 2; ++attempt) {
+            off64_t offset;
+            size_t size;
+            bool isKey;
+            int64_t timeUs;
+            status_t err =
+                getSampleInfo(i, 0, &offset, &size, &isKey, &timeUs);
 
             if (err != OK) {
                 return err;
             }
+
+            uint8_t tmp[8];
+            ssize_t n = mDataSource->readAt(offset - 8, tmp, 8);
+
+            if (n == 8 && IsCorrectChunkType(i, track.mKind, U32_AT(tmp))) {
+                ALOGV("Chunk offsets are %s",
+                     mOffsetsAreAbsolute ? "absolute" : "movie-chunk relative");
+
+                return OK;
+            }
+
+            mOffsetsAreAbsolute = !mOffsetsAreAbsolute;
         }
 
-        ALOGV("Chunk offsets are %s",
-             mOffsetsAreAbsolute ? "absolute" : "movie-chunk relative");
+        return ERROR_MALFORMED;
+    }
+
+    return OK;
+}
+
+status_t AVIExtractor::finishIndex() {
+    status_t err = checkLegacyOffsets();
+
+    if (err != OK) {
+        return err;
     }
 
     for (size_t i = 0; i < mTracks.size(); ++i) {
         Track *track = &mTracks.editItemAt(i);
 
-        if (track->mBytesPerSample > 0) {
-            // Assume all chunks are roughly the same size for now.
-
-            // Compute the avg. size of the first 128 chunks (if there are
-            // that many), but exclude the size of the first one, since
-            // it may be an outlier.
-            size_t numSamplesToAverage = track->mSamples.size();
-            if (numSamplesToAverage > 256) {
-                numSamplesToAverage = 256;
+        if (track->mNumSamples == 0) {
+            continue;
+        }
+
+        off64_t offset;
+        size_t size;
+        bool isKey;
+        int64_t timeUs;
+
+        if (track->mHasSuperIndex) {
+            // Standard indices aren't read until needed, so take the
+            // first one as a sample of the sizes to expect.
+            size_t numSamples = track->mSegments.itemAt(0).mNumSamples;
+
+            for (size_t j = 0; j < numSamples; ++j) {
+                err = getSampleInfo(i, j, &offset, &size, &isKey, &timeUs);
+
+                if (err != OK) {
+                    return err;
+                }
+
+                if (size > track->mMaxSampleSize) {
+                    track->mMaxSampleSize = size;
+                }
             }
+        }
 
-            double avgChunkSize = 0;
-            size_t j;
-            for (j = 0; j <= numSamplesToAverage; ++j) {
-                off64_t offset;
-                size_t size;
-                bool isKey;
-                int64_t dummy;
+        if (track->mKind == Track::VIDEO) {
+            static const size_t kMaxNumSyncSamplesToScan = 20;
 
-                status_t err =
-                    getSampleInfo(
-                            i, j,
-                            &offset, &size, &isKey, &dummy);
+            size_t numSyncSamples = 0;
+            for (size_t j = 0;
+                    j < track->mNumSamples
+                        && numSyncSamples < kMaxNumSyncSamplesToScan;
+                    ++j) {
+                err = getSampleInfo(i, j, &offset, &size, &isKey, &timeUs);
 
                 if (err != OK) {
                     return err;
                 }
 
-                if (j == 0) {
-                    track->mFirstChunkSize = size;
+                if (!isKey) {
                     continue;
                 }
 
-                avgChunkSize += size;
-            }
-
-            avgChunkSize /= numSamplesToAverage;
+                if (size > track->mThumbnailSampleSize) {
+                    track->mThumbnailSampleSize = size;
+                    track->mThumbnailSampleIndex = j;
+                }
 
-            track->mAvgChunkSize = avgChunkSize;
+                ++numSyncSamples;
+            }
         }
 
         int64_t durationUs;
-        CHECK_EQ((status_t)OK,
-                 getSampleTime(i, track->mSamples.size() - 1, &durationUs));
+        err = getSampleTime(i, track->mNumSamples - 1, &durationUs);
+
+        if (err != OK) {
+            return err;
+        }
 
         ALOGV("track %d duration = %.2f secs", i, durationUs / 1E6);
 
@@ -929,8 +1140,6 @@ status_t AVIExtractor::parseIndex(off64_t offset, size_t size) {
                 track->mMeta->setInt64(kKeyThumbnailTime, thumbnailTimeUs);
             }
 
-            status_t err = OK;
-
             if (!strcasecmp(mime.c_str(), MEDIA_MIMETYPE_VIDEO_MPEG4)) {
                 err = addMPEG4CodecSpecificData(i);
             } else if (!strcasecmp(mime.c_str(), MEDIA_MIMETYPE_VIDEO_AVC)) {
@@ -943,8 +1152,6 @@ status_t AVIExtractor::parseIndex(off64_t offset, size_t size) {
         }
     }
 
-    mFoundIndex = true;
-
     return OK;
 }
 
@@ -1105,57 +1312,152 @@ status_t AVIExtractor::getSampleInfo(
         size_t trackIndex, size_t sampleIndex,
         off64_t *offset, size_t *size, bool *isKey,
         int64_t *sampleTimeUs) {
+    Mutex::Autolock autoLock(mLock);
+
+    return getSampleInfo_l(
+            trackIndex, sampleIndex, offset, size, isKey, sampleTimeUs);
+}
+
+status_t AVIExtractor::getSampleInfo_l(
+        size_t trackIndex, size_t sampleIndex,
+        off64_t *offset, size_t *size, bool *isKey,
+        int64_t *sampleTimeUs) {
     if (trackIndex >= mTracks.size()) {
         return -ERANGE;
     }
 
     const Track &track = mTracks.itemAt(trackIndex);
 
-    if (sampleIndex >= track.mSamples.size()) {
+    if (sampleIndex >= track.mNumSamples) {
         return -ERANGE;
     }
 
-    const SampleInfo &info = track.mSamples.itemAt(sampleIndex);
+    // Find the last segment starting at or before the sample.
+    size_t lo = 0;
+    size_t hi = track.mSegments.size();
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+
+        if (track.mSegments.itemAt(mid).mFirstSample <= sampleIndex) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    status_t err = loadSegment_l(trackIndex, lo);
+
+    if (err != OK) {
+        return err;
+    }
+
+    const IndexSegment &segment = track.mSegments.itemAt(lo);
+
+    size_t index = sampleIndex - segment.mFirstSample;
+    const SampleInfo &info = segment.mSamples.itemAt(index);
 
-    if (!mOffsetsAreAbsolute) {
-        *offset = info.mOffset + mMovieOffset + 8;
+    // Legacy index entries point at the chunk header, standard index
+    // entries at the data.
+    if (!segment.mIsLegacy) {
+        *offset = segment.mBaseOffset + info.mOffset;
+    } else if (!mOffsetsAreAbsolute) {
+        *offset = info.mOffset + mMovieOffset + 8 + 8;
     } else {
-        *offset = info.mOffset;
+        *offset = info.mOffset + 8;
     }
 
-    *size = 0;
+    *size = info.mSize & ~kSampleIsNotKey;
+    *isKey = (info.mSize & kSampleIsNotKey) == 0;
 
-    uint8_t tmp[8];
-    ssize_t n = mDataSource->readAt(*offset, tmp, 8);
+    int64_t tick = sampleIndex;
 
-    if (n < 8) {
-        return n < 0 ? (status_t)n : (status_t)ERROR_MALFORMED;
+    if (track.mBytesPerSample > 0) {
+        tick = (segment.mStartBytes + segment.mSampleBytes.itemAt(index))
+                    / track.mBytesPerSample;
     }
 
-    uint32_t chunkType = U32_AT(tmp);
+    *sampleTimeUs = (tick * 1000000ll * track.mRate) / track.mScale;
 
-    if (!IsCorrectChunkType(trackIndex, track.mKind, chunkType)) {
-        return ERROR_MALFORMED;
+    return OK;
+}
+
+status_t AVIExtractor::loadSegment_l(size_t trackIndex, size_t segmentIndex) {
+    Track *track = &mTracks.editItemAt(trackIndex);
+    IndexSegment *segment = &track->mSegments.editItemAt(segmentIndex);
+
+    if (!segment->mSamples.isEmpty()) {
+        return OK;
     }
 
-    *offset += 8;
-    *size = U32LE_AT(&tmp[4]);
+    size_t entrySize = segment->mIsLegacy ? 16 : 8;
 
-    *isKey = info.mIsKey;
+    sp<ABuffer> buffer = new ABuffer(segment->mNumEntries * entrySize);
+    ssize_t n = mDataSource->readAt(
+            segment->mIndexOffset, buffer->data(), buffer->size());
 
-    if (track.mBytesPerSample > 0) {
-        size_t sampleStartInBytes;
-        if (sampleIndex == 0) {
-            sampleStartInBytes = 0;
+    if (n < (ssize_t)buffer->size()) {
+        return n < 0 ? (status_t)n : ERROR_MALFORMED;
+    }
+
+    segment->mSamples.setCapacity(segment->mNumSamples);
+
+    if (track->mBytesPerSample > 0) {
+        segment->mSampleBytes.setCapacity(segment->mNumSamples);
+    }
+
+    const uint8_t *data = buffer->data();
+    uint32_t numBytes = 0;
+
+    for (size_t i = 0; i < segment->mNumEntries; ++i, data += entrySize) {
+        SampleInfo info;
+
+        if (segment->mIsLegacy) {
+            if (!IsCorrectChunkType(trackIndex, track->mKind, U32_AT(data))) {
+                continue;
+            }
+
+            uint32_t flags = U32LE_AT(&data[4]);
+
+            info.mOffset = U32LE_AT(&data[8]);
+            info.mSize = U32LE_AT(&data[12]);
+
+            if (!(flags & 0x10)) {
+                info.mSize |= kSampleIsNotKey;
+            }
         } else {
-            sampleStartInBytes =
-                track.mFirstChunkSize + track.mAvgChunkSize * (sampleIndex - 1);
+            info.mOffset = U32LE_AT(data);
+            info.mSize = U32LE_AT(&data[4]);
+        }
+
+        if (segment->mSamples.size() == segment->mNumSamples) {
+            break;
+        }
+
+        segment->mSamples.push(info);
+
+        if (track->mBytesPerSample > 0) {
+            segment->mSampleBytes.push(numBytes);
+            numBytes += info.mSize & ~kSampleIsNotKey;
         }
+    }
 
-        sampleIndex = sampleStartInBytes / track.mBytesPerSample;
+    if (segment->mSamples.size() != segment->mNumSamples) {
+        segment->mSamples.clear();
+        segment->mSampleBytes.clear();
+
+        return ERROR_MALFORMED;
     }
 
-    *sampleTimeUs = (sampleIndex * 1000000ll * track.mRate) / track.mScale;
+    // Playback and seeking hardly ever move further than to a
+    // neighbouring segment, don't hold on to the others.
+    for (size_t i = 0; i < track->mSegments.size(); ++i) {
+        if (i + 1 < segmentIndex || i > segmentIndex + 1) {
+            IndexSegment *other = &track->mSegments.editItemAt(i);
+
+            other->mSamples.clear();
+            other->mSampleBytes.clear();
+        }
+    }
 
     return OK;
 }
@@ -1169,40 +1471,107 @@ status_t AVIExtractor::getSampleTime(
             trackIndex, sampleIndex, &offset, &size, &isKey, sampleTimeUs);
 }
 
+status_t AVIExtractor::findSyncSample_l(
+        size_t trackIndex, ssize_t sampleIndex, int direction,
+        ssize_t *syncSampleIndex) {
+    const Track &track = mTracks.itemAt(trackIndex);
+
+    while (sampleIndex >= 0 && sampleIndex < (ssize_t)track.mNumSamples) {
+        off64_t offset;
+        size_t size;
+        bool isKey;
+        int64_t timeUs;
+        status_t err = getSampleInfo_l(
+                trackIndex, sampleIndex, &offset, &size, &isKey, &timeUs);
+
+        if (err != OK) {
+            return err;
+        }
+
+        if (isKey) {
+            *syncSampleIndex = sampleIndex;
+            return OK;
+        }
+
+        sampleIndex += direction;
+    }
+
+    return UNKNOWN_ERROR;
+}
+
 status_t AVIExtractor::getSampleIndexAtTime(
         size_t trackIndex,
         int64_t timeUs, MediaSource::ReadOptions::SeekMode mode,
-        size_t *sampleIndex) const {
+        size_t *sampleIndex) {
+    Mutex::Autolock autoLock(mLock);
+
     if (trackIndex >= mTracks.size()) {
         return -ERANGE;
     }
 
     const Track &track = mTracks.itemAt(trackIndex);
 
+    if (track.mNumSamples == 0) {
+        return -ERANGE;
+    }
+
+    if (timeUs < 0) {
+        timeUs = 0;
+    }
+
     ssize_t closestSampleIndex;
 
     if (track.mBytesPerSample > 0) {
-        size_t closestByteOffset =
-            (timeUs * track.mBytesPerSample)
-                / track.mRate * track.mScale / 1000000ll;
+        int64_t closestByteOffset =
+            (timeUs * track.mBytesPerSample * track.mScale)
+                / (track.mRate * 1000000ll);
+
+        // Find the last segment starting at or before that byte offset,
+        // then the last of its samples that does.
+        size_t lo = 0;
+        size_t hi = track.mSegments.size();
+        while (hi - lo > 1) {
+            size_t mid = (lo + hi) / 2;
+
+            if (track.mSegments.itemAt(mid).mStartBytes <= closestByteOffset) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
 
-        if (closestByteOffset <= track.mFirstChunkSize) {
-            closestSampleIndex = 0;
-        } else {
-            closestSampleIndex =
-                (closestByteOffset - track.mFirstChunkSize)
-                    / track.mAvgChunkSize;
+        status_t err = loadSegment_l(trackIndex, lo);
+
+        if (err != OK) {
+            return err;
         }
+
+        const IndexSegment &segment = track.mSegments.itemAt(lo);
+
+        int64_t bytes = closestByteOffset - segment.mStartBytes;
+
+        size_t first = 0;
+        size_t last = segment.mNumSamples;
+        while (last - first > 1) {
+            size_t mid = (first + last) / 2;
+
+            if ((int64_t)segment.mSampleBytes.itemAt(mid) <= bytes) {
+                first = mid;
+            } else {
+                last = mid;
+            }
+        }
+
+        closestSampleIndex = segment.mFirstSample + first;
     } else {
         // Each chunk contains a single sample.
-        closestSampleIndex = timeUs / track.mRate * track.mScale / 1000000ll;
+        closestSampleIndex =
+            (timeUs * track.mScale) / (track.mRate * 1000000ll);
     }
 
-    ssize_t numSamples = track.mSamples.size();
+    ssize_t numSamples = track.mNumSamples;
 
-    if (closestSampleIndex < 0) {
-        closestSampleIndex = 0;
-    } else if (closestSampleIndex >= numSamples) {
+    if (closestSampleIndex >= numSamples) {
         closestSampleIndex = numSamples - 1;
     }
 
@@ -1212,28 +1581,18 @@ status_t AVIExtractor::getSampleIndexAtTime(
         return OK;
     }
 
-    ssize_t prevSyncSampleIndex = closestSampleIndex;
-    while (prevSyncSampleIndex >= 0) {
-        const SampleInfo &info =
-            track.mSamples.itemAt(prevSyncSampleIndex);
-
-        if (info.mIsKey) {
-            break;
-        }
-
-        --prevSyncSampleIndex;
+    ssize_t prevSyncSampleIndex = -1;
+    status_t prevErr = UNKNOWN_ERROR;
+    if (mode != MediaSource::ReadOptions::SEEK_NEXT_SYNC) {
+        prevErr = findSyncSample_l(
+                trackIndex, closestSampleIndex, -1, &prevSyncSampleIndex);
     }
 
-    ssize_t nextSyncSampleIndex = closestSampleIndex;
-    while (nextSyncSampleIndex < numSamples) {
-        const SampleInfo &info =
-            track.mSamples.itemAt(nextSyncSampleIndex);
-
-        if (info.mIsKey) {
-            break;
-        }
-
-        ++nextSyncSampleIndex;
+    ssize_t nextSyncSampleIndex = -1;
+    status_t nextErr = UNKNOWN_ERROR;
+    if (mode != MediaSource::ReadOptions::SEEK_PREVIOUS_SYNC) {
+        nextErr = findSyncSample_l(
+                trackIndex, closestSampleIndex, 1, &nextSyncSampleIndex);
     }
 
     switch (mode) {
@@ -1241,28 +1600,28 @@ status_t AVIExtractor::getSampleIndexAtTime(
         {
             *sampleIndex = prevSyncSampleIndex;
 
-            return prevSyncSampleIndex >= 0 ? OK : UNKNOWN_ERROR;
+            return prevErr;
         }
 
         case MediaSource::ReadOptions::SEEK_NEXT_SYNC:
         {
             *sampleIndex = nextSyncSampleIndex;
 
-            return nextSyncSampleIndex < numSamples ? OK : UNKNOWN_ERROR;
+            return nextErr;
         }
 
         case MediaSource::ReadOptions::SEEK_CLOSEST_SYNC:
         {
-            if (prevSyncSampleIndex < 0 && nextSyncSampleIndex >= numSamples) {
+            if (prevErr != OK && nextErr != OK) {
                 return UNKNOWN_ERROR;
             }
 
-            if (prevSyncSampleIndex < 0) {
+            if (prevErr != OK) {
                 *sampleIndex = nextSyncSampleIndex;
                 return OK;
             }
 
-            if (nextSyncSampleIndex >= numSamples) {
+            if (nextErr != OK) {
                 *sampleIndex = prevSyncSampleIndex;
                 return OK;
             }
@@ -1280,6 +1639,8 @@ status_t AVIExtractor::getSampleIndexAtTime(
             TRESPASS();
             break;
     }
+
+    return UNKNOWN_ERROR;
 }
 
 bool SniffAVI(
@@ -44,6 +44,7 @@ LOCAL_SRC_FILES:=                         \
         HTTPBase.cpp                      \
         JPEGSource.cpp                    \
         MP3Extractor.cpp                  \
+        MP3FrameIndexSeeker.cpp           \
         MPEG2TSWriter.cpp                 \
         MPEG4Extractor.cpp                \
         MPEG4Writer.cpp                   \
@@ -67,6 +68,7 @@ LOCAL_SRC_FILES:=                         \
         OggExtractor.cpp                  \
         SampleIterator.cpp                \
         SampleTable.cpp                   \
+        SeekIndexCache.cpp                \
         SkipCutBuffer.cpp                 \
         StagefrightMediaScanner.cpp       \
         StagefrightMetadataRetriever.cpp  \
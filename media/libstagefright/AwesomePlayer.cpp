@@ -62,6 +62,7 @@
 #include <gui/Surface.h>
 
 #include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/AString.h>
 
 #include <cutils/properties.h>
 
@@ -3266,6 +3267,26 @@ status_t AwesomePlayer::dump(
         }
     }
 
+    // mLock can be held for a long time while preparing, don't let dumpsys
+    // wait for it just to get at the tracks' buffer statistics.
+    sp<MediaSource> audioTrack, videoTrack;
+    if (mLock.tryLock() == OK) {
+        audioTrack = mAudioTrack;
+        videoTrack = mVideoTrack;
+        mLock.unlock();
+    }
+
+    AString sourceStats;
+    if (audioTrack != NULL) {
+        sourceStats.append("  Audio source\n");
+        audioTrack->dump(&sourceStats);
+    }
+    if (videoTrack != NULL) {
+        sourceStats.append("  Video source\n");
+        videoTrack->dump(&sourceStats);
+    }
+    fprintf(out, "%s", sourceStats.c_str());
+
     fclose(out);
     out = NULL;
 
@@ -37,6 +37,7 @@
 #include <media/IMediaHTTPConnection.h>
 #include <media/IMediaHTTPService.h>
 #include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/DataSource.h>
 #include <media/stagefright/DataURISource.h>
@@ -127,6 +128,207 @@ void DataSource::RegisterDefaultSniffers() {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Serves reads of the first few kilobytes of a source from a buffer filled
+// by a single readAt(), so that sniffers inspecting the same header bytes
+// don't each go to the (possibly remote) source.
+struct SniffProbeSource : public DataSource {
+    SniffProbeSource(DataSource *source, size_t probeSize)
+        : mSource(source),
+          mProbeSize(0),
+          mReachedEOS(false),
+          mNumSourceReads(0) {
+        mProbe = (uint8_t *)malloc(probeSize);
+        if (mProbe == NULL) {
+            return;
+        }
+
+        ssize_t n = mSource->readAt(0, mProbe, probeSize);
+        if (n > 0) {
+            mProbeSize = n;
+        }
+        mReachedEOS = (n >= 0 && (size_t)n < probeSize);
+    }
+
+    const uint8_t *probeData() const { return mProbe; }
+    size_t probeSize() const { return mProbeSize; }
+
+    // True if the probe holds everything needed to judge size bytes.
+    bool covers(size_t size) const {
+        return mProbeSize >= size || mReachedEOS;
+    }
+
+    size_t numSourceReads() const { return mNumSourceReads; }
+    void resetStats() { mNumSourceReads = 0; }
+
+    virtual status_t initCheck() const {
+        return mSource->initCheck();
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        if (offset >= 0 && offset + size <= mProbeSize) {
+            memcpy(data, mProbe + offset, size);
+            return size;
+        }
+
+        if (mReachedEOS && offset >= 0 && offset < (off64_t)mProbeSize) {
+            size_t n = mProbeSize - offset;
+            memcpy(data, mProbe + offset, n);
+            return n;
+        }
+
+        ++mNumSourceReads;
+        return mSource->readAt(offset, data, size);
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        return mSource->getSize(size);
+    }
+
+    virtual uint32_t flags() {
+        return mSource->flags();
+    }
+
+    virtual status_t reconnectAtOffset(off64_t offset) {
+        return mSource->reconnectAtOffset(offset);
+    }
+
+    virtual sp<DecryptHandle> DrmInitialization(const char *mime) {
+        // Container based DRM changes what readAt() returns from now on.
+        mProbeSize = 0;
+        mReachedEOS = false;
+
+        return mSource->DrmInitialization(mime);
+    }
+
+    virtual void getDrmInfo(sp<DecryptHandle> &handle, DrmManagerClient **client) {
+        mSource->getDrmInfo(handle, client);
+    }
+
+    virtual String8 getUri() {
+        return mSource->getUri();
+    }
+
+    virtual status_t getFileIdentity(String8 *id) {
+        return mSource->getFileIdentity(id);
+    }
+
+    virtual String8 getMIMEType() const {
+        return mSource->getMIMEType();
+    }
+
+protected:
+    virtual ~SniffProbeSource() {
+        free(mProbe);
+        mProbe = NULL;
+    }
+
+private:
+    sp<DataSource> mSource;
+    uint8_t *mProbe;
+    size_t mProbeSize;
+    bool mReachedEOS;
+    size_t mNumSourceReads;
+
+    DISALLOW_EVIL_CONSTRUCTORS(SniffProbeSource);
+};
+
+// Each entry's matcher repeats the check its sniffer starts with, so a
+// sniffer whose magic bytes are absent from the probe can be skipped.
+// Sniffers without a matcher can't be ruled out up front.
+struct SnifferMagic {
+    DataSource::SnifferFunc mSniffer;
+    const char *mName;
+    size_t mBytesNeeded;
+    bool (*mMatches)(const uint8_t *data, size_t size);
+};
+
+static bool MatchesMatroska(const uint8_t *data, size_t size) {
+    // The EBML header may be preceded by up to 1k of junk.
+    for (size_t i = 0; i + 4 <= size && i < 1024; ++i) {
+        if (!memcmp(&data[i], "\x1a\x45\xdf\xa3", 4)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool MatchesOgg(const uint8_t *data, size_t size) {
+    return size >= 4 && !memcmp(data, "OggS", 4);
+}
+
+static bool MatchesWAV(const uint8_t *data, size_t size) {
+    return size >= 12 && !memcmp(data, "RIFF", 4) && !memcmp(&data[8], "WAVE", 4);
+}
+
+static bool MatchesFLAC(const uint8_t *data, size_t size) {
+    return size >= 8 && !memcmp(data, "fLaC\0\0\0\042", 8);
+}
+
+static bool MatchesAMR(const uint8_t *data, size_t size) {
+    return size >= 9 && !memcmp(data, "#!AMR", 5);
+}
+
+static bool MatchesMPEG2TS(const uint8_t *data, size_t size) {
+    static const size_t kTSPacketSize = 188;
+
+    for (size_t i = 0; i < 5; ++i) {
+        if (i * kTSPacketSize >= size || data[i * kTSPacketSize] != 0x47) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool MatchesMPEG2PS(const uint8_t *data, size_t size) {
+    return size >= 5 && !memcmp(data, "\x00\x00\x01\xba", 4) && (data[4] >> 6) == 1;
+}
+
+static const SnifferMagic kSnifferMagic[] = {
+    { SniffMPEG4,                   "MPEG4",    0,      NULL },
+    { SniffMatroska,                "Matroska", 1028,   MatchesMatroska },
+    { SniffOgg,                     "Ogg",      4,      MatchesOgg },
+    { SniffWAV,                     "WAV",      12,     MatchesWAV },
+    { SniffFLAC,                    "FLAC",     8,      MatchesFLAC },
+    { SniffAMR,                     "AMR",      9,      MatchesAMR },
+    { SniffMPEG2TS,                 "MPEG2TS",  753,    MatchesMPEG2TS },
+    { SniffMP3,                     "MP3",      0,      NULL },
+    { SniffAAC,                     "AAC",      0,      NULL },
+    { SniffMPEG2PS,                 "MPEG2PS",  5,      MatchesMPEG2PS },
+    { SniffWVM,                     "WVM",      0,      NULL },
+    { ExtendedExtractor::Sniff,     "Extended", 0,      NULL },
+    { SniffDRM,                     "DRM",      0,      NULL },
+};
+
+static const SnifferMagic *findSnifferMagic(DataSource::SnifferFunc func) {
+    for (size_t i = 0; i < (size_t)NELEM(kSnifferMagic); ++i) {
+        if (kSnifferMagic[i].mSniffer == func) {
+            return &kSnifferMagic[i];
+        }
+    }
+    return NULL;
+}
+
+static size_t getSniffProbeSize() {
+    static const size_t kDefaultProbeSize = 64 * 1024;
+    static const size_t kMinProbeSize = 4 * 1024;
+    static const size_t kMaxProbeSize = 1024 * 1024;
+
+    char value[PROPERTY_VALUE_MAX];
+    if (!property_get("media.stagefright.sniff-probe-size", value, NULL)) {
+        return kDefaultProbeSize;
+    }
+
+    size_t size = strtoul(value, NULL, 10);
+    if (size < kMinProbeSize) {
+        return kMinProbeSize;
+    } else if (size > kMaxProbeSize) {
+        return kMaxProbeSize;
+    }
+    return size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 Sniffer::Sniffer() {
     registerDefaultSniffers();
 }
@@ -138,21 +340,74 @@ bool Sniffer::sniff(
     *confidence = 0.0f;
     meta->clear();
 
+    sp<SniffProbeSource> probe = new SniffProbeSource(source, getSniffProbeSize());
+
     Mutex::Autolock autoLock(mSnifferMutex);
+
+    // Sniffers whose magic bytes were found run first, those that can't be
+    // ruled out follow, those whose magic is absent don't run at all.
+    Vector<SnifferFunc> sniffers;
+    Vector<size_t> registrationIndices;
+    Vector<SnifferFunc> unmatchedSniffers;
+    Vector<size_t> unmatchedIndices;
+    size_t index = 0;
     for (List<SnifferFunc>::iterator it = mSniffers.begin();
-         it != mSniffers.end(); ++it) {
+         it != mSniffers.end(); ++it, ++index) {
+        const SnifferMagic *magic = findSnifferMagic(*it);
+
+        if (magic == NULL || magic->mMatches == NULL
+                || !probe->covers(magic->mBytesNeeded)) {
+            unmatchedSniffers.push(*it);
+            unmatchedIndices.push(index);
+        } else if (magic->mMatches(probe->probeData(), probe->probeSize())) {
+            sniffers.push(*it);
+            registrationIndices.push(index);
+        } else {
+            ALOGV("skipping %s sniffer, no magic", magic->mName);
+        }
+    }
+    sniffers.appendVector(unmatchedSniffers);
+    registrationIndices.appendVector(unmatchedIndices);
+
+    int64_t startUs = ALooper::GetNowUs();
+    size_t bestIndex = 0;
+
+    for (size_t i = 0; i < sniffers.size(); ++i) {
+        SnifferFunc func = sniffers.itemAt(i);
+
+        probe->resetStats();
+        int64_t sniffStartUs = ALooper::GetNowUs();
+
         String8 newMimeType;
         float newConfidence;
         sp<AMessage> newMeta;
-        if ((*it)(source, &newMimeType, &newConfidence, &newMeta)) {
-            if (newConfidence > *confidence) {
+        bool found = (*func)(probe, &newMimeType, &newConfidence, &newMeta);
+
+        const SnifferMagic *magic = findSnifferMagic(func);
+        ALOGV("%s sniffer took %lld us, %zu reads beyond the probe",
+              magic != NULL ? magic->mName : "extra",
+              (long long)(ALooper::GetNowUs() - sniffStartUs),
+              probe->numSourceReads());
+
+        if (found) {
+            // Ties go to the earlier registered sniffer, as if they had all
+            // run in registration order.
+            size_t regIndex = registrationIndices.itemAt(i);
+            if (newConfidence > *confidence
+                    || (newConfidence == *confidence && *confidence > 0.0f
+                        && regIndex < bestIndex)) {
                 *mimeType = newMimeType;
                 *confidence = newConfidence;
                 *meta = newMeta;
+                bestIndex = regIndex;
             }
         }
     }
 
+    ALOGV("ran %zu of %zu sniffers in %lld us",
+          sniffers.size(), mSniffers.size(),
+          (long long)(ALooper::GetNowUs() - startUs));
+
     return *confidence > 0.0;
 }
 
@@ -253,10 +508,24 @@ sp<DataSource> DataSource::CreateFromURI(
                 *contentType = httpSource->getMIMEType();
             }
 
-            source = new NuCachedSource2(
+            sp<NuCachedSource2> cachedSource = new NuCachedSource2(
                     httpSource,
                     cacheConfig.isEmpty() ? NULL : cacheConfig.string(),
                     disconnectAtHighwatermark);
+
+            // Opt-in: keep several range requests in flight on links where
+            // latency rather than bandwidth limits a single connection.
+            char value[PROPERTY_VALUE_MAX];
+            if (property_get("media.stagefright.cache-connections", value, NULL)) {
+                int maxConnections = atoi(value);
+                if (maxConnections > 1) {
+                    cachedSource->enableParallelFetch(
+                            httpService, uri, &nonCacheSpecificHeaders,
+                            maxConnections);
+                }
+            }
+
+            source = cachedSource;
         } else {
             // We do not want that prefetching, caching, datasource wrapper
             // in the widevine:// case.
@@ -14,8 +14,15 @@
  * limitations under the License.
  */
 
+//#define LOG_NDEBUG 0
+#define LOG_TAG "FileSource"
+#include <utils/Log.h>
+
+#include <cutils/properties.h>
+#include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/FileSource.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -24,6 +31,30 @@
 
 namespace android {
 
+// Larger files are not mapped on 32-bit targets to preserve address space.
+static const int64_t kMaxMappedSize32 = 256ll * 1024 * 1024;
+
+// An ABuffer over a read-only file mapping, unmapped once the last
+// reference goes away.
+struct MappedFileBuffer : public ABuffer {
+    MappedFileBuffer(void *base, size_t baseSize, size_t offset, size_t size)
+        : ABuffer((uint8_t *)base + offset, size),
+          mBase(base),
+          mBaseSize(baseSize) {
+    }
+
+protected:
+    virtual ~MappedFileBuffer() {
+        munmap(mBase, mBaseSize);
+    }
+
+private:
+    void *mBase;
+    size_t mBaseSize;
+
+    DISALLOW_EVIL_CONSTRUCTORS(MappedFileBuffer);
+};
+
 FileSource::FileSource(const char *filename)
     : mFd(-1),
       mOffset(0),
@@ -38,6 +69,7 @@ FileSource::FileSource(const char *filename)
 
     if (mFd >= 0) {
         mLength = lseek64(mFd, 0, SEEK_END);
+        init();
     } else {
         ALOGE("Failed to open file '%s'. (%s)", filename, strerror(errno));
     }
@@ -54,6 +86,54 @@ FileSource::FileSource(int fd, int64_t offset, int64_t length)
       mDrmBuf(NULL){
     CHECK(offset >= 0);
     CHECK(length >= 0);
+
+    init();
+}
+
+void FileSource::init() {
+    mLastReadEnd = -1;
+    mNumSequentialReads = 0;
+    mReadAheadEnd = 0;
+
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("media.stagefright.filesource.mmap", value, NULL)
+            && (!strcmp(value, "1") || !strcasecmp(value, "true"))) {
+        mapFile();
+    }
+}
+
+void FileSource::mapFile() {
+    if (mFd < 0 || mLength <= 0) {
+        return;
+    }
+
+    if (sizeof(void *) < 8 && mLength > kMaxMappedSize32) {
+        return;
+    }
+
+    struct stat st;
+    if (fstat(mFd, &st) != 0 || !S_ISREG(st.st_mode)
+            || st.st_size < mOffset + mLength) {
+        return;
+    }
+
+    // mmap requires a page aligned file offset.
+    long pageSize = sysconf(_SC_PAGESIZE);
+    off64_t alignedOffset = mOffset - (mOffset % pageSize);
+    size_t delta = mOffset - alignedOffset;
+    size_t mapSize = delta + mLength;
+
+    void *base = mmap64(NULL, mapSize, PROT_READ, MAP_SHARED, mFd, alignedOffset);
+    if (base == MAP_FAILED) {
+        ALOGW("mmap of %lld bytes failed (%s)", (long long)mLength, strerror(errno));
+        return;
+    }
+
+    madvise(base, mapSize, MADV_SEQUENTIAL);
+
+    mMapping = new MappedFileBuffer(base, mapSize, delta, mLength);
+
+    ALOGV("mapped %lld bytes", (long long)mLength);
 }
 
 FileSource::~FileSource() {
@@ -89,7 +169,9 @@ ssize_t FileSource::readAt(off64_t offset, void *data, size_t size) {
         return NO_INIT;
     }
 
-    Mutex::Autolock autoLock(mLock);
+    if (offset < 0) {
+        return UNKNOWN_ERROR;
+    }
 
     if (mLength >= 0) {
         if (offset >= mLength) {
@@ -103,15 +185,82 @@ ssize_t FileSource::readAt(off64_t offset, void *data, size_t size) {
 
     if (mDecryptHandle != NULL && DecryptApiType::CONTAINER_BASED
             == mDecryptHandle->decryptApiType) {
+        Mutex::Autolock autoLock(mLock);
         return readAtDRM(offset, data, size);
-   } else {
-        off64_t result = lseek64(mFd, offset + mOffset, SEEK_SET);
-        if (result == -1) {
-            ALOGE("seek to %lld failed", offset + mOffset);
-            return UNKNOWN_ERROR;
+    }
+
+    if (mMapping != NULL) {
+        memcpy(data, mMapping->data() + offset, size);
+        return size;
+    }
+
+    hintReadAhead(offset, size);
+
+    // pread64 does not touch the file position, so concurrent readers
+    // need no serialization here.
+    ssize_t n;
+    do {
+        n = pread64(mFd, data, size, offset + mOffset);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        ALOGE("read of %zu bytes at %lld failed (%s)",
+              size, (long long)(offset + mOffset), strerror(errno));
+        return UNKNOWN_ERROR;
+    }
+
+    return n;
+}
+
+status_t FileSource::getReadView(
+        off64_t offset, size_t size, sp<ABuffer> *view) {
+    if (mMapping == NULL || mDecryptHandle != NULL) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    if (offset < 0 || offset > mLength || (int64_t)size > mLength - offset) {
+        return ERROR_OUT_OF_RANGE;
+    }
+
+    *view = ABuffer::CreateAsSlice(mMapping, offset, size);
+
+    return OK;
+}
+
+void FileSource::hintReadAhead(off64_t offset, size_t size) {
+    off64_t end = offset + size;
+    off64_t hintStart, hintEnd;
+
+    {
+        Mutex::Autolock autoLock(mLock);
+
+        if (mLastReadEnd >= 0
+                && offset + kSequentialSlack >= mLastReadEnd
+                && offset <= mLastReadEnd + kSequentialSlack) {
+            ++mNumSequentialReads;
+        } else {
+            // A seek, restart detection and forget the previous window.
+            mNumSequentialReads = 0;
+            mReadAheadEnd = end;
+        }
+        mLastReadEnd = end;
+
+        if (mNumSequentialReads < kMinSequentialReads
+                || end + kReadAheadBytes / 2 < mReadAheadEnd) {
+            return;
         }
 
-        return ::read(mFd, data, size);
+        hintStart = mReadAheadEnd > end ? mReadAheadEnd : end;
+        hintEnd = end + kReadAheadBytes;
+        if (mLength >= 0 && hintEnd > mLength) {
+            hintEnd = mLength;
+        }
+        mReadAheadEnd = end + kReadAheadBytes;
+    }
+
+    if (hintEnd > hintStart) {
+        posix_fadvise64(mFd, hintStart + mOffset, hintEnd - hintStart,
+                        POSIX_FADV_WILLNEED);
     }
 }
 
@@ -127,6 +276,32 @@ status_t FileSource::getSize(off64_t *size) {
     return OK;
 }
 
+status_t FileSource::getFileIdentity(String8 *id) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mFd < 0) {
+        return NO_INIT;
+    }
+
+    if (mDecryptHandle != NULL) {
+        // Don't key anything persistent off protected content.
+        return ERROR_UNSUPPORTED;
+    }
+
+    struct stat st;
+    if (fstat(mFd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    id->setTo("");
+    id->appendFormat("%llx:%llx:%lld:%lld:%lld:%lld",
+            (unsigned long long)st.st_dev, (unsigned long long)st.st_ino,
+            (long long)st.st_size, (long long)st.st_mtime,
+            (long long)mOffset, (long long)mLength);
+
+    return OK;
+}
+
 sp<DecryptHandle> FileSource::DrmInitialization(const char *mime) {
     if (mDrmManagerClient == NULL) {
         mDrmManagerClient = new DrmManagerClient();
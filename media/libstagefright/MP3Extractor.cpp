@@ -22,9 +22,11 @@
 
 #include "include/avc_utils.h"
 #include "include/ID3.h"
+#include "include/MP3FrameIndexSeeker.h"
 #include "include/VBRISeeker.h"
 #include "include/XINGSeeker.h"
 
+#include <cutils/properties.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/DataSource.h>
@@ -229,6 +231,7 @@ protected:
 
 private:
     static const size_t kMaxFrameSize;
+    static const int64_t kSeekPrerollUs;
     sp<MetaData> mMeta;
     sp<DataSource> mDataSource;
     off64_t mFirstFramePos;
@@ -241,11 +244,24 @@ private:
 
     int64_t mBasisTimeUs;
     int64_t mSamplesRead;
+    int64_t mTargetTimeUs;
 
     MP3Source(const MP3Source &);
     MP3Source &operator=(const MP3Source &);
 };
 
+// Indexing every frame means reading the whole file, which is only cheap
+// for local content.
+static bool UseFrameIndexSeeking(const sp<DataSource> &source) {
+    if (source->flags() & DataSource::kIsCachingDataSource) {
+        return false;
+    }
+
+    char value[PROPERTY_VALUE_MAX];
+    return property_get("media.stagefright.mp3.frame-index", value, NULL)
+        && (!strcmp(value, "1") || !strcasecmp(value, "true"));
+}
+
 MP3Extractor::MP3Extractor(
         const sp<DataSource> &source, const sp<AMessage> &meta)
     : mInitCheck(NO_INIT),
@@ -333,6 +349,15 @@ MP3Extractor::MP3Extractor(
         mFirstFramePos += frame_size;
     }
 
+    if (UseFrameIndexSeeking(mDataSource)) {
+        sp<MP3Seeker> indexSeeker = MP3FrameIndexSeeker::CreateFromSource(
+                mDataSource, mFirstFramePos, mFixedHeader, mSeeker);
+
+        if (indexSeeker != NULL) {
+            mSeeker = indexSeeker;
+        }
+    }
+
     int64_t durationUs;
 
     if (mSeeker == NULL || !mSeeker->getDuration(&durationUs)) {
@@ -416,6 +441,10 @@ sp<MetaData> MP3Extractor::getTrackMetaData(
 //  (8000 samples/sec * 8 bits/byte)) + 1 padding byte/frame = 2881 bytes/frame.
 // Set our max frame size to the nearest power of 2 above this size (aka, 4kB)
 const size_t MP3Source::kMaxFrameSize = (1 << 12); /* 4096 bytes */
+
+// Layer III frames may borrow up to 511 bytes from the frames before them,
+// which at low bitrates spans a couple of 26ms frames.
+const int64_t MP3Source::kSeekPrerollUs = 60000ll;
 MP3Source::MP3Source(
         const sp<MetaData> &meta, const sp<DataSource> &source,
         off64_t first_frame_pos, uint32_t fixed_header,
@@ -430,7 +459,8 @@ MP3Source::MP3Source(
       mSeeker(seeker),
       mGroup(NULL),
       mBasisTimeUs(0),
-      mSamplesRead(0) {
+      mSamplesRead(0),
+      mTargetTimeUs(-1) {
 }
 
 MP3Source::~MP3Source() {
@@ -451,6 +481,7 @@ status_t MP3Source::start(MetaData *) {
 
     mBasisTimeUs = mCurrentTimeUs;
     mSamplesRead = 0;
+    mTargetTimeUs = -1;
 
     mStarted = true;
 
@@ -482,6 +513,20 @@ status_t MP3Source::read(
 
     if (options != NULL && options->getSeekTo(&seekTimeUs, &mode)) {
         int64_t actualSeekTimeUs = seekTimeUs;
+        mTargetTimeUs = -1;
+
+        if (mode == ReadOptions::SEEK_CLOSEST
+                && mSeeker != NULL && mSeeker->isSampleAccurate()) {
+            // Start decoding a little early so the bit reservoir of the
+            // target frame is filled, and let the decoder drop everything
+            // before the requested sample.
+            actualSeekTimeUs = seekTimeUs - kSeekPrerollUs;
+            if (actualSeekTimeUs < 0) {
+                actualSeekTimeUs = 0;
+            }
+            mTargetTimeUs = seekTimeUs;
+        }
+
         if (mSeeker == NULL
                 || !mSeeker->getOffsetForTime(&actualSeekTimeUs, &mCurrentPos)) {
             int32_t bitrate;
@@ -571,6 +616,11 @@ status_t MP3Source::read(
     buffer->meta_data()->setInt64(kKeyTime, mCurrentTimeUs);
     buffer->meta_data()->setInt32(kKeyIsSyncFrame, 1);
 
+    if (mTargetTimeUs >= 0) {
+        buffer->meta_data()->setInt64(kKeyTargetTime, mTargetTimeUs);
+        mTargetTimeUs = -1;
+    }
+
     mCurrentPos += frame_size;
 
     mSamplesRead += num_samples;
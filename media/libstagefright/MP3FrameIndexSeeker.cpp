@@ -0,0 +1,412 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "MP3FrameIndexSeeker"
+#include <utils/Log.h>
+
+#include "include/MP3FrameIndexSeeker.h"
+#include "include/SeekIndexCache.h"
+#include "include/avc_utils.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/Utils.h>
+
+#include <errno.h>
+#include <string.h>
+
+namespace android {
+
+// Same as in MP3Extractor: everything but protection, bitrate, padding,
+// private bits, mode, mode extension, copyright, original and emphasis
+// must match the first frame.
+static const uint32_t kMask = 0xfffe0c00;
+
+static const size_t kFramesPerEntry = 32;
+static const size_t kFramesPerBatch = 4096;
+static const size_t kScanChunkSize = 64 * 1024;
+
+// Number of frames that must follow a header found while resyncing.
+static const size_t kNumResyncFrames = 3;
+
+static const uint32_t kSeekIndexTag = 'mp3 ';
+
+// static
+sp<MP3FrameIndexSeeker> MP3FrameIndexSeeker::CreateFromSource(
+        const sp<DataSource> &source, off64_t first_frame_pos,
+        uint32_t fixed_header, const sp<MP3Seeker> &fallback) {
+    size_t frame_size;
+    int sample_rate;
+    if (!GetMPEGAudioFrameSize(
+                fixed_header, &frame_size, &sample_rate, NULL, NULL, NULL)
+            || sample_rate <= 0) {
+        return NULL;
+    }
+
+    sp<MP3FrameIndexSeeker> seeker = new MP3FrameIndexSeeker(
+            source, first_frame_pos, fixed_header, sample_rate, fallback);
+
+    if (!seeker->loadCachedIndex()) {
+        seeker->startScan();
+    }
+
+    return seeker;
+}
+
+MP3FrameIndexSeeker::MP3FrameIndexSeeker(
+        const sp<DataSource> &source, off64_t first_frame_pos,
+        uint32_t fixed_header, int32_t sample_rate,
+        const sp<MP3Seeker> &fallback)
+    : mSource(source),
+      mFixedHeader(fixed_header),
+      mSampleRate(sample_rate),
+      mFallback(fallback),
+      mSourceSize(-1),
+      mScanPos(first_frame_pos),
+      mScanSamples(0),
+      mScanFrames(0),
+      mScanLostSync(false),
+      mScanDone(false),
+      mScanFailed(false) {
+    if (mSource->getSize(&mSourceSize) != OK) {
+        mSourceSize = -1;
+    }
+}
+
+MP3FrameIndexSeeker::~MP3FrameIndexSeeker() {
+    if (mLooper != NULL) {
+        mLooper->stop();
+        mLooper->unregisterHandler(mReflector->id());
+    }
+}
+
+bool MP3FrameIndexSeeker::loadCachedIndex() {
+    Vector<SeekIndexCache::Entry> cached;
+    if (SeekIndexCache::Load(mSource, kSeekIndexTag, &cached) != OK
+            || cached.size() < 2) {
+        return false;
+    }
+
+    // Entries are stored as (time, offset), the last one marking the end
+    // of the stream. Times were rounded down from sample counts, so
+    // rounding up recovers the exact count.
+    for (size_t i = 0; i + 1 < cached.size(); ++i) {
+        Entry entry;
+        entry.mSample =
+            (cached[i].mTimeUs * mSampleRate + 999999ll) / 1000000ll;
+        entry.mOffset = cached[i].mOffset;
+        mEntries.push(entry);
+    }
+
+    const SeekIndexCache::Entry &last = cached[cached.size() - 1];
+    mScanSamples = (last.mTimeUs * mSampleRate + 999999ll) / 1000000ll;
+    mScanPos = last.mOffset;
+    mScanDone = true;
+
+    ALOGV("loaded cached index of %zu entries", mEntries.size());
+
+    return true;
+}
+
+void MP3FrameIndexSeeker::startScan() {
+    mLooper = new ALooper;
+    mLooper->setName("MP3FrameIndex");
+    mReflector = new AHandlerReflector<MP3FrameIndexSeeker>(this);
+    mLooper->registerHandler(mReflector);
+    mLooper->start(false /* runOnCallingThread */, false /* canCallJava */,
+            PRIORITY_BACKGROUND);
+
+    (new AMessage(kWhatScan, mReflector->id()))->post();
+}
+
+void MP3FrameIndexSeeker::onMessageReceived(const sp<AMessage> &msg) {
+    switch (msg->what()) {
+        case kWhatScan:
+        {
+            bool done;
+            {
+                Mutex::Autolock autoLock(mLock);
+                scanFrames_l(kFramesPerBatch, -1);
+                done = mScanDone;
+            }
+
+            if (!done) {
+                (new AMessage(kWhatScan, mReflector->id()))->post();
+            }
+            break;
+        }
+
+        default:
+            TRESPASS();
+            break;
+    }
+}
+
+bool MP3FrameIndexSeeker::parseHeader(
+        uint32_t header, size_t *frameSize, int *numSamples) const {
+    int sampleRate;
+    return (header & kMask) == (mFixedHeader & kMask)
+        && GetMPEGAudioFrameSize(
+                header, frameSize, &sampleRate, NULL, NULL, numSamples)
+        && sampleRate == mSampleRate;
+}
+
+// Whether the frame at "pos" is followed by a few more frames, or by the
+// end of the file.
+bool MP3FrameIndexSeeker::isFrameSequence(off64_t pos) const {
+    for (size_t i = 0; i < kNumResyncFrames; ++i) {
+        uint8_t header[4];
+        ssize_t n = mSource->readAt(pos, header, sizeof(header));
+        if (n == 0 || (mSourceSize >= 0 && pos >= mSourceSize)) {
+            return i > 0;
+        }
+
+        size_t frameSize;
+        int numSamples;
+        if (n < (ssize_t)sizeof(header)
+                || !parseHeader(U32_AT(header), &frameSize, &numSamples)) {
+            return false;
+        }
+
+        pos += frameSize;
+    }
+
+    return true;
+}
+
+// Moves "*pos" past junk between frames, or the ID3 tag of a concatenated
+// file, to the next frame, the way MP3Extractor's Resync() does. Returns
+// -EAGAIN with "*pos" advanced if no frame was found within
+// kScanChunkSize bytes, and ERROR_END_OF_STREAM if there is none left.
+status_t MP3FrameIndexSeeker::resync_l(off64_t *pos) {
+    uint8_t buffer[1024];
+
+    ssize_t n = mSource->readAt(*pos, buffer, 10);
+    if (n < 0) {
+        return ERROR_IO;
+    } else if (n == 10 && !memcmp("ID3", buffer, 3)) {
+        size_t len =
+            ((buffer[6] & 0x7f) << 21)
+            | ((buffer[7] & 0x7f) << 14)
+            | ((buffer[8] & 0x7f) << 7)
+            | (buffer[9] & 0x7f);
+
+        *pos += 10 + len;
+
+        ALOGV("skipped ID3 tag, continuing at %lld", (long long)*pos);
+        return OK;
+    }
+
+    off64_t stopPos = *pos + kScanChunkSize;
+    while (*pos < stopPos) {
+        n = mSource->readAt(*pos, buffer, sizeof(buffer));
+        if (n < 0) {
+            return ERROR_IO;
+        } else if (n < 4) {
+            return ERROR_END_OF_STREAM;
+        }
+
+        for (size_t i = 0; i + 4 <= (size_t)n; ++i) {
+            size_t frameSize;
+            int numSamples;
+            if (parseHeader(U32_AT(&buffer[i]), &frameSize, &numSamples)
+                    && isFrameSequence(*pos + i)) {
+                *pos += i;
+                return OK;
+            }
+        }
+
+        *pos += n - 3;
+    }
+
+    return -EAGAIN;
+}
+
+// Scans up to maxFrames further frames, stopping early once the frame
+// containing "untilSample" has been indexed (if untilSample >= 0).
+void MP3FrameIndexSeeker::scanFrames_l(size_t maxFrames, int64_t untilSample) {
+    if (mScanBuffer.size() < kScanChunkSize) {
+        mScanBuffer.insertAt((size_t)0, kScanChunkSize - mScanBuffer.size());
+    }
+    uint8_t *buffer = mScanBuffer.editArray();
+
+    off64_t bufferPos = mScanPos;
+    size_t bufferSize = 0;
+
+    for (size_t n = 0; n < maxFrames && !mScanDone; ++n) {
+        if (untilSample >= 0 && mScanSamples > untilSample) {
+            break;
+        }
+
+        if (mScanPos + 4 > bufferPos + (off64_t)bufferSize) {
+            ssize_t read = mSource->readAt(mScanPos, buffer, kScanChunkSize);
+            if (read < 4) {
+                // Short of the end of the file, the rest of it can't be
+                // indexed.
+                if (read < 0
+                        || (mSourceSize >= 0 && mScanPos + 4 <= mSourceSize)) {
+                    ALOGW("read error at %lld, abandoning the frame index",
+                            (long long)mScanPos);
+                    mScanFailed = true;
+                }
+                mScanDone = true;
+                break;
+            }
+
+            bufferPos = mScanPos;
+            bufferSize = read;
+        }
+
+        size_t frameSize;
+        int numSamples;
+        if (!parseHeader(U32_AT(&buffer[mScanPos - bufferPos]),
+                    &frameSize, &numSamples)) {
+            ALOGV("lost sync at %lld", (long long)mScanPos);
+
+            status_t err = resync_l(&mScanPos);
+            if (err == ERROR_END_OF_STREAM) {
+                // Trailing tags or garbage.
+                mScanDone = true;
+                break;
+            } else if (err != OK && err != -EAGAIN) {
+                ALOGW("read error at %lld, abandoning the frame index",
+                        (long long)mScanPos);
+                mScanFailed = true;
+                mScanDone = true;
+                break;
+            }
+
+            // Refill the buffer at the new position.
+            mScanLostSync = true;
+            bufferSize = 0;
+            continue;
+        }
+
+        // Seeks step forward from an entry without resyncing, there must
+        // be one right after any junk.
+        if (mScanFrames % kFramesPerEntry == 0 || mScanLostSync) {
+            Entry entry;
+            entry.mSample = mScanSamples;
+            entry.mOffset = mScanPos;
+            mEntries.push(entry);
+
+            mScanLostSync = false;
+        }
+
+        mScanPos += frameSize;
+        mScanSamples += numSamples;
+        ++mScanFrames;
+    }
+
+    if (mScanDone) {
+        ALOGV("indexed %zu frames, %lld samples",
+                mScanFrames, (long long)mScanSamples);
+
+        mScanBuffer.clear();
+
+        if (mScanFailed) {
+            // Don't make every later open believe in a truncated file.
+            return;
+        }
+
+        Vector<SeekIndexCache::Entry> cached;
+        for (size_t i = 0; i <= mEntries.size(); ++i) {
+            SeekIndexCache::Entry entry;
+            int64_t sample =
+                i < mEntries.size() ? mEntries[i].mSample : mScanSamples;
+            entry.mTimeUs = sample * 1000000ll / mSampleRate;
+            entry.mOffset =
+                i < mEntries.size() ? mEntries[i].mOffset : mScanPos;
+            cached.push(entry);
+        }
+        SeekIndexCache::Store(mSource, kSeekIndexTag, cached);
+    }
+}
+
+bool MP3FrameIndexSeeker::getDuration(int64_t *durationUs) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mScanDone && !mScanFailed) {
+        *durationUs = mScanSamples * 1000000ll / mSampleRate;
+        return true;
+    }
+
+    return mFallback != NULL && mFallback->getDuration(durationUs);
+}
+
+bool MP3FrameIndexSeeker::getOffsetForTime(int64_t *timeUs, off64_t *pos) {
+    Mutex::Autolock autoLock(mLock);
+
+    int64_t targetSample = *timeUs * mSampleRate / 1000000ll;
+    if (targetSample < 0) {
+        targetSample = 0;
+    }
+
+    // Don't wait for the background scan to get there.
+    while (!mScanDone && mScanSamples <= targetSample) {
+        scanFrames_l(kFramesPerBatch, targetSample);
+    }
+
+    if (mScanFailed && mScanSamples <= targetSample) {
+        // The index doesn't reach that far.
+        return mFallback != NULL && mFallback->getOffsetForTime(timeUs, pos);
+    }
+
+    if (mEntries.isEmpty()) {
+        return false;
+    }
+
+    size_t lo = 0;
+    size_t hi = mEntries.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mEntries[mid].mSample <= targetSample) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    const Entry &entry = mEntries[lo > 0 ? lo - 1 : 0];
+    off64_t offset = entry.mOffset;
+    int64_t sample = entry.mSample;
+
+    // Step through the remaining frames to the one containing the target.
+    for (size_t i = 0; i < kFramesPerEntry; ++i) {
+        uint8_t header[4];
+        size_t frameSize;
+        int numSamples;
+        if (mSource->readAt(offset, header, 4) < 4
+                || !parseHeader(U32_AT(header), &frameSize, &numSamples)
+                || sample + numSamples > targetSample) {
+            break;
+        }
+
+        offset += frameSize;
+        sample += numSamples;
+    }
+
+    *pos = offset;
+    *timeUs = sample * 1000000ll / mSampleRate;
+
+    return true;
+}
+
+}  // namespace android
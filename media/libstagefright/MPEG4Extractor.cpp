@@ -70,12 +70,14 @@
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/AString.h>
 #include <media/stagefright/foundation/AUtils.h>
 #include <media/stagefright/MediaBuffer.h>
 #include <media/stagefright/MediaBufferGroup.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MediaSource.h>
 #include <media/stagefright/MetaData.h>
+#include <utils/KeyedVector.h>
 #include <utils/String8.h>
 #ifdef ENABLE_AV_ENHANCEMENTS
 #include <QCMediaDefs.h>
@@ -92,6 +94,8 @@
 #endif // DOLBY_END
 namespace android {
 
+struct MPEG4DataSource;
+
 class MPEG4Source : public MediaSource {
 public:
     // Caller retains ownership of both "dataSource" and "sampleTable".
@@ -112,6 +116,8 @@ public:
     virtual status_t read(MediaBuffer **buffer, const ReadOptions *options = NULL);
     virtual status_t fragmentedRead(MediaBuffer **buffer, const ReadOptions *options = NULL);
 
+    virtual void dump(AString *out);
+
 protected:
     virtual ~MPEG4Source();
 
@@ -122,6 +128,8 @@ private:
     sp<MPEG4Extractor> mOwner;
     sp<MetaData> mFormat;
     sp<DataSource> mDataSource;
+    // Wraps mDataSource for fragmented files, holding the current moof.
+    sp<MPEG4DataSource> mFragmentCache;
     int32_t mTimescale;
     sp<SampleTable> mSampleTable;
     uint32_t mCurrentSampleIndex;
@@ -132,6 +140,10 @@ private:
     off64_t mCurrentMoofOffset;
     off64_t mNextMoofOffset;
     uint32_t mCurrentTime;
+    // Start time (in mTimescale units) of every moof seen so far, keyed by
+    // its offset. Kept across seeks so that each fragment is only scanned
+    // once.
+    KeyedVector<off64_t, uint64_t> mFragmentTimes;
     int32_t mLastParsedTrackId;
     int32_t mTrackId;
 
@@ -164,6 +176,8 @@ private:
 
     size_t parseNALSize(const uint8_t *data) const;
     status_t parseChunk(off64_t *offset);
+    void moveToFragment(off64_t moofOffset, uint64_t startTime);
+    ssize_t findFragmentAtTime(uint64_t time) const;
     status_t parseTrackFragmentHeader(off64_t offset, off64_t size);
     status_t parseTrackFragmentRun(off64_t offset, off64_t size);
     status_t parseSampleAuxiliaryInformationSizes(off64_t offset, off64_t size);
@@ -206,18 +220,32 @@ private:
     MPEG4Source &operator=(const MPEG4Source &);
 };
 
+// MediaBuffers wrapping a view of the data source don't belong to a group.
+// They are observed by this instead, so that reference counting (e.g. by
+// clone()) works as usual, and deleted once the last reference is gone.
+struct ViewBufferObserver : public MediaBufferObserver {
+    virtual void signalBufferReturned(MediaBuffer *buffer) {
+        buffer->setObserver(NULL);
+        buffer->release();
+    }
+};
+
+static ViewBufferObserver gViewBufferObserver;
+
 // This custom data source wraps an existing one and satisfies requests
 // falling entirely within a cached range from the cache while forwarding
 // all remaining requests to the wrapped datasource.
-// This is used to cache the full sampletable metadata for a single track,
-// possibly wrapping multiple times to cover all tracks, i.e.
-// Each MPEG4DataSource caches the sampletable metadata for a single track.
+// This is used to cache the whole moov box, so that all tracks (and the
+// deferred sample table and metadata parsing) are served from one read.
+// If the moov is too large to cache it is wrapped once per track instead,
+// each MPEG4DataSource caching the sampletable metadata for a single track.
 
 struct MPEG4DataSource : public DataSource {
     MPEG4DataSource(const sp<DataSource> &source);
 
     virtual status_t initCheck() const;
     virtual ssize_t readAt(off64_t offset, void *data, size_t size);
+    virtual status_t getReadView(off64_t offset, size_t size, sp<ABuffer> *view);
     virtual status_t getSize(off64_t *size);
     virtual uint32_t flags();
 
@@ -240,6 +268,9 @@ private:
     MPEG4DataSource &operator=(const MPEG4DataSource &);
 };
 
+// Larger moov boxes fall back to caching each stbl separately.
+static const off64_t kMaxCachedMoovSize = 32 * 1024 * 1024;
+
 MPEG4DataSource::MPEG4DataSource(const sp<DataSource> &source)
     : mSource(source),
       mCachedOffset(0),
@@ -279,6 +310,11 @@ ssize_t MPEG4DataSource::readAt(off64_t offset, void *data, size_t size) {
     return mSource->readAt(offset, data, size);
 }
 
+status_t MPEG4DataSource::getReadView(
+        off64_t offset, size_t size, sp<ABuffer> *view) {
+    return mSource->getReadView(offset, size, view);
+}
+
 status_t MPEG4DataSource::getSize(off64_t *size) {
     return mSource->getSize(size);
 }
@@ -450,6 +486,10 @@ MPEG4Extractor::MPEG4Extractor(const sp<DataSource> &source)
       mFirstTrack(NULL),
       mLastTrack(NULL),
       mFileMetaData(new MetaData),
+      mParsingDeferredMetaData(false),
+      mParsingGaplessInfo(false),
+      mGaplessInfoParsed(false),
+      mMoovCached(false),
       mFirstSINF(NULL),
       mIsDrm(false) {
 #ifdef DOLBY_UDC
@@ -493,6 +533,8 @@ sp<MetaData> MPEG4Extractor::getMetaData() {
         return new MetaData;
     }
 
+    parseDeferredMetaData();
+
     return mFileMetaData;
 }
 
@@ -535,6 +577,10 @@ sp<MetaData> MPEG4Extractor::getTrackMetaData(
         return NULL;
     }
 
+    // The iTunes gapless info lives in the file level metadata but is
+    // reported on the track.
+    parseGaplessInfo();
+
     if ((flags & kIncludeExtensiveMetaData)
             && !track->includes_expensive_metadata) {
         track->includes_expensive_metadata = true;
@@ -549,7 +595,7 @@ sp<MetaData> MPEG4Extractor::getTrackMetaData(
                     track->meta->setInt64(
                             kKeyThumbnailTime, duration / 4);
                 }
-            } else {
+            } else if (ensureSampleTable(track) == OK) {
                 uint32_t sampleIndex;
                 uint32_t sampleTime;
                 if (track->sampleTable->findThumbnailSample(&sampleIndex) == OK
@@ -843,6 +889,31 @@ static bool underMetaDataPath(const Vector<uint32_t> &path) {
         && path[3] == FOURCC('i', 'l', 's', 't');
 }
 
+// Whether "path" leads to, or is inside of, a moov/udta/meta/ilst/----
+// comment box, where the iTunes gapless info lives.
+static bool onGaplessInfoPath(const Vector<uint32_t> &path) {
+    static const uint32_t kPath[] = {
+        FOURCC('m', 'o', 'o', 'v'),
+        FOURCC('u', 'd', 't', 'a'),
+        FOURCC('m', 'e', 't', 'a'),
+        FOURCC('i', 'l', 's', 't'),
+        FOURCC('-', '-', '-', '-'),
+    };
+    static const size_t kPathSize = sizeof(kPath) / sizeof(kPath[0]);
+
+    if (path.size() > kPathSize + 1) {
+        return false;
+    }
+
+    for (size_t i = 0; i < path.size() && i < kPathSize; ++i) {
+        if (path[i] != kPath[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 // Given a time in seconds since Jan 1 1904, produce a human-readable string.
 static void convertTimeToDate(int64_t time_1904, String8 *s) {
     time_t time_1970 = time_1904 - (((66 * 365 + 17) * 24) * 3600);
@@ -922,6 +993,30 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
 
     off64_t chunk_data_size = *offset + chunk_size - data_offset;
 
+    if (!mParsingDeferredMetaData
+            && mPath.size() == 2
+            && mPath[0] == FOURCC('m', 'o', 'o', 'v')
+            && (chunk_type == FOURCC('u', 'd', 't', 'a')
+                || chunk_type == FOURCC('m', 'e', 't', 'a'))) {
+        // File level metadata (including any cover art) is only needed
+        // by getMetaData(), don't read it while locating the tracks.
+        // getTrack() and getTrackMetaData() only pick the gapless info
+        // out of it, see parseGaplessInfo().
+        DeferredMetaData deferred;
+        deferred.offset = *offset;
+        deferred.track = mLastTrack;
+        mDeferredMetaData.push(deferred);
+
+        *offset += chunk_size;
+        return OK;
+    }
+
+    if (mParsingGaplessInfo && !onGaplessInfoPath(mPath)) {
+        // Skip cover art, ID3 tags and everything else.
+        *offset += chunk_size;
+        return OK;
+    }
+
     if (chunk_type != FOURCC('c', 'p', 'r', 't')
             && chunk_type != FOURCC('c', 'o', 'v', 'r')
             && mPath.size() == 5 && underMetaDataPath(mPath)) {
@@ -958,10 +1053,24 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
         case FOURCC('s', 'c', 'h', 'i'):
         case FOURCC('e', 'd', 't', 's'):
         {
+            if (chunk_type == FOURCC('m', 'o', 'o', 'v') && !mMoovCached
+                    && chunk_size <= kMaxCachedMoovSize
+                    && (mDataSource->flags()
+                        & (DataSource::kWantsPrefetching
+                            | DataSource::kIsCachingDataSource))) {
+                sp<MPEG4DataSource> cachedSource =
+                    new MPEG4DataSource(mDataSource);
+
+                if (cachedSource->setCachedRange(*offset, chunk_size) == OK) {
+                    mDataSource = cachedSource;
+                    mMoovCached = true;
+                }
+            }
+
             if (chunk_type == FOURCC('s', 't', 'b', 'l')) {
                 ALOGV("sampleTable chunk is %" PRIu64 " bytes long.", chunk_size);
 
-                if (mDataSource->flags()
+                if (!mMoovCached && mDataSource->flags()
                         & (DataSource::kWantsPrefetching
                             | DataSource::kIsCachingDataSource)) {
                     sp<MPEG4DataSource> cachedSource =
@@ -989,6 +1098,8 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
                 mLastTrack = track;
 
                 track->meta = new MetaData;
+                track->sampleTableStatus = NO_INIT;
+                track->hasSampleSizes = false;
                 track->includes_expensive_metadata = false;
                 track->skipTrack = false;
                 track->timescale = 0;
@@ -1578,32 +1689,20 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
 
         case FOURCC('s', 't', 'c', 'o'):
         case FOURCC('c', 'o', '6', '4'):
-        {
-            status_t err =
-                mLastTrack->sampleTable->setChunkOffsetParams(
-                        chunk_type, data_offset, chunk_data_size);
-
-            *offset += chunk_size;
-
-            if (err != OK) {
-                return err;
-            }
-
-            break;
-        }
-
         case FOURCC('s', 't', 's', 'c'):
+        case FOURCC('s', 't', 't', 's'):
+        case FOURCC('c', 't', 't', 's'):
+        case FOURCC('s', 't', 's', 's'):
         {
-            status_t err =
-                mLastTrack->sampleTable->setSampleToChunkParams(
-                        data_offset, chunk_data_size);
-
             *offset += chunk_size;
 
-            if (err != OK) {
-                return err;
-            }
-
+            // Only remember where the box is, the table itself is read by
+            // ensureSampleTable() once the track is used.
+            SampleTableBox box;
+            box.type = chunk_type;
+            box.offset = data_offset;
+            box.size = chunk_data_size;
+            mLastTrack->deferredBoxes.push(box);
             break;
         }
 
@@ -1620,6 +1719,8 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
                 return err;
             }
 
+            mLastTrack->hasSampleSizes = true;
+
             size_t max_size;
             err = mLastTrack->sampleTable->getMaxSampleSize(&max_size);
 
@@ -1677,59 +1778,6 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
             break;
         }
 
-        case FOURCC('s', 't', 't', 's'):
-        {
-            *offset += chunk_size;
-
-            status_t err =
-                mLastTrack->sampleTable->setTimeToSampleParams(
-                        data_offset, chunk_data_size);
-
-            if (err != OK) {
-                return err;
-            }
-
-            break;
-        }
-
-        case FOURCC('c', 't', 't', 's'):
-        {
-            *offset += chunk_size;
-
-            status_t err =
-                mLastTrack->sampleTable->setCompositionTimeToSampleParams(
-                        data_offset, chunk_data_size);
-
-            if (err != OK) {
-                return err;
-            }
-
-            break;
-        }
-
-        case FOURCC('s', 't', 's', 's'):
-        {
-            *offset += chunk_size;
-            // Ignore stss block for audio even if its present
-            // All audio sample are sync samples itself,
-            // self decodeable and playable.
-            // Parsing this block for audio restricts audio seek to few entries
-            // available in this block, sometimes 0, which is undesired.
-            const char *mime;
-            CHECK(mLastTrack->meta->findCString(kKeyMIMEType, &mime));
-            if (strncasecmp("audio/", mime, 6)) {
-                status_t err =
-                    mLastTrack->sampleTable->setSyncSampleParams(
-                            data_offset, chunk_data_size);
-
-                if (err != OK) {
-                    return err;
-                }
-            }
-
-            break;
-        }
-
         // @xyz
         case FOURCC('\xA9', 'x', 'y', 'z'):
         {
@@ -2822,6 +2870,14 @@ sp<MediaSource> MPEG4Extractor::getTrack(size_t index) {
         }
     }
 
+    if (ensureSampleTable(track) != OK) {
+        return NULL;
+    }
+
+    // The iTunes gapless info lives in the file level metadata but is
+    // reported on the track.
+    parseGaplessInfo();
+
     ALOGV("getTrack called, pssh: %zu", mPssh.size());
 
     return new MPEG4Source(this,
@@ -2855,7 +2911,30 @@ status_t MPEG4Extractor::verifyTrack(Track *track) {
         }
     }
 
-    if (track->sampleTable == NULL || !track->sampleTable->isValid()) {
+    // The tables themselves are validated by ensureSampleTable(), here we
+    // only make sure all the mandatory boxes are present.
+    bool hasChunkOffsets = false;
+    bool hasSampleToChunk = false;
+    bool hasTimeToSample = false;
+    for (size_t i = 0; i < track->deferredBoxes.size(); ++i) {
+        switch (track->deferredBoxes.itemAt(i).type) {
+            case FOURCC('s', 't', 'c', 'o'):
+            case FOURCC('c', 'o', '6', '4'):
+                hasChunkOffsets = true;
+                break;
+            case FOURCC('s', 't', 's', 'c'):
+                hasSampleToChunk = true;
+                break;
+            case FOURCC('s', 't', 't', 's'):
+                hasTimeToSample = true;
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (track->sampleTable == NULL || !track->hasSampleSizes
+            || !hasChunkOffsets || !hasSampleToChunk || !hasTimeToSample) {
         // Make sure we have all the metadata we need.
         ALOGE("stbl atom missing/invalid.");
         return ERROR_MALFORMED;
@@ -2864,6 +2943,128 @@ status_t MPEG4Extractor::verifyTrack(Track *track) {
     return OK;
 }
 
+status_t MPEG4Extractor::setSampleTableBox(
+        Track *track, uint32_t type, off64_t data_offset, size_t data_size) {
+    switch (type) {
+        case FOURCC('s', 't', 'c', 'o'):
+        case FOURCC('c', 'o', '6', '4'):
+            return track->sampleTable->setChunkOffsetParams(
+                    type, data_offset, data_size);
+
+        case FOURCC('s', 't', 's', 'c'):
+            return track->sampleTable->setSampleToChunkParams(
+                    data_offset, data_size);
+
+        case FOURCC('s', 't', 't', 's'):
+            return track->sampleTable->setTimeToSampleParams(
+                    data_offset, data_size);
+
+        case FOURCC('c', 't', 't', 's'):
+            return track->sampleTable->setCompositionTimeToSampleParams(
+                    data_offset, data_size);
+
+        case FOURCC('s', 't', 's', 's'):
+        {
+            // Ignore stss block for audio even if its present
+            // All audio sample are sync samples itself,
+            // self decodeable and playable.
+            // Parsing this block for audio restricts audio seek to few entries
+            // available in this block, sometimes 0, which is undesired.
+            const char *mime;
+            CHECK(track->meta->findCString(kKeyMIMEType, &mime));
+            if (!strncasecmp("audio/", mime, 6)) {
+                return OK;
+            }
+
+            return track->sampleTable->setSyncSampleParams(
+                    data_offset, data_size);
+        }
+
+        default:
+            TRESPASS();
+    }
+
+    return OK;
+}
+
+status_t MPEG4Extractor::ensureSampleTable(Track *track) {
+    if (track->sampleTableStatus != NO_INIT) {
+        return track->sampleTableStatus;
+    }
+
+    status_t err = OK;
+    for (size_t i = 0; i < track->deferredBoxes.size(); ++i) {
+        const SampleTableBox &box = track->deferredBoxes.itemAt(i);
+
+        err = setSampleTableBox(track, box.type, box.offset, box.size);
+        if (err != OK) {
+            break;
+        }
+    }
+
+    if (err == OK && !track->sampleTable->isValid()) {
+        ALOGE("stbl atom missing/invalid.");
+        err = ERROR_MALFORMED;
+    }
+
+    track->deferredBoxes.clear();
+    track->sampleTableStatus = err;
+
+    return err;
+}
+
+void MPEG4Extractor::parseDeferredMetaData() {
+    if (mDeferredMetaData.isEmpty()) {
+        return;
+    }
+
+    parseDeferredBoxes();
+
+    mDeferredMetaData.clear();
+    mGaplessInfoParsed = true;
+}
+
+void MPEG4Extractor::parseGaplessInfo() {
+    if (mGaplessInfoParsed) {
+        return;
+    }
+
+    mParsingGaplessInfo = true;
+    parseDeferredBoxes();
+    mParsingGaplessInfo = false;
+
+    mGaplessInfoParsed = true;
+}
+
+void MPEG4Extractor::parseDeferredBoxes() {
+    Track *lastTrack = mLastTrack;
+    mParsingDeferredMetaData = true;
+
+    mLastCommentMean.clear();
+    mLastCommentName.clear();
+    mLastCommentData.clear();
+
+    for (size_t i = 0; i < mDeferredMetaData.size(); ++i) {
+        const DeferredMetaData &deferred = mDeferredMetaData.itemAt(i);
+
+        // Restore the state the box would have been parsed in.
+        mLastTrack = deferred.track;
+        mPath.clear();
+        mPath.push(FOURCC('m', 'o', 'o', 'v'));
+
+        off64_t offset = deferred.offset;
+        status_t err = parseChunk(&offset, 1);
+        if (err != OK) {
+            ALOGW("ignoring malformed metadata at %lld (%d)",
+                    (long long)deferred.offset, err);
+        }
+    }
+
+    mPath.clear();
+    mLastTrack = lastTrack;
+    mParsingDeferredMetaData = false;
+}
+
 typedef enum {
     //AOT_NONE             = -1,
     //AOT_NULL_OBJECT      = 0,
@@ -3197,6 +3398,7 @@ MPEG4Source::MPEG4Source(
       mTrex(trex),
       mFirstMoofOffset(firstMoofOffset),
       mCurrentMoofOffset(firstMoofOffset),
+      mNextMoofOffset(firstMoofOffset),
       mCurrentTime(0),
       mCurrentSampleInfoAllocSize(0),
       mCurrentSampleInfoSizes(NULL),
@@ -3265,8 +3467,10 @@ MPEG4Source::MPEG4Source(
     CHECK(format->findInt32(kKeyTrackID, &mTrackId));
 
     if (mFirstMoofOffset != 0) {
-        off64_t offset = mFirstMoofOffset;
-        parseChunk(&offset);
+        mFragmentCache = new MPEG4DataSource(mDataSource);
+        mDataSource = mFragmentCache;
+
+        moveToFragment(mFirstMoofOffset, 0);
     }
 }
 
@@ -3447,6 +3651,58 @@ status_t MPEG4Source::parseChunk(off64_t *offset) {
     return OK;
 }
 
+// The largest moof read in one piece before parsing it.
+static const size_t kMaxCachedFragmentSize = 1024 * 1024;
+
+void MPEG4Source::moveToFragment(off64_t moofOffset, uint64_t startTime) {
+    mCurrentMoofOffset = moofOffset;
+    mNextMoofOffset = moofOffset;
+    mCurrentSamples.clear();
+    mCurrentSampleIndex = 0;
+    mCurrentTime = startTime;
+
+    // Read the whole moof at once instead of box by box.
+    uint32_t hdr[2];
+    if (mDataSource->readAt(moofOffset, hdr, 8) == 8
+            && ntohl(hdr[1]) == FOURCC('m', 'o', 'o', 'f')
+            && ntohl(hdr[0]) >= 8
+            && ntohl(hdr[0]) <= kMaxCachedFragmentSize) {
+        mFragmentCache->setCachedRange(moofOffset, ntohl(hdr[0]));
+    }
+
+    off64_t offset = moofOffset;
+    parseChunk(&offset);
+
+    mFragmentTimes.add(moofOffset, startTime);
+
+    if (mNextMoofOffset > mCurrentMoofOffset) {
+        // The next fragment starts where this one ends, index it now so a
+        // later seek doesn't have to parse this moof again.
+        uint64_t endTime = startTime;
+        for (size_t i = 0; i < mCurrentSamples.size(); ++i) {
+            endTime += mCurrentSamples[i].duration;
+        }
+        mFragmentTimes.add(mNextMoofOffset, endTime);
+    }
+}
+
+// Returns the index into mFragmentTimes of the last fragment starting at or
+// before "time", or -1 if there is none.
+ssize_t MPEG4Source::findFragmentAtTime(uint64_t time) const {
+    ssize_t left = 0;
+    ssize_t right = mFragmentTimes.size();
+    while (left < right) {
+        ssize_t center = left + (right - left) / 2;
+        if (mFragmentTimes.valueAt(center) <= time) {
+            left = center + 1;
+        } else {
+            right = center;
+        }
+    }
+
+    return left - 1;
+}
+
 status_t MPEG4Source::parseSampleAuxiliaryInformationSizes(
         off64_t offset, off64_t /* size */) {
     ALOGV("parseSampleAuxiliaryInformationSizes");
@@ -3874,6 +4130,14 @@ sp<MetaData> MPEG4Source::getFormat() {
     return mFormat;
 }
 
+void MPEG4Source::dump(AString *out) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mGroup != NULL) {
+        mGroup->dump(out);
+    }
+}
+
 size_t MPEG4Source::parseNALSize(const uint8_t *data) const {
     switch (mNALLengthSize) {
         case 1:
@@ -3994,6 +4258,7 @@ status_t MPEG4Source::read(
     uint32_t cts, stts;
     bool isSyncSample;
     bool newBuffer = false;
+    bool usesView = false;
     if (mBuffer == NULL) {
         newBuffer = true;
 
@@ -4005,18 +4270,32 @@ status_t MPEG4Source::read(
             return err;
         }
 
-        err = mGroup->acquire_buffer(&mBuffer);
+        sp<ABuffer> view;
+        if (((!mIsAVC && !mIsHEVC) || mWantsNALFragments)
+                && mDataSource->getReadView(offset, size, &view) == OK) {
+            // The sample is returned in place, it needs neither a copy
+            // nor a buffer from the group.
+            mBuffer = new MediaBuffer(view);
+            mBuffer->setObserver(&gViewBufferObserver);
+            mBuffer->add_ref();
+            usesView = true;
+        } else {
+            err = mGroup->acquire_buffer(&mBuffer);
 
-        if (err != OK) {
-            CHECK(mBuffer == NULL);
-            return err;
+            if (err != OK) {
+                CHECK(mBuffer == NULL);
+                return err;
+            }
         }
     }
 
     if ((!mIsAVC && !mIsHEVC) || mWantsNALFragments) {
         if (newBuffer) {
-            ssize_t num_bytes_read =
-                mDataSource->readAt(offset, (uint8_t *)mBuffer->data(), size);
+            ssize_t num_bytes_read = size;
+            if (!usesView) {
+                num_bytes_read =
+                    mDataSource->readAt(offset, (uint8_t *)mBuffer->data(), size);
+            }
 
             if (num_bytes_read < (ssize_t)size) {
                 mBuffer->release();
@@ -4093,9 +4372,15 @@ status_t MPEG4Source::read(
         ssize_t num_bytes_read = 0;
         int32_t drm = 0;
         bool usesDRM = (mFormat->findInt32(kKeyIsDRM, &drm) && drm != 0);
+        sp<ABuffer> view;
+        const uint8_t *srcBuffer = mSrcBuffer;
         if (usesDRM) {
             num_bytes_read =
                 mDataSource->readAt(offset, (uint8_t*)mBuffer->data(), size);
+        } else if (mDataSource->getReadView(offset, size, &view) == OK) {
+            // Rewrite the length prefixes straight from the source's memory.
+            srcBuffer = view->data();
+            num_bytes_read = view->size();
         } else {
             num_bytes_read = mDataSource->readAt(offset, mSrcBuffer, size);
         }
@@ -4120,7 +4405,7 @@ status_t MPEG4Source::read(
                 bool isMalFormed = !isInRange((size_t)0u, size, srcOffset, mNALLengthSize);
                 size_t nalLength = 0;
                 if (!isMalFormed) {
-                    nalLength = parseNALSize(&mSrcBuffer[srcOffset]);
+                    nalLength = parseNALSize(&srcBuffer[srcOffset]);
                     srcOffset += mNALLengthSize;
                     isMalFormed = !isInRange((size_t)0u, size, srcOffset, nalLength);
                 }
@@ -4142,7 +4427,7 @@ status_t MPEG4Source::read(
                 dstData[dstOffset++] = 0;
                 dstData[dstOffset++] = 0;
                 dstData[dstOffset++] = 1;
-                memcpy(&dstData[dstOffset], &mSrcBuffer[srcOffset], nalLength);
+                memcpy(&dstData[dstOffset], &srcBuffer[srcOffset], nalLength);
                 srcOffset += nalLength;
                 dstOffset += nalLength;
             }
@@ -4211,19 +4496,42 @@ status_t MPEG4Source::fragmentedRead(
                 totalTime += se->mDurationUs;
                 totalOffset += se->mSize;
             }
-            mCurrentMoofOffset = totalOffset;
-            mCurrentSamples.clear();
-            mCurrentSampleIndex = 0;
-            parseChunk(&totalOffset);
-            mCurrentTime = totalTime * mTimescale / 1000000ll;
+            moveToFragment(totalOffset, totalTime * mTimescale / 1000000ll);
         } else {
-            // without sidx boxes, we can only seek to 0
-            mCurrentMoofOffset = mFirstMoofOffset;
-            mCurrentSamples.clear();
-            mCurrentSampleIndex = 0;
-            off64_t tmp = mCurrentMoofOffset;
-            parseChunk(&tmp);
-            mCurrentTime = 0;
+            // Without sidx boxes, start from the closest fragment indexed so
+            // far and scan forward from there, indexing as we go.
+            uint64_t seekTime = (uint64_t)seekTimeUs * mTimescale / 1000000ll;
+            if (seekTimeUs < 0) {
+                seekTime = 0;
+            }
+
+            ssize_t index = findFragmentAtTime(seekTime);
+            if (index < 0) {
+                moveToFragment(mFirstMoofOffset, 0);
+            } else {
+                moveToFragment(
+                        mFragmentTimes.keyAt(index),
+                        mFragmentTimes.valueAt(index));
+            }
+
+            while (mNextMoofOffset > mCurrentMoofOffset) {
+                uint64_t startTime = mFragmentTimes.valueFor(mCurrentMoofOffset);
+                uint64_t endTime = mFragmentTimes.valueFor(mNextMoofOffset);
+
+                // Only the first sample of a fragment is treated as a sync
+                // sample, so fragment boundaries are the seek points.
+                bool moveOn = endTime <= seekTime
+                    || (mode == ReadOptions::SEEK_NEXT_SYNC
+                            && seekTime > startTime)
+                    || (mode == ReadOptions::SEEK_CLOSEST_SYNC
+                            && seekTime > startTime
+                            && seekTime - startTime > endTime - seekTime);
+                if (!moveOn) {
+                    break;
+                }
+
+                moveToFragment(mNextMoofOffset, endTime);
+            }
         }
 
         if (mBuffer != NULL) {
@@ -4247,11 +4555,7 @@ status_t MPEG4Source::fragmentedRead(
             if (mNextMoofOffset <= mCurrentMoofOffset) {
                 return ERROR_END_OF_STREAM;
             }
-            off64_t nextMoof = mNextMoofOffset;
-            mCurrentMoofOffset = nextMoof;
-            mCurrentSamples.clear();
-            mCurrentSampleIndex = 0;
-            parseChunk(&nextMoof);
+            moveToFragment(mNextMoofOffset, mCurrentTime);
             if (mCurrentSampleIndex >= mCurrentSamples.size()) {
                 return ERROR_END_OF_STREAM;
             }
@@ -4369,9 +4673,15 @@ status_t MPEG4Source::fragmentedRead(
         ssize_t num_bytes_read = 0;
         int32_t drm = 0;
         bool usesDRM = (mFormat->findInt32(kKeyIsDRM, &drm) && drm != 0);
+        sp<ABuffer> view;
+        const uint8_t *srcBuffer = mSrcBuffer;
         if (usesDRM) {
             num_bytes_read =
                 mDataSource->readAt(offset, (uint8_t*)mBuffer->data(), size);
+        } else if (mDataSource->getReadView(offset, size, &view) == OK) {
+            // Rewrite the length prefixes straight from the source's memory.
+            srcBuffer = view->data();
+            num_bytes_read = view->size();
         } else {
             num_bytes_read = mDataSource->readAt(offset, mSrcBuffer, size);
         }
@@ -4397,7 +4707,7 @@ status_t MPEG4Source::fragmentedRead(
                 bool isMalFormed = !isInRange((size_t)0u, size, srcOffset, mNALLengthSize);
                 size_t nalLength = 0;
                 if (!isMalFormed) {
-                    nalLength = parseNALSize(&mSrcBuffer[srcOffset]);
+                    nalLength = parseNALSize(&srcBuffer[srcOffset]);
                     srcOffset += mNALLengthSize;
                     isMalFormed = !isInRange((size_t)0u, size, srcOffset, nalLength);
                 }
@@ -4419,7 +4729,7 @@ status_t MPEG4Source::fragmentedRead(
                 dstData[dstOffset++] = 0;
                 dstData[dstOffset++] = 0;
                 dstData[dstOffset++] = 1;
-                memcpy(&dstData[dstOffset], &mSrcBuffer[srcOffset], nalLength);
+                memcpy(&dstData[dstOffset], &srcBuffer[srcOffset], nalLength);
                 srcOffset += nalLength;
                 dstOffset += nalLength;
             }
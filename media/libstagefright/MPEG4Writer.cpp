@@ -39,6 +39,7 @@
 #include <media/mediarecorder.h>
 #include <cutils/properties.h>
 
+#include "include/avc_utils.h"
 #include "include/ESDS.h"
 #include "include/ExtendedUtils.h"
 
@@ -1883,15 +1884,22 @@ static const uint8_t *findNextStartCode(
 
     ALOGV("findNextStartCode: %p %zu", data, length);
 
-    size_t bytesLeft = length;
-    while (bytesLeft > 4  &&
-            memcmp("\x00\x00\x00\x01", &data[length - bytesLeft], 4)) {
-        --bytesLeft;
-    }
-    if (bytesLeft <= 4) {
-        bytesLeft = 0; // Last parameter set
+    // Look for a 4 byte start code with at least one byte following it,
+    // i.e. a 3 byte one preceded by another zero.
+    const uint8_t *end = data + length;
+    const uint8_t *startCode = data;
+    while (end - startCode > 4) {
+        startCode = FindStartCode(startCode + 1, end - startCode - 1);
+        if (startCode == NULL || end - startCode <= 3) {
+            break;
+        }
+
+        if (startCode[-1] == 0x00) {
+            return startCode - 1;
+        }
     }
-    return &data[length - bytesLeft];
+
+    return end; // Last parameter set
 }
 
 const uint8_t *MPEG4Writer::Track::parseParamSet(
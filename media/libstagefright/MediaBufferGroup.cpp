@@ -15,20 +15,35 @@
  */
 
 #define LOG_TAG "MediaBufferGroup"
+#include <inttypes.h>
 #include <utils/Log.h>
 
 #include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AString.h>
 #include <media/stagefright/MediaBuffer.h>
 #include <media/stagefright/MediaBufferGroup.h>
 
 namespace android {
 
 MediaBufferGroup::MediaBufferGroup()
-    : mFirstBuffer(NULL),
-      mLastBuffer(NULL) {
+    : mNumWaiters(0),
+      mFirstBuffer(NULL),
+      mLastBuffer(NULL),
+      mMaxBufferSize(0),
+      mNumAcquired(0),
+      mNumWaits(0),
+      mTotalWaitUs(0),
+      mMaxWaitUs(0) {
 }
 
 MediaBufferGroup::~MediaBufferGroup() {
+    if (mNumWaits > 0) {
+        ALOGV("%" PRIu64 " of %" PRIu64 " acquisitions waited, "
+              "%" PRId64 " us total, %" PRId64 " us max",
+              mNumWaits, mNumAcquired, mTotalWaitUs, mMaxWaitUs);
+    }
+
     MediaBuffer *next;
     for (MediaBuffer *buffer = mFirstBuffer; buffer != NULL;
          buffer = next) {
@@ -53,22 +68,82 @@ void MediaBufferGroup::add_buffer(MediaBuffer *buffer) {
     }
 
     mLastBuffer = buffer;
+
+    if (buffer->size() > mMaxBufferSize) {
+        mMaxBufferSize = buffer->size();
+    }
+
+    if (buffer->refcount() == 0) {
+        mFreeBuffers.push(buffer);
+
+        if (mNumWaiters > 0) {
+            mCondition.broadcast();
+        }
+    }
+}
+
+ssize_t MediaBufferGroup::findFreeBuffer_l(size_t requestedSize) const {
+    if (requestedSize == 0) {
+        return mFreeBuffers.isEmpty() ? -1 : (ssize_t)mFreeBuffers.size() - 1;
+    }
+
+    ssize_t bestIndex = -1;
+    for (size_t i = mFreeBuffers.size(); i-- > 0;) {
+        size_t size = mFreeBuffers.itemAt(i)->size();
+
+        if (size >= requestedSize
+                && (bestIndex < 0
+                    || size < mFreeBuffers.itemAt(bestIndex)->size())) {
+            bestIndex = i;
+
+            if (size == requestedSize) {
+                break;
+            }
+        }
+    }
+
+    return bestIndex;
 }
 
 status_t MediaBufferGroup::acquire_buffer(
-        MediaBuffer **out, bool nonBlocking) {
+        MediaBuffer **out, bool nonBlocking, size_t requestedSize) {
     Mutex::Autolock autoLock(mLock);
 
+    if (requestedSize > 0 && requestedSize > mMaxBufferSize) {
+        ALOGE("no buffer of at least %zu bytes in group (largest %zu)",
+              requestedSize, mMaxBufferSize);
+
+        *out = NULL;
+        return BAD_VALUE;
+    }
+
+    int64_t waitStartUs = -1ll;
+
     for (;;) {
-        for (MediaBuffer *buffer = mFirstBuffer;
-             buffer != NULL; buffer = buffer->nextBuffer()) {
-            if (buffer->refcount() == 0) {
-                buffer->add_ref();
-                buffer->reset();
-
-                *out = buffer;
-                goto exit;
+        ssize_t index = findFreeBuffer_l(requestedSize);
+
+        if (index >= 0) {
+            MediaBuffer *buffer = mFreeBuffers.itemAt(index);
+            mFreeBuffers.removeAt(index);
+
+            CHECK_EQ(buffer->refcount(), 0);
+
+            buffer->add_ref();
+            buffer->reset();
+
+            ++mNumAcquired;
+
+            if (waitStartUs >= 0ll) {
+                int64_t waitUs = ALooper::GetNowUs() - waitStartUs;
+
+                mTotalWaitUs += waitUs;
+                if (waitUs > mMaxWaitUs) {
+                    mMaxWaitUs = waitUs;
+                }
             }
+
+            *out = buffer;
+            return OK;
         }
 
         if (nonBlocking) {
@@ -76,17 +151,39 @@ status_t MediaBufferGroup::acquire_buffer(
             return WOULD_BLOCK;
         }
 
-        // All buffers are in use. Block until one of them is returned to us.
+        if (waitStartUs < 0ll) {
+            waitStartUs = ALooper::GetNowUs();
+            ++mNumWaits;
+        }
+
+        // All suitable buffers are in use. Block until one of them is
+        // returned to us.
+        ++mNumWaiters;
         mCondition.wait(mLock);
+        --mNumWaiters;
     }
+}
 
-exit:
-    return OK;
+void MediaBufferGroup::signalBufferReturned(MediaBuffer *buffer) {
+    Mutex::Autolock autoLock(mLock);
+
+    mFreeBuffers.push(buffer);
+
+    // Waiters may be after different sizes, wake all of them and let each
+    // one check whether the returned buffer suits it.
+    if (mNumWaiters > 0) {
+        mCondition.broadcast();
+    }
 }
 
-void MediaBufferGroup::signalBufferReturned(MediaBuffer *) {
+void MediaBufferGroup::dump(AString *out) {
     Mutex::Autolock autoLock(mLock);
-    mCondition.signal();
+
+    out->append(StringPrintf(
+            "  MediaBufferGroup: %zu free, %" PRIu64 " acquired, "
+            "%" PRIu64 " waited (%" PRId64 " us total, %" PRId64 " us max)\n",
+            mFreeBuffers.size(), mNumAcquired, mNumWaits,
+            mTotalWaitUs, mMaxWaitUs));
 }
 
 }  // namespace android
@@ -19,6 +19,7 @@
 #include <inttypes.h>
 #include <utils/Log.h>
 
+#include <new>
 #include <stdlib.h>
 #include <string.h>
 
@@ -29,30 +30,199 @@
 
 namespace android {
 
-MetaData::MetaData() {
+struct MetaData::Item {
+    uint32_t mKey;
+    typed_data mData;
+};
+
+// Header of the item array, the items follow it in the same allocation.
+// Items are relocated with memmove/realloc, which is safe since typed_data
+// never points into itself.
+struct MetaData::Storage {
+    int32_t mRefCount;
+    size_t mNumItems;
+    size_t mCapacity;
+
+    static size_t HeaderSize() {
+        return (sizeof(Storage) + 15) & ~(size_t)15;
+    }
+
+    Item *items() {
+        return (Item *)((uint8_t *)this + HeaderSize());
+    }
+
+    const Item *items() const {
+        return (const Item *)((const uint8_t *)this + HeaderSize());
+    }
+
+    static Storage *Allocate(size_t capacity);
+    static Storage *Clone(const Storage *from, size_t capacity);
+    static Storage *Grow(Storage *storage, size_t capacity);
+
+    void destroyItems();
+};
+
+static const size_t kMinItemCapacity = 8;
+
+// static
+MetaData::Storage *MetaData::Storage::Allocate(size_t capacity) {
+    Storage *storage =
+        (Storage *)malloc(HeaderSize() + capacity * sizeof(Item));
+    CHECK(storage != NULL);
+
+    storage->mRefCount = 1;
+    storage->mNumItems = 0;
+    storage->mCapacity = capacity;
+
+    return storage;
+}
+
+// static
+MetaData::Storage *MetaData::Storage::Clone(
+        const Storage *from, size_t capacity) {
+    CHECK_GE(capacity, from->mNumItems);
+
+    Storage *storage = Allocate(capacity);
+
+    for (size_t i = 0; i < from->mNumItems; ++i) {
+        new (&storage->items()[i]) Item(from->items()[i]);
+    }
+    storage->mNumItems = from->mNumItems;
+
+    return storage;
+}
+
+// static
+MetaData::Storage *MetaData::Storage::Grow(Storage *storage, size_t capacity) {
+    CHECK_EQ(storage->mRefCount, 1);
+
+    storage = (Storage *)realloc(
+            storage, HeaderSize() + capacity * sizeof(Item));
+    CHECK(storage != NULL);
+
+    storage->mCapacity = capacity;
+
+    return storage;
+}
+
+void MetaData::Storage::destroyItems() {
+    for (size_t i = 0; i < mNumItems; ++i) {
+        items()[i].~Item();
+    }
+    mNumItems = 0;
+}
+
+MetaData::MetaData()
+    : mStorage(NULL) {
 }
 
 MetaData::MetaData(const MetaData &from)
     : RefBase(),
-      mItems(from.mItems) {
+      mStorage(from.mStorage) {
+    if (mStorage != NULL) {
+        (void) __sync_fetch_and_add(&mStorage->mRefCount, 1);
+    }
 }
 
 MetaData::~MetaData() {
-    clear();
+    releaseStorage();
+}
+
+void MetaData::releaseStorage() {
+    if (mStorage == NULL) {
+        return;
+    }
+
+    if (__sync_sub_and_fetch(&mStorage->mRefCount, 1) == 0) {
+        mStorage->destroyItems();
+        free(mStorage);
+    }
+
+    mStorage = NULL;
+}
+
+void MetaData::editStorage(size_t minCapacity) {
+    if (minCapacity < kMinItemCapacity) {
+        minCapacity = kMinItemCapacity;
+    }
+
+    if (mStorage == NULL) {
+        mStorage = Storage::Allocate(minCapacity);
+        return;
+    }
+
+    if (mStorage->mRefCount > 1) {
+        if (minCapacity < mStorage->mNumItems) {
+            minCapacity = mStorage->mNumItems;
+        }
+
+        Storage *copy = Storage::Clone(mStorage, minCapacity);
+        releaseStorage();
+        mStorage = copy;
+        return;
+    }
+
+    if (mStorage->mCapacity < minCapacity) {
+        size_t capacity = mStorage->mCapacity * 2;
+        if (capacity < minCapacity) {
+            capacity = minCapacity;
+        }
+
+        mStorage = Storage::Grow(mStorage, capacity);
+    }
+}
+
+ssize_t MetaData::findIndex(uint32_t key, size_t *insertionPos) const {
+    size_t lo = 0;
+    size_t hi = (mStorage != NULL) ? mStorage->mNumItems : 0;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        uint32_t midKey = mStorage->items()[mid].mKey;
+
+        if (midKey == key) {
+            return mid;
+        } else if (midKey < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (insertionPos != NULL) {
+        *insertionPos = lo;
+    }
+
+    return -1;
 }
 
 void MetaData::clear() {
-    mItems.clear();
+    if (mStorage == NULL) {
+        return;
+    }
+
+    if (mStorage->mRefCount > 1) {
+        releaseStorage();
+        return;
+    }
+
+    mStorage->destroyItems();
 }
 
 bool MetaData::remove(uint32_t key) {
-    ssize_t i = mItems.indexOfKey(key);
+    ssize_t i = findIndex(key, NULL);
 
     if (i < 0) {
         return false;
     }
 
-    mItems.removeItemsAt(i);
+    editStorage(0);
+
+    Item *items = mStorage->items();
+    items[i].~Item();
+    memmove(&items[i], &items[i + 1],
+            (mStorage->mNumItems - i - 1) * sizeof(Item));
+    --mStorage->mNumItems;
 
     return true;
 }
@@ -192,15 +362,26 @@ bool MetaData::setData(
         uint32_t key, uint32_t type, const void *data, size_t size) {
     bool overwrote_existing = true;
 
-    ssize_t i = mItems.indexOfKey(key);
+    size_t insertionPos;
+    ssize_t i = findIndex(key, &insertionPos);
     if (i < 0) {
-        typed_data item;
-        i = mItems.add(key, item);
+        editStorage(mStorage != NULL ? mStorage->mNumItems + 1 : 1);
+
+        Item *items = mStorage->items();
+        memmove(&items[insertionPos + 1], &items[insertionPos],
+                (mStorage->mNumItems - insertionPos) * sizeof(Item));
+
+        Item *item = new (&items[insertionPos]) Item;
+        item->mKey = key;
+        ++mStorage->mNumItems;
 
+        i = insertionPos;
         overwrote_existing = false;
+    } else {
+        editStorage(0);
     }
 
-    typed_data &item = mItems.editValueAt(i);
+    typed_data &item = mStorage->items()[i].mData;
 
     item.setData(type, data, size);
 
@@ -209,13 +390,13 @@ bool MetaData::setData(
 
 bool MetaData::findData(uint32_t key, uint32_t *type,
                         const void **data, size_t *size) const {
-    ssize_t i = mItems.indexOfKey(key);
+    ssize_t i = findIndex(key, NULL);
 
     if (i < 0) {
         return false;
     }
 
-    const typed_data &item = mItems.valueAt(i);
+    const typed_data &item = mStorage->items()[i].mData;
 
     item.getData(type, data, size);
 
@@ -223,13 +404,7 @@ bool MetaData::findData(uint32_t key, uint32_t *type,
 }
 
 bool MetaData::hasData(uint32_t key) const {
-    ssize_t i = mItems.indexOfKey(key);
-
-    if (i < 0) {
-        return false;
-    }
-
-    return true;
+    return findIndex(key, NULL) >= 0;
 }
 
 MetaData::typed_data::typed_data()
@@ -360,11 +535,15 @@ static void MakeFourCCString(uint32_t x, char *s) {
 }
 
 void MetaData::dumpToLog() const {
-    for (int i = mItems.size(); --i >= 0;) {
-        int32_t key = mItems.keyAt(i);
+    if (mStorage == NULL) {
+        return;
+    }
+
+    for (int i = mStorage->mNumItems; --i >= 0;) {
+        const Item &entry = mStorage->items()[i];
         char cc[5];
-        MakeFourCCString(key, cc);
-        const typed_data &item = mItems.valueAt(i);
+        MakeFourCCString(entry.mKey, cc);
+        const typed_data &item = entry.mData;
         ALOGI("%s: %s", cc, item.asString().string());
     }
 }
@@ -23,20 +23,31 @@
 #include "include/NuCachedSource2.h"
 #include "include/HTTPBase.h"
 
+#include <media/IMediaHTTPService.h>
 #include <cutils/properties.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/MediaErrors.h>
+#include <utils/KeyedVector.h>
+#include <utils/Vector.h>
 
 namespace android {
 
+// The page cache consists of a contiguous window of "active" pages that the
+// prefetcher appends to, and a sparse set of "retained" pages that were
+// dropped from the window by a seek or by trimming behind the read position.
+// Retained pages are keyed by their offset in the source and evicted in
+// least recently used order once they exceed the retained budget, except
+// for pages overlapping a pinned range.
 struct PageCache {
-    PageCache(size_t pageSize);
+    PageCache(size_t pageSize, size_t retainedBudget);
     ~PageCache();
 
     struct Page {
         void *mData;
         size_t mSize;
+        off64_t mOffset;
+        uint32_t mLastUse;
     };
 
     Page *acquirePage();
@@ -49,28 +60,93 @@ struct PageCache {
         return mTotalSize;
     }
 
+    size_t retainedSize() const {
+        return mRetainedSize;
+    }
+
     void copy(size_t from, void *data, size_t size);
 
+    // Copies [offset, offset + size) from retained pages, returns false
+    // unless the whole range is present.
+    bool copyRetained(off64_t offset, void *data, size_t size);
+
+    // Returns a page holding retained data starting exactly at offset, or
+    // NULL if there is none. The page is owned by the caller.
+    Page *takeRetained(off64_t offset);
+
+    void pinRange(off64_t offset, size_t size);
+
+    // Pages fetched ahead of the window by parallel range requests wait
+    // here, keyed by offset, until the window reaches them.
+    void addPendingPage(Page *page);
+    void drainPending(off64_t windowEnd);
+    void retainPending();
+
+    size_t pendingSize() const {
+        return mPendingSize;
+    }
+
 private:
+    struct Range {
+        off64_t mOffset;
+        size_t mSize;
+    };
+
     size_t mPageSize;
     size_t mTotalSize;
 
     List<Page *> mActivePages;
     List<Page *> mFreePages;
 
+    KeyedVector<off64_t, Page *> mRetainedPages;
+    size_t mRetainedSize;
+    size_t mRetainedBudget;
+    uint32_t mUseCounter;
+
+    Vector<Range> mPinnedRanges;
+    size_t mPinnedSize;
+
+    KeyedVector<off64_t, Page *> mPendingPages;
+    size_t mPendingSize;
+
     void freePages(List<Page *> *list);
 
+    ssize_t findRetained(off64_t offset) const;
+    void retainPage(Page *page);
+    void removeRetainedAt(size_t index);
+    void evictRetained();
+    bool isPinned(const Page *page) const;
+
     DISALLOW_EVIL_CONSTRUCTORS(PageCache);
 };
 
-PageCache::PageCache(size_t pageSize)
+PageCache::PageCache(size_t pageSize, size_t retainedBudget)
     : mPageSize(pageSize),
-      mTotalSize(0) {
+      mTotalSize(0),
+      mRetainedSize(0),
+      mRetainedBudget(retainedBudget),
+      mUseCounter(0),
+      mPinnedSize(0),
+      mPendingSize(0) {
 }
 
 PageCache::~PageCache() {
     freePages(&mActivePages);
     freePages(&mFreePages);
+
+    for (size_t i = 0; i < mRetainedPages.size(); ++i) {
+        Page *page = mRetainedPages.valueAt(i);
+
+        free(page->mData);
+        delete page;
+    }
+
+    for (size_t i = 0; i < mPendingPages.size(); ++i) {
+        Page *page = mPendingPages.valueAt(i);
+
+        free(page->mData);
+        delete page;
+    }
 }
 
 void PageCache::freePages(List<Page *> *list) {
@@ -98,6 +174,8 @@ PageCache::Page *PageCache::acquirePage() {
     Page *page = new Page;
     page->mData = malloc(mPageSize);
     page->mSize = 0;
+    page->mOffset = 0;
+    page->mLastUse = 0;
 
     return page;
 }
@@ -129,10 +207,13 @@ size_t PageCache::releaseFromStart(size_t maxBytes) {
         maxBytes -= page->mSize;
         bytesReleased += page->mSize;
 
-        releasePage(page);
+        retainPage(page);
     }
 
     mTotalSize -= bytesReleased;
+
+    evictRetained();
+
     return bytesReleased;
 }
 
@@ -177,8 +258,273 @@ void PageCache::copy(size_t from, void *data, size_t size) {
     }
 }
 
+ssize_t PageCache::findRetained(off64_t offset) const {
+    // Find the last page starting at or before offset.
+    ssize_t lo = 0;
+    ssize_t hi = (ssize_t)mRetainedPages.size() - 1;
+    ssize_t index = -1;
+    while (lo <= hi) {
+        ssize_t mid = lo + (hi - lo) / 2;
+        if (mRetainedPages.keyAt(mid) <= offset) {
+            index = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    if (index >= 0) {
+        const Page *page = mRetainedPages.valueAt(index);
+        if (offset >= page->mOffset + (off64_t)page->mSize) {
+            index = -1;
+        }
+    }
+
+    return index;
+}
+
+bool PageCache::copyRetained(off64_t offset, void *data, size_t size) {
+    ssize_t index = findRetained(offset);
+    if (index < 0) {
+        return false;
+    }
+
+    // Make sure the range is fully covered before touching anything.
+    off64_t end = offset + size;
+    off64_t coveredEnd = offset;
+    for (size_t i = index; coveredEnd < end; ++i) {
+        if (i >= mRetainedPages.size()) {
+            return false;
+        }
+
+        const Page *page = mRetainedPages.valueAt(i);
+        if (page->mOffset > coveredEnd) {
+            return false;
+        }
+        coveredEnd = page->mOffset + page->mSize;
+    }
+
+    ++mUseCounter;
+
+    uint8_t *dst = (uint8_t *)data;
+    for (size_t i = index; offset < end; ++i) {
+        Page *page = mRetainedPages.valueAt(i);
+        page->mLastUse = mUseCounter;
+
+        size_t delta = offset - page->mOffset;
+        size_t copy = page->mSize - delta;
+        if ((off64_t)copy > end - offset) {
+            copy = end - offset;
+        }
+
+        memcpy(dst, (const uint8_t *)page->mData + delta, copy);
+        dst += copy;
+        offset += copy;
+    }
+
+    return true;
+}
+
+PageCache::Page *PageCache::takeRetained(off64_t offset) {
+    ssize_t index = findRetained(offset);
+    if (index < 0) {
+        return NULL;
+    }
+
+    Page *page = mRetainedPages.valueAt(index);
+
+    if (page->mOffset == offset && !isPinned(page)) {
+        mRetainedSize -= page->mSize;
+        mRetainedPages.removeItemsAt(index);
+        return page;
+    }
+
+    // Copy the remainder, the retained page stays where it is.
+    size_t delta = offset - page->mOffset;
+
+    Page *copy = acquirePage();
+    copy->mOffset = offset;
+    copy->mSize = page->mSize - delta;
+    memcpy(copy->mData, (const uint8_t *)page->mData + delta, copy->mSize);
+
+    page->mLastUse = ++mUseCounter;
+
+    return copy;
+}
+
+void PageCache::retainPage(Page *page) {
+    if (mRetainedBudget == 0 || page->mSize == 0) {
+        releasePage(page);
+        return;
+    }
+
+    // Newer data supersedes whatever retained pages it overlaps.
+    off64_t end = page->mOffset + page->mSize;
+    ssize_t index = findRetained(page->mOffset);
+    size_t i = (index >= 0) ? index : 0;
+    while (i < mRetainedPages.size()) {
+        const Page *other = mRetainedPages.valueAt(i);
+        if (other->mOffset >= end) {
+            break;
+        }
+
+        if (other->mOffset + (off64_t)other->mSize > page->mOffset) {
+            removeRetainedAt(i);
+        } else {
+            ++i;
+        }
+    }
+
+    page->mLastUse = ++mUseCounter;
+
+    mRetainedPages.add(page->mOffset, page);
+    mRetainedSize += page->mSize;
+}
+
+void PageCache::removeRetainedAt(size_t index) {
+    Page *page = mRetainedPages.valueAt(index);
+    mRetainedPages.removeItemsAt(index);
+
+    mRetainedSize -= page->mSize;
+    releasePage(page);
+}
+
+void PageCache::evictRetained() {
+    while (mRetainedSize > mRetainedBudget) {
+        ssize_t victim = -1;
+        for (size_t i = 0; i < mRetainedPages.size(); ++i) {
+            const Page *page = mRetainedPages.valueAt(i);
+
+            if (isPinned(page)) {
+                continue;
+            }
+
+            // Compare by age so that counter wrap-around is harmless.
+            if (victim < 0
+                    || (int32_t)(page->mLastUse
+                            - mRetainedPages.valueAt(victim)->mLastUse) < 0) {
+                victim = i;
+            }
+        }
+
+        if (victim < 0) {
+            break;
+        }
+
+        removeRetainedAt(victim);
+    }
+}
+
+void PageCache::pinRange(off64_t offset, size_t size) {
+    if (size == 0 || mPinnedSize + size > mRetainedBudget / 2) {
+        ALOGW("not pinning %zu bytes at %lld, pin budget exhausted",
+              size, (long long)offset);
+        return;
+    }
+
+    Range range;
+    range.mOffset = offset;
+    range.mSize = size;
+    mPinnedRanges.push(range);
+
+    mPinnedSize += size;
+}
+
+void PageCache::addPendingPage(Page *page) {
+    ssize_t index = mPendingPages.indexOfKey(page->mOffset);
+    if (index >= 0) {
+        Page *old = mPendingPages.valueAt(index);
+        mPendingSize -= old->mSize;
+        releasePage(old);
+
+        mPendingPages.replaceValueAt(index, page);
+    } else {
+        mPendingPages.add(page->mOffset, page);
+    }
+
+    mPendingSize += page->mSize;
+}
+
+void PageCache::drainPending(off64_t windowEnd) {
+    while (!mPendingPages.isEmpty()) {
+        Page *page = mPendingPages.valueAt(0);
+
+        if (page->mOffset > windowEnd) {
+            break;
+        }
+
+        mPendingPages.removeItemsAt(0);
+        mPendingSize -= page->mSize;
+
+        if (page->mOffset == windowEnd) {
+            appendPage(page);
+            windowEnd += page->mSize;
+        } else if (page->mOffset + (off64_t)page->mSize > windowEnd) {
+            // Straddles the window end, takeRetained() picks up the tail.
+            retainPage(page);
+            evictRetained();
+        } else {
+            releasePage(page);
+        }
+    }
+}
+
+void PageCache::retainPending() {
+    for (size_t i = 0; i < mPendingPages.size(); ++i) {
+        retainPage(mPendingPages.valueAt(i));
+    }
+
+    mPendingPages.clear();
+    mPendingSize = 0;
+
+    evictRetained();
+}
+
+bool PageCache::isPinned(const Page *page) const {
+    off64_t end = page->mOffset + page->mSize;
+    for (size_t i = 0; i < mPinnedRanges.size(); ++i) {
+        const Range &range = mPinnedRanges.itemAt(i);
+
+        if (range.mOffset < end
+                && range.mOffset + (off64_t)range.mSize > page->mOffset) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
+// An additional connection to the source's uri, running on its own looper,
+// that fetches pages ahead of the prefetch window.
+struct NuCachedSource2::RangeFetcher {
+    RangeFetcher(NuCachedSource2 *owner, const sp<HTTPBase> &source, size_t index)
+        : mSource(source),
+          mReflector(new AHandlerReflector<NuCachedSource2>(owner)),
+          mLooper(new ALooper),
+          mIndex(index),
+          mConnected(false) {
+        mLooper->setName("NuCachedSource2Range");
+        mLooper->registerHandler(mReflector);
+        mLooper->start(false /* runOnCallingThread */, true /* canCallJava */);
+    }
+
+    ~RangeFetcher() {
+        mLooper->stop();
+        mLooper->unregisterHandler(mReflector->id());
+    }
+
+    sp<HTTPBase> mSource;
+    sp<AHandlerReflector<NuCachedSource2> > mReflector;
+    sp<ALooper> mLooper;
+    size_t mIndex;
+    bool mConnected;
+
+private:
+    DISALLOW_EVIL_CONSTRUCTORS(RangeFetcher);
+};
+
 NuCachedSource2::NuCachedSource2(
         const sp<DataSource> &source,
         const char *cacheConfig,
@@ -186,7 +532,7 @@ NuCachedSource2::NuCachedSource2(
     : mSource(source),
       mReflector(new AHandlerReflector<NuCachedSource2>(this)),
       mLooper(new ALooper),
-      mCache(new PageCache(kPageSize)),
+      mCache(new PageCache(kPageSize, kDefaultRetainedBytes)),
       mCacheOffset(0),
       mFinalStatus(OK),
       mLastAccessPos(0),
@@ -198,7 +544,13 @@ NuCachedSource2::NuCachedSource2(
       mLowwaterThresholdBytes(kDefaultLowWaterThreshold),
       mKeepAliveIntervalUs(kDefaultKeepAliveIntervalUs),
       mDisconnectAtHighwatermark(disconnectAtHighwatermark),
-      mSuspended(false) {
+      mSuspended(false),
+      mNumActiveFetchers(0),
+      mNextRangeOffset(0),
+      mRangeLimit(-1),
+      mFetchDeferred(false),
+      mLastAdaptTimeUs(-1),
+      mLastAggregateBps(0) {
     // We are NOT going to support disconnect-at-highwatermark indefinitely
     // and we are not guaranteeing support for client-specified cache
     // parameters. Both of these are temporary measures to solve a specific
@@ -227,10 +579,19 @@ NuCachedSource2::NuCachedSource2(
     mLooper->start(false /* runOnCallingThread */, true /* canCallJava */);
 
     Mutex::Autolock autoLock(mLock);
+
+    // Container headers are re-read on every seek and track switch.
+    mCache->pinRange(0, kPinnedHeaderBytes);
+
     (new AMessage(kWhatFetchMore, mReflector->id()))->post();
 }
 
 NuCachedSource2::~NuCachedSource2() {
+    for (size_t i = 0; i < mRangeFetchers.size(); ++i) {
+        delete mRangeFetchers.itemAt(i);
+    }
+    mRangeFetchers.clear();
+
     mLooper->stop();
     mLooper->unregisterHandler(mReflector->id());
 
@@ -264,9 +625,65 @@ void NuCachedSource2::disconnect() {
         // explicitly disconnect from the source, to allow any
         // pending reads to return more promptly
         static_cast<HTTPBase *>(mSource.get())->disconnect();
+
+        for (size_t i = 0; i < mRangeFetchers.size(); ++i) {
+            mRangeFetchers.itemAt(i)->mSource->disconnect();
+        }
     }
 }
 
+void NuCachedSource2::enableParallelFetch(
+        const sp<IMediaHTTPService> &httpService,
+        const char *uri,
+        const KeyedVector<String8, String8> *headers,
+        size_t maxConnections) {
+    if (!(mSource->flags() & kIsHTTPBasedSource) || maxConnections < 2) {
+        return;
+    }
+
+    if (maxConnections > kMaxConnections) {
+        maxConnections = kMaxConnections;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+
+    if (!mRangeFetchers.isEmpty()) {
+        return;
+    }
+
+    mUri = uri;
+    if (headers != NULL) {
+        mUriHeaders = *headers;
+    }
+
+    off64_t size;
+    if (mSource->getSize(&size) == OK) {
+        mRangeLimit = size;
+    }
+
+    for (size_t i = 0; i < maxConnections - 1; ++i) {
+        sp<DataSource> source = DataSource::CreateMediaHTTP(httpService);
+        if (source == NULL) {
+            break;
+        }
+
+        RangeFetcher *fetcher = new RangeFetcher(
+                this, static_cast<HTTPBase *>(source.get()), i);
+        mRangeFetchers.push(fetcher);
+
+        sp<AMessage> msg = new AMessage(kWhatFetchRange, fetcher->mReflector->id());
+        msg->setSize("fetcher", i);
+        msg->post();
+    }
+
+    // Start with a single extra connection and let adaptConcurrency_l()
+    // add more while they pay off.
+    mNumActiveFetchers = mRangeFetchers.isEmpty() ? 0 : 1;
+    mLastAdaptTimeUs = ALooper::GetNowUs();
+
+    ALOGV("parallel fetch enabled, up to %zu connections", mRangeFetchers.size() + 1);
+}
+
 status_t NuCachedSource2::setCacheStatCollectFreq(int32_t freqMs) {
     if (mSource->flags() & kIsHTTPBasedSource) {
         HTTPBase *source = static_cast<HTTPBase *>(mSource.get());
@@ -303,6 +720,12 @@ void NuCachedSource2::onMessageReceived(const sp<AMessage> &msg) {
             break;
         }
 
+        case kWhatFetchRange:
+        {
+            onFetchRange(msg);
+            break;
+        }
+
         default:
             TRESPASS();
     }
@@ -315,6 +738,32 @@ void NuCachedSource2::fetchInternal() {
 
     {
         Mutex::Autolock autoLock(mLock);
+
+        // Don't download again what a previous window or a parallel
+        // range request already brought in.
+        if (mFetching) {
+            mCache->drainPending(mCacheOffset + mCache->totalSize());
+
+            off64_t offset = mCacheOffset + mCache->totalSize();
+            PageCache::Page *page = mCache->takeRetained(offset);
+
+            if (page != NULL) {
+                ALOGV("reusing %zu retained bytes at %lld",
+                      page->mSize, (long long)offset);
+
+                mCache->appendPage(page);
+                return;
+            }
+
+            // A range fetcher is already downloading this page.
+            for (size_t i = 0; i < mInFlightOffsets.size(); ++i) {
+                if (mInFlightOffsets.itemAt(i) == offset) {
+                    mFetchDeferred = true;
+                    return;
+                }
+            }
+        }
+
         CHECK(mFinalStatus == OK || mNumRetriesLeft > 0);
 
         if (mFinalStatus != OK) {
@@ -347,10 +796,14 @@ void NuCachedSource2::fetchInternal() {
         }
     }
 
-    PageCache::Page *page = mCache->acquirePage();
+    PageCache::Page *page;
+    {
+        Mutex::Autolock autoLock(mLock);
+        page = mCache->acquirePage();
+        page->mOffset = mCacheOffset + mCache->totalSize();
+    }
 
-    ssize_t n = mSource->readAt(
-            mCacheOffset + mCache->totalSize(), page->mData, kPageSize);
+    ssize_t n = mSource->readAt(page->mOffset, page->mData, kPageSize);
 
     Mutex::Autolock autoLock(mLock);
 
@@ -386,6 +839,13 @@ void NuCachedSource2::fetchInternal() {
 void NuCachedSource2::onFetch() {
     ALOGV("onFetch");
 
+    mFetchDeferred = false;
+
+    if (!mRangeFetchers.isEmpty()) {
+        Mutex::Autolock autoLock(mLock);
+        adaptConcurrency_l();
+    }
+
     if (mFinalStatus != OK && mNumRetriesLeft == 0) {
         ALOGV("EOS reached, done prefetching for now");
         mFetching = false;
@@ -427,6 +887,9 @@ void NuCachedSource2::onFetch() {
         if (mFinalStatus != OK && mNumRetriesLeft > 0) {
             // We failed this time and will try again in 3 seconds.
             delayUs = 3000000ll;
+        } else if (mFetchDeferred) {
+            // Waiting for a range fetcher to deliver the next page.
+            delayUs = 10000ll;
         } else {
             delayUs = 0;
         }
@@ -476,6 +939,139 @@ void NuCachedSource2::onRead(const sp<AMessage> &msg) {
     mCondition.signal();
 }
 
+void NuCachedSource2::onFetchRange(const sp<AMessage> &msg) {
+    size_t index;
+    CHECK(msg->findSize("fetcher", &index));
+
+    RangeFetcher *fetcher = mRangeFetchers.itemAt(index);
+
+    off64_t offset;
+    PageCache::Page *page;
+    {
+        Mutex::Autolock autoLock(mLock);
+
+        if (mDisconnecting) {
+            return;
+        }
+
+        off64_t windowEnd = mCacheOffset + mCache->totalSize();
+
+        // The page at the window end is left to the main connection,
+        // range fetchers work on the ones after it.
+        if (mNextRangeOffset < windowEnd + kPageSize) {
+            mNextRangeOffset = windowEnd + kPageSize;
+        }
+
+        bool idle = index >= mNumActiveFetchers
+            || !mFetching
+            || mSuspended
+            || mFinalStatus != OK
+            || (mRangeLimit >= 0 && mNextRangeOffset >= mRangeLimit)
+            || mNextRangeOffset + kPageSize - mCacheOffset
+                    > (off64_t)mHighwaterThresholdBytes;
+
+        if (idle) {
+            msg->post(50000ll);
+            return;
+        }
+
+        offset = mNextRangeOffset;
+        mNextRangeOffset += kPageSize;
+        mInFlightOffsets.push(offset);
+
+        page = mCache->acquirePage();
+    }
+
+    status_t err = OK;
+    if (!fetcher->mConnected) {
+        err = fetcher->mSource->connect(mUri.string(), &mUriHeaders, offset);
+        fetcher->mConnected = (err == OK);
+    }
+
+    ssize_t n = (err == OK)
+        ? fetcher->mSource->readAt(offset, page->mData, kPageSize) : err;
+
+    Mutex::Autolock autoLock(mLock);
+
+    for (size_t i = 0; i < mInFlightOffsets.size(); ++i) {
+        if (mInFlightOffsets.itemAt(i) == offset) {
+            mInFlightOffsets.removeAt(i);
+            break;
+        }
+    }
+
+    if (n <= 0) {
+        if (n == 0 && (mRangeLimit < 0 || offset < mRangeLimit)) {
+            mRangeLimit = offset;
+        } else if (n < 0) {
+            ALOGW("range request at %lld failed (%zd)", (long long)offset, n);
+            fetcher->mSource->disconnect();
+            fetcher->mConnected = false;
+        }
+
+        // The main connection fetches whatever we failed to.
+        mCache->releasePage(page);
+        msg->post(n < 0 ? 1000000ll : 50000ll);
+        return;
+    }
+
+    page->mOffset = offset;
+    page->mSize = n;
+
+    off64_t windowEnd = mCacheOffset + mCache->totalSize();
+    if (offset + n <= windowEnd) {
+        mCache->releasePage(page);
+    } else {
+        mCache->addPendingPage(page);
+        mCache->drainPending(windowEnd);
+    }
+
+    msg->post();
+}
+
+void NuCachedSource2::adaptConcurrency_l() {
+    static const int64_t kAdaptIntervalUs = 2000000ll;
+
+    int64_t nowUs = ALooper::GetNowUs();
+    if (nowUs < mLastAdaptTimeUs + kAdaptIntervalUs) {
+        return;
+    }
+    mLastAdaptTimeUs = nowUs;
+
+    // Each connection estimates its own throughput, their sum is what the
+    // current number of connections achieves together.
+    int32_t aggregateBps = 0;
+    int32_t bps;
+    if (static_cast<HTTPBase *>(mSource.get())->estimateBandwidth(&bps)) {
+        aggregateBps += bps;
+    }
+    for (size_t i = 0; i < mNumActiveFetchers; ++i) {
+        if (mRangeFetchers.itemAt(i)->mSource->estimateBandwidth(&bps)) {
+            aggregateBps += bps;
+        }
+    }
+
+    if (aggregateBps == 0) {
+        return;
+    }
+
+    if (mLastAggregateBps == 0 || aggregateBps > mLastAggregateBps * 11 / 10) {
+        // The last connection added paid off, try another one.
+        if (mNumActiveFetchers < mRangeFetchers.size()) {
+            ++mNumActiveFetchers;
+        }
+    } else if (aggregateBps < mLastAggregateBps * 9 / 10
+            && mNumActiveFetchers > 1) {
+        // Connections compete for the link rather than hide latency.
+        --mNumActiveFetchers;
+    }
+
+    ALOGV("aggregate bandwidth %d bps, %zu range fetchers active",
+          aggregateBps, mNumActiveFetchers);
+
+    mLastAggregateBps = aggregateBps;
+}
+
 void NuCachedSource2::restartPrefetcherIfNecessary_l(
         bool ignoreLowWaterThreshold, bool force) {
     static const size_t kGrayArea = 1024 * 1024;
@@ -529,6 +1125,12 @@ ssize_t NuCachedSource2::readAt(off64_t offset, void *data, size_t size) {
         return size;
     }
 
+    // Retained pages satisfy the read without moving the prefetch window,
+    // the streaming position is left alone.
+    if (mCache->copyRetained(offset, data, size)) {
+        return size;
+    }
+
     sp<AMessage> msg = new AMessage(kWhatRead, mReflector->id());
     msg->setInt64("offset", offset);
     msg->setPointer("data", data);
@@ -558,6 +1160,11 @@ ssize_t NuCachedSource2::readAt(off64_t offset, void *data, size_t size) {
     return (ssize_t)result;
 }
 
+void NuCachedSource2::pinRange(off64_t offset, size_t size) {
+    Mutex::Autolock autoLock(mLock);
+    mCache->pinRange(offset, size);
+}
+
 size_t NuCachedSource2::cachedSize() {
     Mutex::Autolock autoLock(mLock);
     return mCacheOffset + mCache->totalSize();
@@ -590,6 +1197,12 @@ ssize_t NuCachedSource2::readInternal(off64_t offset, void *data, size_t size) {
 
     Mutex::Autolock autoLock(mLock);
 
+    if ((offset < mCacheOffset
+            || offset >= (off64_t)(mCacheOffset + mCache->totalSize()))
+            && mCache->copyRetained(offset, data, size)) {
+        return size;
+    }
+
     if (!mFetching) {
         mLastAccessPos = offset;
         restartPrefetcherIfNecessary_l(
@@ -654,6 +1267,10 @@ status_t NuCachedSource2::seekInternal_l(off64_t offset) {
     size_t totalSize = mCache->totalSize();
     CHECK_EQ(mCache->releaseFromStart(totalSize), totalSize);
 
+    // Pages fetched ahead for the old window may still come in handy.
+    mCache->retainPending();
+    mNextRangeOffset = 0;
+
     mNumRetriesLeft = kMaxNumRetries;
     mFetching = true;
 
@@ -770,6 +1387,9 @@ void NuCachedSource2::RemoveCacheSpecificHeaders(
 status_t NuCachedSource2::disconnectWhileSuspend() {
     if (mSource != NULL) {
         static_cast<HTTPBase *>(mSource.get())->disconnect();
+        for (size_t i = 0; i < mRangeFetchers.size(); ++i) {
+            mRangeFetchers.itemAt(i)->mSource->disconnect();
+        }
         mFinalStatus = -EAGAIN;
         mSuspended = true;
     } else {
@@ -19,9 +19,11 @@
 #include <utils/Log.h>
 
 #include "include/OggExtractor.h"
+#include "include/SeekIndexCache.h"
 
 #include <cutils/properties.h>
 #include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AUtils.h>
 #include <media/stagefright/DataSource.h>
 #include <media/stagefright/MediaBuffer.h>
 #include <media/stagefright/MediaBufferGroup.h>
@@ -30,6 +32,7 @@
 #include <media/stagefright/MediaSource.h>
 #include <media/stagefright/MetaData.h>
 #include <media/stagefright/Utils.h>
+#include <utils/KeyedVector.h>
 #include <utils/String8.h>
 
 extern "C" {
@@ -118,6 +121,10 @@ private:
 
     Vector<TOCEntry> mTableOfContents;
 
+    // Granule positions of the pages read so far, keyed by page offset.
+    // Used to narrow down bisection seeks when there is no TOC.
+    KeyedVector<off64_t, uint64_t> mPageMap;
+
     ssize_t readPage(off64_t offset, Page *page);
     status_t findNextPage(off64_t startOffset, off64_t *pageOffset);
 
@@ -130,6 +137,10 @@ private:
 
     status_t findPrevGranulePosition(off64_t pageOffset, uint64_t *granulePos);
 
+    status_t probeGranulePosition(
+            off64_t offset, off64_t *pageOffset, uint64_t *granulePos);
+    status_t bisectToTime(int64_t timeUs, off64_t *pageOffset);
+
     void buildTableOfContents();
 
     MyVorbisExtractor(const MyVorbisExtractor &);
@@ -314,7 +325,164 @@ status_t MyVorbisExtractor::findPrevGranulePosition(
     }
 }
 
+// Finds the first page at or after "offset" that has a granule position
+// (i.e. some packet ends on it) and returns its offset and granule position.
+status_t MyVorbisExtractor::probeGranulePosition(
+        off64_t offset, off64_t *pageOffset, uint64_t *granulePos) {
+    static const size_t kMaxProbePages = 8;
+
+    status_t err = findNextPage(offset, pageOffset);
+    if (err != OK) {
+        return err;
+    }
+
+    off64_t cur = *pageOffset;
+    for (size_t i = 0; i < kMaxProbePages; ++i) {
+        Page page;
+        ssize_t n = readPage(cur, &page);
+        if (n <= 0) {
+            return n < 0 ? (status_t)n : ERROR_END_OF_STREAM;
+        }
+
+        if (page.mGranulePosition != (uint64_t)-1) {
+            *pageOffset = cur;
+            *granulePos = page.mGranulePosition;
+            return OK;
+        }
+
+        cur += n;
+    }
+
+    return ERROR_MALFORMED;
+}
+
+// Locates the page holding the sample at "timeUs" by interpolating between
+// the closest known (offset, granule position) pairs, refining them with a
+// bounded number of probe reads.
+status_t MyVorbisExtractor::bisectToTime(int64_t timeUs, off64_t *pageOffset) {
+    static const size_t kMaxProbes = 16;
+    // Below this the remaining pages are simply read in order.
+    static const off64_t kLinearScanBytes = 32 * 1024;
+    // Aim a little early so the probe lands before the target page.
+    static const off64_t kProbeBackoff = 4 * 1024;
+
+    off64_t size;
+    if (mVi.rate <= 0 || mSource->getSize(&size) != OK) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    const uint64_t target = (uint64_t)timeUs * mVi.rate / 1000000ll;
+
+    off64_t loOffset = mFirstDataOffset;
+    uint64_t loGranule = 0;
+    off64_t hiOffset = size;
+    uint64_t hiGranule = 0;
+    bool hiGranuleKnown = false;
+
+    int64_t durationUs;
+    if (mMeta->findInt64(kKeyDuration, &durationUs)) {
+        hiGranule = (uint64_t)durationUs * mVi.rate / 1000000ll;
+        hiGranuleKnown = true;
+    }
+
+    // Start from the tightest bracket the pages seen so far allow.
+    size_t left = 0;
+    size_t right = mPageMap.size();
+    while (left < right) {
+        size_t center = left + (right - left) / 2;
+        if (mPageMap.valueAt(center) <= target) {
+            left = center + 1;
+        } else {
+            right = center;
+        }
+    }
+    if (left > 0 && mPageMap.keyAt(left - 1) > loOffset) {
+        loOffset = mPageMap.keyAt(left - 1);
+        loGranule = mPageMap.valueAt(left - 1);
+    }
+    if (left < mPageMap.size() && mPageMap.keyAt(left) < hiOffset) {
+        hiOffset = mPageMap.keyAt(left);
+        hiGranule = mPageMap.valueAt(left);
+        hiGranuleKnown = true;
+    }
+
+    for (size_t probe = 0;
+            probe < kMaxProbes && hiOffset - loOffset > kLinearScanBytes;
+            ++probe) {
+        off64_t guess;
+        if (hiGranuleKnown && hiGranule > loGranule) {
+            guess = loOffset + (off64_t)((double)(target - loGranule)
+                    * (hiOffset - loOffset) / (hiGranule - loGranule));
+        } else {
+            // No upper granule position yet, go by the average bitrate
+            // but never beyond the middle of the bracket.
+            guess = loOffset + (off64_t)((double)(target - loGranule)
+                    * approxBitrate() / (8.0 * mVi.rate));
+            guess = min(guess, loOffset + (hiOffset - loOffset) / 2);
+        }
+
+        guess -= kProbeBackoff;
+        if (guess <= loOffset) {
+            guess = loOffset + 1;
+        } else if (guess >= hiOffset) {
+            guess = hiOffset - 1;
+        }
+
+        off64_t probeOffset;
+        uint64_t probeGranule;
+        status_t err = probeGranulePosition(guess, &probeOffset, &probeGranule);
+
+        ALOGV("probe %zu at %lld: page %lld, granule %llu (target %llu)",
+                probe, (long long)guess, (long long)probeOffset,
+                (unsigned long long)probeGranule, (unsigned long long)target);
+
+        if (err != OK || probeOffset >= hiOffset) {
+            // Nothing with a granule position between guess and hiOffset.
+            hiOffset = guess;
+            continue;
+        }
+
+        if (probeGranule <= target) {
+            loOffset = probeOffset;
+            loGranule = probeGranule;
+        } else {
+            hiOffset = probeOffset;
+            hiGranule = probeGranule;
+            hiGranuleKnown = true;
+        }
+    }
+
+    // Walk forward to the first page ending at or after the target.
+    static const size_t kMaxLinearPages = 256;
+    off64_t offset = loOffset;
+    for (size_t i = 0; i < kMaxLinearPages; ++i) {
+        Page page;
+        ssize_t n = readPage(offset, &page);
+        if (n <= 0) {
+            break;
+        }
+
+        if (page.mGranulePosition != (uint64_t)-1
+                && page.mGranulePosition >= target) {
+            break;
+        }
+
+        offset += n;
+    }
+
+    *pageOffset = offset;
+
+    return OK;
+}
+
 status_t MyVorbisExtractor::seekToTime(int64_t timeUs) {
+    off64_t pageOffset;
+    if (mTableOfContents.isEmpty() && timeUs > 0
+            && bisectToTime(timeUs, &pageOffset) == OK) {
+        ALOGV("seeking to bisected offset %lld", (long long)pageOffset);
+        return seekToOffset(pageOffset);
+    }
+
     if (mTableOfContents.isEmpty()) {
         // Perform approximate seeking based on avg. bitrate.
 
@@ -422,6 +590,12 @@ ssize_t MyVorbisExtractor::readPage(off64_t offset, Page *page) {
 
     page->mGranulePosition = U64LE_AT(&header[6]);
 
+    static const size_t kMaxPageMapSize = 4096;
+    if (page->mGranulePosition != (uint64_t)-1
+            && mPageMap.size() < kMaxPageMapSize) {
+        mPageMap.add(offset, page->mGranulePosition);
+    }
+
 #if 0
     printf("granulePosition = %llu (0x%llx)\n",
            page->mGranulePosition, page->mGranulePosition);
@@ -660,6 +834,19 @@ status_t MyVorbisExtractor::init() {
 }
 
 void MyVorbisExtractor::buildTableOfContents() {
+    // Scanning every page is expensive for large files, reuse the table
+    // built the last time this file was opened if there is one.
+    Vector<SeekIndexCache::Entry> cached;
+    if (SeekIndexCache::Load(mSource, 'ogg ', &cached) == OK) {
+        for (size_t i = 0; i < cached.size(); ++i) {
+            TOCEntry entry;
+            entry.mPageOffset = cached[i].mOffset;
+            entry.mTimeUs = cached[i].mTimeUs;
+            mTableOfContents.push(entry);
+        }
+        return;
+    }
+
     off64_t offset = mFirstDataOffset;
     Page page;
     ssize_t pageSize;
@@ -696,6 +883,14 @@ void MyVorbisExtractor::buildTableOfContents() {
             }
         }
     }
+
+    for (size_t i = 0; i < mTableOfContents.size(); ++i) {
+        SeekIndexCache::Entry entry;
+        entry.mTimeUs = mTableOfContents[i].mTimeUs;
+        entry.mOffset = mTableOfContents[i].mPageOffset;
+        cached.push(entry);
+    }
+    SeekIndexCache::Store(mSource, 'ogg ', cached);
 }
 
 int32_t MyVorbisExtractor::packetBlockSize(MediaBuffer *buffer) {
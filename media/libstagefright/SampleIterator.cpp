@@ -21,6 +21,7 @@
 #include "include/SampleIterator.h"
 
 #include <arpa/inet.h>
+#include <new>
 
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/DataSource.h>
@@ -70,11 +71,12 @@ status_t SampleIterator::seekTo(uint32_t sampleIndex) {
         return OK;
     }
 
-    if (!mInitialized || sampleIndex < mFirstChunkSampleIndex) {
+    if (!mInitialized) {
         reset();
     }
 
-    if (sampleIndex >= mStopChunkSampleIndex) {
+    if (sampleIndex < mFirstChunkSampleIndex
+            || sampleIndex >= mStopChunkSampleIndex) {
         status_t err;
         if ((err = findChunkRange(sampleIndex)) != OK) {
             ALOGE("findChunkRange failed");
@@ -97,21 +99,15 @@ status_t SampleIterator::seekTo(uint32_t sampleIndex) {
             return err;
         }
 
-        mCurrentChunkSampleSizes.clear();
-
         uint32_t firstChunkSampleIndex =
             mFirstChunkSampleIndex
                 + mSamplesPerChunk * (mCurrentChunkIndex - mFirstChunk);
 
-        for (uint32_t i = 0; i < mSamplesPerChunk; ++i) {
-            size_t sampleSize;
-            if ((err = getSampleSizeDirect(
-                            firstChunkSampleIndex + i, &sampleSize)) != OK) {
-                ALOGE("getSampleSizeDirect return error");
-                return err;
-            }
-
-            mCurrentChunkSampleSizes.push(sampleSize);
+        if ((err = getSampleSizesDirect(
+                        firstChunkSampleIndex, mSamplesPerChunk,
+                        &mCurrentChunkSampleSizes)) != OK) {
+            ALOGE("getSampleSizesDirect return error");
+            return err;
         }
     }
 
@@ -124,13 +120,6 @@ status_t SampleIterator::seekTo(uint32_t sampleIndex) {
     }
 
     mCurrentSampleSize = mCurrentChunkSampleSizes[chunkRelativeSampleIndex];
-    if (sampleIndex < mTTSSampleIndex) {
-        mTimeToSampleIndex = 0;
-        mTTSSampleIndex = 0;
-        mTTSSampleTime = 0;
-        mTTSCount = 0;
-        mTTSDuration = 0;
-    }
 
     status_t err;
     if ((err = findSampleTimeAndDuration(
@@ -147,34 +136,46 @@ status_t SampleIterator::seekTo(uint32_t sampleIndex) {
 }
 
 status_t SampleIterator::findChunkRange(uint32_t sampleIndex) {
-    CHECK(sampleIndex >= mFirstChunkSampleIndex);
+    uint32_t numEntries = mTable->mNumSampleToChunkOffsets;
+    const SampleTable::SampleToChunkEntry *entries =
+        mTable->mSampleToChunkEntries;
 
-    while (sampleIndex >= mStopChunkSampleIndex) {
-        if (mSampleToChunkIndex == mTable->mNumSampleToChunkOffsets) {
-            return ERROR_OUT_OF_RANGE;
+    if (numEntries == 0 || sampleIndex < entries[0].firstSample) {
+        return ERROR_OUT_OF_RANGE;
+    }
+
+    // Find the last entry starting at or before sampleIndex, entries
+    // covering no samples share their successor's start and are skipped.
+    uint32_t left = 0;
+    uint32_t right = numEntries;
+    while (right - left > 1) {
+        uint32_t center = left + (right - left) / 2;
+        if (entries[center].firstSample <= sampleIndex) {
+            left = center;
+        } else {
+            right = center;
         }
+    }
 
-        mFirstChunkSampleIndex = mStopChunkSampleIndex;
+    const SampleTable::SampleToChunkEntry *entry = &entries[left];
 
-        const SampleTable::SampleToChunkEntry *entry =
-            &mTable->mSampleToChunkEntries[mSampleToChunkIndex];
+    mFirstChunkSampleIndex = entry->firstSample;
+    mFirstChunk = entry->startChunk;
+    mSamplesPerChunk = entry->samplesPerChunk;
+    mChunkDesc = entry->chunkDesc;
 
-        mFirstChunk = entry->startChunk;
-        mSamplesPerChunk = entry->samplesPerChunk;
-        mChunkDesc = entry->chunkDesc;
+    if (left + 1 < numEntries) {
+        mStopChunk = entry[1].startChunk;
+        mStopChunkSampleIndex = entry[1].firstSample;
+    } else {
+        mStopChunk = 0xffffffff;
+        mStopChunkSampleIndex = 0xffffffff;
+    }
 
-        if (mSampleToChunkIndex + 1 < mTable->mNumSampleToChunkOffsets) {
-            mStopChunk = entry[1].startChunk;
+    mSampleToChunkIndex = left + 1;
 
-            mStopChunkSampleIndex =
-                mFirstChunkSampleIndex
-                    + (mStopChunk - mFirstChunk) * mSamplesPerChunk;
-        } else {
-            mStopChunk = 0xffffffff;
-            mStopChunkSampleIndex = 0xffffffff;
-        }
-
-        ++mSampleToChunkIndex;
+    if (sampleIndex >= mStopChunkSampleIndex || mSamplesPerChunk == 0) {
+        return ERROR_OUT_OF_RANGE;
     }
 
     return OK;
@@ -286,24 +287,107 @@ status_t SampleIterator::getSampleSizeDirect(
     return OK;
 }
 
+status_t SampleIterator::getSampleSizesDirect(
+        uint32_t firstSampleIndex, uint32_t count, Vector<size_t> *sizes) {
+    sizes->clear();
+
+    if (count == 0) {
+        return OK;
+    }
+
+    if (firstSampleIndex >= mTable->mNumSampleSizes) {
+        return ERROR_OUT_OF_RANGE;
+    }
+
+    // The last chunk may be cut short by the sample count.
+    if (count > mTable->mNumSampleSizes - firstSampleIndex) {
+        count = mTable->mNumSampleSizes - firstSampleIndex;
+    }
+
+    if (mTable->mDefaultSampleSize > 0) {
+        sizes->insertAt((size_t)mTable->mDefaultSampleSize, 0, count);
+        return OK;
+    }
+
+    uint32_t fieldSize = mTable->mSampleSizeFieldSize;
+
+    off64_t offset = mTable->mSampleSizeOffset + 12;
+    size_t numBytes;
+    if (fieldSize == 4) {
+        offset += firstSampleIndex / 2;
+        numBytes = (firstSampleIndex + count + 1) / 2 - firstSampleIndex / 2;
+    } else {
+        offset += (off64_t)firstSampleIndex * (fieldSize / 8);
+        numBytes = (size_t)count * (fieldSize / 8);
+    }
+
+    uint8_t *data = new (std::nothrow) uint8_t[numBytes];
+    if (data == NULL) {
+        return -ENOMEM;
+    }
+
+    if (mTable->mDataSource->readAt(offset, data, numBytes)
+            < (ssize_t)numBytes) {
+        delete[] data;
+        return ERROR_IO;
+    }
+
+    sizes->setCapacity(count);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        size_t size;
+        switch (fieldSize) {
+            case 32:
+                size = U32_AT(&data[4 * i]);
+                break;
+
+            case 16:
+                size = U16_AT(&data[2 * i]);
+                break;
+
+            case 8:
+                size = data[i];
+                break;
+
+            default:
+            {
+                CHECK_EQ(fieldSize, 4);
+
+                uint32_t sampleIndex = firstSampleIndex + i;
+                uint8_t x = data[sampleIndex / 2 - firstSampleIndex / 2];
+                size = (sampleIndex & 1) ? x & 0x0f : x >> 4;
+                break;
+            }
+        }
+
+        sizes->push(size);
+    }
+
+    delete[] data;
+
+    return OK;
+}
+
 status_t SampleIterator::findSampleTimeAndDuration(
         uint32_t sampleIndex, uint32_t *time, uint32_t *duration) {
     if (sampleIndex >= mTable->mNumSampleSizes) {
         return ERROR_OUT_OF_RANGE;
     }
 
-    while (sampleIndex >= mTTSSampleIndex + mTTSCount) {
-        if (mTimeToSampleIndex == mTable->mTimeToSampleCount) {
+    // Sequential reads stay within the current stts run, everything else
+    // looks the run up by binary search.
+    if (sampleIndex < mTTSSampleIndex
+            || sampleIndex - mTTSSampleIndex >= mTTSCount) {
+        ssize_t run = mTable->findTimeToSampleRun(sampleIndex);
+        if (run < 0) {
             return ERROR_OUT_OF_RANGE;
         }
 
-        mTTSSampleIndex += mTTSCount;
-        mTTSSampleTime += mTTSCount * mTTSDuration;
-
-        mTTSCount = mTable->mTimeToSample[2 * mTimeToSampleIndex];
-        mTTSDuration = mTable->mTimeToSample[2 * mTimeToSampleIndex + 1];
-
-        ++mTimeToSampleIndex;
+        mTimeToSampleIndex = run + 1;
+        mTTSSampleIndex = mTable->mTimeToSampleStarts[2 * run];
+        mTTSSampleTime = mTable->mTimeToSampleStarts[2 * run + 1];
+        mTTSCount = mTable->mTimeToSample[2 * run];
+        mTTSDuration = mTable->mTimeToSample[2 * run + 1];
     }
 
     *time = mTTSSampleTime + mTTSDuration * (sampleIndex - mTTSSampleIndex);
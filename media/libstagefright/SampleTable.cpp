@@ -22,6 +22,7 @@
 #include "include/SampleIterator.h"
 
 #include <arpa/inet.h>
+#include <new>
 
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/DataSource.h>
@@ -42,6 +43,7 @@ const uint32_t SampleTable::kSampleSizeTypeCompact = FOURCC('s', 't', 'z', '2');
 
 struct SampleTable::CompositionDeltaLookup {
     CompositionDeltaLookup();
+    ~CompositionDeltaLookup();
 
     void setEntries(
             const uint32_t *deltaEntries, size_t numDeltaEntries);
@@ -54,6 +56,9 @@ private:
     const uint32_t *mDeltaEntries;
     size_t mNumDeltaEntries;
 
+    // First sample index of each entry, for binary searching.
+    uint32_t *mEntrySampleIndices;
+
     size_t mCurrentDeltaEntry;
     size_t mCurrentEntrySampleIndex;
 
@@ -63,10 +68,16 @@ private:
 SampleTable::CompositionDeltaLookup::CompositionDeltaLookup()
     : mDeltaEntries(NULL),
       mNumDeltaEntries(0),
+      mEntrySampleIndices(NULL),
       mCurrentDeltaEntry(0),
       mCurrentEntrySampleIndex(0) {
 }
 
+SampleTable::CompositionDeltaLookup::~CompositionDeltaLookup() {
+    delete[] mEntrySampleIndices;
+    mEntrySampleIndices = NULL;
+}
+
 void SampleTable::CompositionDeltaLookup::setEntries(
         const uint32_t *deltaEntries, size_t numDeltaEntries) {
     Mutex::Autolock autolock(mLock);
@@ -75,29 +86,53 @@ void SampleTable::CompositionDeltaLookup::setEntries(
     mNumDeltaEntries = numDeltaEntries;
     mCurrentDeltaEntry = 0;
     mCurrentEntrySampleIndex = 0;
+
+    delete[] mEntrySampleIndices;
+    mEntrySampleIndices = new uint32_t[numDeltaEntries];
+
+    uint64_t sampleIndex = 0;
+    for (size_t i = 0; i < numDeltaEntries; ++i) {
+        mEntrySampleIndices[i] =
+            sampleIndex > UINT32_MAX ? UINT32_MAX : (uint32_t)sampleIndex;
+        sampleIndex += deltaEntries[2 * i];
+    }
 }
 
 uint32_t SampleTable::CompositionDeltaLookup::getCompositionTimeOffset(
         uint32_t sampleIndex) {
     Mutex::Autolock autolock(mLock);
 
-    if (mDeltaEntries == NULL) {
+    if (mDeltaEntries == NULL || mNumDeltaEntries == 0) {
         return 0;
     }
 
-    if (sampleIndex < mCurrentEntrySampleIndex) {
-        mCurrentDeltaEntry = 0;
-        mCurrentEntrySampleIndex = 0;
-    }
-
-    while (mCurrentDeltaEntry < mNumDeltaEntries) {
+    // Sequential access stays within the current entry or moves to the
+    // next one, anything else is a binary search.
+    if (mCurrentDeltaEntry < mNumDeltaEntries
+            && sampleIndex >= mCurrentEntrySampleIndex) {
         uint32_t sampleCount = mDeltaEntries[2 * mCurrentDeltaEntry];
-        if (sampleIndex < mCurrentEntrySampleIndex + sampleCount) {
+        if (sampleIndex - mCurrentEntrySampleIndex < sampleCount) {
             return mDeltaEntries[2 * mCurrentDeltaEntry + 1];
         }
+    }
+
+    size_t left = 0;
+    size_t right = mNumDeltaEntries;
+    while (right - left > 1) {
+        size_t center = left + (right - left) / 2;
+        if (mEntrySampleIndices[center] <= sampleIndex) {
+            left = center;
+        } else {
+            right = center;
+        }
+    }
+
+    // Empty entries share their successor's start and are skipped this way.
+    mCurrentDeltaEntry = left;
+    mCurrentEntrySampleIndex = mEntrySampleIndices[left];
 
-        mCurrentEntrySampleIndex += sampleCount;
-        ++mCurrentDeltaEntry;
+    if (sampleIndex - mCurrentEntrySampleIndex < mDeltaEntries[2 * left]) {
+        return mDeltaEntries[2 * left + 1];
     }
 
     return 0;
@@ -118,14 +153,15 @@ SampleTable::SampleTable(const sp<DataSource> &source)
       mNumSampleSizes(0),
       mTimeToSampleCount(0),
       mTimeToSample(NULL),
-      mSampleTimeEntries(NULL),
+      mTimeToSampleStarts(NULL),
+      mSortedSampleIndices(NULL),
+      mSortedSampleIndicesBuilt(false),
       mCompositionTimeDeltaEntries(NULL),
       mNumCompositionTimeDeltaEntries(0),
       mCompositionDeltaLookup(new CompositionDeltaLookup),
       mSyncSampleOffset(-1),
       mNumSyncSamples(0),
       mSyncSamples(NULL),
-      mLastSyncSampleIndex(0),
       mSampleToChunkEntries(NULL) {
     mSampleIterator = new SampleIterator(this);
 }
@@ -143,8 +179,11 @@ SampleTable::~SampleTable() {
     delete[] mCompositionTimeDeltaEntries;
     mCompositionTimeDeltaEntries = NULL;
 
-    delete[] mSampleTimeEntries;
-    mSampleTimeEntries = NULL;
+    delete[] mSortedSampleIndices;
+    mSortedSampleIndices = NULL;
+
+    delete[] mTimeToSampleStarts;
+    mTimeToSampleStarts = NULL;
 
     delete[] mTimeToSample;
     mTimeToSample = NULL;
@@ -236,22 +275,45 @@ status_t SampleTable::setSampleToChunkParams(
     mSampleToChunkEntries =
         new SampleToChunkEntry[mNumSampleToChunkOffsets];
 
+    size_t size = mNumSampleToChunkOffsets * 12;
+    uint8_t *buffer = new (std::nothrow) uint8_t[size];
+    if (buffer == NULL) {
+        return -ENOMEM;
+    }
+
+    if (mDataSource->readAt(mSampleToChunkOffset + 8, buffer, size)
+            != (ssize_t)size) {
+        delete[] buffer;
+        return ERROR_IO;
+    }
+
+    uint64_t firstSample = 0;
     for (uint32_t i = 0; i < mNumSampleToChunkOffsets; ++i) {
-        uint8_t buffer[12];
-        if (mDataSource->readAt(
-                    mSampleToChunkOffset + 8 + i * 12, buffer, sizeof(buffer))
-                != (ssize_t)sizeof(buffer)) {
-            return ERROR_IO;
-        }
+        const uint8_t *entry = &buffer[i * 12];
 
-        CHECK(U32_AT(buffer) >= 1);  // chunk index is 1 based in the spec.
+        CHECK(U32_AT(entry) >= 1);  // chunk index is 1 based in the spec.
 
         // We want the chunk index to be 0-based.
-        mSampleToChunkEntries[i].startChunk = U32_AT(buffer) - 1;
-        mSampleToChunkEntries[i].samplesPerChunk = U32_AT(&buffer[4]);
-        mSampleToChunkEntries[i].chunkDesc = U32_AT(&buffer[8]);
+        mSampleToChunkEntries[i].startChunk = U32_AT(entry) - 1;
+        mSampleToChunkEntries[i].samplesPerChunk = U32_AT(&entry[4]);
+        mSampleToChunkEntries[i].chunkDesc = U32_AT(&entry[8]);
+
+        if (i > 0) {
+            const SampleToChunkEntry &prev = mSampleToChunkEntries[i - 1];
+
+            // Out of order entries are treated as empty runs.
+            if (mSampleToChunkEntries[i].startChunk > prev.startChunk) {
+                firstSample += (uint64_t)prev.samplesPerChunk
+                    * (mSampleToChunkEntries[i].startChunk - prev.startChunk);
+            }
+        }
+
+        mSampleToChunkEntries[i].firstSample =
+            firstSample > UINT32_MAX ? UINT32_MAX : (uint32_t)firstSample;
     }
 
+    delete[] buffer;
+
     return OK;
 }
 
@@ -349,6 +411,22 @@ status_t SampleTable::setTimeToSampleParams(
         mTimeToSample[i] = ntohl(mTimeToSample[i]);
     }
 
+    // Times wrap around like the 32-bit sample times handed out elsewhere.
+    mTimeToSampleStarts = new uint32_t[2 * (mTimeToSampleCount + 1)];
+
+    uint64_t sampleIndex = 0;
+    uint32_t sampleTime = 0;
+    for (uint32_t i = 0; i <= mTimeToSampleCount; ++i) {
+        mTimeToSampleStarts[2 * i] =
+            sampleIndex > UINT32_MAX ? UINT32_MAX : (uint32_t)sampleIndex;
+        mTimeToSampleStarts[2 * i + 1] = sampleTime;
+
+        if (i < mTimeToSampleCount) {
+            sampleIndex += mTimeToSample[2 * i];
+            sampleTime += mTimeToSample[2 * i] * mTimeToSample[2 * i + 1];
+        }
+    }
+
     return OK;
 }
 
@@ -498,42 +576,81 @@ int SampleTable::CompareIncreasingTime(const void *_a, const void *_b) {
 void SampleTable::buildSampleEntriesTable() {
     Mutex::Autolock autoLock(mLock);
 
-    if (mSampleTimeEntries != NULL) {
+    if (mSortedSampleIndicesBuilt) {
         return;
     }
+    mSortedSampleIndicesBuilt = true;
 
-    mSampleTimeEntries = new SampleTimeEntry[mNumSampleSizes];
+    // Without composition offsets samples are already in time order and
+    // lookups go straight to the stts runs.
+    if (mCompositionTimeDeltaEntries == NULL || mNumSampleSizes == 0) {
+        return;
+    }
 
-    uint32_t sampleIndex = 0;
-    uint32_t sampleTime = 0;
+    SampleTimeEntry *entries =
+        new (std::nothrow) SampleTimeEntry[mNumSampleSizes];
+    if (entries == NULL) {
+        ALOGE("out of memory sorting %u samples", mNumSampleSizes);
+        return;
+    }
 
-    for (uint32_t i = 0; i < mTimeToSampleCount; ++i) {
-        uint32_t n = mTimeToSample[2 * i];
-        uint32_t delta = mTimeToSample[2 * i + 1];
+    for (uint32_t i = 0; i < mNumSampleSizes; ++i) {
+        entries[i].mSampleIndex = i;
+        entries[i].mCompositionTime = getCompositionTime(i);
+    }
 
-        for (uint32_t j = 0; j < n; ++j) {
-            if (sampleIndex < mNumSampleSizes) {
-                // Technically this should always be the case if the file
-                // is well-formed, but you know... there's (gasp) malformed
-                // content out there.
+    qsort(entries, mNumSampleSizes, sizeof(SampleTimeEntry),
+          CompareIncreasingTime);
 
-                mSampleTimeEntries[sampleIndex].mSampleIndex = sampleIndex;
+    // Only the order is kept, times are cheap to recompute.
+    mSortedSampleIndices = new (std::nothrow) uint32_t[mNumSampleSizes];
+    if (mSortedSampleIndices != NULL) {
+        for (uint32_t i = 0; i < mNumSampleSizes; ++i) {
+            mSortedSampleIndices[i] = entries[i].mSampleIndex;
+        }
+    }
 
-                uint32_t compTimeDelta =
-                    mCompositionDeltaLookup->getCompositionTimeOffset(
-                            sampleIndex);
+    delete[] entries;
+}
 
-                mSampleTimeEntries[sampleIndex].mCompositionTime =
-                    sampleTime + compTimeDelta;
-            }
+ssize_t SampleTable::findTimeToSampleRun(uint32_t sampleIndex) const {
+    if (mTimeToSampleStarts == NULL
+            || sampleIndex >= mTimeToSampleStarts[2 * mTimeToSampleCount]) {
+        return -1;
+    }
 
-            ++sampleIndex;
-            sampleTime += delta;
+    // Find the last run starting at or before sampleIndex, empty runs share
+    // their successor's start and are skipped this way.
+    size_t left = 0;
+    size_t right = mTimeToSampleCount;
+    while (right - left > 1) {
+        size_t center = left + (right - left) / 2;
+        if (mTimeToSampleStarts[2 * center] <= sampleIndex) {
+            left = center;
+        } else {
+            right = center;
         }
     }
 
-    qsort(mSampleTimeEntries, mNumSampleSizes, sizeof(SampleTimeEntry),
-          CompareIncreasingTime);
+    return left;
+}
+
+uint32_t SampleTable::getCompositionTime(uint32_t sampleIndex) {
+    ssize_t run = findTimeToSampleRun(sampleIndex);
+
+    uint32_t time;
+    if (run < 0) {
+        // Malformed content with fewer stts than stsz entries, pretend the
+        // remaining samples sit at the very end.
+        time = mTimeToSampleStarts != NULL
+            ? mTimeToSampleStarts[2 * mTimeToSampleCount + 1] : 0;
+    } else {
+        time = mTimeToSampleStarts[2 * run + 1]
+            + mTimeToSample[2 * run + 1]
+                * (sampleIndex - mTimeToSampleStarts[2 * run]);
+    }
+
+    return time + getCompositionTimeOffset(sampleIndex);
 }
 
 status_t SampleTable::findSampleAtTime(
@@ -553,7 +670,7 @@ status_t SampleTable::findSampleAtTime(
         } else if (req_time > centerTime) {
             left = center + 1;
         } else {
-            *sample_index = mSampleTimeEntries[center].mSampleIndex;
+            *sample_index = getSortedSampleIndex(center);
             return OK;
         }
     }
@@ -602,7 +719,7 @@ status_t SampleTable::findSampleAtTime(
         }
     }
 
-    *sample_index = mSampleTimeEntries[closestIndex].mSampleIndex;
+    *sample_index = getSortedSampleIndex(closestIndex);
     return OK;
 }
 
@@ -782,25 +899,7 @@ status_t SampleTable::getMetaDataForSample(
     }
 
     if (isSyncSample) {
-        *isSyncSample = false;
-        if (mSyncSampleOffset < 0) {
-            // Every sample is a sync sample.
-            *isSyncSample = true;
-        } else {
-            size_t i = (mLastSyncSampleIndex < mNumSyncSamples)
-                    && (mSyncSamples[mLastSyncSampleIndex] <= sampleIndex)
-                ? mLastSyncSampleIndex : 0;
-
-            while (i < mNumSyncSamples && mSyncSamples[i] < sampleIndex) {
-                ++i;
-            }
-
-            if (i < mNumSyncSamples && mSyncSamples[i] == sampleIndex) {
-                *isSyncSample = true;
-            }
-
-            mLastSyncSampleIndex = i;
-        }
+        *isSyncSample = isSyncSample_l(sampleIndex);
     }
 
     if (sampleDuration) {
@@ -810,6 +909,26 @@ status_t SampleTable::getMetaDataForSample(
     return OK;
 }
 
+bool SampleTable::isSyncSample_l(uint32_t sampleIndex) const {
+    if (mSyncSampleOffset < 0) {
+        // Every sample is a sync sample.
+        return true;
+    }
+
+    size_t left = 0;
+    size_t right = mNumSyncSamples;
+    while (left < right) {
+        size_t center = left + (right - left) / 2;
+        if (mSyncSamples[center] < sampleIndex) {
+            left = center + 1;
+        } else {
+            right = center;
+        }
+    }
+
+    return left < mNumSyncSamples && mSyncSamples[left] == sampleIndex;
+}
+
 uint32_t SampleTable::getCompositionTimeOffset(uint32_t sampleIndex) {
     return mCompositionDeltaLookup->getCompositionTimeOffset(sampleIndex);
 }
@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SeekIndexCache"
+#include <utils/Log.h>
+
+#include "include/SeekIndexCache.h"
+
+#include <cutils/properties.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaErrors.h>
+#include <utils/String8.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace android {
+
+static const uint32_t kMagic = 'skix';
+
+// Bump whenever the layout of Header or Entry changes.
+static const uint32_t kVersion = 1;
+
+// Amount of data hashed at either end of the file.
+static const size_t kHashChunkSize = 4096;
+
+// Refuse to load anything larger, the file is most likely corrupt.
+static const uint32_t kMaxNumEntries = 1 << 20;
+
+struct Header {
+    uint32_t mMagic;
+    uint32_t mVersion;
+    uint32_t mTag;
+    uint32_t mNumEntries;
+    uint64_t mContentHash;
+};
+
+// 64-bit FNV-1a.
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *ptr = (const uint8_t *)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= ptr[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+static const uint64_t kHashSeed = 0xcbf29ce484222325ull;
+
+// static
+status_t SeekIndexCache::GetIndexPath(
+        const sp<DataSource> &source, uint32_t tag,
+        String8 *path, uint64_t *contentHash) {
+    char dir[PROPERTY_VALUE_MAX];
+    if (!property_get("media.stagefright.seek-index-dir", dir, NULL)
+            || dir[0] == '\0') {
+        return ERROR_UNSUPPORTED;
+    }
+
+    String8 id;
+    status_t err = source->getFileIdentity(&id);
+    if (err != OK) {
+        return err;
+    }
+
+    off64_t size;
+    if (source->getSize(&size) != OK) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    uint64_t keyHash = hashBytes(kHashSeed, id.string(), id.size());
+    keyHash = hashBytes(keyHash, &tag, sizeof(tag));
+
+    // The identity covers size and modification time, the content hash
+    // catches files rewritten in place within the mtime granularity.
+    uint8_t buffer[kHashChunkSize];
+    uint64_t hash = kHashSeed;
+    size_t n = size < (off64_t)kHashChunkSize ? (size_t)size : kHashChunkSize;
+    if (source->readAt(0, buffer, n) != (ssize_t)n) {
+        return ERROR_IO;
+    }
+    hash = hashBytes(hash, buffer, n);
+
+    if (source->readAt(size - n, buffer, n) != (ssize_t)n) {
+        return ERROR_IO;
+    }
+    hash = hashBytes(hash, buffer, n);
+
+    path->setTo(dir);
+    path->appendFormat("/%016llx.idx", (unsigned long long)keyHash);
+    *contentHash = hash;
+
+    return OK;
+}
+
+// static
+status_t SeekIndexCache::Load(
+        const sp<DataSource> &source, uint32_t tag,
+        Vector<Entry> *entries) {
+    String8 path;
+    uint64_t contentHash;
+    status_t err = GetIndexPath(source, tag, &path, &contentHash);
+    if (err != OK) {
+        return err;
+    }
+
+    int fd = open(path.string(), O_RDONLY);
+    if (fd < 0) {
+        return NAME_NOT_FOUND;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header)) {
+        close(fd);
+        return ERROR_MALFORMED;
+    }
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    fd = -1;
+
+    if (base == MAP_FAILED) {
+        return ERROR_IO;
+    }
+
+    const Header *header = (const Header *)base;
+
+    err = OK;
+    if (header->mMagic != kMagic
+            || header->mVersion != kVersion
+            || header->mTag != tag
+            || header->mContentHash != contentHash
+            || header->mNumEntries > kMaxNumEntries
+            || (size_t)st.st_size
+                != sizeof(Header) + header->mNumEntries * sizeof(Entry)) {
+        ALOGW("discarding stale or corrupt seek index %s", path.string());
+        unlink(path.string());
+        err = ERROR_MALFORMED;
+    } else {
+        entries->clear();
+        entries->appendArray(
+                (const Entry *)((const uint8_t *)base + sizeof(Header)),
+                header->mNumEntries);
+
+        ALOGV("loaded %u entries from %s", header->mNumEntries, path.string());
+    }
+
+    munmap(base, st.st_size);
+
+    return err;
+}
+
+static bool writeFully(int fd, const void *data, size_t size) {
+    const uint8_t *ptr = (const uint8_t *)data;
+    while (size > 0) {
+        ssize_t n = write(fd, ptr, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return false;
+        }
+
+        ptr += n;
+        size -= n;
+    }
+
+    return true;
+}
+
+// static
+status_t SeekIndexCache::Store(
+        const sp<DataSource> &source, uint32_t tag,
+        const Vector<Entry> &entries) {
+    if (entries.isEmpty() || entries.size() > kMaxNumEntries) {
+        return BAD_VALUE;
+    }
+
+    String8 path;
+    uint64_t contentHash;
+    status_t err = GetIndexPath(source, tag, &path, &contentHash);
+    if (err != OK) {
+        return err;
+    }
+
+    // Write to a private temporary file first, readers must never see a
+    // partially written index. The name is unique, several extractors in
+    // the same process may be storing an index for the same file.
+    char tmpPath[PATH_MAX];
+    if (snprintf(tmpPath, sizeof(tmpPath), "%s.XXXXXX", path.string())
+            >= (int)sizeof(tmpPath)) {
+        return ERROR_IO;
+    }
+
+    int fd = mkstemp(tmpPath);
+    if (fd < 0) {
+        ALOGV("unable to create %s (%s)", tmpPath, strerror(errno));
+        return ERROR_IO;
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.mMagic = kMagic;
+    header.mVersion = kVersion;
+    header.mTag = tag;
+    header.mNumEntries = entries.size();
+    header.mContentHash = contentHash;
+
+    // mkstemp() creates the file readable by its owner only.
+    bool success = fchmod(fd, 0644) == 0
+        && writeFully(fd, &header, sizeof(header))
+        && writeFully(fd, entries.array(), entries.size() * sizeof(Entry));
+
+    if (close(fd) != 0) {
+        success = false;
+    }
+
+    if (!success || rename(tmpPath, path.string()) != 0) {
+        unlink(tmpPath);
+        return ERROR_IO;
+    }
+
+    ALOGV("stored %zu entries to %s", entries.size(), path.string());
+
+    return OK;
+}
+
+}  // namespace android
@@ -113,9 +113,14 @@ MediaScanResult StagefrightMediaScanner::processFile(
         MediaScannerClient &client) {
     ALOGV("processFile '%s'.", path);
 
+    MediaScanResult result;
+    if (takePrefetchedFile(path, client, &result)) {
+        return result;
+    }
+
     client.setLocale(locale());
     client.beginFile();
-    MediaScanResult result = processFileInternal(path, mimeType, client);
+    result = processFileInternal(path, mimeType, client);
     client.endFile();
     return result;
 }
@@ -21,6 +21,7 @@
 #include "include/WAVExtractor.h"
 
 #include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AString.h>
 #include <media/stagefright/DataSource.h>
 #include <media/stagefright/MediaBufferGroup.h>
 #include <media/stagefright/MediaDefs.h>
@@ -28,8 +29,22 @@
 #include <media/stagefright/MediaSource.h>
 #include <media/stagefright/MetaData.h>
 #include <media/stagefright/Utils.h>
+#include <utils/Mutex.h>
 #include <utils/String8.h>
 #include <cutils/bitops.h>
+#include <cutils/properties.h>
+
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #ifdef ENABLE_AV_ENHANCEMENTS
 #include "QCMediaDefs.h"
@@ -42,6 +57,7 @@ namespace android {
 
 enum {
     WAVE_FORMAT_PCM        = 0x0001,
+    WAVE_FORMAT_IEEE_FLOAT = 0x0003,
     WAVE_FORMAT_ALAW       = 0x0006,
     WAVE_FORMAT_MULAW      = 0x0007,
     WAVE_FORMAT_MSGSM      = 0x0031,
@@ -59,6 +75,256 @@ static uint16_t U16_LE_AT(const uint8_t *ptr) {
     return ptr[1] << 8 | ptr[0];
 }
 
+static size_t getReadBufferSize() {
+    static const size_t kDefaultBufferSize = 64 * 1024;
+    static const size_t kMinBufferSize = 4 * 1024;
+    static const size_t kMaxBufferSize = 1024 * 1024;
+
+    char value[PROPERTY_VALUE_MAX];
+    if (!property_get("media.stagefright.wav.read-size", value, NULL)) {
+        return kDefaultBufferSize;
+    }
+
+    size_t size = strtoul(value, NULL, 10);
+    if (size < kMinBufferSize) {
+        return kMinBufferSize;
+    } else if (size > kMaxBufferSize) {
+        return kMaxBufferSize;
+    }
+    return size;
+}
+
+// The conversions below run in place on the buffer the samples were read
+// into. The ones that widen samples walk it from the end so that nothing
+// is overwritten before it has been read.
+
+static inline int16_t U8ToS16(uint8_t x) {
+    return (int16_t)(((int16_t)x - 128) * 256);
+}
+
+static void ConvertU8ToS16(uint8_t *data, size_t numSamples) {
+    int16_t *dst = (int16_t *)data;
+    size_t i = numSamples;
+#if defined(__SSE2__)
+    for (; i % 16 != 0; --i) {
+        dst[i - 1] = U8ToS16(data[i - 1]);
+    }
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    while (i > 0) {
+        i -= 16;
+        __m128i x = _mm_xor_si128(
+                _mm_loadu_si128((const __m128i *)(data + i)), bias);
+        _mm_storeu_si128(
+                (__m128i *)(dst + i + 8), _mm_unpackhi_epi8(zero, x));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi8(zero, x));
+    }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; i % 16 != 0; --i) {
+        dst[i - 1] = U8ToS16(data[i - 1]);
+    }
+    const uint8x16_t bias = vdupq_n_u8(0x80);
+    while (i > 0) {
+        i -= 16;
+        uint8x16_t x = veorq_u8(vld1q_u8(data + i), bias);
+        vst1q_s16(dst + i + 8,
+                vreinterpretq_s16_u16(vshll_n_u8(vget_high_u8(x), 8)));
+        vst1q_s16(dst + i,
+                vreinterpretq_s16_u16(vshll_n_u8(vget_low_u8(x), 8)));
+    }
+#endif
+    for (; i > 0; --i) {
+        dst[i - 1] = U8ToS16(data[i - 1]);
+    }
+}
+
+// Keeps the upper 16 bits of each 24-bit sample.
+static void Convert24ToS16(uint8_t *data, size_t numSamples) {
+    int16_t *dst = (int16_t *)data;
+    size_t i = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; i + 16 <= numSamples; i += 16) {
+        uint8x16x3_t x = vld3q_u8(data + 3 * i);
+        uint8x16x2_t y;
+        y.val[0] = x.val[1];
+        y.val[1] = x.val[2];
+        vst2q_u8((uint8_t *)(dst + i), y);
+    }
+#elif defined(__SSSE3__)
+    const __m128i shuffle = _mm_setr_epi8(
+            1, 2, 4, 5, 7, 8, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1);
+    // The second load of each block reaches 4 bytes into the next one.
+    for (; i + 10 <= numSamples; i += 8) {
+        __m128i lo = _mm_shuffle_epi8(
+                _mm_loadu_si128((const __m128i *)(data + 3 * i)), shuffle);
+        __m128i hi = _mm_shuffle_epi8(
+                _mm_loadu_si128((const __m128i *)(data + 3 * i + 12)),
+                shuffle);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi64(lo, hi));
+    }
+#endif
+    for (; i < numSamples; ++i) {
+        const uint8_t *src = data + 3 * i;
+        dst[i] = (int16_t)(src[1] | src[2] << 8);
+    }
+}
+
+// Widens 24-bit samples to 32 bits, either left-justified by padding them
+// with a zero byte or, for AUDIO_FORMAT_PCM_8_24_BIT, sign-extended into
+// Q8.23.
+static inline int32_t S24ToS32(const uint8_t *src) {
+    return (int32_t)((uint32_t)src[0] << 8
+            | (uint32_t)src[1] << 16 | (uint32_t)src[2] << 24);
+}
+
+static inline int32_t S24ToQ8_23(const uint8_t *src) {
+    return S24ToS32(src) >> 8;
+}
+
+static void Convert24ToS32(uint8_t *data, size_t numSamples, bool q8_23) {
+    int32_t *dst = (int32_t *)data;
+    size_t i = numSamples;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; i % 8 != 0; --i) {
+        const uint8_t *src = data + 3 * (i - 1);
+        dst[i - 1] = q8_23 ? S24ToQ8_23(src) : S24ToS32(src);
+    }
+    while (i > 0) {
+        i -= 8;
+        uint8x8x3_t x = vld3_u8(data + 3 * i);
+        uint8x8x4_t y;
+        if (q8_23) {
+            y.val[0] = x.val[0];
+            y.val[1] = x.val[1];
+            y.val[2] = x.val[2];
+            y.val[3] = vreinterpret_u8_s8(
+                    vshr_n_s8(vreinterpret_s8_u8(x.val[2]), 7));
+        } else {
+            y.val[0] = vdup_n_u8(0);
+            y.val[1] = x.val[0];
+            y.val[2] = x.val[1];
+            y.val[3] = x.val[2];
+        }
+        vst4_u8((uint8_t *)(dst + i), y);
+    }
+#elif defined(__SSSE3__)
+    // Each load reaches 4 bytes past its block, so leave at least two
+    // samples above the blocks to the scalar loop.
+    size_t numBlockSamples =
+        numSamples > 2 ? ((numSamples - 2) / 4) * 4 : 0;
+    for (; i > numBlockSamples; --i) {
+        const uint8_t *src = data + 3 * (i - 1);
+        dst[i - 1] = q8_23 ? S24ToQ8_23(src) : S24ToS32(src);
+    }
+    const __m128i shuffle = _mm_setr_epi8(
+            -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    const __m128i shift = _mm_cvtsi32_si128(q8_23 ? 8 : 0);
+    while (i > 0) {
+        i -= 4;
+        _mm_storeu_si128((__m128i *)(dst + i),
+                _mm_sra_epi32(_mm_shuffle_epi8(
+                        _mm_loadu_si128((const __m128i *)(data + 3 * i)),
+                        shuffle), shift));
+    }
+#endif
+    for (; i > 0; --i) {
+        const uint8_t *src = data + 3 * (i - 1);
+        dst[i - 1] = q8_23 ? S24ToQ8_23(src) : S24ToS32(src);
+    }
+}
+
+static void ConvertS32ToFloat(uint8_t *data, size_t numSamples) {
+    const int32_t *src = (const int32_t *)data;
+    float *dst = (float *)data;
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+    for (; i + 4 <= numSamples; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_mul_ps(
+                    _mm_cvtepi32_ps(
+                        _mm_loadu_si128((const __m128i *)(src + i))),
+                    scale));
+    }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; i + 4 <= numSamples; i += 4) {
+        vst1q_f32(dst + i, vcvtq_n_f32_s32(vld1q_s32(src + i), 31));
+    }
+#endif
+    for (; i < numSamples; ++i) {
+        dst[i] = src[i] * (1.0f / 2147483648.0f);
+    }
+}
+
+// All paths clip to [-1, 1], round to nearest even and map NaN to 0.
+static inline int16_t FloatToS16(float x) {
+    if (x != x) {
+        return 0;
+    } else if (x <= -1.0f) {
+        return -32768;
+    } else if (x >= 1.0f) {
+        return 32767;
+    }
+    int32_t y = (int32_t)lrintf(x * 32768.0f);
+    return y > 32767 ? 32767 : (int16_t)y;
+}
+
+static void ConvertFloatToS16(uint8_t *data, size_t numSamples) {
+    const float *src = (const float *)data;
+    int16_t *dst = (int16_t *)data;
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 lower = _mm_set1_ps(-1.0f);
+    const __m128 upper = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    for (; i + 8 <= numSamples; i += 8) {
+        __m128 lo = _mm_loadu_ps(src + i);
+        __m128 hi = _mm_loadu_ps(src + i + 4);
+        // Clear NaNs before clipping. The pack saturates 32768 to 32767.
+        lo = _mm_and_ps(lo, _mm_cmpord_ps(lo, lo));
+        hi = _mm_and_ps(hi, _mm_cmpord_ps(hi, hi));
+        lo = _mm_min_ps(_mm_max_ps(lo, lower), upper);
+        hi = _mm_min_ps(_mm_max_ps(hi, lower), upper);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(
+                    _mm_cvtps_epi32(_mm_mul_ps(lo, scale)),
+                    _mm_cvtps_epi32(_mm_mul_ps(hi, scale))));
+    }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    const float32x4_t lower = vdupq_n_f32(-1.0f);
+    const float32x4_t upper = vdupq_n_f32(1.0f);
+    // Adding and removing 1.5 * 2^23 rounds to nearest even, as the
+    // conversion itself truncates.
+    const float32x4_t magic = vdupq_n_f32(12582912.0f);
+    for (; i + 8 <= numSamples; i += 8) {
+        float32x4_t lo = vld1q_f32(src + i);
+        float32x4_t hi = vld1q_f32(src + i + 4);
+        // vmaxq_f32 and vminq_f32 keep NaNs, which the conversion maps to 0.
+        lo = vmulq_n_f32(vminq_f32(vmaxq_f32(lo, lower), upper), 32768.0f);
+        hi = vmulq_n_f32(vminq_f32(vmaxq_f32(hi, lower), upper), 32768.0f);
+        lo = vsubq_f32(vaddq_f32(lo, magic), magic);
+        hi = vsubq_f32(vaddq_f32(hi, magic), magic);
+        vst1q_s16(dst + i, vcombine_s16(
+                    vqmovn_s32(vcvtq_s32_f32(lo)),
+                    vqmovn_s32(vcvtq_s32_f32(hi))));
+    }
+#endif
+    for (; i < numSamples; ++i) {
+        dst[i] = FloatToS16(src[i]);
+    }
+}
+
+static size_t pcmBytesPerSample(int32_t format) {
+    switch (format) {
+        case AUDIO_FORMAT_PCM_32_BIT:
+        case AUDIO_FORMAT_PCM_8_24_BIT:
+        case AUDIO_FORMAT_PCM_FLOAT:
+            return 4;
+        case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+            return 3;
+        default:
+            return 2;
+    }
+}
+
 struct WAVSource : public MediaSource {
     WAVSource(
             const sp<DataSource> &dataSource,
@@ -74,11 +340,14 @@ struct WAVSource : public MediaSource {
     virtual status_t read(
             MediaBuffer **buffer, const ReadOptions *options = NULL);
 
+    virtual void dump(AString *out);
+
 protected:
     virtual ~WAVSource();
 
 private:
-    static const size_t kMaxFrameSize;
+    // Guards mGroup against dump() while the source starts or stops.
+    Mutex mLock;
 
     sp<DataSource> mDataSource;
     sp<MetaData> mMeta;
@@ -90,9 +359,14 @@ private:
     size_t mSize;
     bool mStarted;
     int32_t mOutputFormat;
+    size_t mBufferSize;
     MediaBufferGroup *mGroup;
     off64_t mCurrentPos;
 
+    bool isPCM() const;
+    void setOutputFormat(int32_t format);
+    void convertSamples(MediaBuffer *buffer, size_t numSamples);
+
     WAVSource(const WAVSource &);
     WAVSource &operator=(const WAVSource &);
 };
@@ -184,6 +458,7 @@ status_t WAVExtractor::init() {
 
             mWaveFormat = U16_LE_AT(formatSpec);
             if (mWaveFormat != WAVE_FORMAT_PCM
+                    && mWaveFormat != WAVE_FORMAT_IEEE_FLOAT
                     && mWaveFormat != WAVE_FORMAT_ALAW
                     && mWaveFormat != WAVE_FORMAT_MULAW
                     && mWaveFormat != WAVE_FORMAT_MSGSM
@@ -221,8 +496,16 @@ status_t WAVExtractor::init() {
 
             if (mWaveFormat == WAVE_FORMAT_PCM
                     || mWaveFormat == WAVE_FORMAT_EXTENSIBLE) {
+                // 32 bits are only supported for float samples, whose
+                // extensible subformat is checked below.
                 if (mBitsPerSample != 8 && mBitsPerSample != 16
-                    && mBitsPerSample != 24) {
+                    && mBitsPerSample != 24
+                    && (mBitsPerSample != 32
+                        || mWaveFormat != WAVE_FORMAT_EXTENSIBLE)) {
+                    return ERROR_UNSUPPORTED;
+                }
+            } else if (mWaveFormat == WAVE_FORMAT_IEEE_FLOAT) {
+                if (mBitsPerSample != 32) {
                     return ERROR_UNSUPPORTED;
                 }
             } else if (mWaveFormat == WAVE_FORMAT_MSGSM) {
@@ -268,8 +551,15 @@ status_t WAVExtractor::init() {
                 // In a WAVE_EXT header, the first two bytes of the GUID stored at byte 24 contain
                 // the sample format, using the same definitions as a regular WAV header
                 mWaveFormat = U16_LE_AT(&formatSpec[24]);
-                if (mWaveFormat != WAVE_FORMAT_PCM
-                        && mWaveFormat != WAVE_FORMAT_ALAW
+                if (mWaveFormat == WAVE_FORMAT_PCM) {
+                    if (mBitsPerSample == 32) {
+                        return ERROR_UNSUPPORTED;
+                    }
+                } else if (mWaveFormat == WAVE_FORMAT_IEEE_FLOAT) {
+                    if (mBitsPerSample != 32) {
+                        return ERROR_UNSUPPORTED;
+                    }
+                } else if (mWaveFormat != WAVE_FORMAT_ALAW
                         && mWaveFormat != WAVE_FORMAT_MULAW) {
                     return ERROR_UNSUPPORTED;
                 }
@@ -296,6 +586,15 @@ status_t WAVExtractor::init() {
                         mTrackMeta->setInt32(kKeySampleBits, mBitsPerSample);
 #endif
 #endif
+                        // Until a consumer asks for more, see WAVSource::start().
+                        mTrackMeta->setInt32(
+                                kKeyPcmEncoding, AUDIO_FORMAT_PCM_16_BIT);
+                        break;
+                    case WAVE_FORMAT_IEEE_FLOAT:
+                        mTrackMeta->setCString(
+                                kKeyMIMEType, MEDIA_MIMETYPE_AUDIO_RAW);
+                        mTrackMeta->setInt32(
+                                kKeyPcmEncoding, AUDIO_FORMAT_PCM_16_BIT);
                         break;
                     case WAVE_FORMAT_ALAW:
                         mTrackMeta->setCString(
@@ -340,8 +639,6 @@ status_t WAVExtractor::init() {
     return NO_INIT;
 }
 
-const size_t WAVSource::kMaxFrameSize = 32768;
-
 WAVSource::WAVSource(
         const sp<DataSource> &dataSource,
         const sp<MetaData> &meta,
@@ -358,11 +655,12 @@ WAVSource::WAVSource(
       mSize(size),
       mStarted(false),
       mOutputFormat(AUDIO_FORMAT_PCM_16_BIT),
+      mBufferSize(getReadBufferSize()),
       mGroup(NULL) {
     CHECK(mMeta->findInt32(kKeySampleRate, &mSampleRate));
     CHECK(mMeta->findInt32(kKeyChannelCount, &mNumChannels));
 
-    mMeta->setInt32(kKeyMaxInputSize, kMaxFrameSize);
+    mMeta->setInt32(kKeyMaxInputSize, mBufferSize);
 }
 
 WAVSource::~WAVSource() {
@@ -371,38 +669,80 @@ WAVSource::~WAVSource() {
     }
 }
 
+bool WAVSource::isPCM() const {
+    return mWaveFormat == WAVE_FORMAT_PCM
+        || mWaveFormat == WAVE_FORMAT_EXTENSIBLE
+        || mWaveFormat == WAVE_FORMAT_IEEE_FLOAT;
+}
+
+// Picks the encoding of the buffers returned by read(). 24-bit and float
+// samples can be handed on without losing precision, everything else is
+// converted to 16 bits.
+void WAVSource::setOutputFormat(int32_t format) {
+    if (!isPCM()) {
+        return;
+    }
+
+    bool isFloat = (mWaveFormat == WAVE_FORMAT_IEEE_FLOAT);
+    bool supported;
+    switch (format) {
+        case AUDIO_FORMAT_PCM_16_BIT:
+            supported = true;
+            break;
+        case AUDIO_FORMAT_PCM_FLOAT:
+            supported = (isFloat || mBitsPerSample == 24);
+            break;
+        case AUDIO_FORMAT_PCM_32_BIT:
+        case AUDIO_FORMAT_PCM_8_24_BIT:
+        case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+            supported = (!isFloat && mBitsPerSample == 24);
+            break;
+        default:
+            supported = false;
+            break;
+    }
+
+    if (!supported) {
+        ALOGW("output format %#x not supported for %d bit %s samples",
+                format, mBitsPerSample, isFloat ? "float" : "integer");
+        format = AUDIO_FORMAT_PCM_16_BIT;
+    }
+
+    mOutputFormat = format;
+    mMeta->setInt32(kKeyPcmEncoding, mOutputFormat);
+}
+
 status_t WAVSource::start(MetaData *params) {
     ALOGV("WAVSource::start");
 
+    int32_t outputFormat = AUDIO_FORMAT_PCM_16_BIT;
 #ifdef ENABLE_AV_ENHANCEMENTS
 #ifdef PCM_OFFLOAD_ENABLED_24
-    if (params != NULL) {
-        if (params->findInt32(kKeyPcmFormat, &mOutputFormat)) {
-            ALOGV("%s mOutputFormat: %x", __func__, mOutputFormat);
-        } else {
-            mOutputFormat = AUDIO_FORMAT_PCM_16_BIT;
-            ALOGV("%s Couldn't find format. Setting output format to default: %x",
-               __func__, mOutputFormat);
+    if (params != NULL && params->findInt32(kKeyPcmFormat, &outputFormat)) {
+        ALOGV("%s mOutputFormat: %x", __func__, outputFormat);
+        // Offload asks for 8_24 but takes left-justified 32-bit samples.
+        if (outputFormat == AUDIO_FORMAT_PCM_8_24_BIT) {
+            outputFormat = AUDIO_FORMAT_PCM_32_BIT;
         }
     } else {
         ALOGV("Use default output format if metadata is not set");
-        mOutputFormat = AUDIO_FORMAT_PCM_16_BIT;
     }
 #endif
 #endif
+    if (params != NULL) {
+        params->findInt32(kKeyPcmEncoding, &outputFormat);
+    }
+    setOutputFormat(outputFormat);
 
     if(mStarted) {
         ALOGW("WAVSource::start, already started. mOutputFormat set to:%d",mOutputFormat);
         return OK;
     }
 
+    // Samples are converted in place, one buffer is all it takes.
+    Mutex::Autolock autoLock(mLock);
     mGroup = new MediaBufferGroup;
-    mGroup->add_buffer(new MediaBuffer(kMaxFrameSize));
-
-    if (mBitsPerSample == 8 || mBitsPerSample == 24) {
-        // As a temporary buffer for {8->16, 24->32} bit conversion.
-        mGroup->add_buffer(new MediaBuffer(kMaxFrameSize));
-    }
+    mGroup->add_buffer(new MediaBuffer(mBufferSize));
 
     mCurrentPos = mOffset;
 
@@ -416,6 +756,7 @@ status_t WAVSource::stop() {
 
     CHECK(mStarted);
 
+    Mutex::Autolock autoLock(mLock);
     delete mGroup;
     mGroup = NULL;
 
@@ -430,6 +771,47 @@ sp<MetaData> WAVSource::getFormat() {
     return mMeta;
 }
 
+void WAVSource::dump(AString *out) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mGroup != NULL) {
+        mGroup->dump(out);
+    }
+}
+
+void WAVSource::convertSamples(MediaBuffer *buffer, size_t numSamples) {
+    uint8_t *data = (uint8_t *)buffer->data();
+
+    if (mWaveFormat == WAVE_FORMAT_IEEE_FLOAT) {
+        if (mOutputFormat == AUDIO_FORMAT_PCM_16_BIT) {
+            ConvertFloatToS16(data, numSamples);
+        }
+    } else if (mBitsPerSample == 8) {
+        ConvertU8ToS16(data, numSamples);
+    } else if (mBitsPerSample == 24) {
+        switch (mOutputFormat) {
+            case AUDIO_FORMAT_PCM_16_BIT:
+                Convert24ToS16(data, numSamples);
+                break;
+            case AUDIO_FORMAT_PCM_32_BIT:
+                Convert24ToS32(data, numSamples, false /* q8_23 */);
+                break;
+            case AUDIO_FORMAT_PCM_8_24_BIT:
+                Convert24ToS32(data, numSamples, true /* q8_23 */);
+                break;
+            case AUDIO_FORMAT_PCM_FLOAT:
+                Convert24ToS32(data, numSamples, false /* q8_23 */);
+                ConvertS32ToFloat(data, numSamples);
+                break;
+            default:
+                CHECK_EQ(mOutputFormat, (int32_t)AUDIO_FORMAT_PCM_24_BIT_PACKED);
+                break;
+        }
+    }
+
+    buffer->set_range(0, numSamples * pcmBytesPerSample(mOutputFormat));
+}
+
 status_t WAVSource::read(
         MediaBuffer **out, const ReadOptions *options) {
     *out = NULL;
@@ -459,19 +841,15 @@ status_t WAVSource::read(
         return err;
     }
 
-    // make sure that maxBytesToRead is multiple of 3, in 24-bit case
-    size_t maxBytesToRead;
-    if(8 == mBitsPerSample)
-        maxBytesToRead = kMaxFrameSize / 2;
-    else if (24 == mBitsPerSample) {
-        if (AUDIO_FORMAT_PCM_8_24_BIT == mOutputFormat)
-            maxBytesToRead = 3*(kMaxFrameSize/4);
-        else
-            maxBytesToRead = kMaxFrameSize;
-    } else
-        maxBytesToRead = kMaxFrameSize;
-    ALOGV("%s mOutputFormat %x, mBitsPerSample %d, kMaxFrameSize %d, ",
-          __func__, mOutputFormat, mBitsPerSample, kMaxFrameSize);
+    // Leave room for samples that are widened after reading them.
+    size_t maxBytesToRead = mBufferSize;
+    const size_t inputBytesPerSample = mBitsPerSample >> 3;
+    if (isPCM() && pcmBytesPerSample(mOutputFormat) > inputBytesPerSample) {
+        maxBytesToRead =
+            mBufferSize / pcmBytesPerSample(mOutputFormat) * inputBytesPerSample;
+    }
+    ALOGV("%s mOutputFormat %x, mBitsPerSample %d, mBufferSize %zu",
+          __func__, mOutputFormat, mBitsPerSample, mBufferSize);
 
     size_t maxBytesAvailable =
         (mCurrentPos - mOffset >= (off64_t)mSize)
@@ -507,67 +885,8 @@ status_t WAVSource::read(
 
     buffer->set_range(0, n);
 
-    if (mWaveFormat == WAVE_FORMAT_PCM || mWaveFormat == WAVE_FORMAT_EXTENSIBLE) {
-        if (mBitsPerSample == 8) {
-            // Convert 8-bit unsigned samples to 16-bit signed.
-
-            MediaBuffer *tmp;
-            CHECK_EQ(mGroup->acquire_buffer(&tmp), (status_t)OK);
-
-            // The new buffer holds the sample number of samples, but each
-            // one is 2 bytes wide.
-            tmp->set_range(0, 2 * n);
-
-            int16_t *dst = (int16_t *)tmp->data();
-            const uint8_t *src = (const uint8_t *)buffer->data();
-            ssize_t numBytes = n;
-
-            while (numBytes-- > 0) {
-                *dst++ = ((int16_t)(*src) - 128) * 256;
-                ++src;
-            }
-
-            buffer->release();
-            buffer = tmp;
-        } else if (mBitsPerSample == 24) {
-            if (AUDIO_FORMAT_PCM_16_BIT == mOutputFormat) {
-                // Convert 24-bit signed samples to 16-bit signed.
-
-                const uint8_t *src =
-                    (const uint8_t *)buffer->data() + buffer->range_offset();
-                int16_t *dst = (int16_t *)src;
-
-                size_t numSamples = buffer->range_length() / 3;
-                for (size_t i = 0; i < numSamples; ++i) {
-                    int32_t x = (int32_t)(src[0] | src[1] << 8 | src[2] << 16);
-                    x = (x << 8) >> 8;  // sign extension
-
-                    x = x >> 8;
-                    *dst++ = (int16_t)x;
-                    src += 3;
-                }
-                buffer->set_range(buffer->range_offset(), 2 * numSamples);
-            } else if (AUDIO_FORMAT_PCM_8_24_BIT == mOutputFormat) {
-                // Padding done here to convert to 32-bit samples
-                MediaBuffer *tmp;
-                CHECK_EQ(mGroup->acquire_buffer(&tmp), (status_t)OK);
-                ssize_t numBytes = buffer->range_length() / 3;
-                tmp->set_range(0, 4 * numBytes);
-                int8_t *dst = (int8_t *)tmp->data();
-                const uint8_t *src = (const uint8_t *)buffer->data();
-                ALOGV("numBytes = %d", numBytes);
-                while(numBytes-- > 0) {
-                   *dst++ = 0x0;
-                   *dst++ = src[0];
-                   *dst++ = src[1];
-                   *dst++ = src[2];
-                   src += 3;
-                }
-                buffer->release();
-                buffer = tmp;
-                ALOGV("length = %d", buffer->range_length());
-            }
-        }
+    if (isPCM()) {
+        convertSamples(buffer, n / inputBytesPerSample);
     }
 
     int64_t timeStampUs = 0;
@@ -27,23 +27,22 @@
 #include <media/stagefright/MediaErrors.h>
 #include <media/stagefright/MetaData.h>
 
-namespace android {
+#include <string.h>
 
-unsigned parseUE(ABitReader *br) {
-    unsigned numZeroes = 0;
-    while (br->getBits(1) == 0) {
-        ++numZeroes;
-    }
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
-    unsigned x = br->getBits(numZeroes);
+namespace android {
 
-    return x + (1u << numZeroes) - 1;
+unsigned parseUE(ABitReader *br) {
+    return br->getUE();
 }
 
 signed parseSE(ABitReader *br) {
-    unsigned codeNum = parseUE(br);
-
-    return (codeNum & 1) ? (codeNum + 1) / 2 : -(codeNum / 2);
+    return br->getSE();
 }
 
 static void skipScalingList(ABitReader *br, size_t sizeOfScalingList) {
@@ -216,6 +215,126 @@ void FindAVCDimensions(
     }
 }
 
+// Skips 16 byte blocks that can't contain the start of a start code,
+// stopping with fewer than 18 bytes left so the loads stay in bounds.
+static const uint8_t *SkipToStartCodeCandidate(
+        const uint8_t *ptr, const uint8_t *end) {
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    while (end - ptr >= 18) {
+        __m128i b0 = _mm_loadu_si128((const __m128i *)ptr);
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(ptr + 1));
+        __m128i b2 = _mm_loadu_si128((const __m128i *)(ptr + 2));
+        __m128i match = _mm_and_si128(
+                _mm_and_si128(
+                    _mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)),
+                _mm_cmpeq_epi8(b2, one));
+        if (_mm_movemask_epi8(match) != 0) {
+            break;
+        }
+        ptr += 16;
+    }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t one = vdupq_n_u8(1);
+    while (end - ptr >= 18) {
+        uint8x16_t match = vandq_u8(
+                vandq_u8(
+                    vceqq_u8(vld1q_u8(ptr), zero),
+                    vceqq_u8(vld1q_u8(ptr + 1), zero)),
+                vceqq_u8(vld1q_u8(ptr + 2), one));
+        uint64x2_t match64 = vreinterpretq_u64_u8(match);
+        if ((vgetq_lane_u64(match64, 0) | vgetq_lane_u64(match64, 1)) != 0) {
+            break;
+        }
+        ptr += 16;
+    }
+#else
+    (void)end;
+#endif
+    return ptr;
+}
+
+const uint8_t *FindStartCode(const uint8_t *data, size_t size) {
+    const uint8_t *end = data + size;
+    const uint8_t *ptr = SkipToStartCodeCandidate(data, end);
+
+    // Look at the last byte of each candidate: anything above 0x01 rules
+    // out the three start codes it could belong to, a 0x01 that isn't
+    // preceded by two zeros rules out three as well.
+    for (ptr += 2; ptr < end;) {
+        if (*ptr > 0x01) {
+            ptr += 3;
+        } else if (*ptr == 0x00) {
+            ++ptr;
+        } else if (ptr[-1] == 0x00 && ptr[-2] == 0x00) {
+            return ptr - 2;
+        } else {
+            ptr += 3;
+        }
+    }
+
+    return NULL;
+}
+
+// Like SkipToStartCodeCandidate, for a 0xff byte followed by one with all
+// of the bits in "mask" set.
+static const uint8_t *SkipToSyncWordCandidate(
+        const uint8_t *ptr, const uint8_t *end, uint8_t mask) {
+#if defined(__SSE2__)
+    const __m128i ff = _mm_set1_epi8((char)0xff);
+    const __m128i bits = _mm_set1_epi8((char)mask);
+    while (end - ptr >= 17) {
+        __m128i b0 = _mm_loadu_si128((const __m128i *)ptr);
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(ptr + 1));
+        __m128i match = _mm_and_si128(
+                _mm_cmpeq_epi8(b0, ff),
+                _mm_cmpeq_epi8(_mm_and_si128(b1, bits), bits));
+        if (_mm_movemask_epi8(match) != 0) {
+            break;
+        }
+        ptr += 16;
+    }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    const uint8x16_t ff = vdupq_n_u8(0xff);
+    const uint8x16_t bits = vdupq_n_u8(mask);
+    while (end - ptr >= 17) {
+        uint8x16_t match = vandq_u8(
+                vceqq_u8(vld1q_u8(ptr), ff),
+                vceqq_u8(vandq_u8(vld1q_u8(ptr + 1), bits), bits));
+        uint64x2_t match64 = vreinterpretq_u64_u8(match);
+        if ((vgetq_lane_u64(match64, 0) | vgetq_lane_u64(match64, 1)) != 0) {
+            break;
+        }
+        ptr += 16;
+    }
+#else
+    (void)end;
+    (void)mask;
+#endif
+    return ptr;
+}
+
+const uint8_t *FindSyncWord(const uint8_t *data, size_t size, uint8_t mask) {
+    const uint8_t *end = data + size;
+    const uint8_t *ptr = SkipToSyncWordCandidate(data, end, mask);
+
+    while (end - ptr >= 2) {
+        ptr = (const uint8_t *)memchr(ptr, 0xff, end - ptr - 1);
+        if (ptr == NULL) {
+            break;
+        }
+
+        if ((ptr[1] & mask) == mask) {
+            return ptr;
+        }
+        ++ptr;
+    }
+
+    return NULL;
+}
+
 status_t getNextNALUnit(
         const uint8_t **_data, size_t *_size,
         const uint8_t **nalStart, size_t *nalSize,
@@ -230,43 +349,26 @@ status_t getNextNALUnit(
         return -EAGAIN;
     }
 
-    size_t offset = 0;
-
     // A valid startcode consists of at least two 0x00 bytes followed by 0x01.
-    for (; offset + 2 < size; ++offset) {
-        if (data[offset + 2] == 0x01 && data[offset] == 0x00
-                && data[offset + 1] == 0x00) {
-            break;
-        }
-    }
-    if (offset + 2 >= size) {
-        *_data = &data[offset];
+    const uint8_t *startCode = FindStartCode(data, size);
+    if (startCode == NULL) {
+        *_data = &data[size - 2];
         *_size = 2;
         return -EAGAIN;
     }
-    offset += 3;
 
-    size_t startOffset = offset;
-
-    for (;;) {
-        while (offset < size && data[offset] != 0x01) {
-            ++offset;
-        }
+    size_t startOffset = startCode - data + 3;
 
-        if (offset == size) {
-            if (startCodeFollows) {
-                offset = size + 2;
-                break;
-            }
-
-            return -EAGAIN;
-        }
-
-        if (data[offset - 1] == 0x00 && data[offset - 2] == 0x00) {
-            break;
-        }
-
-        ++offset;
+    // "offset" is the position of the 0x01 byte terminating the next
+    // start code.
+    size_t offset;
+    startCode = FindStartCode(&data[startOffset], size - startOffset);
+    if (startCode != NULL) {
+        offset = startCode - data + 2;
+    } else if (startCodeFollows) {
+        offset = size + 2;
+    } else {
+        return -EAGAIN;
     }
 
     size_t endOffset = offset - 2;
@@ -33,9 +33,26 @@ ABitReader::~ABitReader() {
 void ABitReader::fillReservoir() {
     CHECK_GT(mSize, 0u);
 
+    if (mSize >= 8) {
+        // Refill a whole big-endian word at once.
+        mReservoir = ((uint64_t)mData[0] << 56)
+            | ((uint64_t)mData[1] << 48)
+            | ((uint64_t)mData[2] << 40)
+            | ((uint64_t)mData[3] << 32)
+            | ((uint64_t)mData[4] << 24)
+            | ((uint64_t)mData[5] << 16)
+            | ((uint64_t)mData[6] << 8)
+            | (uint64_t)mData[7];
+
+        mData += 8;
+        mSize -= 8;
+        mNumBitsLeft = 64;
+        return;
+    }
+
     mReservoir = 0;
     size_t i;
-    for (i = 0; mSize > 0 && i < 4; ++i) {
+    for (i = 0; mSize > 0 && i < 8; ++i) {
         mReservoir = (mReservoir << 8) | *mData;
 
         ++mData;
@@ -43,10 +60,10 @@ void ABitReader::fillReservoir() {
     }
 
     mNumBitsLeft = 8 * i;
-    mReservoir <<= 32 - mNumBitsLeft;
+    mReservoir <<= 64 - mNumBitsLeft;
 }
 
-uint32_t ABitReader::getBits(size_t n) {
+uint32_t ABitReader::getBitsSlow(size_t n) {
     CHECK_LE(n, 32u);
 
     uint32_t result = 0;
@@ -60,7 +77,7 @@ uint32_t ABitReader::getBits(size_t n) {
             m = mNumBitsLeft;
         }
 
-        result = (result << m) | (mReservoir >> (32 - m));
+        result = (result << m) | (uint32_t)(mReservoir >> (64 - m));
         mReservoir <<= m;
         mNumBitsLeft -= m;
 
@@ -70,7 +87,7 @@ uint32_t ABitReader::getBits(size_t n) {
     return result;
 }
 
-void ABitReader::skipBits(size_t n) {
+void ABitReader::skipBitsSlow(size_t n) {
     while (n > 32) {
         getBits(32);
         n -= 32;
@@ -81,16 +98,53 @@ void ABitReader::skipBits(size_t n) {
     }
 }
 
+uint32_t ABitReader::getUE() {
+    if (mReservoir != 0) {
+        // Fast path: leading zeros, marker bit and suffix are all buffered.
+        size_t numZeros = __builtin_clzll(mReservoir);
+        size_t codeLength = 2 * numZeros + 1;
+
+        if (numZeros < 32 && codeLength <= mNumBitsLeft) {
+            uint64_t code = mReservoir >> (64 - codeLength);
+            mReservoir <<= codeLength;
+            mNumBitsLeft -= codeLength;
+
+            return (uint32_t)(code - 1);
+        }
+    }
+
+    size_t numZeros = 0;
+    while (getBits(1) == 0) {
+        ++numZeros;
+    }
+
+    CHECK_LT(numZeros, 32u);
+
+    uint32_t x = getBits(numZeros);
+
+    return x + (1u << numZeros) - 1;
+}
+
+int32_t ABitReader::getSE() {
+    uint32_t codeNum = getUE();
+
+    return (codeNum & 1) ? (int32_t)((codeNum + 1) / 2) : -(int32_t)(codeNum / 2);
+}
+
 void ABitReader::putBits(uint32_t x, size_t n) {
     CHECK_LE(n, 32u);
 
-    while (mNumBitsLeft + n > 32) {
+    if (n == 0) {
+        return;
+    }
+
+    while (mNumBitsLeft + n > 64) {
         mNumBitsLeft -= 8;
         --mData;
         ++mSize;
     }
 
-    mReservoir = (mReservoir >> n) | (x << (32 - n));
+    mReservoir = (mReservoir >> n) | ((uint64_t)x << (64 - n));
     mNumBitsLeft += n;
 }
 
@@ -144,7 +198,7 @@ void NALBitReader::fillReservoir() {
 
     mReservoir = 0;
     size_t i = 0;
-    while (mSize > 0 && i < 4) {
+    while (mSize > 0 && i < 8) {
         bool isEmulationPreventionByte = (mNumZeros >= 2 && *mData == 3);
 
         if (*mData == 0) {
@@ -164,7 +218,9 @@ void NALBitReader::fillReservoir() {
     }
 
     mNumBitsLeft = 8 * i;
-    mReservoir <<= 32 - mNumBitsLeft;
+    if (mNumBitsLeft > 0) {
+        mReservoir <<= 64 - mNumBitsLeft;
+    }
 }
 
 }  // namespace android
@@ -51,6 +51,18 @@ sp<ABuffer> ABuffer::CreateAsCopy(const void *data, size_t capacity)
     return res;
 }
 
+// static
+sp<ABuffer> ABuffer::CreateAsSlice(
+        const sp<ABuffer> &parent, size_t offset, size_t size) {
+    CHECK(parent != NULL);
+    CHECK_LE(offset, parent->size());
+    CHECK_LE(size, parent->size() - offset);
+
+    sp<ABuffer> res = new ABuffer(parent->data() + offset, size);
+    res->mParent = parent;
+    return res;
+}
+
 ABuffer::~ABuffer() {
     if (mOwnsData) {
         if (mData != NULL) {
@@ -74,6 +86,21 @@ void ABuffer::setRange(size_t offset, size_t size) {
     mRangeLength = size;
 }
 
+void ABuffer::reset() {
+    // The previous user is done with the buffer, say goodbye on its behalf
+    // just as if it had been destroyed.
+    if (mFarewell != NULL) {
+        mFarewell->post();
+        mFarewell.clear();
+    }
+
+    mRangeOffset = 0;
+    mRangeLength = mCapacity;
+    mInt32Data = 0;
+    mMeta.clear();
+    setMediaBufferBase(NULL);
+}
+
 void ABuffer::setFarewellMessage(const sp<AMessage> msg) {
     mFarewell = msg;
 }
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ABufferPool"
+#include <utils/Log.h>
+
+#include "ABufferPool.h"
+
+#include "ABuffer.h"
+#include "ADebug.h"
+
+namespace android {
+
+ABufferPool::ABufferPool(
+        size_t minCapacity, size_t maxCapacity, size_t maxBuffersPerClass)
+    : mMinCapacity(minCapacity),
+      mMaxCapacity(maxCapacity),
+      mMaxBuffersPerClass(maxBuffersPerClass) {
+    CHECK_GT(mMinCapacity, 0u);
+    CHECK_LE(mMinCapacity, mMaxCapacity);
+
+    size_t numClasses = classIndex(mMaxCapacity) + 1;
+    for (size_t i = 0; i < numClasses; ++i) {
+        mClasses.push(Vector<sp<ABuffer> >());
+    }
+}
+
+ABufferPool::~ABufferPool() {
+}
+
+size_t ABufferPool::classIndex(size_t capacity) const {
+    size_t index = 0;
+    size_t classCapacity = mMinCapacity;
+    while (classCapacity < capacity) {
+        classCapacity <<= 1;
+        ++index;
+    }
+    return index;
+}
+
+sp<ABuffer> ABufferPool::acquire(size_t capacity) {
+    if (capacity > mMaxCapacity) {
+        return new ABuffer(capacity);
+    }
+
+    size_t index = classIndex(capacity);
+    size_t classCapacity = mMinCapacity << index;
+    if (classCapacity > mMaxCapacity) {
+        classCapacity = mMaxCapacity;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+
+    Vector<sp<ABuffer> > &buffers = mClasses.editItemAt(index);
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        const sp<ABuffer> &buffer = buffers.itemAt(i);
+
+        // The pool's own reference is the only one left, nobody else can
+        // obtain a new one without going through us.
+        if (buffer->getStrongCount() == 1) {
+            buffer->reset();
+            buffer->setRange(0, capacity);
+            return buffer;
+        }
+    }
+
+    sp<ABuffer> buffer = new ABuffer(classCapacity);
+    buffer->setRange(0, capacity);
+
+    if (buffers.size() < mMaxBuffersPerClass) {
+        buffers.push(buffer);
+    } else {
+        ALOGV("size class %zu exhausted, allocating unpooled buffer",
+              classCapacity);
+    }
+
+    return buffer;
+}
+
+void ABufferPool::trim() {
+    Mutex::Autolock autoLock(mLock);
+
+    for (size_t i = 0; i < mClasses.size(); ++i) {
+        Vector<sp<ABuffer> > &buffers = mClasses.editItemAt(i);
+
+        size_t j = 0;
+        while (j < buffers.size()) {
+            if (buffers.itemAt(j)->getStrongCount() == 1) {
+                buffers.removeAt(j);
+            } else {
+                ++j;
+            }
+        }
+    }
+}
+
+}  // namespace android
@@ -27,6 +27,7 @@
 #include <net/if.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 
@@ -52,6 +53,14 @@ static uint64_t U64_AT(const uint8_t *ptr) {
 static const size_t kMaxUDPSize = 1500;
 static const int32_t kMaxUDPRetries = 200;
 
+// Number of datagrams moved per recvmmsg/sendmmsg call.
+static const size_t kMaxUDPBatchSize = 16;
+
+static const size_t kMaxEpollEvents = 32;
+
+// Session IDs start at 1, the wakeup pipe is registered under this ID.
+static const int32_t kPipeSessionID = 0;
+
 struct ANetworkSession::NetworkThread : public Thread {
     NetworkThread(ANetworkSession *session);
 
@@ -96,6 +105,11 @@ struct ANetworkSession::Session : public RefBase {
     bool wantsToRead();
     bool wantsToWrite();
 
+    // Events currently registered with the epoll instance, 0 if the socket
+    // is not registered at all.
+    uint32_t epollEvents() const;
+    void setEpollEvents(uint32_t events);
+
     status_t readMore();
     status_t writeMore();
 
@@ -126,9 +140,14 @@ private:
     sp<AMessage> mNotify;
     bool mSawReceiveFailure, mSawSendFailure;
     int32_t mUDPRetries;
+    uint32_t mEpollEvents;
 
     List<Fragment> mOutFragments;
 
+    // Receive buffers for the next recvmmsg call, buffers handed out to
+    // clients are replaced lazily.
+    sp<ABuffer> mReceiveBuffers[kMaxUDPBatchSize];
+
     AString mInBuffer;
 
     int64_t mLastStallReportUs;
@@ -170,6 +189,7 @@ ANetworkSession::Session::Session(
       mSawReceiveFailure(false),
       mSawSendFailure(false),
       mUDPRetries(kMaxUDPRetries),
+      mEpollEvents(0),
       mLastStallReportUs(-1ll) {
     if (mState == CONNECTED) {
         struct sockaddr_in localAddr;
@@ -265,22 +285,42 @@ bool ANetworkSession::Session::wantsToWrite() {
             || (mState == DATAGRAM && !mOutFragments.empty()));
 }
 
+uint32_t ANetworkSession::Session::epollEvents() const {
+    return mEpollEvents;
+}
+
+void ANetworkSession::Session::setEpollEvents(uint32_t events) {
+    mEpollEvents = events;
+}
+
 status_t ANetworkSession::Session::readMore() {
     if (mState == DATAGRAM) {
         CHECK_EQ(mMode, MODE_DATAGRAM);
 
         status_t err;
         do {
-            sp<ABuffer> buf = new ABuffer(kMaxUDPSize);
+            struct mmsghdr msgs[kMaxUDPBatchSize];
+            struct iovec iovs[kMaxUDPBatchSize];
+            struct sockaddr_in remoteAddrs[kMaxUDPBatchSize];
+
+            memset(msgs, 0, sizeof(msgs));
+            for (size_t i = 0; i < kMaxUDPBatchSize; ++i) {
+                if (mReceiveBuffers[i] == NULL) {
+                    mReceiveBuffers[i] = new ABuffer(kMaxUDPSize);
+                }
 
-            struct sockaddr_in remoteAddr;
-            socklen_t remoteAddrLen = sizeof(remoteAddr);
+                iovs[i].iov_base = mReceiveBuffers[i]->base();
+                iovs[i].iov_len = mReceiveBuffers[i]->capacity();
 
-            ssize_t n;
+                msgs[i].msg_hdr.msg_name = &remoteAddrs[i];
+                msgs[i].msg_hdr.msg_namelen = sizeof(remoteAddrs[i]);
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+
+            int n;
             do {
-                n = recvfrom(
-                        mSocket, buf->data(), buf->capacity(), 0,
-                        (struct sockaddr *)&remoteAddr, &remoteAddrLen);
+                n = recvmmsg(mSocket, msgs, kMaxUDPBatchSize, 0, NULL);
             } while (n < 0 && errno == EINTR);
 
             err = OK;
@@ -288,16 +328,27 @@ status_t ANetworkSession::Session::readMore() {
                 err = -errno;
             } else if (n == 0) {
                 err = -ECONNRESET;
-            } else {
-                buf->setRange(0, n);
+            }
 
-                int64_t nowUs = ALooper::GetNowUs();
+            int64_t nowUs = ALooper::GetNowUs();
+
+            for (int i = 0; i < n && err == OK; ++i) {
+                if (msgs[i].msg_len == 0) {
+                    err = -ECONNRESET;
+                    break;
+                }
+
+                sp<ABuffer> buf = mReceiveBuffers[i];
+                mReceiveBuffers[i].clear();
+
+                buf->setRange(0, msgs[i].msg_len);
                 buf->meta()->setInt64("arrivalTimeUs", nowUs);
 
                 sp<AMessage> notify = mNotify->dup();
                 notify->setInt32("sessionID", mSessionID);
                 notify->setInt32("reason", kWhatDatagram);
 
+                const struct sockaddr_in &remoteAddr = remoteAddrs[i];
                 uint32_t ip = ntohl(remoteAddr.sin_addr.s_addr);
                 notify->setString(
                         "fromAddr",
@@ -554,22 +605,39 @@ status_t ANetworkSession::Session::writeMore() {
 
         status_t err;
         do {
-            const Fragment &frag = *mOutFragments.begin();
-            const sp<ABuffer> &datagram = frag.mBuffer;
+            struct mmsghdr msgs[kMaxUDPBatchSize];
+            struct iovec iovs[kMaxUDPBatchSize];
+
+            memset(msgs, 0, sizeof(msgs));
+
+            size_t count = 0;
+            for (List<Fragment>::iterator it = mOutFragments.begin();
+                    it != mOutFragments.end() && count < kMaxUDPBatchSize;
+                    ++it, ++count) {
+                iovs[count].iov_base = (*it).mBuffer->data();
+                iovs[count].iov_len = (*it).mBuffer->size();
+
+                msgs[count].msg_hdr.msg_iov = &iovs[count];
+                msgs[count].msg_hdr.msg_iovlen = 1;
+            }
 
             int n;
             do {
-                n = send(mSocket, datagram->data(), datagram->size(), 0);
+                n = sendmmsg(mSocket, msgs, count, 0);
             } while (n < 0 && errno == EINTR);
 
             err = OK;
 
             if (n > 0) {
-                if (frag.mFlags & FRAGMENT_FLAG_TIME_VALID) {
-                    dumpFragmentStats(frag);
-                }
+                for (int i = 0; i < n; ++i) {
+                    const Fragment &frag = *mOutFragments.begin();
 
-                mOutFragments.erase(mOutFragments.begin());
+                    if (frag.mFlags & FRAGMENT_FLAG_TIME_VALID) {
+                        dumpFragmentStats(frag);
+                    }
+
+                    mOutFragments.erase(mOutFragments.begin());
+                }
             } else if (n < 0) {
                 err = -errno;
             } else if (n == 0) {
@@ -798,7 +866,8 @@ void ANetworkSession::Session::notify(NotificationReason reason) {
 ////////////////////////////////////////////////////////////////////////////////
 
 ANetworkSession::ANetworkSession()
-    : mNextSessionID(1) {
+    : mNextSessionID(1),
+      mEpollFd(-1) {
     mPipeFd[0] = mPipeFd[1] = -1;
 }
 
@@ -817,6 +886,32 @@ status_t ANetworkSession::start() {
         return -errno;
     }
 
+    mEpollFd = epoll_create(kMaxEpollEvents);
+    if (mEpollFd < 0) {
+        status_t err = -errno;
+
+        close(mPipeFd[0]);
+        close(mPipeFd[1]);
+        mPipeFd[0] = mPipeFd[1] = -1;
+
+        return err;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = kPipeSessionID;
+    CHECK_EQ(epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mPipeFd[0], &event), 0);
+
+    {
+        Mutex::Autolock autoLock(mLock);
+
+        // Pick up sessions that were created before we were started.
+        for (size_t i = 0; i < mSessions.size(); ++i) {
+            updateSessionEvents_l(mSessions.valueAt(i));
+        }
+    }
+
     mThread = new NetworkThread(this);
 
     status_t err = mThread->run("ANetworkSession", ANDROID_PRIORITY_AUDIO);
@@ -824,6 +919,9 @@ status_t ANetworkSession::start() {
     if (err != OK) {
         mThread.clear();
 
+        close(mEpollFd);
+        mEpollFd = -1;
+
         close(mPipeFd[0]);
         close(mPipeFd[1]);
         mPipeFd[0] = mPipeFd[1] = -1;
@@ -845,6 +943,19 @@ status_t ANetworkSession::stop() {
 
     mThread.clear();
 
+    {
+        Mutex::Autolock autoLock(mLock);
+
+        // The epoll instance goes away, sessions must register anew if
+        // we are restarted.
+        for (size_t i = 0; i < mSessions.size(); ++i) {
+            mSessions.valueAt(i)->setEpollEvents(0);
+        }
+
+        close(mEpollFd);
+        mEpollFd = -1;
+    }
+
     close(mPipeFd[0]);
     close(mPipeFd[1]);
     mPipeFd[0] = mPipeFd[1] = -1;
@@ -937,6 +1048,7 @@ status_t ANetworkSession::destroySession(int32_t sessionID) {
         return -ENOENT;
     }
 
+    unregisterSession_l(mSessions.valueAt(index));
     mSessions.removeItemsAt(index);
 
     interrupt();
@@ -1149,6 +1261,7 @@ status_t ANetworkSession::createClientOrServer(
     }
 
     mSessions.add(session->sessionID(), session);
+    updateSessionEvents_l(session);
 
     interrupt();
 
@@ -1216,6 +1329,7 @@ status_t ANetworkSession::sendRequest(
     const sp<Session> session = mSessions.valueAt(index);
 
     status_t err = session->sendRequest(data, size, timeValid, timeUs);
+    updateSessionEvents_l(session);
 
     interrupt();
 
@@ -1248,43 +1362,63 @@ void ANetworkSession::interrupt() {
     }
 }
 
-void ANetworkSession::threadLoop() {
-    fd_set rs, ws;
-    FD_ZERO(&rs);
-    FD_ZERO(&ws);
-
-    FD_SET(mPipeFd[0], &rs);
-    int maxFd = mPipeFd[0];
+void ANetworkSession::updateSessionEvents_l(const sp<Session> &session) {
+    if (mEpollFd < 0 || session->socket() < 0) {
+        return;
+    }
 
-    {
-        Mutex::Autolock autoLock(mLock);
+    uint32_t events = 0;
+    if (session->wantsToRead()) {
+        events |= EPOLLIN;
+    }
+    if (session->wantsToWrite()) {
+        events |= EPOLLOUT;
+    }
 
-        for (size_t i = 0; i < mSessions.size(); ++i) {
-            const sp<Session> &session = mSessions.valueAt(i);
+    uint32_t oldEvents = session->epollEvents();
+    if (events == oldEvents) {
+        return;
+    }
 
-            int s = session->socket();
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.u32 = session->sessionID();
+
+    int res;
+    if (events == 0) {
+        // EPOLLERR and EPOLLHUP cannot be masked, a socket nobody is
+        // interested in must leave the set or it would keep waking us up.
+        res = epoll_ctl(mEpollFd, EPOLL_CTL_DEL, session->socket(), &event);
+    } else if (oldEvents == 0) {
+        res = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, session->socket(), &event);
+    } else {
+        res = epoll_ctl(mEpollFd, EPOLL_CTL_MOD, session->socket(), &event);
+    }
 
-            if (s < 0) {
-                continue;
-            }
+    if (res < 0) {
+        ALOGE("epoll_ctl on socket %d failed w/ error %d (%s)",
+              session->socket(), errno, strerror(errno));
+        return;
+    }
 
-            if (session->wantsToRead()) {
-                FD_SET(s, &rs);
-                if (s > maxFd) {
-                    maxFd = s;
-                }
-            }
+    session->setEpollEvents(events);
+}
 
-            if (session->wantsToWrite()) {
-                FD_SET(s, &ws);
-                if (s > maxFd) {
-                    maxFd = s;
-                }
-            }
-        }
+void ANetworkSession::unregisterSession_l(const sp<Session> &session) {
+    if (mEpollFd >= 0 && session->epollEvents() != 0) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, session->socket(), &event);
     }
 
-    int res = select(maxFd + 1, &rs, &ws, NULL, NULL /* tv */);
+    session->setEpollEvents(0);
+}
+
+void ANetworkSession::threadLoop() {
+    struct epoll_event events[kMaxEpollEvents];
+
+    int res = epoll_wait(mEpollFd, events, kMaxEpollEvents, -1 /* timeout */);
 
     if (res == 0) {
         return;
@@ -1295,116 +1429,126 @@ void ANetworkSession::threadLoop() {
             return;
         }
 
-        ALOGE("select failed w/ error %d (%s)", errno, strerror(errno));
+        ALOGE("epoll_wait failed w/ error %d (%s)", errno, strerror(errno));
         return;
     }
 
-    if (FD_ISSET(mPipeFd[0], &rs)) {
-        char c;
-        ssize_t n;
-        do {
-            n = read(mPipeFd[0], &c, 1);
-        } while (n < 0 && errno == EINTR);
+    Mutex::Autolock autoLock(mLock);
+
+    List<sp<Session> > sessionsToAdd;
+
+    for (int i = 0; i < res; ++i) {
+        int32_t sessionID = events[i].data.u32;
+
+        if (sessionID == kPipeSessionID) {
+            char buffer[64];
+            ssize_t n;
+            do {
+                n = read(mPipeFd[0], buffer, sizeof(buffer));
+            } while (n < 0 && errno == EINTR);
+
+            if (n < 0) {
+                ALOGW("Error reading from pipe (%s)", strerror(errno));
+            }
 
-        if (n < 0) {
-            ALOGW("Error reading from pipe (%s)", strerror(errno));
+            continue;
         }
 
-        --res;
-    }
+        ssize_t index = mSessions.indexOfKey(sessionID);
 
-    {
-        Mutex::Autolock autoLock(mLock);
+        if (index < 0) {
+            // Destroyed since epoll_wait returned.
+            continue;
+        }
 
-        List<sp<Session> > sessionsToAdd;
+        sp<Session> session = mSessions.valueAt(index);
 
-        for (size_t i = mSessions.size(); res > 0 && i-- > 0;) {
-            const sp<Session> &session = mSessions.valueAt(i);
+        int s = session->socket();
 
-            int s = session->socket();
+        if (s < 0) {
+            continue;
+        }
 
-            if (s < 0) {
-                continue;
-            }
+        uint32_t ready = events[i].events;
 
-            if (FD_ISSET(s, &rs) || FD_ISSET(s, &ws)) {
-                --res;
-            }
+        if ((ready & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                && session->wantsToRead()) {
+            if (session->isRTSPServer() || session->isTCPDatagramServer()) {
+                struct sockaddr_in remoteAddr;
+                socklen_t remoteAddrLen = sizeof(remoteAddr);
 
-            if (FD_ISSET(s, &rs)) {
-                if (session->isRTSPServer() || session->isTCPDatagramServer()) {
-                    struct sockaddr_in remoteAddr;
-                    socklen_t remoteAddrLen = sizeof(remoteAddr);
-
-                    int clientSocket = accept(
-                            s, (struct sockaddr *)&remoteAddr, &remoteAddrLen);
-
-                    if (clientSocket >= 0) {
-                        status_t err = MakeSocketNonBlocking(clientSocket);
-
-                        if (err != OK) {
-                            ALOGE("Unable to make client socket non blocking, "
-                                  "failed w/ error %d (%s)",
-                                  err, strerror(-err));
-
-                            close(clientSocket);
-                            clientSocket = -1;
-                        } else {
-                            in_addr_t addr = ntohl(remoteAddr.sin_addr.s_addr);
-
-                            ALOGI("incoming connection from %d.%d.%d.%d:%d "
-                                  "(socket %d)",
-                                  (addr >> 24),
-                                  (addr >> 16) & 0xff,
-                                  (addr >> 8) & 0xff,
-                                  addr & 0xff,
-                                  ntohs(remoteAddr.sin_port),
-                                  clientSocket);
-
-                            sp<Session> clientSession =
-                                new Session(
-                                        mNextSessionID++,
-                                        Session::CONNECTED,
-                                        clientSocket,
-                                        session->getNotificationMessage());
-
-                            clientSession->setMode(
-                                    session->isRTSPServer()
-                                        ? Session::MODE_RTSP
-                                        : Session::MODE_DATAGRAM);
-
-                            sessionsToAdd.push_back(clientSession);
-                        }
+                int clientSocket = accept(
+                        s, (struct sockaddr *)&remoteAddr, &remoteAddrLen);
+
+                if (clientSocket >= 0) {
+                    status_t err = MakeSocketNonBlocking(clientSocket);
+
+                    if (err != OK) {
+                        ALOGE("Unable to make client socket non blocking, "
+                              "failed w/ error %d (%s)",
+                              err, strerror(-err));
+
+                        close(clientSocket);
+                        clientSocket = -1;
                     } else {
-                        ALOGE("accept returned error %d (%s)",
-                              errno, strerror(errno));
+                        in_addr_t addr = ntohl(remoteAddr.sin_addr.s_addr);
+
+                        ALOGI("incoming connection from %d.%d.%d.%d:%d "
+                              "(socket %d)",
+                              (addr >> 24),
+                              (addr >> 16) & 0xff,
+                              (addr >> 8) & 0xff,
+                              addr & 0xff,
+                              ntohs(remoteAddr.sin_port),
+                              clientSocket);
+
+                        sp<Session> clientSession =
+                            new Session(
+                                    mNextSessionID++,
+                                    Session::CONNECTED,
+                                    clientSocket,
+                                    session->getNotificationMessage());
+
+                        clientSession->setMode(
+                                session->isRTSPServer()
+                                    ? Session::MODE_RTSP
+                                    : Session::MODE_DATAGRAM);
+
+                        sessionsToAdd.push_back(clientSession);
                     }
                 } else {
-                    status_t err = session->readMore();
-                    if (err != OK) {
-                        ALOGE("readMore on socket %d failed w/ error %d (%s)",
-                              s, err, strerror(-err));
-                    }
+                    ALOGE("accept returned error %d (%s)",
+                          errno, strerror(errno));
                 }
-            }
-
-            if (FD_ISSET(s, &ws)) {
-                status_t err = session->writeMore();
+            } else {
+                status_t err = session->readMore();
                 if (err != OK) {
-                    ALOGE("writeMore on socket %d failed w/ error %d (%s)",
+                    ALOGE("readMore on socket %d failed w/ error %d (%s)",
                           s, err, strerror(-err));
                 }
             }
         }
 
-        while (!sessionsToAdd.empty()) {
-            sp<Session> session = *sessionsToAdd.begin();
-            sessionsToAdd.erase(sessionsToAdd.begin());
+        if ((ready & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+                && session->wantsToWrite()) {
+            status_t err = session->writeMore();
+            if (err != OK) {
+                ALOGE("writeMore on socket %d failed w/ error %d (%s)",
+                      s, err, strerror(-err));
+            }
+        }
 
-            mSessions.add(session->sessionID(), session);
+        updateSessionEvents_l(session);
+    }
 
-            ALOGI("added clientSession %d", session->sessionID());
-        }
+    while (!sessionsToAdd.empty()) {
+        sp<Session> session = *sessionsToAdd.begin();
+        sessionsToAdd.erase(sessionsToAdd.begin());
+
+        mSessions.add(session->sessionID(), session);
+        updateSessionEvents_l(session);
+
+        ALOGI("added clientSession %d", session->sessionID());
     }
 }
 
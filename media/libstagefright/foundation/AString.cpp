@@ -27,47 +27,50 @@
 
 namespace android {
 
-// static
-const char *AString::kEmptyString = "";
-
 AString::AString()
-    : mData((char *)kEmptyString),
+    : mData(mInline),
       mSize(0),
-      mAllocSize(1) {
+      mAllocSize(kInlineSize) {
+    mInline[0] = '\0';
 }
 
 AString::AString(const char *s)
-    : mData(NULL),
+    : mData(mInline),
       mSize(0),
-      mAllocSize(1) {
+      mAllocSize(kInlineSize) {
+    mInline[0] = '\0';
     setTo(s);
 }
 
 AString::AString(const char *s, size_t size)
-    : mData(NULL),
+    : mData(mInline),
       mSize(0),
-      mAllocSize(1) {
+      mAllocSize(kInlineSize) {
+    mInline[0] = '\0';
     setTo(s, size);
 }
 
 AString::AString(const String8 &from)
-    : mData(NULL),
+    : mData(mInline),
       mSize(0),
-      mAllocSize(1) {
+      mAllocSize(kInlineSize) {
+    mInline[0] = '\0';
     setTo(from.string(), from.length());
 }
 
 AString::AString(const AString &from)
-    : mData(NULL),
+    : mData(mInline),
       mSize(0),
-      mAllocSize(1) {
+      mAllocSize(kInlineSize) {
+    mInline[0] = '\0';
     setTo(from, 0, from.size());
 }
 
 AString::AString(const AString &from, size_t offset, size_t n)
-    : mData(NULL),
+    : mData(mInline),
       mSize(0),
-      mAllocSize(1) {
+      mAllocSize(kInlineSize) {
+    mInline[0] = '\0';
     setTo(from, offset, n);
 }
 
@@ -83,6 +86,55 @@ AString &AString::operator=(const AString &from) {
     return *this;
 }
 
+#if __cplusplus >= 201103L
+AString::AString(AString &&from)
+    : mData(mInline),
+      mSize(0),
+      mAllocSize(kInlineSize) {
+    mInline[0] = '\0';
+    moveFrom(from);
+}
+
+AString &AString::operator=(AString &&from) {
+    if (&from != this) {
+        clear();
+        moveFrom(from);
+    }
+
+    return *this;
+}
+#endif
+
+void AString::moveFrom(AString &from) {
+    CHECK(isInline() && mSize == 0);
+
+    if (from.isInline()) {
+        memcpy(mInline, from.mInline, from.mSize + 1);
+    } else {
+        mData = from.mData;
+        mAllocSize = from.mAllocSize;
+
+        from.mData = from.mInline;
+        from.mAllocSize = kInlineSize;
+    }
+
+    mSize = from.mSize;
+
+    from.mSize = 0;
+    from.mInline[0] = '\0';
+}
+
+void AString::swap(AString &other) {
+    if (&other == this) {
+        return;
+    }
+
+    AString tmp;
+    tmp.moveFrom(*this);
+    moveFrom(other);
+    other.moveFrom(tmp);
+}
+
 size_t AString::size() const {
     return mSize;
 }
@@ -112,14 +164,14 @@ void AString::setTo(const AString &from, size_t offset, size_t n) {
 }
 
 void AString::clear() {
-    if (mData && mData != kEmptyString) {
+    if (!isInline()) {
         free(mData);
-        mData = NULL;
     }
 
-    mData = (char *)kEmptyString;
+    mData = mInline;
+    mData[0] = '\0';
     mSize = 0;
-    mAllocSize = 1;
+    mAllocSize = kInlineSize;
 }
 
 size_t AString::hash() const {
@@ -136,8 +188,6 @@ bool AString::operator==(const AString &other) const {
 }
 
 void AString::trim() {
-    makeMutable();
-
     size_t i = 0;
     while (i < mSize && isspace(mData[i])) {
         ++i;
@@ -157,17 +207,27 @@ void AString::erase(size_t start, size_t n) {
     CHECK_LT(start, mSize);
     CHECK_LE(start + n, mSize);
 
-    makeMutable();
-
     memmove(&mData[start], &mData[start + n], mSize - start - n);
     mSize -= n;
     mData[mSize] = '\0';
 }
 
-void AString::makeMutable() {
-    if (mData == kEmptyString) {
-        mData = strdup(kEmptyString);
+void AString::reserve(size_t allocSize) {
+    if (allocSize <= mAllocSize) {
+        return;
+    }
+
+    if (isInline()) {
+        char *data = (char *)malloc(allocSize);
+        CHECK(data != NULL);
+        memcpy(data, mInline, mSize + 1);
+        mData = data;
+    } else {
+        mData = (char *)realloc(mData, allocSize);
+        CHECK(mData != NULL);
     }
+
+    mAllocSize = allocSize;
 }
 
 void AString::append(const char *s) {
@@ -175,12 +235,8 @@ void AString::append(const char *s) {
 }
 
 void AString::append(const char *s, size_t size) {
-    makeMutable();
-
     if (mSize + size + 1 > mAllocSize) {
-        mAllocSize = (mAllocSize + size + 31) & -32;
-        mData = (char *)realloc(mData, mAllocSize);
-        CHECK(mData != NULL);
+        reserve((mAllocSize + size + 31) & -32);
     }
 
     memcpy(&mData[mSize], s, size);
@@ -279,12 +335,8 @@ void AString::insert(const char *from, size_t size, size_t insertionPos) {
     CHECK_GE(insertionPos, 0u);
     CHECK_LE(insertionPos, mSize);
 
-    makeMutable();
-
     if (mSize + size + 1 > mAllocSize) {
-        mAllocSize = (mAllocSize + size + 31) & -32;
-        mData = (char *)realloc(mData, mAllocSize);
-        CHECK(mData != NULL);
+        reserve((mAllocSize + size + 31) & -32);
     }
 
     memmove(&mData[insertionPos + size],
@@ -316,8 +368,6 @@ bool AString::equalsIgnoreCase(const AString &other) const {
 }
 
 void AString::tolower() {
-    makeMutable();
-
     for (size_t i = 0; i < mSize; ++i) {
         mData[i] = ::tolower(mData[i]);
     }
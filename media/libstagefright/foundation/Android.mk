@@ -5,6 +5,7 @@ LOCAL_SRC_FILES:=                 \
     AAtomizer.cpp                 \
     ABitReader.cpp                \
     ABuffer.cpp                   \
+    ABufferPool.cpp               \
     ADebug.cpp                    \
     AHandler.cpp                  \
     AHierarchicalStateMachine.cpp \
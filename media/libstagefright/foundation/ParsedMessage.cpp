@@ -19,6 +19,7 @@
 #include <ctype.h>
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AStringView.h>
 #include <media/stagefright/foundation/hexdump.h>
 
 namespace android {
@@ -103,12 +104,12 @@ ssize_t ParsedMessage::parse(const char *data, size_t size, bool noMoreData) {
             return -1;
         }
 
-        AString line(&data[offset], lineEndOffset - offset);
+        AStringView line(&data[offset], lineEndOffset - offset);
 
         if (offset == 0) {
             // Special handling for the request/status line.
 
-            mDict.add(AString("_"), line);
+            mDict.add(AString("_"), line.toAString());
             offset = lineEndOffset + 2;
 
             continue;
@@ -121,7 +122,7 @@ ssize_t ParsedMessage::parse(const char *data, size_t size, bool noMoreData) {
             break;
         }
 
-        if (line.c_str()[0] == ' ' || line.c_str()[0] == '\t') {
+        if (line[0] == ' ' || line[0] == '\t') {
             // Support for folded header values.
 
             if (lastDictIndex >= 0) {
@@ -129,22 +130,19 @@ ssize_t ParsedMessage::parse(const char *data, size_t size, bool noMoreData) {
                 // cannot continue anything...
 
                 AString &value = mDict.editValueAt(lastDictIndex);
-                value.append(line);
+                value.append(line.data(), line.size());
             }
 
             offset = lineEndOffset + 2;
             continue;
         }
 
-        ssize_t colonPos = line.find(":");
+        ssize_t colonPos = line.find(':');
         if (colonPos >= 0) {
-            AString key(line, 0, colonPos);
-            key.trim();
+            AString key = line.substr(0, colonPos).trimmed().toAString();
             key.tolower();
 
-            line.erase(0, colonPos + 1);
-
-            lastDictIndex = mDict.add(key, line);
+            lastDictIndex = mDict.add(key, line.substr(colonPos + 1).toAString());
         }
 
         offset = lineEndOffset + 2;
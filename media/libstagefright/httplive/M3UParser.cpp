@@ -23,6 +23,7 @@
 #include <cutils/properties.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/AStringView.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MediaErrors.h>
 #include <media/stagefright/Utils.h>
@@ -445,7 +446,7 @@ bool M3UParser::getTypeURI(size_t index, const char *key, AString *uri) const {
     return true;
 }
 
-static bool MakeURL(const char *baseURL, const char *url, AString *out) {
+static bool MakeURL(const char *baseURL, const AStringView &url, AString *out) {
     out->clear();
 
     if (strncasecmp("http://", baseURL, 7)
@@ -457,16 +458,18 @@ static bool MakeURL(const char *baseURL, const char *url, AString *out) {
     const size_t schemeEnd = (strstr(baseURL, "//") - baseURL) + 2;
     CHECK(schemeEnd == 7 || schemeEnd == 8);
 
-    if (!strncasecmp("http://", url, 7) || !strncasecmp("https://", url, 8)) {
+    if (url.startsWithIgnoreCase("http://")
+            || url.startsWithIgnoreCase("https://")) {
         // "url" is already an absolute URL, ignore base URL.
-        out->setTo(url);
+        out->setTo(url.data(), url.size());
 
-        ALOGV("base:'%s', url:'%s' => '%s'", baseURL, url, out->c_str());
+        ALOGV("base:'%s', url:'%.*s' => '%s'",
+                baseURL, (int)url.size(), url.data(), out->c_str());
 
         return true;
     }
 
-    if (url[0] == '/') {
+    if (url.startsWith("/")) {
         // URL is an absolute path.
 
         char *protocolEnd = strstr(baseURL, "//") + 2;
@@ -478,7 +481,7 @@ static bool MakeURL(const char *baseURL, const char *url, AString *out) {
             out->setTo(baseURL);
         }
 
-        out->append(url);
+        out->append(url.data(), url.size());
     } else {
         // URL is a relative path
 
@@ -507,10 +510,11 @@ static bool MakeURL(const char *baseURL, const char *url, AString *out) {
         }
 
         out->append("/");
-        out->append(url);
+        out->append(url.data(), url.size());
     }
 
-    ALOGV("base:'%s', url:'%s' => '%s'", baseURL, url, out->c_str());
+    ALOGV("base:'%s', url:'%.*s' => '%s'",
+            baseURL, (int)url.size(), url.data(), out->c_str());
 
     return true;
 }
@@ -529,15 +533,15 @@ status_t M3UParser::parse(const void *_data, size_t size) {
             ++offsetLF;
         }
 
-        AString line;
+        // Slice the line out of the playlist. Only the tags whose values
+        // are parsed get copied, URIs are resolved straight from the slice.
+        AStringView line;
         if (offsetLF > offset && data[offsetLF - 1] == '\r') {
-            line.setTo(&data[offset], offsetLF - offset - 1);
+            line = AStringView(&data[offset], offsetLF - offset - 1);
         } else {
-            line.setTo(&data[offset], offsetLF - offset);
+            line = AStringView(&data[offset], offsetLF - offset);
         }
 
-        // ALOGI("#%s#", line.c_str());
-
         if (line.empty()) {
             offset = offsetLF + 1;
             continue;
@@ -547,24 +551,26 @@ status_t M3UParser::parse(const void *_data, size_t size) {
             mIsExtM3U = true;
         }
 
-        if (mIsExtM3U) {
+        if (mIsExtM3U && line.startsWith("#EXT")) {
             status_t err = OK;
 
             if (line.startsWith("#EXT-X-TARGETDURATION")) {
                 if (mIsVariantPlaylist) {
                     return ERROR_MALFORMED;
                 }
-                err = parseMetaData(line, &mMeta, "target-duration");
+                err = parseMetaData(
+                        line.toAString(), &mMeta, "target-duration");
             } else if (line.startsWith("#EXT-X-MEDIA-SEQUENCE")) {
                 if (mIsVariantPlaylist) {
                     return ERROR_MALFORMED;
                 }
-                err = parseMetaData(line, &mMeta, "media-sequence");
+                err = parseMetaData(
+                        line.toAString(), &mMeta, "media-sequence");
             } else if (line.startsWith("#EXT-X-KEY")) {
                 if (mIsVariantPlaylist) {
                     return ERROR_MALFORMED;
                 }
-                err = parseCipherInfo(line, &itemMeta, mBaseURI);
+                err = parseCipherInfo(line.toAString(), &itemMeta, mBaseURI);
             } else if (line.startsWith("#EXT-X-ENDLIST")) {
                 mIsComplete = true;
             } else if (line.startsWith("#EXT-X-PLAYLIST-TYPE:EVENT")) {
@@ -573,7 +579,8 @@ status_t M3UParser::parse(const void *_data, size_t size) {
                 if (mIsVariantPlaylist) {
                     return ERROR_MALFORMED;
                 }
-                err = parseMetaDataDuration(line, &itemMeta, "durationUs");
+                err = parseMetaDataDuration(
+                        line.toAString(), &itemMeta, "durationUs");
             } else if (line.startsWith("#EXT-X-DISCONTINUITY")) {
                 if (mIsVariantPlaylist) {
                     return ERROR_MALFORMED;
@@ -587,14 +594,15 @@ status_t M3UParser::parse(const void *_data, size_t size) {
                     return ERROR_MALFORMED;
                 }
                 mIsVariantPlaylist = true;
-                err = parseStreamInf(line, &itemMeta);
+                err = parseStreamInf(line.toAString(), &itemMeta);
             } else if (line.startsWith("#EXT-X-BYTERANGE")) {
                 if (mIsVariantPlaylist) {
                     return ERROR_MALFORMED;
                 }
 
                 uint64_t length, offset;
-                err = parseByteRange(line, segmentRangeOffset, &length, &offset);
+                err = parseByteRange(
+                        line.toAString(), segmentRangeOffset, &length, &offset);
 
                 if (err == OK) {
                     if (itemMeta == NULL) {
@@ -607,10 +615,10 @@ status_t M3UParser::parse(const void *_data, size_t size) {
                     segmentRangeOffset = offset + length;
                 }
             } else if (line.startsWith("#EXT-X-MEDIA")) {
-                err = parseMedia(line);
+                err = parseMedia(line.toAString());
             } else if (line.startsWith("#EXT-X-DISCONTINUITY-SEQUENCE")) {
                 size_t seq;
-                err = parseDiscontinuitySequence(line, &seq);
+                err = parseDiscontinuitySequence(line.toAString(), &seq);
                 if (err == OK) {
                     mDiscontinuitySeq = seq;
                 }
@@ -633,7 +641,7 @@ status_t M3UParser::parse(const void *_data, size_t size) {
             mItems.push();
             Item *item = &mItems.editItemAt(mItems.size() - 1);
 
-            CHECK(MakeURL(mBaseURI.c_str(), line.c_str(), &item->mURI));
+            CHECK(MakeURL(mBaseURI.c_str(), line, &item->mURI));
 
             item->mMeta = itemMeta;
 
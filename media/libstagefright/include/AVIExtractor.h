@@ -21,6 +21,7 @@
 #include <media/stagefright/foundation/ABase.h>
 #include <media/stagefright/MediaExtractor.h>
 #include <media/stagefright/MediaSource.h>
+#include <utils/threads.h>
 #include <utils/Vector.h>
 
 namespace android {
@@ -44,14 +45,51 @@ private:
     struct AVISource;
     struct MP3Splitter;
 
+    enum {
+        // Set in SampleInfo::mSize for samples that aren't sync samples,
+        // just like in OpenDML standard index entries.
+        kSampleIsNotKey = 0x80000000,
+    };
+
     struct SampleInfo {
         uint32_t mOffset;
-        bool mIsKey;
+        uint32_t mSize;
+    };
+
+    // A contiguous run of a track's samples, described either by a range
+    // of entries in the legacy 'idx1' chunk (shared by all tracks) or by
+    // an OpenDML standard index ('ix##' chunk). Its samples are only read
+    // from the file when first accessed.
+    struct IndexSegment {
+        bool mIsLegacy;
+
+        // Offset and number of the index entries in the file.
+        off64_t mIndexOffset;
+        size_t mNumEntries;
+
+        // Sample offsets are relative to this for standard indices.
+        off64_t mBaseOffset;
+
+        size_t mFirstSample;
+        size_t mNumSamples;
+
+        // Sum of the sizes of all samples in previous segments.
+        int64_t mStartBytes;
+
+        // Empty unless loaded.
+        Vector<SampleInfo> mSamples;
+
+        // If mBytesPerSample > 0, the sum of the sizes of all preceding
+        // samples in this segment.
+        Vector<uint32_t> mSampleBytes;
     };
 
     struct Track {
         sp<MetaData> mMeta;
-        Vector<SampleInfo> mSamples;
+        Vector<IndexSegment> mSegments;
+        size_t mNumSamples;
+        int64_t mNumBytes;
+        bool mHasSuperIndex;
         uint32_t mRate;
         uint32_t mScale;
 
@@ -67,16 +105,13 @@ private:
 
         } mKind;
 
-        size_t mNumSyncSamples;
         size_t mThumbnailSampleSize;
         ssize_t mThumbnailSampleIndex;
         size_t mMaxSampleSize;
-
-        // If mBytesPerSample > 0:
-        double mAvgChunkSize;
-        size_t mFirstChunkSize;
     };
 
+    Mutex mLock;
+
     sp<DataSource> mDataSource;
     status_t mInitCheck;
     Vector<Track> mTracks;
@@ -89,6 +124,11 @@ private:
     status_t parseStreamHeader(off64_t offset, size_t size);
     status_t parseStreamFormat(off64_t offset, size_t size);
     status_t parseIndex(off64_t offset, size_t size);
+    status_t parseSuperIndex(off64_t offset, size_t size);
+    status_t addStandardIndex(
+            Track *track, off64_t offset, int64_t startBytes);
+    status_t checkLegacyOffsets();
+    status_t finishIndex();
 
     status_t parseHeaders();
 
@@ -103,7 +143,18 @@ private:
     status_t getSampleIndexAtTime(
             size_t trackIndex,
             int64_t timeUs, MediaSource::ReadOptions::SeekMode mode,
-            size_t *sampleIndex) const;
+            size_t *sampleIndex);
+
+    status_t getSampleInfo_l(
+            size_t trackIndex, size_t sampleIndex,
+            off64_t *offset, size_t *size, bool *isKey,
+            int64_t *sampleTimeUs);
+
+    status_t findSyncSample_l(
+            size_t trackIndex, ssize_t sampleIndex, int direction,
+            ssize_t *syncSampleIndex);
+
+    status_t loadSegment_l(size_t trackIndex, size_t segmentIndex);
 
     status_t addMPEG4CodecSpecificData(size_t trackIndex);
     status_t addH264CodecSpecificData(size_t trackIndex);
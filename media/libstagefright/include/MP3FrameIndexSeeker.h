@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_FRAME_INDEX_SEEKER_H_
+
+#define MP3_FRAME_INDEX_SEEKER_H_
+
+#include "include/MP3Seeker.h"
+
+#include <media/stagefright/foundation/AHandlerReflector.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+struct ALooper;
+struct AMessage;
+class DataSource;
+
+// Seeks using an index of frame offsets built by scanning the frame headers
+// in the background. Seeks land on the frame containing the requested
+// sample and report that frame's exact time, for VBR files without or with
+// only coarse XING/VBRI tables. A seek past the scanned part of the file
+// scans up to its target first. The scan resyncs past junk and ID3 tags
+// between frames. Completed indices are kept in the SeekIndexCache, one
+// cut short by a read error is not.
+struct MP3FrameIndexSeeker : public MP3Seeker {
+    // "fallback" answers duration queries until the scan completes, and
+    // seeks past the point where it failed.
+    static sp<MP3FrameIndexSeeker> CreateFromSource(
+            const sp<DataSource> &source, off64_t first_frame_pos,
+            uint32_t fixed_header, const sp<MP3Seeker> &fallback);
+
+    virtual bool getDuration(int64_t *durationUs);
+    virtual bool getOffsetForTime(int64_t *timeUs, off64_t *pos);
+    virtual bool isSampleAccurate() const { return true; }
+
+protected:
+    virtual ~MP3FrameIndexSeeker();
+
+private:
+    friend struct AHandlerReflector<MP3FrameIndexSeeker>;
+
+    enum {
+        kWhatScan = 'scan',
+    };
+
+    struct Entry {
+        int64_t mSample;
+        off64_t mOffset;
+    };
+
+    Mutex mLock;
+
+    sp<DataSource> mSource;
+    uint32_t mFixedHeader;
+    int32_t mSampleRate;
+    sp<MP3Seeker> mFallback;
+
+    // One entry every kFramesPerEntry frames.
+    Vector<Entry> mEntries;
+
+    // -1 if unknown.
+    off64_t mSourceSize;
+
+    // Scan state, protected by mLock.
+    off64_t mScanPos;
+    int64_t mScanSamples;
+    size_t mScanFrames;
+    bool mScanLostSync;
+    bool mScanDone;
+    bool mScanFailed;
+    Vector<uint8_t> mScanBuffer;
+
+    sp<ALooper> mLooper;
+    sp<AHandlerReflector<MP3FrameIndexSeeker> > mReflector;
+
+    MP3FrameIndexSeeker(
+            const sp<DataSource> &source, off64_t first_frame_pos,
+            uint32_t fixed_header, int32_t sample_rate,
+            const sp<MP3Seeker> &fallback);
+
+    void onMessageReceived(const sp<AMessage> &msg);
+
+    bool loadCachedIndex();
+    void startScan();
+    void scanFrames_l(size_t maxFrames, int64_t untilSample);
+    status_t resync_l(off64_t *pos);
+    bool isFrameSequence(off64_t pos) const;
+    bool parseHeader(uint32_t header, size_t *frameSize, int *numSamples) const;
+
+    DISALLOW_EVIL_CONSTRUCTORS(MP3FrameIndexSeeker);
+};
+
+}  // namespace android
+
+#endif  // MP3_FRAME_INDEX_SEEKER_H_
@@ -33,6 +33,10 @@ struct MP3Seeker : public RefBase {
     // the actual time that seekpoint represents.
     virtual bool getOffsetForTime(int64_t *timeUs, off64_t *pos) = 0;
 
+    // Returns true if "*pos" from getOffsetForTime() is the start of the
+    // frame containing "*timeUs" rather than an estimate.
+    virtual bool isSampleAccurate() const { return false; }
+
 protected:
     virtual ~MP3Seeker() {}
 
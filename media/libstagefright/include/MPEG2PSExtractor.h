@@ -22,6 +22,7 @@
 #include <media/stagefright/MediaExtractor.h>
 #include <utils/threads.h>
 #include <utils/KeyedVector.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -60,6 +61,19 @@ private:
     bool mProgramStreamMapValid;
     KeyedVector<unsigned, unsigned> mStreamTypeByESID;
 
+    // Offsets of pack headers by their SCR, sorted by time. Collected by
+    // seeks and playback, they narrow down later bisections.
+    struct SeekPoint {
+        int64_t mTimeUs;
+        off64_t mOffset;
+    };
+    Vector<SeekPoint> mSeekPoints;
+    bool mSeekPointsChanged;
+
+    // The stream seeks are performed on, or -1 if not seekable.
+    int32_t mSeekStreamID;
+    off64_t mFileSize;
+
     status_t feedMore();
 
     status_t dequeueChunk();
@@ -67,6 +81,14 @@ private:
     ssize_t dequeueSystemHeader();
     ssize_t dequeuePES();
 
+    void initSeeking();
+    status_t seekTo(int64_t seekTimeUs);
+    void addSeekPoint(int64_t timeUs, off64_t offset);
+    bool probeSCR(off64_t *pos, int64_t *timeUs);
+    bool scanPES(
+            off64_t start, off64_t maxBytes, int64_t untilUs,
+            off64_t *packOffset, int64_t *timeUs, int64_t *lastPTSUs);
+
     DISALLOW_EVIL_CONSTRUCTORS(MPEG2PSExtractor);
 };
 
@@ -29,6 +29,7 @@ struct AMessage;
 struct AnotherPacketSource;
 struct ATSParser;
 struct DataSource;
+struct MPEG2TSSeekIndex;
 struct MPEG2TSSource;
 struct String8;
 
@@ -56,8 +57,14 @@ private:
 
     off64_t mOffset;
 
+    // Indexes the seekable track, if its stream and time base are known.
+    sp<MPEG2TSSeekIndex> mSeekIndex;
+    int64_t mFirstPTSUs;
+
     void init();
+    void initSeekIndex(bool haveVideo);
     status_t feedMore();
+    status_t seekTo(int64_t seekTimeUs);
 
     DISALLOW_EVIL_CONSTRUCTORS(MPEG2TSExtractor);
 };
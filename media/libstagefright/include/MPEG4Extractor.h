@@ -72,15 +72,31 @@ private:
         uint32_t datalen;
         uint8_t *data;
     };
+    struct SampleTableBox {
+        uint32_t type;
+        off64_t offset;
+        size_t size;
+    };
     struct Track {
         Track *next;
         sp<MetaData> meta;
         uint32_t timescale;
         sp<SampleTable> sampleTable;
+        // stco/co64, stsc, stts, ctts and stss boxes are only located while
+        // reading the moov; they are applied to "sampleTable" the first
+        // time the track is actually used, see ensureSampleTable().
+        Vector<SampleTableBox> deferredBoxes;
+        status_t sampleTableStatus;
+        bool hasSampleSizes;
         bool includes_expensive_metadata;
         bool skipTrack;
     };
 
+    struct DeferredMetaData {
+        off64_t offset;
+        Track *track;
+    };
+
     Vector<SidxEntry> mSidxEntries;
     off64_t mMoofOffset;
 
@@ -97,6 +113,15 @@ private:
 
     sp<MetaData> mFileMetaData;
 
+    // moov/udta and moov/meta boxes, parsed on the first getMetaData().
+    // Until then getTrack() and getTrackMetaData() only read the gapless
+    // info out of them.
+    Vector<DeferredMetaData> mDeferredMetaData;
+    bool mParsingDeferredMetaData;
+    bool mParsingGaplessInfo;
+    bool mGaplessInfoParsed;
+    bool mMoovCached;
+
     Vector<uint32_t> mPath;
     String8 mLastCommentMean;
     String8 mLastCommentName;
@@ -107,6 +132,13 @@ private:
     status_t parseITunesMetaData(off64_t offset, size_t size);
     status_t parse3GPPMetaData(off64_t offset, size_t size, int depth);
     void parseID3v2MetaData(off64_t offset);
+    void parseDeferredMetaData();
+    void parseGaplessInfo();
+    void parseDeferredBoxes();
+
+    status_t ensureSampleTable(Track *track);
+    status_t setSampleTableBox(
+            Track *track, uint32_t type, off64_t data_offset, size_t data_size);
 
     status_t updateAudioTrackInfoFromESDS_MPEG4Audio(
             const void *esds_data, size_t esds_size);
@@ -21,10 +21,14 @@
 #include <media/stagefright/foundation/ABase.h>
 #include <media/stagefright/foundation/AHandlerReflector.h>
 #include <media/stagefright/DataSource.h>
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
 
 namespace android {
 
 struct ALooper;
+struct IMediaHTTPService;
 struct PageCache;
 
 struct NuCachedSource2 : public DataSource {
@@ -55,6 +59,20 @@ struct NuCachedSource2 : public DataSource {
 
     void resumeFetchingIfNecessary();
 
+    // Keeps cached data in the given range, e.g. a container index,
+    // from being evicted when the prefetch window moves elsewhere.
+    void pinRange(off64_t offset, size_t size);
+
+    // Lets up to maxConnections - 1 additional connections to uri fetch
+    // pages ahead of the read position concurrently. The number actually
+    // used follows the measured aggregate bandwidth. Only effective if
+    // the source is HTTP based.
+    void enableParallelFetch(
+            const sp<IMediaHTTPService> &httpService,
+            const char *uri,
+            const KeyedVector<String8, String8> *headers,
+            size_t maxConnections);
+
     // The following methods are supported only if the
     // data source is HTTP-based; otherwise, ERROR_UNSUPPORTED
     // is returned.
@@ -80,6 +98,11 @@ private:
         kDefaultHighWaterThreshold      = 20 * 1024 * 1024,
         kDefaultLowWaterThreshold       = 4 * 1024 * 1024,
 
+        // Data dropped from the prefetch window by seeks is kept around,
+        // least recently used first out, up to this many bytes.
+        kDefaultRetainedBytes           = 8 * 1024 * 1024,
+        kPinnedHeaderBytes              = 256 * 1024,
+
         // Read data after a 15 sec timeout whether we're actively
         // fetching or not.
         kDefaultKeepAliveIntervalUs     = 15000000,
@@ -88,12 +111,16 @@ private:
     enum {
         kWhatFetchMore  = 'fetc',
         kWhatRead       = 'read',
+        kWhatFetchRange = 'frng',
     };
 
     enum {
         kMaxNumRetries = 10,
+        kMaxConnections = 4,
     };
 
+    struct RangeFetcher;
+
     sp<DataSource> mSource;
     sp<AHandlerReflector<NuCachedSource2> > mReflector;
     sp<ALooper> mLooper;
@@ -123,9 +150,23 @@ private:
 
     bool mDisconnectAtHighwatermark;
 
+    // Parallel range fetching, see enableParallelFetch().
+    Vector<RangeFetcher *> mRangeFetchers;
+    size_t mNumActiveFetchers;
+    String8 mUri;
+    KeyedVector<String8, String8> mUriHeaders;
+    Vector<off64_t> mInFlightOffsets;
+    off64_t mNextRangeOffset;
+    off64_t mRangeLimit;
+    bool mFetchDeferred;
+    int64_t mLastAdaptTimeUs;
+    int32_t mLastAggregateBps;
+
     void onMessageReceived(const sp<AMessage> &msg);
     void onFetch();
     void onRead(const sp<AMessage> &msg);
+    void onFetchRange(const sp<AMessage> &msg);
+    void adaptConcurrency_l();
 
     void fetchInternal();
     ssize_t readInternal(off64_t offset, void *data, size_t size);
@@ -35,6 +35,10 @@ struct SampleIterator {
     status_t getSampleSizeDirect(
             uint32_t sampleIndex, size_t *size);
 
+    // Reads the sizes of count consecutive samples with a single read.
+    status_t getSampleSizesDirect(
+            uint32_t firstSampleIndex, uint32_t count, Vector<size_t> *sizes);
+
 private:
     SampleTable *mTable;
 
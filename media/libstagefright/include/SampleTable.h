@@ -113,11 +113,19 @@ private:
     uint32_t mTimeToSampleCount;
     uint32_t *mTimeToSample;
 
+    // For each stts run its first sample index and decoding time, followed
+    // by a sentinel holding the number of samples and the total duration.
+    uint32_t *mTimeToSampleStarts;
+
     struct SampleTimeEntry {
         uint32_t mSampleIndex;
         uint32_t mCompositionTime;
     };
-    SampleTimeEntry *mSampleTimeEntries;
+
+    // Sample indices in increasing composition time order. Only needed if
+    // there are composition offsets, otherwise decoding order is time order.
+    uint32_t *mSortedSampleIndices;
+    bool mSortedSampleIndicesBuilt;
 
     uint32_t *mCompositionTimeDeltaEntries;
     size_t mNumCompositionTimeDeltaEntries;
@@ -126,7 +134,6 @@ private:
     off64_t mSyncSampleOffset;
     uint32_t mNumSyncSamples;
     uint32_t *mSyncSamples;
-    size_t mLastSyncSampleIndex;
 
     SampleIterator *mSampleIterator;
 
@@ -134,20 +141,35 @@ private:
         uint32_t startChunk;
         uint32_t samplesPerChunk;
         uint32_t chunkDesc;
+        // Index of the first sample in startChunk.
+        uint32_t firstSample;
     };
     SampleToChunkEntry *mSampleToChunkEntries;
 
     friend struct SampleIterator;
 
+    // Returns the index of the stts run containing sampleIndex, or -1 if
+    // sampleIndex lies past the end of the table.
+    ssize_t findTimeToSampleRun(uint32_t sampleIndex) const;
+
+    uint32_t getCompositionTime(uint32_t sampleIndex);
+
+    // Maps a position in composition time order to a sample index.
+    uint32_t getSortedSampleIndex(uint32_t position) const {
+        return mSortedSampleIndices != NULL
+            ? mSortedSampleIndices[position] : position;
+    }
+
     // normally we don't round
     inline uint64_t getSampleTime(
-            size_t sample_index, uint64_t scale_num, uint64_t scale_den) const {
-        return (mSampleTimeEntries[sample_index].mCompositionTime
+            size_t position, uint64_t scale_num, uint64_t scale_den) {
+        return ((uint64_t)getCompositionTime(getSortedSampleIndex(position))
             * scale_num) / scale_den;
     }
 
     status_t getSampleSize_l(uint32_t sample_index, size_t *sample_size);
     uint32_t getCompositionTimeOffset(uint32_t sampleIndex);
+    bool isSyncSample_l(uint32_t sampleIndex) const;
 
     static int CompareIncreasingTime(const void *, const void *);
 
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SEEK_INDEX_CACHE_H_
+
+#define SEEK_INDEX_CACHE_H_
+
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+class DataSource;
+class String8;
+
+// Persists the seek indices (time -> byte offset tables, sorted by time)
+// that extractors build by scanning a file, so that reopening the same
+// local file doesn't have to scan it again.
+//
+// An index is keyed by the file's identity (DataSource::getFileIdentity),
+// the extractor's tag and a hash over the head and tail of the content.
+// Each index is a single file holding a fixed header followed by the raw
+// Entry array, written atomically and mapped read-only when loaded.
+//
+// The cache is disabled unless "media.stagefright.seek-index-dir" names
+// a directory the media server can write to.
+struct SeekIndexCache {
+    struct Entry {
+        int64_t mTimeUs;
+        int64_t mOffset;
+    };
+
+    // Returns OK and fills in *entries if an index was previously stored
+    // for "source" under "tag".
+    static status_t Load(
+            const sp<DataSource> &source, uint32_t tag,
+            Vector<Entry> *entries);
+
+    static status_t Store(
+            const sp<DataSource> &source, uint32_t tag,
+            const Vector<Entry> &entries);
+
+private:
+    static status_t GetIndexPath(
+            const sp<DataSource> &source, uint32_t tag,
+            String8 *path, uint64_t *contentHash);
+
+    DISALLOW_EVIL_CONSTRUCTORS(SeekIndexCache);
+};
+
+}  // namespace android
+
+#endif  // SEEK_INDEX_CACHE_H_
@@ -44,6 +44,14 @@ void FindAVCDimensions(
 
 unsigned parseUE(ABitReader *br);
 
+// Returns the first 0x00 0x00 0x01 start code prefix in the given data,
+// or NULL if there is none.
+const uint8_t *FindStartCode(const uint8_t *data, size_t size);
+
+// Returns the first 0xff byte followed by a byte with all of the bits in
+// "mask" set (0xf0 for ADTS, 0xe0 for MPEG audio), or NULL.
+const uint8_t *FindSyncWord(const uint8_t *data, size_t size, uint8_t mask);
+
 status_t getNextNALUnit(
         const uint8_t **_data, size_t *_size,
         const uint8_t **nalStart, size_t *nalSize,
@@ -21,6 +21,8 @@
 #include "MatroskaExtractor.h"
 
 #include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/foundation/hexdump.h>
 #include <media/stagefright/DataSource.h>
 #include <media/stagefright/MediaBuffer.h>
@@ -32,6 +34,7 @@
 #include <utils/String8.h>
 
 #include <inttypes.h>
+#include <limits.h>
 
 #include <ExtendedUtils.h>
 
@@ -163,30 +166,26 @@ const mkvparser::Track* MatroskaExtractor::TrackInfo::getTrack() const {
 }
 
 // This function does exactly the same as mkvparser::Cues::Find, except that it
-// searches in our own track based vectors. We should not need this once mkvparser
-// adds the same functionality.
-const mkvparser::CuePoint::TrackPosition *MatroskaExtractor::TrackInfo::find(
+// searches in our own track based vectors, which hold the cue times directly
+// instead of re-deriving them from the cue points.
+const MatroskaExtractor::CueEntry *MatroskaExtractor::TrackInfo::find(
         long long timeNs) const {
-    ALOGV("mCuePoints.size %zu", mCuePoints.size());
-    if (mCuePoints.empty()) {
+    ALOGV("mCueEntries.size %zu", mCueEntries.size());
+    if (mCueEntries.empty()) {
         return NULL;
     }
 
-    const mkvparser::CuePoint* cp = mCuePoints.itemAt(0);
-    const mkvparser::Track* track = getTrack();
-    if (timeNs <= cp->GetTime(mExtractor->mSegment)) {
-        return cp->Find(track);
+    if (timeNs <= mCueEntries.itemAt(0).mTimeNs) {
+        return &mCueEntries.itemAt(0);
     }
 
     // Binary searches through relevant cues; assumes cues are ordered by timecode.
     // If we do detect out-of-order cues, return NULL.
     size_t lo = 0;
-    size_t hi = mCuePoints.size();
+    size_t hi = mCueEntries.size();
     while (lo < hi) {
         const size_t mid = lo + (hi - lo) / 2;
-        const mkvparser::CuePoint* const midCp = mCuePoints.itemAt(mid);
-        const long long cueTimeNs = midCp->GetTime(mExtractor->mSegment);
-        if (cueTimeNs <= timeNs) {
+        if (mCueEntries.itemAt(mid).mTimeNs <= timeNs) {
             lo = mid + 1;
         } else {
             hi = mid;
@@ -197,12 +196,12 @@ const mkvparser::CuePoint::TrackPosition *MatroskaExtractor::TrackInfo::find(
         return NULL;
     }
 
-    cp = mCuePoints.itemAt(lo - 1);
-    if (cp->GetTime(mExtractor->mSegment) > timeNs) {
+    const CueEntry *entry = &mCueEntries.itemAt(lo - 1);
+    if (entry->mTimeNs > timeNs) {
         return NULL;
     }
 
-    return cp->Find(track);
+    return entry;
 }
 
 MatroskaSource::MatroskaSource(
@@ -327,6 +326,7 @@ void BlockIterator::advance_l() {
             CHECK(!nextCluster->EOS());
 
             mCluster = nextCluster;
+            mExtractor->addClusterToIndex_l(mCluster);
 
             res = mCluster->Parse(pos, len);
             ALOGV("Parse (2) returned %ld", res);
@@ -383,90 +383,82 @@ void BlockIterator::seek(
 
     ALOGV("Seeking to: %" PRId64, seekTimeUs);
 
-    // If the Cues have not been located then find them.
-    const mkvparser::Cues* pCues = pSegment->GetCues();
-    const mkvparser::SeekHead* pSH = pSegment->GetSeekHead();
-    if (!pCues && pSH) {
-        const size_t count = pSH->GetCount();
-        const mkvparser::SeekHead::Entry* pEntry;
-        ALOGV("No Cues yet");
-
-        for (size_t index = 0; index < count; index++) {
-            pEntry = pSH->GetEntry(index);
-
-            if (pEntry->id == 0x0C53BB6B) { // Cues ID
-                long len; long long pos;
-                pSegment->ParseCues(pEntry->pos, pos, len);
-                pCues = pSegment->GetCues();
-                ALOGV("Cues found");
-                break;
-            }
-        }
+    mkvparser::Tracks const *pTracks = pSegment->GetTracks();
+    const mkvparser::Track *thisTrack = pTracks->GetTrackByNumber(mTrackNum);
+
+    // The cues are normally loaded in the background already, only load
+    // what is needed to reach the seek point if they aren't yet.
+    const mkvparser::Cues* pCues = mExtractor->locateCues_l();
+    if (!pCues) {
+        ALOGV("No Cues, seeking through the clusters");
 
-        if (!pCues) {
-            ALOGE("No Cues in file");
+        mCluster = mExtractor->findClusterNear_l(seekTimeNs);
+        if (mCluster == NULL || mCluster->EOS()) {
+            ALOGE("Did not locate a cluster for seeking");
+            mCluster = NULL;
             return;
         }
-    }
-    else if (!pSH) {
-        ALOGE("No SeekHead");
-        return;
-    }
 
-    const mkvparser::CuePoint* pCP;
-    mkvparser::Tracks const *pTracks = pSegment->GetTracks();
-    while (!pCues->DoneParsing()) {
-        pCues->LoadCuePoint();
-        pCP = pCues->GetLast();
-        CHECK(pCP);
+        mBlockEntryIndex = 0;
+    } else {
+        mExtractor->loadCuePoints_l(pCues, SIZE_MAX, seekTimeNs);
 
-        size_t trackCount = mExtractor->mTracks.size();
-        for (size_t index = 0; index < trackCount; ++index) {
-            MatroskaExtractor::TrackInfo& track = mExtractor->mTracks.editItemAt(index);
-            const mkvparser::Track *pTrack = pTracks->GetTrackByNumber(track.mTrackNum);
-            if (pTrack && pTrack->GetType() == 1 && pCP->Find(pTrack)) { // VIDEO_TRACK
-                track.mCuePoints.push_back(pCP);
-            }
-        }
+        long long clusterPos = -1;
+        long long block = 0;
 
-        if (pCP->GetTime(pSegment) >= seekTimeNs) {
-            ALOGV("Parsed past relevant Cue");
-            break;
+        // The Cue index is built around video keyframes, always *search*
+        // based on the video track, but finalize based on mTrackNum.
+        const MatroskaExtractor::CueEntry *entry = NULL;
+        if (thisTrack->GetType() == 1) { // video
+            entry = mExtractor->mTracks.itemAt(mIndex).find(seekTimeNs);
+        } else {
+            for (size_t index = 0; index < mExtractor->mTracks.size(); ++index) {
+                const MatroskaExtractor::TrackInfo &track =
+                    mExtractor->mTracks.itemAt(index);
+                const mkvparser::Track *pTrack = track.getTrack();
+                if (pTrack && pTrack->GetType() == 1) {
+                    entry = track.find(seekTimeNs);
+                    if (entry) {
+                        ALOGV("Video track located at %zu", index);
+                        break;
+                    }
+                }
+            }
         }
-    }
 
-    const mkvparser::CuePoint::TrackPosition *pTP = NULL;
-    const mkvparser::Track *thisTrack = pTracks->GetTrackByNumber(mTrackNum);
-    if (thisTrack->GetType() == 1) { // video
-        MatroskaExtractor::TrackInfo& track = mExtractor->mTracks.editItemAt(mIndex);
-        pTP = track.find(seekTimeNs);
-    } else {
-        // The Cue index is built around video keyframes
-        unsigned long int trackCount = pTracks->GetTracksCount();
-        for (size_t index = 0; index < trackCount; ++index) {
-            const mkvparser::Track *pTrack = pTracks->GetTrackByIndex(index);
-            if (pTrack && pTrack->GetType() == 1 && pCues->Find(seekTimeNs, pTrack, pCP, pTP)) {
-                ALOGV("Video track located at %zu", index);
-                break;
+        if (entry) {
+            clusterPos = entry->mClusterPos;
+            block = entry->mBlock;
+        } else if (thisTrack->GetType() != 1) {
+            // The video track may be one we don't expose.
+            const mkvparser::CuePoint* pCP;
+            const mkvparser::CuePoint::TrackPosition *pTP = NULL;
+            unsigned long int trackCount = pTracks->GetTracksCount();
+            for (size_t index = 0; index < trackCount; ++index) {
+                const mkvparser::Track *pTrack = pTracks->GetTrackByIndex(index);
+                if (pTrack && pTrack->GetType() == 1 && pCues->Find(seekTimeNs, pTrack, pCP, pTP)) {
+                    ALOGV("Video track located at %zu", index);
+                    clusterPos = pTP->m_pos;
+                    block = pTP->m_block;
+                    break;
+                }
             }
         }
-    }
-
 
-    // Always *search* based on the video track, but finalize based on mTrackNum
-    if (!pTP) {
-        ALOGE("Did not locate the video track for seeking");
-        return;
-    }
+        if (clusterPos < 0) {
+            ALOGE("Did not locate the video track for seeking");
+            return;
+        }
 
-    mCluster = pSegment->FindOrPreloadCluster(pTP->m_pos);
+        mCluster = pSegment->FindOrPreloadCluster(clusterPos);
 
-    CHECK(mCluster);
-    CHECK(!mCluster->EOS());
+        CHECK(mCluster);
+        CHECK(!mCluster->EOS());
 
-    // mBlockEntryIndex starts at 0 but m_block starts at 1
-    CHECK_GT(pTP->m_block, 0);
-    mBlockEntryIndex = pTP->m_block - 1;
+        // mBlockEntryIndex starts at 0 but m_block starts at 1
+        CHECK_GT(block, 0);
+        mBlockEntryIndex = block - 1;
+    }
 
     for (;;) {
         advance_l();
@@ -757,6 +749,11 @@ MatroskaExtractor::MatroskaExtractor(const sp<DataSource> &source)
 }
 
 MatroskaExtractor::~MatroskaExtractor() {
+    if (mLooper != NULL) {
+        mLooper->stop();
+        mLooper->unregisterHandler(mReflector->id());
+    }
+
     delete mSegment;
     mSegment = NULL;
 
@@ -773,6 +770,16 @@ sp<MediaSource> MatroskaExtractor::getTrack(size_t index) {
         return NULL;
     }
 
+    if (mLooper == NULL && !isLiveStreaming()) {
+        mLooper = new ALooper;
+        mLooper->setName("MatroskaCues");
+        mReflector = new AHandlerReflector<MatroskaExtractor>(this);
+        mLooper->registerHandler(mReflector);
+        mLooper->start();
+
+        (new AMessage(kWhatLoadCues, mReflector->id()))->post();
+    }
+
     return new MatroskaSource(this, index);
 }
 
@@ -795,6 +802,188 @@ bool MatroskaExtractor::isLiveStreaming() const {
     return mIsLiveStreaming;
 }
 
+void MatroskaExtractor::onMessageReceived(const sp<AMessage> &msg) {
+    switch (msg->what()) {
+        case kWhatLoadCues:
+        {
+            // Load a batch at a time so that readers waiting for the lock
+            // are only ever held up briefly.
+            static const size_t kCuePointsPerBatch = 64;
+
+            bool done;
+            {
+                Mutex::Autolock autoLock(mLock);
+
+                const mkvparser::Cues *cues = locateCues_l();
+                done = cues == NULL
+                    || loadCuePoints_l(cues, kCuePointsPerBatch, LLONG_MAX);
+            }
+
+            if (!done) {
+                (new AMessage(kWhatLoadCues, mReflector->id()))->post();
+            } else {
+                ALOGV("done loading cues");
+            }
+            break;
+        }
+
+        default:
+            TRESPASS();
+            break;
+    }
+}
+
+const mkvparser::Cues *MatroskaExtractor::locateCues_l() {
+    const mkvparser::Cues* pCues = mSegment->GetCues();
+    if (pCues) {
+        return pCues;
+    }
+
+    // If the Cues have not been located then find them.
+    const mkvparser::SeekHead* pSH = mSegment->GetSeekHead();
+    if (!pSH) {
+        ALOGV("No SeekHead");
+        return NULL;
+    }
+
+    const size_t count = pSH->GetCount();
+    for (size_t index = 0; index < count; index++) {
+        const mkvparser::SeekHead::Entry* pEntry = pSH->GetEntry(index);
+
+        if (pEntry->id == 0x0C53BB6B) { // Cues ID
+            long len; long long pos;
+            mSegment->ParseCues(pEntry->pos, pos, len);
+            pCues = mSegment->GetCues();
+            ALOGV("Cues found");
+            break;
+        }
+    }
+
+    return pCues;
+}
+
+// Loads up to maxCount further cue points, stopping early after the first
+// one at or past untilTimeNs. Returns true once all cue points are loaded.
+bool MatroskaExtractor::loadCuePoints_l(
+        const mkvparser::Cues *cues, size_t maxCount, long long untilTimeNs) {
+    for (size_t n = 0; n < maxCount && !cues->DoneParsing(); ++n) {
+        cues->LoadCuePoint();
+        const mkvparser::CuePoint *pCP = cues->GetLast();
+        CHECK(pCP);
+
+        const long long timeNs = pCP->GetTime(mSegment);
+
+        for (size_t index = 0; index < mTracks.size(); ++index) {
+            TrackInfo &track = mTracks.editItemAt(index);
+            const mkvparser::Track *pTrack = track.getTrack();
+            if (pTrack == NULL || pTrack->GetType() != 1) { // VIDEO_TRACK
+                continue;
+            }
+
+            const mkvparser::CuePoint::TrackPosition *pTP = pCP->Find(pTrack);
+            if (pTP) {
+                CueEntry entry;
+                entry.mTimeNs = timeNs;
+                entry.mClusterPos = pTP->m_pos;
+                entry.mBlock = pTP->m_block;
+                track.mCueEntries.push(entry);
+            }
+        }
+
+        if (timeNs >= untilTimeNs) {
+            ALOGV("Parsed past relevant Cue");
+            break;
+        }
+    }
+
+    return cues->DoneParsing();
+}
+
+void MatroskaExtractor::addClusterToIndex_l(const mkvparser::Cluster *cluster) {
+    if (cluster == NULL || cluster->EOS()) {
+        return;
+    }
+
+    const long long pos = cluster->GetPosition();
+
+    // Clusters are mostly visited in order, check the end first.
+    size_t lo = 0;
+    size_t hi = mClusterIndex.size();
+    if (hi > 0 && mClusterIndex.itemAt(hi - 1).mPos < pos) {
+        lo = hi;
+    }
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (mClusterIndex.itemAt(mid).mPos < pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo < mClusterIndex.size() && mClusterIndex.itemAt(lo).mPos == pos) {
+        return;
+    }
+
+    ClusterEntry entry;
+    entry.mTimeNs = cluster->GetTime();
+    entry.mPos = pos;
+    mClusterIndex.insertAt(entry, lo);
+}
+
+// Returns the last cluster starting at or before timeNs, starting from the
+// closest cluster indexed so far and walking forward from there.
+const mkvparser::Cluster *MatroskaExtractor::findClusterNear_l(long long timeNs) {
+    const mkvparser::Cluster *cluster = NULL;
+
+    // Clusters are in increasing time order, so the index sorted by
+    // position is sorted by time as well.
+    size_t lo = 0;
+    size_t hi = mClusterIndex.size();
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (mClusterIndex.itemAt(mid).mTimeNs <= timeNs) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo > 0) {
+        cluster = mSegment->FindOrPreloadCluster(mClusterIndex.itemAt(lo - 1).mPos);
+    }
+
+    if (cluster == NULL || cluster->EOS()) {
+        cluster = mSegment->GetFirst();
+    }
+
+    if (cluster == NULL || cluster->EOS()) {
+        return NULL;
+    }
+
+    addClusterToIndex_l(cluster);
+
+    for (;;) {
+        const mkvparser::Cluster *nextCluster;
+        long long pos;
+        long len;
+        if (mSegment->ParseNext(cluster, nextCluster, pos, len) != 0
+                || nextCluster == NULL || nextCluster->EOS()) {
+            break;
+        }
+
+        addClusterToIndex_l(nextCluster);
+
+        if (nextCluster->GetTime() > timeNs) {
+            break;
+        }
+
+        cluster = nextCluster;
+    }
+
+    return cluster;
+}
+
 static int bytesForSize(size_t size) {
     // use at most 28 bits (4 times 7)
     CHECK(size <= 0xfffffff);
@@ -20,12 +20,14 @@
 
 #include "mkvparser.hpp"
 
+#include <media/stagefright/foundation/AHandlerReflector.h>
 #include <media/stagefright/MediaExtractor.h>
 #include <utils/Vector.h>
 #include <utils/threads.h>
 
 namespace android {
 
+struct ALooper;
 struct AMessage;
 class String8;
 
@@ -52,20 +54,47 @@ protected:
 private:
     friend struct MatroskaSource;
     friend struct BlockIterator;
+    friend struct AHandlerReflector<MatroskaExtractor>;
+
+    enum {
+        kWhatLoadCues = 'ldcu',
+    };
+
+    // A cue point reduced to what seeking needs.
+    struct CueEntry {
+        long long mTimeNs;
+        long long mClusterPos;
+        long long mBlock;
+    };
+
+    struct ClusterEntry {
+        long long mTimeNs;
+        long long mPos;
+    };
 
     struct TrackInfo {
         unsigned long mTrackNum;
         sp<MetaData> mMeta;
         const MatroskaExtractor *mExtractor;
-        Vector<const mkvparser::CuePoint*> mCuePoints;
+        // Cue points referencing this (video) track, in increasing time.
+        Vector<CueEntry> mCueEntries;
 
         const mkvparser::Track* getTrack() const;
-        const mkvparser::CuePoint::TrackPosition *find(long long timeNs) const;
+        const CueEntry *find(long long timeNs) const;
     };
 
     Mutex mLock;
     Vector<TrackInfo> mTracks;
 
+    // Loads the cues in the background once the first track is requested,
+    // so that the first seek doesn't have to.
+    sp<ALooper> mLooper;
+    sp<AHandlerReflector<MatroskaExtractor> > mReflector;
+
+    // Clusters seen so far ordered by position, used to seek in files
+    // that don't have cues.
+    Vector<ClusterEntry> mClusterIndex;
+
     sp<DataSource> mDataSource;
     DataSourceReader *mReader;
     mkvparser::Segment *mSegment;
@@ -79,6 +108,14 @@ private:
 
     bool isLiveStreaming() const;
 
+    void onMessageReceived(const sp<AMessage> &msg);
+
+    const mkvparser::Cues *locateCues_l();
+    bool loadCuePoints_l(
+            const mkvparser::Cues *cues, size_t maxCount, long long untilTimeNs);
+    void addClusterToIndex_l(const mkvparser::Cluster *cluster);
+    const mkvparser::Cluster *findClusterNear_l(long long timeNs);
+
     MatroskaExtractor(const MatroskaExtractor &);
     MatroskaExtractor &operator=(const MatroskaExtractor &);
 };
@@ -91,6 +91,12 @@ struct ATSParser::Program : public RefBase {
         return mFirstPTSValid;
     }
 
+    bool getFirstPTS(uint64_t *PTS) const;
+
+    bool getSourceInfo(
+            SourceType type, unsigned *elementaryPID, unsigned *streamType,
+            unsigned *PCR_PID);
+
     unsigned number() const { return mProgramNumber; }
 
     void updateProgramMapPID(unsigned programMapPID) {
@@ -101,6 +107,8 @@ struct ATSParser::Program : public RefBase {
         return mProgramMapPID;
     }
 
+    void addStreamsByPID(Vector<Stream *> *streamsByPID);
+
     uint32_t parserFlags() const {
         return mParser->mFlags;
     }
@@ -126,6 +134,7 @@ struct ATSParser::Stream : public RefBase {
 
     unsigned type() const { return mStreamType; }
     unsigned pid() const { return mElementaryPID; }
+    unsigned pcrPID() const { return mPCR_PID; }
     void setPID(unsigned pid) { mElementaryPID = pid; }
 
     status_t parse(
@@ -133,6 +142,11 @@ struct ATSParser::Stream : public RefBase {
             unsigned payload_unit_start_indicator,
             ABitReader *br);
 
+    status_t parse(
+            unsigned continuity_counter,
+            unsigned payload_unit_start_indicator,
+            const uint8_t *data, size_t size);
+
     void signalDiscontinuity(
             DiscontinuityType type, const sp<AMessage> &extra);
 
@@ -163,6 +177,7 @@ private:
 
     status_t flush();
     status_t parsePES(ABitReader *br);
+    bool parsePESHeaderFast(const uint8_t *data, size_t size, status_t *err);
 
     void onPayloadData(
             unsigned PTS_DTS_flags, uint64_t PTS, uint64_t DTS,
@@ -236,6 +251,17 @@ bool ATSParser::Program::parsePID(
     return true;
 }
 
+void ATSParser::Program::addStreamsByPID(Vector<Stream *> *streamsByPID) {
+    for (size_t i = 0; i < mStreams.size(); ++i) {
+        unsigned pid = mStreams.keyAt(i);
+
+        // The first program claiming a PID gets its packets, as in parsePID.
+        if (streamsByPID->itemAt(pid) == NULL) {
+            streamsByPID->editItemAt(pid) = mStreams.valueAt(i).get();
+        }
+    }
+}
+
 void ATSParser::Program::signalDiscontinuity(
         DiscontinuityType type, const sp<AMessage> &extra) {
     int64_t mediaTimeUs;
@@ -461,6 +487,32 @@ sp<MediaSource> ATSParser::Program::getSource(SourceType type) {
     return NULL;
 }
 
+bool ATSParser::Program::getSourceInfo(
+        SourceType type, unsigned *elementaryPID, unsigned *streamType,
+        unsigned *PCR_PID) {
+    for (size_t i = 0; i < mStreams.size(); ++i) {
+        const sp<Stream> &stream = mStreams.editValueAt(i);
+        if (stream->getSource(type) != NULL) {
+            *elementaryPID = stream->pid();
+            *streamType = stream->type();
+            *PCR_PID = stream->pcrPID();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ATSParser::Program::getFirstPTS(uint64_t *PTS) const {
+    if (mParser->mFlags & TS_TIMESTAMPS_ARE_ABSOLUTE) {
+        *PTS = 0;
+        return true;
+    }
+
+    *PTS = mFirstPTS;
+    return mFirstPTSValid;
+}
+
 bool ATSParser::Program::hasSource(SourceType type) const {
     for (size_t i = 0; i < mStreams.size(); ++i) {
         const sp<Stream> &stream = mStreams.valueAt(i);
@@ -581,6 +633,18 @@ ATSParser::Stream::~Stream() {
 status_t ATSParser::Stream::parse(
         unsigned continuity_counter,
         unsigned payload_unit_start_indicator, ABitReader *br) {
+    size_t payloadSizeBits = br->numBitsLeft();
+    CHECK_EQ(payloadSizeBits % 8, 0u);
+
+    return parse(
+            continuity_counter, payload_unit_start_indicator,
+            br->data(), payloadSizeBits / 8);
+}
+
+status_t ATSParser::Stream::parse(
+        unsigned continuity_counter,
+        unsigned payload_unit_start_indicator,
+        const uint8_t *data, size_t size) {
     if (mQueue == NULL) {
         return OK;
     }
@@ -614,10 +678,7 @@ status_t ATSParser::Stream::parse(
         return OK;
     }
 
-    size_t payloadSizeBits = br->numBitsLeft();
-    CHECK_EQ(payloadSizeBits % 8, 0u);
-
-    size_t neededSize = mBuffer->size() + payloadSizeBits / 8;
+    size_t neededSize = mBuffer->size() + size;
     if (mBuffer->capacity() < neededSize) {
         // Increment in multiples of 64K.
         neededSize = (neededSize + 65535) & ~65535;
@@ -630,8 +691,8 @@ status_t ATSParser::Stream::parse(
         mBuffer = newBuffer;
     }
 
-    memcpy(mBuffer->data() + mBuffer->size(), br->data(), payloadSizeBits / 8);
-    mBuffer->setRange(0, mBuffer->size() + payloadSizeBits / 8);
+    memcpy(mBuffer->data() + mBuffer->size(), data, size);
+    mBuffer->setRange(0, mBuffer->size() + size);
 
     return OK;
 }
@@ -894,15 +955,101 @@ status_t ATSParser::Stream::flush() {
 
     ALOGV("flushing stream 0x%04x size = %zu", mElementaryPID, mBuffer->size());
 
-    ABitReader br(mBuffer->data(), mBuffer->size());
-
-    status_t err = parsePES(&br);
+    status_t err;
+    if (!parsePESHeaderFast(mBuffer->data(), mBuffer->size(), &err)) {
+        ABitReader br(mBuffer->data(), mBuffer->size());
+        err = parsePES(&br);
+    }
 
     mBuffer->setRange(0, 0);
 
     return err;
 }
 
+// Handles the PES packets of regular streams carrying nothing but PTS/DTS
+// in their header directly from the bytes. Returns false for anything
+// else, including malformed headers, which parsePES deals with.
+bool ATSParser::Stream::parsePESHeaderFast(
+        const uint8_t *data, size_t size, status_t *err) {
+    *err = OK;
+
+    if (size < 9 || data[0] != 0x00 || data[1] != 0x00 || data[2] != 0x01) {
+        return false;
+    }
+
+    unsigned stream_id = data[3];
+    if (stream_id == 0xbc || stream_id == 0xbe || stream_id == 0xbf
+            || stream_id == 0xf0 || stream_id == 0xf1 || stream_id == 0xff
+            || stream_id == 0xf2 || stream_id == 0xf8) {
+        return false;
+    }
+
+    unsigned PES_packet_length = U16_AT(&data[4]);
+    unsigned PTS_DTS_flags = data[7] >> 6;
+    unsigned PES_header_data_length = data[8];
+
+    if ((data[6] >> 6) != 2
+            || (data[7] & 0x30) != 0  // ESCR_flag, ES_rate_flag
+            || PTS_DTS_flags == 1
+            || 9 + PES_header_data_length > size) {
+        return false;
+    }
+
+    uint64_t PTS = 0, DTS = 0;
+
+    if (PTS_DTS_flags == 2 || PTS_DTS_flags == 3) {
+        const uint8_t *ptr = &data[9];
+        if (PES_header_data_length < (PTS_DTS_flags == 3 ? 10u : 5u)
+                || !(ptr[0] & ptr[2] & ptr[4] & 1)) {
+            return false;
+        }
+
+        if ((unsigned)(ptr[0] >> 4) != PTS_DTS_flags) {
+            ALOGE("PES data Error!");
+            *err = ERROR_MALFORMED;
+            return true;
+        }
+
+        PTS = ((uint64_t)((ptr[0] >> 1) & 7) << 30)
+            | ((uint64_t)ptr[1] << 22) | ((uint64_t)(ptr[2] >> 1) << 15)
+            | ((uint64_t)ptr[3] << 7) | (ptr[4] >> 1);
+
+        ALOGV("PTS = 0x%016" PRIx64 " (%.2f)", PTS, PTS / 90000.0);
+
+        if (PTS_DTS_flags == 3) {
+            ptr += 5;
+            if ((ptr[0] >> 4) != 1 || !(ptr[0] & ptr[2] & ptr[4] & 1)) {
+                return false;
+            }
+
+            DTS = ((uint64_t)((ptr[0] >> 1) & 7) << 30)
+                | ((uint64_t)ptr[1] << 22) | ((uint64_t)(ptr[2] >> 1) << 15)
+                | ((uint64_t)ptr[3] << 7) | (ptr[4] >> 1);
+
+            ALOGV("DTS = %" PRIu64, DTS);
+        }
+    }
+
+    size_t offset = 9 + PES_header_data_length;
+
+    if (PES_packet_length != 0) {
+        if (PES_packet_length < PES_header_data_length + 3
+                || size - offset
+                    < PES_packet_length - 3 - PES_header_data_length) {
+            return false;
+        }
+
+        onPayloadData(
+                PTS_DTS_flags, PTS, DTS, &data[offset],
+                PES_packet_length - 3 - PES_header_data_length);
+    } else {
+        onPayloadData(
+                PTS_DTS_flags, PTS, DTS, &data[offset], size - offset);
+    }
+
+    return true;
+}
+
 void ATSParser::Stream::onPayloadData(
         unsigned PTS_DTS_flags, uint64_t PTS, uint64_t /* DTS */,
         const uint8_t *data, size_t size) {
@@ -937,13 +1084,14 @@ void ATSParser::Stream::onPayloadData(
                      mElementaryPID, mStreamType);
 
                 const char *mime;
-                bool isAvcIDR = !strcasecmp(mime, MEDIA_MIMETYPE_VIDEO_AVC)
-                        && !IsIDR(accessUnit);
-                bool isHevcIDR = !strcasecmp(mime, MEDIA_MIMETYPE_VIDEO_HEVC)
-                        && !ExtendedUtils::IsHevcIDR(accessUnit);
-                if (meta->findCString(kKeyMIMEType, &mime)
-                        && (isAvcIDR || isHevcIDR)) {
-                    continue;
+                if (meta->findCString(kKeyMIMEType, &mime)) {
+                    bool isAvcIDR = !strcasecmp(mime, MEDIA_MIMETYPE_VIDEO_AVC)
+                            && !IsIDR(accessUnit);
+                    bool isHevcIDR = !strcasecmp(mime, MEDIA_MIMETYPE_VIDEO_HEVC)
+                            && !ExtendedUtils::IsHevcIDR(accessUnit);
+                    if (isAvcIDR || isHevcIDR) {
+                        continue;
+                    }
                 }
                 mSource = new AnotherPacketSource(meta);
                 mSource->queueAccessUnit(accessUnit);
@@ -994,6 +1142,7 @@ ATSParser::ATSParser(uint32_t flags)
       mTimeOffsetValid(false),
       mTimeOffsetUs(0ll),
       mNumTSPacketsParsed(0),
+      mStreamsByPIDValid(false),
       mNumPCRs(0) {
     mPSISections.add(0 /* PID */, new PSISection);
 }
@@ -1008,6 +1157,99 @@ status_t ATSParser::feedTSPacket(const void *data, size_t size) {
     return parseTS(&br);
 }
 
+status_t ATSParser::feedTSPackets(const void *data, size_t size) {
+    CHECK_EQ(size % kTSPacketSize, 0u);
+
+    const uint8_t *packet = (const uint8_t *)data;
+    const uint8_t *end = packet + size;
+    for (; packet < end; packet += kTSPacketSize) {
+        if (!mStreamsByPIDValid) {
+            rebuildStreamsByPID();
+        }
+
+        Stream *stream = NULL;
+        if (packet[0] == 0x47) {
+            stream = mStreamsByPID.itemAt(((packet[1] & 0x1f) << 8) | packet[2]);
+        }
+
+        status_t err;
+        if (stream == NULL || !parseStreamPacket(stream, packet, &err)) {
+            ABitReader br(packet, kTSPacketSize);
+            err = parseTS(&br);
+        }
+
+        if (err != OK) {
+            return err;
+        }
+    }
+
+    return OK;
+}
+
+void ATSParser::rebuildStreamsByPID() {
+    static const size_t kNumPIDs = 8192;
+
+    if (mStreamsByPID.size() != kNumPIDs) {
+        mStreamsByPID.clear();
+        mStreamsByPID.insertAt((Stream *)NULL, 0, kNumPIDs);
+    } else {
+        for (size_t i = 0; i < kNumPIDs; ++i) {
+            mStreamsByPID.editItemAt(i) = NULL;
+        }
+    }
+
+    for (size_t i = 0; i < mPrograms.size(); ++i) {
+        mPrograms.editItemAt(i)->addStreamsByPID(&mStreamsByPID);
+    }
+
+    // PSI sections take precedence over streams, see parsePID.
+    for (size_t i = 0; i < mPSISections.size(); ++i) {
+        mStreamsByPID.editItemAt(mPSISections.keyAt(i)) = NULL;
+    }
+
+    mStreamsByPIDValid = true;
+}
+
+// The parseTS path for packets of a known elementary stream, reading the
+// header bytes directly. Returns false for packets carrying a PCR or a
+// malformed adaptation field, which need the general path.
+bool ATSParser::parseStreamPacket(
+        Stream *stream, const uint8_t *packet, status_t *err) {
+    *err = OK;
+
+    if (packet[1] & 0x80) {  // transport_error_indicator
+        // silently ignore.
+        return true;
+    }
+
+    unsigned payload_unit_start_indicator = (packet[1] >> 6) & 1;
+    unsigned adaptation_field_control = (packet[3] >> 4) & 3;
+    unsigned continuity_counter = packet[3] & 0x0f;
+
+    size_t offset = 4;
+
+    if (adaptation_field_control == 2 || adaptation_field_control == 3) {
+        unsigned adaptation_field_length = packet[4];
+
+        if (offset + 1 + adaptation_field_length > kTSPacketSize
+                || (adaptation_field_length > 0 && (packet[5] & 0x10))) {
+            return false;
+        }
+
+        offset += 1 + adaptation_field_length;
+    }
+
+    if (adaptation_field_control == 1 || adaptation_field_control == 3) {
+        *err = stream->parse(
+                continuity_counter, payload_unit_start_indicator,
+                &packet[offset], kTSPacketSize - offset);
+    }
+
+    ++mNumTSPacketsParsed;
+
+    return true;
+}
+
 void ATSParser::signalDiscontinuity(
         DiscontinuityType type, const sp<AMessage> &extra) {
     int64_t mediaTimeUs;
@@ -1032,6 +1274,11 @@ void ATSParser::signalDiscontinuity(
         return;
     }
 
+    // Sections in progress won't be continued past a discontinuity.
+    for (size_t i = 0; i < mPSISections.size(); ++i) {
+        mPSISections.editValueAt(i)->clear();
+    }
+
     for (size_t i = 0; i < mPrograms.size(); ++i) {
         mPrograms.editItemAt(i)->signalDiscontinuity(type, extra);
     }
@@ -1140,6 +1387,9 @@ status_t ATSParser::parsePID(
             return OK;
         }
 
+        // Programs and streams may change below.
+        mStreamsByPIDValid = false;
+
         ABitReader sectionBits(section->data(), section->size());
 
         if (PID == 0) {
@@ -1335,6 +1585,21 @@ bool ATSParser::PTSTimeDeltaEstablished() {
     return mPrograms.editItemAt(0)->PTSTimeDeltaEstablished();
 }
 
+bool ATSParser::getSourceInfo(
+        SourceType type, unsigned *elementaryPID, unsigned *streamType,
+        unsigned *PCR_PID, uint64_t *firstPTS, bool *firstPTSValid) {
+    for (size_t i = 0; i < mPrograms.size(); ++i) {
+        const sp<Program> &program = mPrograms.editItemAt(i);
+
+        if (program->getSourceInfo(type, elementaryPID, streamType, PCR_PID)) {
+            *firstPTSValid = program->getFirstPTS(firstPTS);
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void ATSParser::updatePCR(
         unsigned /* PID */, uint64_t PCR, size_t byteOffsetFromStart) {
     ALOGV("PCR 0x%016" PRIx64 " @ %zu", PCR, byteOffsetFromStart);
@@ -82,6 +82,10 @@ struct ATSParser : public RefBase {
 
     status_t feedTSPacket(const void *data, size_t size);
 
+    // Feeds "size / 188" consecutive packets. Elementary stream packets are
+    // demuxed through a PID lookup table instead of ABitReader.
+    status_t feedTSPackets(const void *data, size_t size);
+
     void signalDiscontinuity(
             DiscontinuityType type, const sp<AMessage> &extra);
 
@@ -97,6 +101,13 @@ struct ATSParser : public RefBase {
 
     bool PTSTimeDeltaEstablished();
 
+    // Describes the stream backing getSource(type): its PID and stream
+    // type, the PCR PID of its program and the PTS that the program maps
+    // to media time 0 (if already established).
+    bool getSourceInfo(
+            SourceType type, unsigned *elementaryPID, unsigned *streamType,
+            unsigned *PCR_PID, uint64_t *firstPTS, bool *firstPTSValid);
+
     enum {
         // From ISO/IEC 13818-1: 2000 (E), Table 2-29
         STREAMTYPE_RESERVED             = 0x00,
@@ -141,6 +152,15 @@ private:
 
     size_t mNumTSPacketsParsed;
 
+    // Elementary stream for each of the 8192 PIDs, NULL for PIDs that take
+    // the general path. Rebuilt whenever a PSI section was parsed.
+    Vector<Stream *> mStreamsByPID;
+    bool mStreamsByPIDValid;
+
+    void rebuildStreamsByPID();
+    bool parseStreamPacket(
+            Stream *stream, const uint8_t *packet, status_t *err);
+
     void parseProgramAssociationTable(ABitReader *br);
     void parseProgramMap(ABitReader *br);
     void parsePES(ABitReader *br);
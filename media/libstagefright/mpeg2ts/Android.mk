@@ -8,6 +8,7 @@ LOCAL_SRC_FILES:=                 \
         ESQueue.cpp               \
         MPEG2PSExtractor.cpp      \
         MPEG2TSExtractor.cpp      \
+        MPEG2TSSeekIndex.cpp      \
 
 LOCAL_C_INCLUDES:= \
         $(TOP)/frameworks/av/media/libstagefright \
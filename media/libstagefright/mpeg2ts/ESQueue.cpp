@@ -289,10 +289,19 @@ status_t ElementaryStreamQueue::appendData(
 #else
                 uint8_t *ptr = (uint8_t *)data;
 
+                // Look for a 4 byte start code, i.e. a 3 byte one preceded
+                // by another zero.
                 ssize_t startOffset = -1;
-                for (size_t i = 0; i + 3 < size; ++i) {
-                    if (!memcmp("\x00\x00\x00\x01", &ptr[i], 4)) {
-                        startOffset = i;
+                const uint8_t *startCode = ptr;
+                while (size > 3 && startCode < ptr + size - 3) {
+                    startCode = FindStartCode(
+                            startCode + 1, ptr + size - startCode - 1);
+                    if (startCode == NULL) {
+                        break;
+                    }
+
+                    if (startCode[-1] == 0x00) {
+                        startOffset = startCode - ptr - 1;
                         break;
                     }
                 }
@@ -323,11 +332,9 @@ status_t ElementaryStreamQueue::appendData(
                 uint8_t *ptr = (uint8_t *)data;
 
                 ssize_t startOffset = -1;
-                for (size_t i = 0; i + 2 < size; ++i) {
-                    if (!memcmp("\x00\x00\x01", &ptr[i], 3)) {
-                        startOffset = i;
-                        break;
-                    }
+                const uint8_t *startCode = FindStartCode(ptr, size);
+                if (startCode != NULL) {
+                    startOffset = startCode - ptr;
                 }
 
                 if (startOffset < 0) {
@@ -357,12 +364,16 @@ status_t ElementaryStreamQueue::appendData(
 #else
                 ssize_t startOffset = -1;
                 size_t frameLength;
-                for (size_t i = 0; i < size; ++i) {
+                const uint8_t *syncWord = ptr;
+                while ((syncWord = FindSyncWord(
+                                syncWord, ptr + size - syncWord, 0xf0))
+                        != NULL) {
                     if (IsSeeminglyValidADTSHeader(
-                            &ptr[i], size - i, &frameLength)) {
-                        startOffset = i;
+                            syncWord, ptr + size - syncWord, &frameLength)) {
+                        startOffset = syncWord - ptr;
                         break;
                     }
+                    ++syncWord;
                 }
 
                 if (startOffset < 0) {
@@ -419,11 +430,16 @@ status_t ElementaryStreamQueue::appendData(
                 uint8_t *ptr = (uint8_t *)data;
 
                 ssize_t startOffset = -1;
-                for (size_t i = 0; i < size; ++i) {
-                    if (IsSeeminglyValidMPEGAudioHeader(&ptr[i], size - i)) {
-                        startOffset = i;
+                const uint8_t *syncWord = ptr;
+                while ((syncWord = FindSyncWord(
+                                syncWord, ptr + size - syncWord, 0xe0))
+                        != NULL) {
+                    if (IsSeeminglyValidMPEGAudioHeader(
+                            syncWord, ptr + size - syncWord)) {
+                        startOffset = syncWord - ptr;
                         break;
                     }
+                    ++syncWord;
                 }
 
                 if (startOffset < 0) {
@@ -1190,10 +1206,13 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGVideo() {
 
     size_t offset = 0;
     while (offset + 3 < size) {
-        if (memcmp(&data[offset], "\x00\x00\x01", 3)) {
-            ++offset;
-            continue;
+        // The start code must be followed by its type byte.
+        const uint8_t *startCode =
+            FindStartCode(&data[offset], size - offset - 1);
+        if (startCode == NULL) {
+            break;
         }
+        offset = startCode - data;
 
         pprevStartCode = prevStartCode;
         prevStartCode = currentStartCode;
@@ -1298,13 +1317,9 @@ static ssize_t getNextChunkSize(
         TRESPASS();
     }
 
-    size_t offset = 3;
-    while (offset + 2 < size) {
-        if (!memcmp(&data[offset], kStartCode, 3)) {
-            return offset;
-        }
-
-        ++offset;
+    const uint8_t *startCode = FindStartCode(&data[3], size - 3);
+    if (startCode != NULL) {
+        return startCode - data;
     }
 
     return -EAGAIN;
@@ -38,9 +38,12 @@
 #include <utils/Log.h>
 
 #include "include/MPEG2PSExtractor.h"
+#include "include/SeekIndexCache.h"
+#include "include/avc_utils.h"
 
 #include "AnotherPacketSource.h"
 #include "ESQueue.h"
+#include "MPEG2TSSeekIndex.h"
 
 #include <media/stagefright/foundation/ABitReader.h>
 #include <media/stagefright/foundation/ABuffer.h>
@@ -48,6 +51,7 @@
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/foundation/hexdump.h>
 #include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaBuffer.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MediaErrors.h>
 #include <media/stagefright/MediaSource.h>
@@ -59,6 +63,89 @@
 
 namespace android {
 
+// How much data we're reading at a time
+static const size_t kChunkSize = 65536;
+
+// Large enough to hold any pack or PES packet.
+static const size_t kScanWindowSize = 128 * 1024;
+
+// Bisection stops once the interval is this small and the remainder is
+// scanned for the target's key frame.
+static const off64_t kBisectMinBytes = 256 * 1024;
+
+// Bisection targets an SCR this much before the seek time, leaving room
+// for the decoding delay between SCR and PTS and for the preceding GOP.
+static const int64_t kBisectMarginUs = 2000000ll;
+
+static const off64_t kMaxForwardScanBytes = 16 * 1024 * 1024;
+static const off64_t kTailBytes = 1024 * 1024;
+
+static const int64_t kMinSeekPointIntervalUs = 1000000ll;
+
+static const uint32_t kSeekIndexTag = 'm2ps';
+
+// Parses the system_clock_reference of an MPEG-1 or MPEG-2 pack header.
+static bool ParseSCR(const uint8_t *pack, int64_t *timeUs) {
+    uint64_t SCR;
+    if ((pack[4] & 0xc4) == 0x44) {
+        // MPEG-2
+        if (!(pack[6] & 0x04) || !(pack[8] & 0x04)) {
+            return false;
+        }
+
+        SCR = ((uint64_t)((pack[4] >> 3) & 7) << 30)
+            | ((uint64_t)(pack[4] & 3) << 28)
+            | ((uint64_t)pack[5] << 20)
+            | ((uint64_t)(pack[6] >> 3) << 15)
+            | ((uint64_t)(pack[6] & 3) << 13)
+            | ((uint64_t)pack[7] << 5)
+            | (pack[8] >> 3);
+    } else if ((pack[4] & 0xf1) == 0x21) {
+        // MPEG-1
+        if (!(pack[6] & 0x01) || !(pack[8] & 0x01)) {
+            return false;
+        }
+
+        SCR = ((uint64_t)((pack[4] >> 1) & 7) << 30)
+            | ((uint64_t)pack[5] << 22)
+            | ((uint64_t)(pack[6] >> 1) << 15)
+            | ((uint64_t)pack[7] << 7)
+            | (pack[8] >> 1);
+    } else {
+        return false;
+    }
+
+    *timeUs = (SCR * 100) / 9;
+    return true;
+}
+
+// Parses the PTS and locates the payload of a complete MPEG-2 PES packet.
+static bool ParsePESHeader(
+        const uint8_t *data, size_t size,
+        int64_t *PTSUs, const uint8_t **payload, size_t *payloadSize) {
+    if (size < 14 || (data[6] & 0xc0) != 0x80 || !(data[7] & 0x80)) {
+        return false;
+    }
+
+    size_t headerSize = 9 + data[8];
+    if (headerSize > size) {
+        return false;
+    }
+
+    uint64_t PTS =
+        ((uint64_t)((data[9] >> 1) & 7) << 30)
+        | ((uint64_t)data[10] << 22)
+        | ((uint64_t)(data[11] >> 1) << 15)
+        | ((uint64_t)data[12] << 7)
+        | (data[13] >> 1);
+
+    *PTSUs = (PTS * 100) / 9;
+    *payload = data + headerSize;
+    *payloadSize = size - headerSize;
+
+    return true;
+}
+
 struct MPEG2PSExtractor::Track : public MediaSource {
     Track(MPEG2PSExtractor *extractor,
           unsigned stream_id, unsigned stream_type);
@@ -83,6 +170,8 @@ private:
     ElementaryStreamQueue *mQueue;
     sp<AnotherPacketSource> mSource;
 
+    int64_t mTargetTimeUs;
+
     status_t appendPESData(
             unsigned PTS_DTS_flags,
             uint64_t PTS, uint64_t DTS,
@@ -119,7 +208,10 @@ MPEG2PSExtractor::MPEG2PSExtractor(const sp<DataSource> &source)
       mFinalResult(OK),
       mBuffer(new ABuffer(0)),
       mScanning(true),
-      mProgramStreamMapValid(false) {
+      mProgramStreamMapValid(false),
+      mSeekPointsChanged(false),
+      mSeekStreamID(-1),
+      mFileSize(-1) {
     for (size_t i = 0; i < 500; ++i) {
         if (feedMore() != OK) {
             break;
@@ -134,9 +226,21 @@ MPEG2PSExtractor::MPEG2PSExtractor(const sp<DataSource> &source)
     }
 
     mScanning = false;
+
+    initSeeking();
 }
 
 MPEG2PSExtractor::~MPEG2PSExtractor() {
+    if (mSeekPointsChanged) {
+        Vector<SeekIndexCache::Entry> cached;
+        for (size_t i = 0; i < mSeekPoints.size(); ++i) {
+            SeekIndexCache::Entry entry;
+            entry.mTimeUs = mSeekPoints[i].mTimeUs;
+            entry.mOffset = mSeekPoints[i].mOffset;
+            cached.push(entry);
+        }
+        SeekIndexCache::Store(mDataSource, kSeekIndexTag, cached);
+    }
 }
 
 size_t MPEG2PSExtractor::countTracks() {
@@ -168,34 +272,45 @@ sp<MetaData> MPEG2PSExtractor::getMetaData() {
 }
 
 uint32_t MPEG2PSExtractor::flags() const {
-    return CAN_PAUSE;
+    uint32_t flags = CAN_PAUSE;
+
+    if (mSeekStreamID >= 0) {
+        flags |= CAN_SEEK_BACKWARD | CAN_SEEK_FORWARD | CAN_SEEK;
+    }
+
+    return flags;
 }
 
 status_t MPEG2PSExtractor::feedMore() {
     Mutex::Autolock autoLock(mLock);
 
-    // How much data we're reading at a time
-    static const size_t kChunkSize = 8192;
-
     for (;;) {
         status_t err = dequeueChunk();
 
         if (err == -EAGAIN && mFinalResult == OK) {
-            memmove(mBuffer->base(), mBuffer->data(), mBuffer->size());
-            mBuffer->setRange(0, mBuffer->size());
-
-            if (mBuffer->size() + kChunkSize > mBuffer->capacity()) {
-                size_t newCapacity = mBuffer->capacity() + kChunkSize;
-                sp<ABuffer> newBuffer = new ABuffer(newCapacity);
-                memcpy(newBuffer->data(), mBuffer->data(), mBuffer->size());
-                newBuffer->setRange(0, mBuffer->size());
-                mBuffer = newBuffer;
+            // Only move the remaining data once the buffer's tail is used
+            // up, and grow it geometrically for large PES packets.
+            if (mBuffer->offset() + mBuffer->size() + kChunkSize
+                    > mBuffer->capacity()) {
+                if (mBuffer->size() + kChunkSize > mBuffer->capacity()) {
+                    size_t newCapacity = 2 * mBuffer->capacity();
+                    if (newCapacity < mBuffer->size() + kChunkSize) {
+                        newCapacity = mBuffer->size() + kChunkSize;
+                    }
+                    sp<ABuffer> newBuffer = new ABuffer(newCapacity);
+                    memcpy(newBuffer->data(), mBuffer->data(), mBuffer->size());
+                    newBuffer->setRange(0, mBuffer->size());
+                    mBuffer = newBuffer;
+                } else {
+                    memmove(mBuffer->base(), mBuffer->data(), mBuffer->size());
+                    mBuffer->setRange(0, mBuffer->size());
+                }
             }
 
             ssize_t n = mDataSource->readAt(
                     mOffset, mBuffer->data() + mBuffer->size(), kChunkSize);
 
-            if (n < (ssize_t)kChunkSize) {
+            if (n <= 0) {
                 mFinalResult = (n < 0) ? (status_t)n : ERROR_END_OF_STREAM;
                 return mFinalResult;
             }
@@ -265,6 +380,11 @@ ssize_t MPEG2PSExtractor::dequeuePack() {
 
     unsigned pack_stuffing_length = mBuffer->data()[13] & 7;
 
+    int64_t timeUs;
+    if (ParseSCR(mBuffer->data(), &timeUs)) {
+        addSeekPoint(timeUs, mOffset - mBuffer->size());
+    }
+
     return pack_stuffing_length + 14;
 }
 
@@ -550,6 +670,269 @@ ssize_t MPEG2PSExtractor::dequeuePES() {
     return n;
 }
 
+void MPEG2PSExtractor::initSeeking() {
+    if (mTracks.isEmpty() || mDataSource->getSize(&mFileSize) != OK) {
+        return;
+    }
+
+    // Seek on the video track, or the only track there is.
+    mSeekStreamID = mTracks.keyAt(0);
+    for (size_t i = 0; i < mTracks.size(); ++i) {
+        const char *mime;
+        if (mTracks.valueAt(i)->getFormat()->findCString(kKeyMIMEType, &mime)
+                && !strncasecmp("video/", mime, 6)) {
+            mSeekStreamID = mTracks.keyAt(i);
+            break;
+        }
+    }
+
+    Vector<SeekIndexCache::Entry> cached;
+    if (SeekIndexCache::Load(mDataSource, kSeekIndexTag, &cached) == OK) {
+        for (size_t i = 0; i < cached.size(); ++i) {
+            addSeekPoint(cached[i].mTimeUs, cached[i].mOffset);
+        }
+    }
+
+    // Timestamps are the stream's PTS, so its last PTS is the duration.
+    off64_t packOffset;
+    int64_t timeUs;
+    int64_t lastPTSUs = -1;
+    scanPES(mFileSize > kTailBytes ? mFileSize - kTailBytes : 0, kTailBytes,
+            -1, &packOffset, &timeUs, &lastPTSUs);
+
+    if (lastPTSUs > 0) {
+        for (size_t i = 0; i < mTracks.size(); ++i) {
+            mTracks.valueAt(i)->getFormat()->setInt64(kKeyDuration, lastPTSUs);
+        }
+    }
+}
+
+void MPEG2PSExtractor::addSeekPoint(int64_t timeUs, off64_t offset) {
+    size_t lo = 0;
+    size_t hi = mSeekPoints.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mSeekPoints[mid].mTimeUs <= timeUs) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if ((lo > 0
+                && timeUs - mSeekPoints[lo - 1].mTimeUs
+                    < kMinSeekPointIntervalUs)
+            || (lo < mSeekPoints.size()
+                && mSeekPoints[lo].mTimeUs - timeUs
+                    < kMinSeekPointIntervalUs)) {
+        return;
+    }
+
+    SeekPoint point;
+    point.mTimeUs = timeUs;
+    point.mOffset = offset;
+    mSeekPoints.insertAt(point, lo);
+    mSeekPointsChanged = true;
+}
+
+// Finds the first pack header at or after "*pos" and returns its SCR.
+bool MPEG2PSExtractor::probeSCR(off64_t *pos, int64_t *timeUs) {
+    sp<ABuffer> buffer = new ABuffer(kChunkSize);
+    const uint8_t *data = buffer->data();
+
+    ssize_t n = mDataSource->readAt(*pos, buffer->data(), kChunkSize);
+
+    size_t offset = 0;
+    while (n > 0 && offset + 14 <= (size_t)n) {
+        const uint8_t *startCode = FindStartCode(&data[offset], n - offset);
+        if (startCode == NULL) {
+            break;
+        }
+
+        offset = startCode - data;
+        if (offset + 14 <= (size_t)n && startCode[3] == 0xba
+                && ParseSCR(startCode, timeUs)) {
+            *pos += offset;
+            return true;
+        }
+
+        offset += 3;
+    }
+
+    return false;
+}
+
+// Walks the packs and PES packets following "start" for up to "maxBytes",
+// or until the seek stream has a PTS past "untilUs" (if >= 0). Returns
+// the last pack in which a PES packet of the seek stream starts with a key
+// frame, if any. "*lastPTSUs" tracks the largest PTS of the seek stream.
+bool MPEG2PSExtractor::scanPES(
+        off64_t start, off64_t maxBytes, int64_t untilUs,
+        off64_t *packOffset, int64_t *timeUs, int64_t *lastPTSUs) {
+    ssize_t trackIndex = mTracks.indexOfKey(mSeekStreamID);
+    if (trackIndex < 0) {
+        return false;
+    }
+    unsigned streamType = mTracks.valueAt(trackIndex)->mStreamType;
+
+    sp<ABuffer> buffer = new ABuffer(kScanWindowSize);
+    const uint8_t *data = buffer->data();
+
+    bool found = false;
+    off64_t lastPackOffset = -1;
+    off64_t pos = start;
+    while (pos < start + maxBytes) {
+        ssize_t n = mDataSource->readAt(pos, buffer->data(), kScanWindowSize);
+        if (n < 6) {
+            break;
+        }
+
+        size_t offset = 0;
+        for (;;) {
+            const uint8_t *startCode = FindStartCode(&data[offset], n - offset);
+            if (startCode == NULL) {
+                // Keep what could be the beginning of a start code.
+                offset = n - 3;
+                break;
+            }
+
+            offset = startCode - data;
+            if (offset + 6 > (size_t)n) {
+                break;
+            }
+
+            unsigned id = startCode[3];
+            if (id == 0xba) {
+                lastPackOffset = pos + offset;
+                offset += 4;
+                continue;
+            } else if (id < 0xbb) {
+                offset += 3;
+                continue;
+            }
+
+            // System header or PES packet.
+            size_t length = 6 + U16_AT(&startCode[4]);
+            if (offset + length > (size_t)n) {
+                break;
+            }
+
+            int64_t PTSUs;
+            const uint8_t *payload;
+            size_t payloadSize;
+            if (id == (unsigned)mSeekStreamID
+                    && ParsePESHeader(
+                        startCode, length, &PTSUs, &payload, &payloadSize)) {
+                if (PTSUs > *lastPTSUs) {
+                    *lastPTSUs = PTSUs;
+                }
+
+                if (untilUs >= 0 && PTSUs > untilUs) {
+                    return found;
+                }
+
+                if (lastPackOffset >= 0
+                        && MPEG2TSSeekIndex::IsRandomAccessPoint(
+                            streamType, payload, payloadSize)) {
+                    *packOffset = lastPackOffset;
+                    *timeUs = PTSUs;
+                    found = true;
+                }
+            }
+
+            offset += length;
+        }
+
+        if (offset == 0) {
+            break;
+        }
+
+        pos += offset;
+    }
+
+    return found;
+}
+
+status_t MPEG2PSExtractor::seekTo(int64_t seekTimeUs) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mSeekStreamID < 0) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    int64_t boundUs = seekTimeUs - kBisectMarginUs;
+
+    // Start from the known pack headers around the target.
+    size_t lo = 0;
+    size_t hi = mSeekPoints.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mSeekPoints[mid].mTimeUs <= boundUs) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    off64_t loOffset = lo > 0 ? mSeekPoints[lo - 1].mOffset : 0;
+    off64_t hiOffset =
+        lo < mSeekPoints.size() ? mSeekPoints[lo].mOffset : mFileSize;
+    if (hiOffset < loOffset) {
+        // The SCR isn't monotonic, fall back to the whole file.
+        loOffset = 0;
+        hiOffset = mFileSize;
+    }
+
+    while (hiOffset - loOffset > kBisectMinBytes) {
+        off64_t pos = loOffset + (hiOffset - loOffset) / 2;
+        int64_t timeUs;
+        if (!probeSCR(&pos, &timeUs) || pos >= hiOffset) {
+            hiOffset = loOffset + (hiOffset - loOffset) / 2;
+            continue;
+        }
+
+        addSeekPoint(timeUs, pos);
+
+        if (timeUs <= boundUs) {
+            loOffset = pos;
+        } else {
+            hiOffset = pos;
+        }
+    }
+
+    off64_t offset;
+    int64_t timeUs;
+    int64_t lastPTSUs = -1;
+    if (!scanPES(loOffset, kMaxForwardScanBytes, seekTimeUs,
+                &offset, &timeUs, &lastPTSUs)) {
+        // No key frame found, start decoding at the bisected pack.
+        offset = loOffset;
+        timeUs = -1;
+    }
+
+    ALOGV("seeking to %lld us, offset %lld (%lld us)",
+            (long long)seekTimeUs, (long long)offset, (long long)timeUs);
+
+    mOffset = offset;
+    mBuffer->setRange(0, 0);
+    mFinalResult = OK;
+
+    for (size_t i = 0; i < mTracks.size(); ++i) {
+        const sp<Track> &track = mTracks.valueAt(i);
+
+        if (track->mQueue != NULL) {
+            track->mQueue->clear(false /* clearFormat */);
+        }
+
+        if (track->mSource != NULL) {
+            track->mSource->queueDiscontinuity(
+                    ATSParser::DISCONTINUITY_NONE, NULL, true /* discard */);
+        }
+    }
+
+    return OK;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 MPEG2PSExtractor::Track::Track(
@@ -557,7 +940,8 @@ MPEG2PSExtractor::Track::Track(
     : mExtractor(extractor),
       mStreamID(stream_id),
       mStreamType(stream_type),
-      mQueue(NULL) {
+      mQueue(NULL),
+      mTargetTimeUs(-1) {
     bool supported = true;
     ElementaryStreamQueue::Mode mode;
 
@@ -637,6 +1021,19 @@ status_t MPEG2PSExtractor::Track::read(
         return NO_INIT;
     }
 
+    int64_t seekTimeUs;
+    ReadOptions::SeekMode seekMode;
+    if ((int32_t)mStreamID == mExtractor->mSeekStreamID
+            && options && options->getSeekTo(&seekTimeUs, &seekMode)) {
+        status_t err = mExtractor->seekTo(seekTimeUs);
+        if (err != OK) {
+            return err;
+        }
+
+        mTargetTimeUs =
+            (seekMode == ReadOptions::SEEK_CLOSEST) ? seekTimeUs : -1;
+    }
+
     status_t finalResult;
     while (!mSource->hasBufferAvailable(&finalResult)) {
         if (finalResult != OK) {
@@ -650,7 +1047,14 @@ status_t MPEG2PSExtractor::Track::read(
         }
     }
 
-    return mSource->read(buffer, options);
+    status_t err = mSource->read(buffer, options);
+
+    if (err == OK && mTargetTimeUs >= 0) {
+        (*buffer)->meta_data()->setInt64(kKeyTargetTime, mTargetTimeUs);
+        mTargetTimeUs = -1;
+    }
+
+    return err;
 }
 
 status_t MPEG2PSExtractor::Track::appendPESData(
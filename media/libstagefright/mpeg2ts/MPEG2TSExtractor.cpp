@@ -23,6 +23,7 @@
 
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaBuffer.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MediaErrors.h>
 #include <media/stagefright/MediaSource.h>
@@ -31,6 +32,7 @@
 
 #include "AnotherPacketSource.h"
 #include "ATSParser.h"
+#include "MPEG2TSSeekIndex.h"
 
 namespace android {
 
@@ -57,6 +59,8 @@ private:
     // will be seekable, otherwise the single stream will be seekable.
     bool mSeekable;
 
+    int64_t mTargetTimeUs;
+
     DISALLOW_EVIL_CONSTRUCTORS(MPEG2TSSource);
 };
 
@@ -66,7 +70,8 @@ MPEG2TSSource::MPEG2TSSource(
         bool seekable)
     : mExtractor(extractor),
       mImpl(impl),
-      mSeekable(seekable) {
+      mSeekable(seekable),
+      mTargetTimeUs(-1) {
 }
 
 status_t MPEG2TSSource::start(MetaData *params) {
@@ -88,7 +93,13 @@ status_t MPEG2TSSource::read(
     int64_t seekTimeUs;
     ReadOptions::SeekMode seekMode;
     if (mSeekable && options && options->getSeekTo(&seekTimeUs, &seekMode)) {
-        return ERROR_UNSUPPORTED;
+        status_t err = mExtractor->seekTo(seekTimeUs);
+        if (err != OK) {
+            return err;
+        }
+
+        mTargetTimeUs =
+            (seekMode == ReadOptions::SEEK_CLOSEST) ? seekTimeUs : -1;
     }
 
     status_t finalResult;
@@ -103,7 +114,14 @@ status_t MPEG2TSSource::read(
         }
     }
 
-    return mImpl->read(out, options);
+    status_t err = mImpl->read(out, options);
+
+    if (err == OK && mTargetTimeUs >= 0) {
+        (*out)->meta_data()->setInt64(kKeyTargetTime, mTargetTimeUs);
+        mTargetTimeUs = -1;
+    }
+
+    return err;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -111,7 +129,8 @@ status_t MPEG2TSSource::read(
 MPEG2TSExtractor::MPEG2TSExtractor(const sp<DataSource> &source)
     : mDataSource(source),
       mParser(new ATSParser),
-      mOffset(0) {
+      mOffset(0),
+      mFirstPTSUs(0) {
     init();
 }
 
@@ -191,6 +210,42 @@ void MPEG2TSExtractor::init() {
     }
 
     ALOGI("haveAudio=%d, haveVideo=%d", haveAudio, haveVideo);
+
+    if (haveAudio || haveVideo) {
+        initSeekIndex(haveVideo);
+    }
+}
+
+void MPEG2TSExtractor::initSeekIndex(bool haveVideo) {
+    unsigned elementaryPID, streamType, PCR_PID;
+    uint64_t firstPTS;
+    bool firstPTSValid;
+    if (!mParser->getSourceInfo(
+                haveVideo ? ATSParser::VIDEO : ATSParser::AUDIO,
+                &elementaryPID, &streamType, &PCR_PID,
+                &firstPTS, &firstPTSValid)
+            || !firstPTSValid) {
+        return;
+    }
+
+    mFirstPTSUs = (firstPTS * 100) / 9;
+
+    mSeekIndex = new MPEG2TSSeekIndex(
+            mDataSource, elementaryPID, streamType, PCR_PID);
+
+    // Leave streamed content to bisection and what playback reads anyway.
+    mSeekIndex->start(
+            !(mDataSource->flags() & DataSource::kIsCachingDataSource));
+
+    int64_t lastTimeUs;
+    if (mSeekIndex->getLastTimeUs(&lastTimeUs) && lastTimeUs > mFirstPTSUs) {
+        for (size_t i = 0; i < mSourceImpls.size(); ++i) {
+            sp<MetaData> meta = mSourceImpls.editItemAt(i)->getFormat();
+            if (meta != NULL) {
+                meta->setInt64(kKeyDuration, lastTimeUs - mFirstPTSUs);
+            }
+        }
+    }
 }
 
 status_t MPEG2TSExtractor::feedMore() {
@@ -203,12 +258,48 @@ status_t MPEG2TSExtractor::feedMore() {
         return (n < 0) ? (status_t)n : ERROR_END_OF_STREAM;
     }
 
+    if (mSeekIndex != NULL) {
+        mSeekIndex->notePacket(packet, mOffset);
+    }
+
     mOffset += n;
     return mParser->feedTSPacket(packet, kTSPacketSize);
 }
 
+status_t MPEG2TSExtractor::seekTo(int64_t seekTimeUs) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mSeekIndex == NULL) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    int64_t timeUs = seekTimeUs + mFirstPTSUs;
+    off64_t offset;
+    status_t err = mSeekIndex->findSeekPoint(&timeUs, &offset);
+    if (err != OK) {
+        return err;
+    }
+
+    ALOGV("seeking to %lld us, offset %lld (%lld us)",
+            (long long)seekTimeUs, (long long)offset,
+            (long long)(timeUs - mFirstPTSUs));
+
+    mOffset = offset;
+
+    // Drops everything demuxed from before the new offset.
+    mParser->signalDiscontinuity(ATSParser::DISCONTINUITY_NONE, NULL);
+
+    return OK;
+}
+
 uint32_t MPEG2TSExtractor::flags() const {
-    return CAN_PAUSE;
+    uint32_t flags = CAN_PAUSE;
+
+    if (mSeekIndex != NULL) {
+        flags |= CAN_SEEK_BACKWARD | CAN_SEEK_FORWARD | CAN_SEEK;
+    }
+
+    return flags;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
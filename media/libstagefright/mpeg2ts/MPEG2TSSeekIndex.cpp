@@ -0,0 +1,545 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "MPEG2TSSeekIndex"
+#include <utils/Log.h>
+
+#include "MPEG2TSSeekIndex.h"
+
+#include "ATSParser.h"
+
+#include "include/SeekIndexCache.h"
+#include "include/avc_utils.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaErrors.h>
+
+namespace android {
+
+static const size_t kTSPacketSize = 188;
+
+static const size_t kScanChunkSize = 1024 * kTSPacketSize;
+static const off64_t kScanBytesPerBatch = 2 * 1024 * 1024;
+
+// Bisection stops once the interval is this small and the remainder is
+// scanned packet by packet.
+static const off64_t kBisectMinBytes = 512 * 1024;
+
+// Bisection targets a PCR this much before the seek time, leaving room for
+// the decoding delay between PCR and PTS and for the preceding GOP.
+static const int64_t kBisectMarginUs = 2000000ll;
+
+// Gives up looking for a random access point after this much data.
+static const off64_t kMaxForwardScanBytes = 16 * 1024 * 1024;
+
+static const off64_t kTailBytes = 1024 * 1024;
+
+static const int64_t kMinEntryIntervalUs = 200000ll;
+
+static const uint32_t kSeekIndexTag = 'm2ts';
+
+// Returns the offset of the first sync byte followed by another one a
+// packet later, or "size" if there is none.
+static size_t FindSync(const uint8_t *data, size_t size) {
+    size_t offset = 0;
+    while (offset < size) {
+        const uint8_t *sync =
+            (const uint8_t *)memchr(data + offset, 0x47, size - offset);
+        if (sync == NULL) {
+            return size;
+        }
+
+        offset = sync - data;
+        if (offset + kTSPacketSize >= size
+                || data[offset + kTSPacketSize] == 0x47) {
+            return offset;
+        }
+
+        ++offset;
+    }
+
+    return size;
+}
+
+MPEG2TSSeekIndex::MPEG2TSSeekIndex(
+        const sp<DataSource> &source,
+        unsigned elementaryPID, unsigned streamType, unsigned PCR_PID)
+    : mSource(source),
+      mElementaryPID(elementaryPID),
+      mStreamType(streamType),
+      mPCR_PID(PCR_PID),
+      mFileSize(-1),
+      mScanPos(0),
+      mScanTimeUs(-1),
+      mScanDone(false),
+      mLastTimeUs(-1) {
+    if (mSource->getSize(&mFileSize) != OK) {
+        mFileSize = -1;
+    }
+}
+
+MPEG2TSSeekIndex::~MPEG2TSSeekIndex() {
+    if (mLooper != NULL) {
+        mLooper->stop();
+        mLooper->unregisterHandler(mReflector->id());
+    }
+}
+
+void MPEG2TSSeekIndex::start(bool scanInBackground) {
+    if (loadCachedIndex() || !scanInBackground) {
+        return;
+    }
+
+    mLooper = new ALooper;
+    mLooper->setName("MPEG2TSSeekIndex");
+    mReflector = new AHandlerReflector<MPEG2TSSeekIndex>(this);
+    mLooper->registerHandler(mReflector);
+    mLooper->start(false /* runOnCallingThread */, false /* canCallJava */,
+            PRIORITY_BACKGROUND);
+
+    (new AMessage(kWhatScan, mReflector->id()))->post();
+}
+
+bool MPEG2TSSeekIndex::loadCachedIndex() {
+    Vector<SeekIndexCache::Entry> cached;
+    if (SeekIndexCache::Load(mSource, kSeekIndexTag, &cached) != OK
+            || cached.isEmpty()) {
+        return false;
+    }
+
+    // The last entry marks the end of the stream.
+    for (size_t i = 0; i + 1 < cached.size(); ++i) {
+        Entry entry;
+        entry.mTimeUs = cached[i].mTimeUs;
+        entry.mOffset = cached[i].mOffset;
+        mEntries.push(entry);
+    }
+
+    const SeekIndexCache::Entry &last = cached[cached.size() - 1];
+    mScanTimeUs = last.mTimeUs;
+    mScanPos = last.mOffset;
+    mScanDone = true;
+
+    ALOGV("loaded cached index of %zu entries", mEntries.size());
+
+    return true;
+}
+
+void MPEG2TSSeekIndex::storeIndex_l() {
+    ALOGV("indexed %zu random access points up to %lld us",
+            mEntries.size(), (long long)mScanTimeUs);
+
+    mScanBuffer.clear();
+
+    Vector<SeekIndexCache::Entry> cached;
+    for (size_t i = 0; i <= mEntries.size(); ++i) {
+        SeekIndexCache::Entry entry;
+        entry.mTimeUs =
+            i < mEntries.size() ? mEntries[i].mTimeUs : mScanTimeUs;
+        entry.mOffset =
+            i < mEntries.size() ? mEntries[i].mOffset : mScanPos;
+        cached.push(entry);
+    }
+    SeekIndexCache::Store(mSource, kSeekIndexTag, cached);
+}
+
+void MPEG2TSSeekIndex::onMessageReceived(const sp<AMessage> &msg) {
+    switch (msg->what()) {
+        case kWhatScan:
+        {
+            bool done;
+            {
+                Mutex::Autolock autoLock(mLock);
+                if (!mScanDone) {
+                    status_t err = scan_l(
+                            &mScanPos, kScanBytesPerBatch, -1, &mScanTimeUs);
+                    if (err != OK) {
+                        mScanDone = true;
+                        storeIndex_l();
+                    }
+                }
+                done = mScanDone;
+            }
+
+            if (!done) {
+                (new AMessage(kWhatScan, mReflector->id()))->post();
+            }
+            break;
+        }
+
+        default:
+            TRESPASS();
+            break;
+    }
+}
+
+void MPEG2TSSeekIndex::notePacket(const uint8_t *packet, off64_t offset) {
+    // Never hold up playback behind a background scan batch, that will
+    // index these packets anyway.
+    if (mLock.tryLock() != OK) {
+        return;
+    }
+
+    if (!mScanDone && offset >= mScanPos) {
+        int64_t PTSUs, PCRUs;
+        if (parsePacket_l(packet, &PTSUs, &PCRUs)) {
+            addEntry_l(PTSUs, offset);
+        }
+
+        if (offset == mScanPos) {
+            mScanPos += kTSPacketSize;
+            if (PTSUs > mScanTimeUs) {
+                mScanTimeUs = PTSUs;
+            }
+        }
+    }
+
+    mLock.unlock();
+}
+
+// Returns true if "packet" starts a PES packet of the indexed stream at a
+// random access point, "*PTSUs" is set for any PES packet of the indexed
+// stream and "*PCRUs" for any packet carrying its program's PCR.
+bool MPEG2TSSeekIndex::parsePacket_l(
+        const uint8_t *packet, int64_t *PTSUs, int64_t *PCRUs) {
+    *PTSUs = -1;
+    *PCRUs = -1;
+
+    if (packet[0] != 0x47) {
+        return false;
+    }
+
+    unsigned PID = ((packet[1] & 0x1f) << 8) | packet[2];
+    bool payloadUnitStart = (packet[1] & 0x40) != 0;
+    unsigned adaptationFieldControl = (packet[3] >> 4) & 3;
+
+    size_t offset = 4;
+    bool randomAccess = false;
+    if (adaptationFieldControl & 2) {
+        size_t length = packet[4];
+        if (5 + length > kTSPacketSize) {
+            return false;
+        }
+
+        if (length > 0) {
+            randomAccess = (packet[5] & 0x40) != 0;
+
+            if ((packet[5] & 0x10) && length >= 7 && PID == mPCR_PID) {
+                uint64_t PCR_base =
+                    ((uint64_t)packet[6] << 25)
+                    | ((uint64_t)packet[7] << 17)
+                    | ((uint64_t)packet[8] << 9)
+                    | ((uint64_t)packet[9] << 1)
+                    | (packet[10] >> 7);
+
+                *PCRUs = (PCR_base * 100) / 9;
+            }
+        }
+
+        offset = 5 + length;
+    }
+
+    if (PID != mElementaryPID || !payloadUnitStart
+            || !(adaptationFieldControl & 1)) {
+        return false;
+    }
+
+    const uint8_t *pes = packet + offset;
+    size_t size = kTSPacketSize - offset;
+
+    if (size < 14 || pes[0] != 0x00 || pes[1] != 0x00 || pes[2] != 0x01
+            || (pes[6] & 0xc0) != 0x80 || !(pes[7] & 0x80)) {
+        return false;
+    }
+
+    uint64_t PTS =
+        ((uint64_t)((pes[9] >> 1) & 7) << 30)
+        | ((uint64_t)pes[10] << 22)
+        | ((uint64_t)(pes[11] >> 1) << 15)
+        | ((uint64_t)pes[12] << 7)
+        | (pes[13] >> 1);
+
+    *PTSUs = (PTS * 100) / 9;
+
+    size_t headerSize = 9 + pes[8];
+    if (randomAccess || headerSize >= size) {
+        return randomAccess;
+    }
+
+    return IsRandomAccessPoint(
+            mStreamType, pes + headerSize, size - headerSize);
+}
+
+// Looks for the start of a key frame in (the beginning of) a PES payload,
+// for streams that don't flag their random access points.
+// static
+bool MPEG2TSSeekIndex::IsRandomAccessPoint(
+        unsigned streamType, const uint8_t *data, size_t size) {
+    switch (streamType) {
+        case ATSParser::STREAMTYPE_H264:
+        case ATSParser::STREAMTYPE_H265:
+        case ATSParser::STREAMTYPE_MPEG1_VIDEO:
+        case ATSParser::STREAMTYPE_MPEG2_VIDEO:
+        case ATSParser::STREAMTYPE_MPEG4_VIDEO:
+            break;
+
+        default:
+            // Every audio frame is a random access point.
+            return true;
+    }
+
+    const uint8_t *end = data + size;
+    const uint8_t *startCode = FindStartCode(data, size);
+    while (startCode != NULL && startCode + 4 < end) {
+        unsigned code = startCode[3];
+
+        switch (streamType) {
+            case ATSParser::STREAMTYPE_H264:
+            {
+                unsigned nalType = code & 0x1f;
+                if (nalType == 5 || nalType == 7) {
+                    return true;
+                }
+                break;
+            }
+
+            case ATSParser::STREAMTYPE_H265:
+            {
+                unsigned nalType = (code >> 1) & 0x3f;
+                if ((nalType >= 16 && nalType <= 21)
+                        || nalType == 32 || nalType == 33) {
+                    return true;
+                }
+                break;
+            }
+
+            case ATSParser::STREAMTYPE_MPEG4_VIDEO:
+            {
+                // Visual object sequence, group of VOP or an I-VOP.
+                if (code == 0xb0 || code == 0xb3
+                        || (code == 0xb6 && (startCode[4] >> 6) == 0)) {
+                    return true;
+                }
+                break;
+            }
+
+            default:
+            {
+                // Sequence header or group of pictures.
+                if (code == 0xb3 || code == 0xb8) {
+                    return true;
+                }
+                break;
+            }
+        }
+
+        startCode = FindStartCode(startCode + 3, end - startCode - 3);
+    }
+
+    return false;
+}
+
+void MPEG2TSSeekIndex::addEntry_l(int64_t timeUs, off64_t offset) {
+    size_t lo = 0;
+    size_t hi = mEntries.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mEntries[mid].mTimeUs <= timeUs) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo > 0 && (mEntries[lo - 1].mOffset == offset
+                || timeUs - mEntries[lo - 1].mTimeUs < kMinEntryIntervalUs)) {
+        return;
+    }
+
+    Entry entry;
+    entry.mTimeUs = timeUs;
+    entry.mOffset = offset;
+    mEntries.insertAt(entry, lo);
+}
+
+// Indexes the packets starting at "*pos" until "maxBytes" have been
+// scanned or a PTS past "untilUs" (if >= 0) has been found, and advances
+// "*pos" past them. "*lastTimeUs" tracks the largest PTS found.
+status_t MPEG2TSSeekIndex::scan_l(
+        off64_t *pos, off64_t maxBytes, int64_t untilUs,
+        int64_t *lastTimeUs) {
+    if (mScanBuffer.size() < kScanChunkSize) {
+        mScanBuffer.insertAt((size_t)0, kScanChunkSize - mScanBuffer.size());
+    }
+    uint8_t *buffer = mScanBuffer.editArray();
+
+    off64_t end = *pos + maxBytes;
+    while (*pos < end) {
+        ssize_t n = mSource->readAt(*pos, buffer, kScanChunkSize);
+        if (n < (ssize_t)kTSPacketSize) {
+            return n < 0 ? (status_t)n : ERROR_END_OF_STREAM;
+        }
+
+        size_t offset = 0;
+        while (offset + kTSPacketSize <= (size_t)n) {
+            if (buffer[offset] != 0x47) {
+                offset += FindSync(&buffer[offset], n - offset);
+                continue;
+            }
+
+            int64_t PTSUs, PCRUs;
+            if (parsePacket_l(&buffer[offset], &PTSUs, &PCRUs)) {
+                addEntry_l(PTSUs, *pos + offset);
+            }
+
+            offset += kTSPacketSize;
+
+            if (PTSUs > *lastTimeUs) {
+                *lastTimeUs = PTSUs;
+            }
+
+            if (untilUs >= 0 && PTSUs > untilUs) {
+                *pos += offset;
+                return OK;
+            }
+        }
+
+        *pos += offset;
+    }
+
+    return OK;
+}
+
+// Finds the time of the first PCR (or PTS of the indexed stream, if the
+// program has no PCR) at or after "*pos" and moves "*pos" to the start of
+// the first packet there.
+bool MPEG2TSSeekIndex::probeTime_l(off64_t *pos, int64_t *timeUs) {
+    if (mScanBuffer.size() < kScanChunkSize) {
+        mScanBuffer.insertAt((size_t)0, kScanChunkSize - mScanBuffer.size());
+    }
+    uint8_t *buffer = mScanBuffer.editArray();
+
+    ssize_t n = mSource->readAt(*pos, buffer, kScanChunkSize);
+    if (n < (ssize_t)kTSPacketSize) {
+        return false;
+    }
+
+    size_t sync = FindSync(buffer, n);
+    for (size_t offset = sync;
+            offset + kTSPacketSize <= (size_t)n;
+            offset += kTSPacketSize) {
+        int64_t PTSUs, PCRUs;
+        parsePacket_l(&buffer[offset], &PTSUs, &PCRUs);
+
+        int64_t probeTimeUs = mPCR_PID != 0x1fff ? PCRUs : PTSUs;
+        if (probeTimeUs >= 0) {
+            *pos += sync;
+            *timeUs = probeTimeUs;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+status_t MPEG2TSSeekIndex::findSeekPoint(int64_t *timeUs, off64_t *offset) {
+    Mutex::Autolock autoLock(mLock);
+
+    int64_t targetUs = *timeUs;
+
+    // Random access points found before "windowStart" may be far away
+    // from the target, since the file in between hasn't been indexed.
+    off64_t windowStart = 0;
+
+    if (!mScanDone && targetUs > mScanTimeUs) {
+        off64_t lo = mScanPos;
+        off64_t hi = mFileSize;
+        while (hi - lo > kBisectMinBytes) {
+            off64_t pos = lo + (hi - lo) / 2;
+            int64_t probeTimeUs;
+            if (!probeTime_l(&pos, &probeTimeUs)) {
+                hi = lo + (hi - lo) / 2;
+            } else if (probeTimeUs <= targetUs - kBisectMarginUs) {
+                lo = pos;
+            } else {
+                hi = lo + (hi - lo) / 2;
+            }
+        }
+
+        ALOGV("bisected seek to %lld us to offset %lld",
+                (long long)targetUs, (long long)lo);
+
+        windowStart = lo;
+
+        if (lo == mScanPos) {
+            status_t err = scan_l(
+                    &mScanPos, kMaxForwardScanBytes, targetUs, &mScanTimeUs);
+            if (err != OK) {
+                mScanDone = true;
+                storeIndex_l();
+            }
+        } else {
+            int64_t lastTimeUs = -1;
+            scan_l(&lo, kMaxForwardScanBytes, targetUs, &lastTimeUs);
+        }
+    }
+
+    size_t lo = 0;
+    size_t hi = mEntries.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mEntries[mid].mTimeUs <= targetUs) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    ssize_t index = (ssize_t)lo - 1;
+
+    if (index < 0 || mEntries[index].mOffset < windowStart) {
+        // No random access point found, start decoding at the window.
+        *offset = windowStart;
+        return OK;
+    }
+
+    *timeUs = mEntries[index].mTimeUs;
+    *offset = mEntries[index].mOffset;
+
+    return OK;
+}
+
+bool MPEG2TSSeekIndex::getLastTimeUs(int64_t *timeUs) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mScanDone) {
+        *timeUs = mScanTimeUs;
+        return mScanTimeUs >= 0;
+    }
+
+    if (mLastTimeUs < 0 && mFileSize > 0) {
+        off64_t pos = mFileSize > kTailBytes ? mFileSize - kTailBytes : 0;
+        scan_l(&pos, kTailBytes, -1, &mLastTimeUs);
+    }
+
+    *timeUs = mLastTimeUs;
+    return mLastTimeUs >= 0;
+}
+
+}  // namespace android
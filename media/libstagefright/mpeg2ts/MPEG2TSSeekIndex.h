@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPEG2_TS_SEEK_INDEX_H_
+
+#define MPEG2_TS_SEEK_INDEX_H_
+
+#include <media/stagefright/foundation/ABase.h>
+#include <media/stagefright/foundation/AHandlerReflector.h>
+#include <utils/RefBase.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+struct ALooper;
+struct AMessage;
+class DataSource;
+
+// Maps presentation times of one elementary stream in a transport stream
+// file to the offsets of the packets starting its random access points.
+//
+// All times are raw PTS values converted to microseconds, i.e. not
+// relative to the start of the stream.
+//
+// The index is filled from the start of the file by a background scan
+// (local files only) and by the packets the extractor reads during
+// playback. Seeks beyond the scanned part bisect the file over the PCR
+// first and then index the packets leading up to their target. Completed
+// indices are kept in the SeekIndexCache.
+struct MPEG2TSSeekIndex : public RefBase {
+    MPEG2TSSeekIndex(
+            const sp<DataSource> &source,
+            unsigned elementaryPID, unsigned streamType, unsigned PCR_PID);
+
+    // Loads a cached index or, if "scanInBackground", starts scanning.
+    void start(bool scanInBackground);
+
+    // Called for every packet the extractor demuxes.
+    void notePacket(const uint8_t *packet, off64_t offset);
+
+    // Returns the offset of the last random access point at or before
+    // "*timeUs" and updates "*timeUs" to its time.
+    status_t findSeekPoint(int64_t *timeUs, off64_t *offset);
+
+    // Returns the time of the last PTS in the file.
+    bool getLastTimeUs(int64_t *timeUs);
+
+    // Returns true if the start of a PES payload of the given stream type
+    // begins a key frame.
+    static bool IsRandomAccessPoint(
+            unsigned streamType, const uint8_t *data, size_t size);
+
+protected:
+    virtual ~MPEG2TSSeekIndex();
+
+private:
+    friend struct AHandlerReflector<MPEG2TSSeekIndex>;
+
+    enum {
+        kWhatScan = 'scan',
+    };
+
+    struct Entry {
+        int64_t mTimeUs;
+        off64_t mOffset;
+    };
+
+    Mutex mLock;
+
+    sp<DataSource> mSource;
+    unsigned mElementaryPID;
+    unsigned mStreamType;
+    unsigned mPCR_PID;
+    off64_t mFileSize;
+
+    // Random access points, sorted by time.
+    Vector<Entry> mEntries;
+
+    // Everything before mScanPos has been indexed, mScanTimeUs is the
+    // largest PTS found there. Protected by mLock.
+    off64_t mScanPos;
+    int64_t mScanTimeUs;
+    bool mScanDone;
+    Vector<uint8_t> mScanBuffer;
+
+    // Largest PTS near the end of the file, while the scan isn't done.
+    int64_t mLastTimeUs;
+
+    sp<ALooper> mLooper;
+    sp<AHandlerReflector<MPEG2TSSeekIndex> > mReflector;
+
+    void onMessageReceived(const sp<AMessage> &msg);
+
+    bool loadCachedIndex();
+    void storeIndex_l();
+
+    status_t scan_l(
+            off64_t *pos, off64_t maxBytes, int64_t untilUs,
+            int64_t *lastTimeUs);
+
+    bool parsePacket_l(
+            const uint8_t *packet, int64_t *PTSUs, int64_t *PCRUs);
+
+    void addEntry_l(int64_t timeUs, off64_t offset);
+
+    bool probeTime_l(off64_t *pos, int64_t *timeUs);
+
+    DISALLOW_EVIL_CONSTRUCTORS(MPEG2TSSeekIndex);
+};
+
+}  // namespace android
+
+#endif  // MPEG2_TS_SEEK_INDEX_H_
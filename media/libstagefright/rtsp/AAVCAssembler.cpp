@@ -159,8 +159,8 @@ bool AAVCAssembler::addSingleTimeAggregationPacket(const sp<ABuffer> &buffer) {
             return false;
         }
 
-        sp<ABuffer> unit = new ABuffer(nalSize);
-        memcpy(unit->data(), &data[2], nalSize);
+        sp<ABuffer> unit = ABuffer::CreateAsSlice(
+                buffer, (data + 2) - buffer->data(), nalSize);
 
         CopyTimes(unit, buffer);
 
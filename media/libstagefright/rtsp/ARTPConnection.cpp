@@ -25,6 +25,7 @@
 #include "ASessionDescription.h"
 
 #include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ABufferPool.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/foundation/AString.h>
@@ -41,6 +42,8 @@
 namespace android {
 
 static const size_t kMaxUDPSize = 1500;
+static const size_t kMaxReceiveSize = 65536;
+static const size_t kMaxPooledReceiveBuffers = 64;
 
 static uint16_t u16at(const uint8_t *data) {
     return data[0] << 8 | data[1];
@@ -76,7 +79,9 @@ ARTPConnection::ARTPConnection(uint32_t flags)
     : mFlags(flags),
       mPollEventPending(false),
       mLastReceiverReportTimeUs(-1),
-      mIPVersion(IPV4) {
+      mIPVersion(IPV4),
+      mBufferPool(new ABufferPool(
+                  kMaxReceiveSize, kMaxReceiveSize, kMaxPooledReceiveBuffers)) {
 }
 
 ARTPConnection::~ARTPConnection() {
@@ -407,7 +412,7 @@ status_t ARTPConnection::receive(StreamInfo *s, bool receiveRTP) {
 
     CHECK(!s->mIsInjected);
 
-    sp<ABuffer> buffer = new ABuffer(65536);
+    sp<ABuffer> buffer = mBufferPool->acquire(kMaxReceiveSize);
 
     socklen_t remoteAddrLen =
         (!receiveRTP && s->mNumRTCPPacketsReceived == 0)
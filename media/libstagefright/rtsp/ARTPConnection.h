@@ -24,6 +24,7 @@
 namespace android {
 
 struct ABuffer;
+struct ABufferPool;
 struct ARTPSource;
 struct ASessionDescription;
 
@@ -75,6 +76,9 @@ private:
     int64_t mLastReceiverReportTimeUs;
     int mIPVersion;
 
+    // Datagram buffers are recycled once the assemblers release them.
+    sp<ABufferPool> mBufferPool;
+
     void onAddStream(const sp<AMessage> &msg);
     void onRemoveStream(const sp<AMessage> &msg);
     void onPollStreams();
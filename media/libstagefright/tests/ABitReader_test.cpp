@@ -0,0 +1,189 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ABitReader_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include <stdlib.h>
+
+#include <media/stagefright/foundation/ABitReader.h>
+#include <media/stagefright/foundation/ADebug.h>
+
+namespace android {
+
+// Straightforward bit-at-a-time reader used as a reference.
+struct ReferenceBitReader {
+    ReferenceBitReader(const uint8_t *data, size_t size)
+        : mData(data), mSize(size), mBitPos(0) {}
+
+    uint32_t getBits(size_t n) {
+        uint32_t result = 0;
+        while (n-- > 0) {
+            CHECK_LT(mBitPos / 8, mSize);
+            result = (result << 1)
+                | ((mData[mBitPos / 8] >> (7 - (mBitPos % 8))) & 1);
+            ++mBitPos;
+        }
+        return result;
+    }
+
+    size_t numBitsLeft() const {
+        return mSize * 8 - mBitPos;
+    }
+
+private:
+    const uint8_t *mData;
+    size_t mSize;
+    size_t mBitPos;
+};
+
+class ABitReaderTest : public ::testing::Test {
+protected:
+    void fillRandom(uint8_t *data, size_t size, unsigned seed) {
+        srand(seed);
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = rand() & 0xff;
+        }
+    }
+};
+
+TEST_F(ABitReaderTest, TestGetBitsMatchesReference) {
+    uint8_t data[1031];
+    fillRandom(data, sizeof(data), 1);
+
+    ABitReader br(data, sizeof(data));
+    ReferenceBitReader ref(data, sizeof(data));
+
+    srand(2);
+    while (ref.numBitsLeft() > 0) {
+        size_t n = 1 + rand() % 32;
+        if (n > ref.numBitsLeft()) {
+            n = ref.numBitsLeft();
+        }
+
+        ASSERT_EQ(ref.numBitsLeft(), br.numBitsLeft());
+        ASSERT_EQ(ref.getBits(n), br.getBits(n));
+    }
+    ASSERT_EQ(0u, br.numBitsLeft());
+}
+
+TEST_F(ABitReaderTest, TestSkipAndPutBits) {
+    uint8_t data[64];
+    fillRandom(data, sizeof(data), 3);
+
+    ABitReader br(data, sizeof(data));
+    ReferenceBitReader ref(data, sizeof(data));
+
+    br.skipBits(3);
+    ref.getBits(3);
+    br.skipBits(77);
+    ref.getBits(32);
+    ref.getBits(32);
+    ref.getBits(13);
+    ASSERT_EQ(ref.numBitsLeft(), br.numBitsLeft());
+
+    uint32_t x = br.getBits(24);
+    br.putBits(x, 24);
+    ASSERT_EQ(ref.getBits(24), br.getBits(24));
+    ASSERT_EQ(ref.getBits(17), br.getBits(17));
+}
+
+TEST_F(ABitReaderTest, TestExpGolomb) {
+    // ue(v) codes 0 through 6 followed by se(v) +1:
+    // 1 010 011 00100 00101 00110 00111 010
+    static const uint8_t kData[] = { 0xa6, 0x42, 0x98, 0xe8 };
+
+    ABitReader br(kData, sizeof(kData));
+    ASSERT_EQ(0u, br.getUE());
+    ASSERT_EQ(1u, br.getUE());
+    ASSERT_EQ(2u, br.getUE());
+    ASSERT_EQ(3u, br.getUE());
+    ASSERT_EQ(4u, br.getUE());
+    ASSERT_EQ(5u, br.getUE());
+    ASSERT_EQ(6u, br.getUE());
+    ASSERT_EQ(1, br.getSE());
+
+    // A code straddling the reservoir refill takes the slow path.
+    static const uint8_t kLongCode[] = {
+        0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x01,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    };
+
+    ABitReader br2(kLongCode, sizeof(kLongCode));
+    ASSERT_EQ(0xffffffffu, br2.getBits(32));
+    ASSERT_EQ((1u << 31) - 1, br2.getUE());
+}
+
+TEST_F(ABitReaderTest, TestNALEmulationPrevention) {
+    static const uint8_t kData[] = {
+        0x00, 0x00, 0x03, 0x01, 0x00, 0x00, 0x03, 0x00, 0xff
+    };
+
+    NALBitReader br(kData, sizeof(kData));
+    ASSERT_TRUE(br.atLeastNumBitsLeft(56));
+    ASSERT_FALSE(br.atLeastNumBitsLeft(57));
+    ASSERT_EQ(0x000001u, br.getBits(24));
+    ASSERT_EQ(0x000000u, br.getBits(24));
+    ASSERT_EQ(0xffu, br.getBits(8));
+}
+
+TEST_F(ABitReaderTest, BenchmarkHeaderParsing) {
+    static const size_t kSize = 1 << 20;
+    static const int kIterations = 8;
+
+    uint8_t *data = new uint8_t[kSize];
+    fillRandom(data, kSize, 4);
+    for (size_t i = 0; i < kSize; ++i) {
+        // Keep Exp-Golomb prefixes short enough to be valid.
+        data[i] |= 0x01;
+    }
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    uint32_t sum = 0;
+    for (int i = 0; i < kIterations; ++i) {
+        ABitReader br(data, kSize);
+        while (br.numBitsLeft() >= 64) {
+            sum += br.getBits(1);
+            sum += br.getBits(7);
+            sum += br.getBits(13);
+            sum += br.getBits(3);
+            br.skipBits(8);
+        }
+    }
+    nsecs_t getBitsNs = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; ++i) {
+        ABitReader br(data, kSize);
+        while (br.numBitsLeft() >= 128) {
+            sum += br.getUE();
+        }
+    }
+    nsecs_t getUENs = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    delete[] data;
+
+    ALOGI("getBits: %.2f MB/s, getUE: %.2f MB/s (checksum %u)",
+          (double)kSize * kIterations * 1E3 / getBitsNs,
+          (double)kSize * kIterations * 1E3 / getUENs,
+          sum);
+}
+
+}  // namespace android
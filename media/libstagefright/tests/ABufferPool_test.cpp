@@ -0,0 +1,188 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ABufferPool_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+#include <utils/threads.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ABufferPool.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+
+namespace android {
+
+static const size_t kMinCapacity = 256;
+static const size_t kMaxCapacity = 4096;
+static const size_t kMaxBuffersPerClass = 2;
+
+// Counts the farewell messages it receives.
+struct FarewellHandler : public AHandler {
+    FarewellHandler() : mNumFarewells(0) {}
+
+    // Returns false if fewer than "count" farewells arrived within a second.
+    bool waitForFarewells(int32_t count) {
+        Mutex::Autolock autoLock(mLock);
+        while (mNumFarewells < count) {
+            if (mCondition.waitRelative(mLock, 1000000000ll) != OK) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int32_t numFarewells() {
+        Mutex::Autolock autoLock(mLock);
+        return mNumFarewells;
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> & /* msg */) {
+        Mutex::Autolock autoLock(mLock);
+        ++mNumFarewells;
+        mCondition.broadcast();
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    int32_t mNumFarewells;
+};
+
+class ABufferPoolTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        mPool = new ABufferPool(kMinCapacity, kMaxCapacity, kMaxBuffersPerClass);
+
+        mLooper = new ALooper;
+        mLooper->setName("ABufferPool_test");
+        mLooper->start();
+
+        mHandler = new FarewellHandler;
+        mLooper->registerHandler(mHandler);
+    }
+
+    virtual void TearDown() {
+        mLooper->unregisterHandler(mHandler->id());
+        mLooper->stop();
+    }
+
+    sp<AMessage> newFarewell() {
+        return new AMessage(0, mHandler->id());
+    }
+
+    sp<ABufferPool> mPool;
+    sp<ALooper> mLooper;
+    sp<FarewellHandler> mHandler;
+};
+
+TEST_F(ABufferPoolTest, TestAcquire) {
+    // Capacities are rounded up to the next size class.
+    static const size_t kCapacities[][2] = {
+        { 1, 256 }, { 256, 256 }, { 257, 512 }, { 1000, 1024 },
+        { 4096, 4096 },
+    };
+    for (size_t i = 0; i < sizeof(kCapacities) / sizeof(kCapacities[0]); ++i) {
+        sp<ABuffer> buffer = mPool->acquire(kCapacities[i][0]);
+        ASSERT_TRUE(buffer != NULL);
+        EXPECT_EQ(kCapacities[i][1], buffer->capacity());
+        EXPECT_EQ(0u, buffer->offset());
+        EXPECT_EQ(kCapacities[i][0], buffer->size());
+    }
+
+    // Larger requests get exactly what they asked for.
+    sp<ABuffer> buffer = mPool->acquire(kMaxCapacity + 1);
+    EXPECT_EQ(kMaxCapacity + 1, buffer->capacity());
+    EXPECT_EQ(kMaxCapacity + 1, buffer->size());
+}
+
+TEST_F(ABufferPoolTest, TestReuse) {
+    sp<ABuffer> buffer = mPool->acquire(300);
+    ABuffer *first = buffer.get();
+    buffer->setRange(10, 20);
+    buffer->setInt32Data(42);
+    buffer->meta()->setInt32("foo", 1);
+
+    // Still in use, by the buffer itself and by a slice of it.
+    sp<ABuffer> slice = ABuffer::CreateAsSlice(buffer, 0, 10);
+    buffer.clear();
+    sp<ABuffer> second = mPool->acquire(300);
+    EXPECT_NE(first, second.get());
+
+    // Released, and back to the state of a new buffer.
+    slice.clear();
+    buffer = mPool->acquire(400);
+    EXPECT_EQ(first, buffer.get());
+    EXPECT_EQ(0u, buffer->offset());
+    EXPECT_EQ(400u, buffer->size());
+    EXPECT_EQ(0, buffer->int32Data());
+    int32_t foo;
+    EXPECT_FALSE(buffer->meta()->findInt32("foo", &foo));
+
+    // The size class is full, further buffers aren't pooled.
+    sp<ABuffer> unpooled = mPool->acquire(300);
+    EXPECT_NE(first, unpooled.get());
+    EXPECT_NE(second.get(), unpooled.get());
+
+    ABuffer *pooled = second.get();
+    unpooled.clear();
+    second.clear();
+    second = mPool->acquire(300);
+    EXPECT_EQ(pooled, second.get());
+}
+
+TEST_F(ABufferPoolTest, TestFarewell) {
+    sp<ABuffer> buffer = mPool->acquire(100);
+    ABuffer *first = buffer.get();
+    buffer->setFarewellMessage(newFarewell());
+    buffer.clear();
+    EXPECT_EQ(0, mHandler->numFarewells());
+
+    // Recycling the buffer posts the farewell of its previous user, and
+    // only once.
+    buffer = mPool->acquire(100);
+    ASSERT_EQ(first, buffer.get());
+    ASSERT_TRUE(mHandler->waitForFarewells(1));
+    buffer.clear();
+    buffer = mPool->acquire(100);
+    buffer.clear();
+
+    // So does dropping it from the pool.
+    buffer = mPool->acquire(100);
+    buffer->setFarewellMessage(newFarewell());
+    buffer.clear();
+    mPool->trim();
+    ASSERT_TRUE(mHandler->waitForFarewells(2));
+
+    // Unpooled buffers say goodbye as soon as they are released.
+    buffer = mPool->acquire(kMaxCapacity + 1);
+    buffer->setFarewellMessage(newFarewell());
+    buffer.clear();
+    ASSERT_TRUE(mHandler->waitForFarewells(3));
+
+    // Flush the looper before checking nothing else arrived.
+    sp<AMessage> flush = newFarewell();
+    flush->post();
+    ASSERT_TRUE(mHandler->waitForFarewells(4));
+    EXPECT_EQ(4, mHandler->numFarewells());
+}
+
+}  // namespace android
@@ -0,0 +1,351 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ATSParser_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MediaSource.h>
+#include <media/stagefright/MetaData.h>
+
+#include "include/MPEG2TSExtractor.h"
+#include "mpeg2ts/ATSParser.h"
+#include "mpeg2ts/AnotherPacketSource.h"
+
+namespace android {
+
+static const size_t kTSPacketSize = 188;
+static const unsigned kPMTPID = 0x100;
+static const unsigned kAudioPID = 0x101;
+
+class TSDataSourceStub : public DataSource {
+public:
+    TSDataSourceStub(const Vector<uint8_t> &data) : mData(data) {}
+
+    virtual status_t initCheck() const {
+        return OK;
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        if (offset >= (off64_t)mData.size()) {
+            return 0;
+        }
+
+        if (size > mData.size() - offset) {
+            size = mData.size() - offset;
+        }
+        memcpy(data, mData.array() + offset, size);
+        return size;
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        *size = mData.size();
+        return OK;
+    }
+
+private:
+    Vector<uint8_t> mData;
+};
+
+class ATSParserTest : public ::testing::Test {
+protected:
+    // Builds a transport stream with a PAT, a PMT and "numPES" ADTS audio
+    // PES packets, each starting with a PCR and ending with stuffing.
+    void makeStream(Vector<uint8_t> *ts, size_t numPES) {
+        static const uint8_t kPAT[] = {
+            0x00,                               // pointer_field
+            0x00, 0xb0, 0x0d, 0x00, 0x01, 0xc1, 0x00, 0x00,
+            0x00, 0x01, 0xe1, 0x00,             // program 1 -> PID 0x100
+            0x00, 0x00, 0x00, 0x00,             // CRC, not checked
+        };
+        static const uint8_t kPMT[] = {
+            0x00,                               // pointer_field
+            0x02, 0xb0, 0x12, 0x00, 0x01, 0xc1, 0x00, 0x00,
+            0xe1, 0x01,                         // PCR_PID
+            0xf0, 0x00,                         // program_info_length
+            0x0f, 0xe1, 0x01, 0xf0, 0x00,       // ADTS on PID 0x101
+            0x00, 0x00, 0x00, 0x00,             // CRC, not checked
+        };
+
+        srand(1);
+        unsigned cc = 0;
+
+        appendPackets(ts, 0, kPAT, sizeof(kPAT), &cc, -1);
+        cc = 0;
+        appendPackets(ts, kPMTPID, kPMT, sizeof(kPMT), &cc, -1);
+
+        cc = 0;
+        for (size_t i = 0; i < numPES; ++i) {
+            uint64_t PTS = 90000 + i * 8 * 1920;  // 8 frames at 48kHz
+
+            Vector<uint8_t> pes;
+            pes.push(0x00);
+            pes.push(0x00);
+            pes.push(0x01);
+            pes.push(0xc0);
+            pes.push(0x00);  // PES_packet_length, filled in below
+            pes.push(0x00);
+            pes.push(0x80);
+            pes.push(0x80);  // PTS only
+            pes.push(0x05);
+            pes.push(0x21 | ((PTS >> 29) & 0x0e));
+            pes.push((PTS >> 22) & 0xff);
+            pes.push(((PTS >> 14) & 0xfe) | 1);
+            pes.push((PTS >> 7) & 0xff);
+            pes.push(((PTS << 1) & 0xfe) | 1);
+
+            for (size_t j = 0; j < 8; ++j) {
+                size_t frameLength = 7 + 100 + rand() % 400;
+                pes.push(0xff);
+                pes.push(0xf1);
+                pes.push(0x4c);  // AAC LC, 48kHz
+                pes.push(0x80 | ((frameLength >> 11) & 3));
+                pes.push((frameLength >> 3) & 0xff);
+                pes.push(((frameLength & 7) << 5) | 0x1f);
+                pes.push(0xfc);
+                for (size_t k = 7; k < frameLength; ++k) {
+                    pes.push(rand() & 0xff);
+                }
+            }
+
+            size_t PES_packet_length = pes.size() - 6;
+            pes.editItemAt(4) = PES_packet_length >> 8;
+            pes.editItemAt(5) = PES_packet_length & 0xff;
+
+            appendPackets(ts, kAudioPID, pes.array(), pes.size(), &cc,
+                          PTS * 300);
+        }
+    }
+
+    // Splits "data" into packets with payload_unit_start set on the first.
+    // A PCR is put into the first packet unless PCR is negative.
+    void appendPackets(
+            Vector<uint8_t> *ts, unsigned PID,
+            const uint8_t *data, size_t size, unsigned *cc, int64_t PCR) {
+        bool first = true;
+        while (size > 0) {
+            uint8_t packet[kTSPacketSize];
+            packet[0] = 0x47;
+            packet[1] = (first ? 0x40 : 0x00) | (PID >> 8);
+            packet[2] = PID & 0xff;
+
+            size_t adaptationSize = 0;
+            if (first && PCR >= 0) {
+                adaptationSize = 8;
+            }
+
+            size_t payloadSize = kTSPacketSize - 4 - adaptationSize;
+            if (size < payloadSize) {
+                // Stuff the rest with the adaptation field.
+                adaptationSize = kTSPacketSize - 4 - size;
+                payloadSize = size;
+            }
+
+            packet[3] = (adaptationSize > 0 ? 0x30 : 0x10) | *cc;
+            *cc = (*cc + 1) & 0x0f;
+
+            uint8_t *ptr = &packet[4];
+            if (adaptationSize > 0) {
+                memset(ptr, 0xff, adaptationSize);
+                ptr[0] = adaptationSize - 1;
+                if (adaptationSize > 1) {
+                    ptr[1] = 0x00;
+                    if (first && PCR >= 0 && adaptationSize >= 8) {
+                        uint64_t base = PCR / 300;
+                        unsigned ext = PCR % 300;
+                        ptr[1] = 0x10;
+                        ptr[2] = base >> 25;
+                        ptr[3] = base >> 17;
+                        ptr[4] = base >> 9;
+                        ptr[5] = base >> 1;
+                        ptr[6] = ((base & 1) << 7) | 0x7e | (ext >> 8);
+                        ptr[7] = ext & 0xff;
+                    }
+                }
+                ptr += adaptationSize;
+            }
+
+            memcpy(ptr, data, payloadSize);
+            ts->appendArray(packet, kTSPacketSize);
+
+            data += payloadSize;
+            size -= payloadSize;
+            first = false;
+        }
+    }
+
+    void drainAudio(const sp<ATSParser> &parser, Vector<sp<ABuffer> > *units) {
+        parser->signalEOS(ERROR_END_OF_STREAM);
+
+        sp<AnotherPacketSource> source = static_cast<AnotherPacketSource *>(
+                parser->getSource(ATSParser::AUDIO).get());
+        ASSERT_TRUE(source != NULL);
+
+        status_t finalResult;
+        while (source->hasBufferAvailable(&finalResult)) {
+            sp<ABuffer> accessUnit;
+            ASSERT_EQ(OK, source->dequeueAccessUnit(&accessUnit));
+            units->push(accessUnit);
+        }
+    }
+};
+
+TEST_F(ATSParserTest, TestBatchedMatchesSinglePackets) {
+    Vector<uint8_t> ts;
+    makeStream(&ts, 64);
+
+    sp<ATSParser> single = new ATSParser;
+    for (size_t offset = 0; offset < ts.size(); offset += kTSPacketSize) {
+        ASSERT_EQ(OK, single->feedTSPacket(&ts[offset], kTSPacketSize));
+    }
+
+    // Uneven batches, so PSI changes land in the middle of a batch.
+    sp<ATSParser> batched = new ATSParser;
+    size_t offset = 0;
+    for (size_t n = 1; offset < ts.size(); n = n * 2 + 1) {
+        size_t size = n * kTSPacketSize;
+        if (size > ts.size() - offset) {
+            size = ts.size() - offset;
+        }
+        ASSERT_EQ(OK, batched->feedTSPackets(&ts[offset], size));
+        offset += size;
+    }
+
+    Vector<sp<ABuffer> > singleUnits, batchedUnits;
+    drainAudio(single, &singleUnits);
+    drainAudio(batched, &batchedUnits);
+
+    ASSERT_GT(singleUnits.size(), 0u);
+    ASSERT_EQ(singleUnits.size(), batchedUnits.size());
+    for (size_t i = 0; i < singleUnits.size(); ++i) {
+        int64_t singleTimeUs, batchedTimeUs;
+        ASSERT_TRUE(singleUnits[i]->meta()->findInt64("timeUs", &singleTimeUs));
+        ASSERT_TRUE(batchedUnits[i]->meta()->findInt64("timeUs", &batchedTimeUs));
+        ASSERT_EQ(singleTimeUs, batchedTimeUs);
+        ASSERT_EQ(singleUnits[i]->size(), batchedUnits[i]->size());
+        ASSERT_EQ(0, memcmp(singleUnits[i]->data(), batchedUnits[i]->data(),
+                            singleUnits[i]->size()));
+    }
+}
+
+TEST_F(ATSParserTest, TestExtractorSeek) {
+    // About 170 seconds of audio, 3MB.
+    Vector<uint8_t> ts;
+    makeStream(&ts, 1000);
+
+    sp<MPEG2TSExtractor> extractor =
+        new MPEG2TSExtractor(new TSDataSourceStub(ts));
+    ASSERT_EQ(1u, extractor->countTracks());
+    ASSERT_TRUE(extractor->flags() & MediaExtractor::CAN_SEEK);
+
+    // 999 PES packets after the first one, of 8 frames each.
+    int64_t durationUs;
+    ASSERT_TRUE(extractor->getTrackMetaData(0, 0)->findInt64(
+                kKeyDuration, &durationUs));
+    EXPECT_EQ(999ll * 8 * 1920 * 100 / 9, durationUs);
+
+    sp<MediaSource> track = extractor->getTrack(0);
+    ASSERT_EQ(OK, track->start());
+
+    // Forwards into the unscanned part and back again.
+    static const int64_t kSeekTimesUs[] = {
+        100000000ll, 20000000ll, 150000000ll, 5000000ll, 0ll, 160000000ll,
+    };
+
+    for (size_t i = 0; i < sizeof(kSeekTimesUs) / sizeof(kSeekTimesUs[0]); ++i) {
+        MediaSource::ReadOptions options;
+        options.setSeekTo(
+                kSeekTimesUs[i], MediaSource::ReadOptions::SEEK_PREVIOUS_SYNC);
+
+        MediaBuffer *buffer;
+        ASSERT_EQ(OK, track->read(&buffer, &options));
+
+        int64_t timeUs;
+        ASSERT_TRUE(buffer->meta_data()->findInt64(kKeyTime, &timeUs));
+        buffer->release();
+
+        // Within one index interval before the target.
+        EXPECT_LE(timeUs, kSeekTimesUs[i]);
+        EXPECT_GE(timeUs, kSeekTimesUs[i] - 400000ll);
+    }
+
+    track->stop();
+}
+
+// Set ATSPARSER_BENCHMARK_FILE to measure a captured transport stream
+// instead of the generated one.
+TEST_F(ATSParserTest, BenchmarkFeed) {
+    Vector<uint8_t> ts;
+
+    const char *path = getenv("ATSPARSER_BENCHMARK_FILE");
+    FILE *file = (path != NULL) ? fopen(path, "rb") : NULL;
+    if (file != NULL) {
+        uint8_t buffer[kTSPacketSize * 64];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            ts.appendArray(buffer, n - n % kTSPacketSize);
+        }
+        fclose(file);
+    } else {
+        makeStream(&ts, 4096);
+    }
+
+    // Parsers are destroyed outside of the timed sections, along with
+    // everything they queued.
+    sp<ATSParser> singleParser = new ATSParser;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t offset = 0; offset < ts.size(); offset += kTSPacketSize) {
+        if (singleParser->feedTSPacket(&ts[offset], kTSPacketSize) != OK) {
+            break;
+        }
+    }
+    nsecs_t singleNs = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    static const size_t kBatchSize = 7 * kTSPacketSize;  // One UDP datagram
+
+    sp<ATSParser> batchedParser = new ATSParser;
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t offset = 0; offset < ts.size(); offset += kBatchSize) {
+        size_t size = kBatchSize;
+        if (size > ts.size() - offset) {
+            size = ts.size() - offset;
+        }
+        if (batchedParser->feedTSPackets(&ts[offset], size) != OK) {
+            break;
+        }
+    }
+    nsecs_t batchedNs = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    ALOGI("%zu bytes, feedTSPacket: %.2f MB/s, feedTSPackets: %.2f MB/s",
+          ts.size(),
+          (double)ts.size() * 1E3 / singleNs,
+          (double)ts.size() * 1E3 / batchedNs);
+}
+
+}  // namespace android
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "M3UParser_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+
+#include <string.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/AString.h>
+#include <media/stagefright/MediaErrors.h>
+
+#include "httplive/M3UParser.h"
+
+namespace android {
+
+class M3UParserTest : public ::testing::Test {
+protected:
+    sp<M3UParser> parse(const char *baseURI, const char *playlist) {
+        return new M3UParser(baseURI, playlist, strlen(playlist));
+    }
+
+    void checkItem(
+            const sp<M3UParser> &parser, size_t index,
+            const char *expectedURI, int64_t expectedDurationUs) {
+        AString uri;
+        sp<AMessage> meta;
+        ASSERT_TRUE(parser->itemAt(index, &uri, &meta));
+        EXPECT_STREQ(expectedURI, uri.c_str()) << "item " << index;
+
+        ASSERT_TRUE(meta != NULL);
+        int64_t durationUs;
+        ASSERT_TRUE(meta->findInt64("durationUs", &durationUs));
+        EXPECT_EQ(expectedDurationUs, durationUs) << "item " << index;
+    }
+};
+
+// Every tag and URI below is short enough for AString's inline storage,
+// apart from the resolved absolute URI of the last segment.
+TEST_F(M3UParserTest, TestMediaPlaylist) {
+    sp<M3UParser> parser = parse(
+            "http://a.b/c/d.m3u8",
+            "#EXTM3U\r\n"
+            "#EXT-X-TARGETDURATION:10\r\n"
+            "#EXT-X-MEDIA-SEQUENCE:7\r\n"
+            "# A comment, not a tag\r\n"
+            "#EXTINF:9.5,\r\n"
+            "e.ts\r\n"
+            "\r\n"
+            "#EXT-X-UNKNOWN-TAG:ignored\r\n"
+            "#EXT-X-DISCONTINUITY\r\n"
+            "#EXTINF:10,\r\n"
+            "/f.ts\r\n"
+            "#EXTINF:2,\n"
+            "#EXT-X-BYTERANGE:100@20\n"
+            "http://g.h/a/much/longer/segment.ts\n"
+            "#EXT-X-ENDLIST\n");
+
+    ASSERT_EQ(OK, parser->initCheck());
+    EXPECT_TRUE(parser->isExtM3U());
+    EXPECT_FALSE(parser->isVariantPlaylist());
+    EXPECT_TRUE(parser->isComplete());
+    EXPECT_FALSE(parser->isEvent());
+
+    int32_t targetDuration, mediaSequence;
+    ASSERT_TRUE(parser->meta() != NULL);
+    ASSERT_TRUE(parser->meta()->findInt32("target-duration", &targetDuration));
+    ASSERT_TRUE(parser->meta()->findInt32("media-sequence", &mediaSequence));
+    EXPECT_EQ(10, targetDuration);
+    EXPECT_EQ(7, mediaSequence);
+
+    ASSERT_EQ(3u, parser->size());
+    checkItem(parser, 0, "http://a.b/c/e.ts", 9500000ll);
+    checkItem(parser, 1, "http://a.b/f.ts", 10000000ll);
+    checkItem(parser, 2, "http://g.h/a/much/longer/segment.ts", 2000000ll);
+
+    AString uri;
+    sp<AMessage> meta;
+    int32_t discontinuity;
+    ASSERT_TRUE(parser->itemAt(0, &uri, &meta));
+    EXPECT_FALSE(meta->findInt32("discontinuity", &discontinuity));
+    ASSERT_TRUE(parser->itemAt(1, &uri, &meta));
+    EXPECT_TRUE(meta->findInt32("discontinuity", &discontinuity));
+
+    int64_t rangeOffset, rangeLength;
+    ASSERT_TRUE(parser->itemAt(2, &uri, &meta));
+    ASSERT_TRUE(meta->findInt64("range-offset", &rangeOffset));
+    ASSERT_TRUE(meta->findInt64("range-length", &rangeLength));
+    EXPECT_EQ(20, rangeOffset);
+    EXPECT_EQ(100, rangeLength);
+}
+
+TEST_F(M3UParserTest, TestVariantPlaylist) {
+    sp<M3UParser> parser = parse(
+            "https://a.b/c.m3u8?x=1",
+            "#EXTM3U\n"
+            "#EXT-X-STREAM-INF:BANDWIDTH=1280\n"
+            "lo.m3u8\n"
+            "#EXT-X-STREAM-INF:BANDWIDTH=2560\n"
+            "hi.m3u8\n");
+
+    ASSERT_EQ(OK, parser->initCheck());
+    EXPECT_TRUE(parser->isVariantPlaylist());
+    ASSERT_EQ(2u, parser->size());
+
+    static const char *kURIs[] = {
+        "https://a.b/lo.m3u8", "https://a.b/hi.m3u8",
+    };
+    static const int32_t kBandwidths[] = { 1280, 2560 };
+    for (size_t i = 0; i < 2; ++i) {
+        AString uri;
+        sp<AMessage> meta;
+        ASSERT_TRUE(parser->itemAt(i, &uri, &meta));
+        EXPECT_STREQ(kURIs[i], uri.c_str());
+
+        int32_t bandwidth;
+        ASSERT_TRUE(meta != NULL);
+        ASSERT_TRUE(meta->findInt32("bandwidth", &bandwidth));
+        EXPECT_EQ(kBandwidths[i], bandwidth);
+    }
+}
+
+TEST_F(M3UParserTest, TestMalformed) {
+    // A media segment needs a duration.
+    EXPECT_EQ(ERROR_MALFORMED,
+              parse("http://a.b/c.m3u8", "#EXTM3U\nd.ts\n")->initCheck());
+
+    // Media playlist tags can't follow variants.
+    EXPECT_EQ(ERROR_MALFORMED, parse("http://a.b/c.m3u8",
+                "#EXTM3U\n"
+                "#EXT-X-STREAM-INF:BANDWIDTH=1\n"
+                "d.m3u8\n"
+                "#EXTINF:1,\n")->initCheck());
+
+    EXPECT_EQ(ERROR_MALFORMED, parse("http://a.b/c.m3u8",
+                "#EXTM3U\n#EXT-X-TARGETDURATION\n")->initCheck());
+}
+
+}  // namespace android
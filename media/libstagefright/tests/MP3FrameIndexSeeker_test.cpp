@@ -0,0 +1,269 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "MP3FrameIndexSeeker_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaErrors.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include "include/MP3FrameIndexSeeker.h"
+
+namespace android {
+
+static const int32_t kSampleRate = 44100;
+static const int32_t kSamplesPerFrame = 1152;
+static const size_t kNumFramesPerPart = 100;
+
+// MPEG-1 layer III at 44.1kHz, 128 and 160kbps.
+static const uint32_t kHeaders[] = { 0xfffb9064, 0xfffba064 };
+
+static const off64_t kFallbackOffset = 12345;
+static const int64_t kFallbackDurationUs = 42000000ll;
+
+// Optionally fails to read the byte at "failOffset", as a bad sector would.
+class MP3DataSourceStub : public DataSource {
+public:
+    MP3DataSourceStub(const Vector<uint8_t> &data, off64_t failOffset = -1)
+        : mData(data),
+          mFailOffset(failOffset) {
+    }
+
+    virtual status_t initCheck() const {
+        return OK;
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        if (mFailOffset >= 0 && offset <= mFailOffset
+                && offset + (off64_t)size > mFailOffset) {
+            if (offset == mFailOffset) {
+                return ERROR_IO;
+            }
+            size = mFailOffset - offset;
+        }
+
+        if (offset >= (off64_t)mData.size()) {
+            return 0;
+        }
+
+        if (size > mData.size() - offset) {
+            size = mData.size() - offset;
+        }
+        memcpy(data, mData.array() + offset, size);
+        return size;
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        *size = mData.size();
+        return OK;
+    }
+
+    virtual status_t getFileIdentity(String8 *id) {
+        *id = String8::format("MP3DataSourceStub:%zu", mData.size());
+        return OK;
+    }
+
+private:
+    Vector<uint8_t> mData;
+    off64_t mFailOffset;
+};
+
+// Stands in for a XING or VBRI table.
+struct FallbackSeeker : public MP3Seeker {
+    virtual bool getDuration(int64_t *durationUs) {
+        *durationUs = kFallbackDurationUs;
+        return true;
+    }
+
+    virtual bool getOffsetForTime(int64_t * /* timeUs */, off64_t *pos) {
+        *pos = kFallbackOffset;
+        return true;
+    }
+};
+
+class MP3FrameIndexSeekerTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        const char *tmp = getenv("TMPDIR");
+        char dir[PATH_MAX];
+        snprintf(dir, sizeof(dir), "%s/MP3FrameIndexSeeker_test.XXXXXX",
+                tmp ? tmp : "/data/local/tmp");
+        ASSERT_TRUE(mkdtemp(dir) != NULL);
+
+        mCacheDir.setTo(dir);
+        property_set("media.stagefright.seek-index-dir", mCacheDir.string());
+    }
+
+    virtual void TearDown() {
+        property_set("media.stagefright.seek-index-dir", "");
+        String8 command = String8::format("rm -rf '%s'", mCacheDir.string());
+        system(command.string());
+    }
+
+    void appendFrames(Vector<uint8_t> *data, size_t numFrames) {
+        for (size_t i = 0; i < numFrames; ++i) {
+            uint32_t header = kHeaders[rand() % 2];
+            size_t frameSize = header == kHeaders[0] ? 417 : 522;
+
+            mFrameOffsets.push(data->size());
+            data->push(header >> 24);
+            data->push((header >> 16) & 0xff);
+            data->push((header >> 8) & 0xff);
+            data->push(header & 0xff);
+            data->insertAt((uint8_t)0, data->size(), frameSize - 4);
+        }
+    }
+
+    // Two runs of frames with junk and the ID3 tag of a concatenated file
+    // between them, and an ID3v1 tag at the end.
+    void makeFile(Vector<uint8_t> *data) {
+        srand(1);
+
+        appendFrames(data, kNumFramesPerPart);
+
+        for (size_t i = 0; i < 3000; ++i) {
+            data->push(rand() & 0xff);
+        }
+
+        static const uint8_t kID3[] = {
+            'I', 'D', '3', 0x03, 0x00, 0x00, 0x00, 0x00, 0x03, 0x74,
+        };
+        data->appendArray(kID3, sizeof(kID3));
+        data->insertAt((uint8_t)0xff, data->size(), 500);
+
+        appendFrames(data, kNumFramesPerPart);
+
+        data->appendArray((const uint8_t *)"TAG", 3);
+        data->insertAt((uint8_t)0, data->size(), 125);
+    }
+
+    sp<MP3Seeker> createSeeker(const sp<DataSource> &source) {
+        return MP3FrameIndexSeeker::CreateFromSource(
+                source, 0, kHeaders[0], new FallbackSeeker);
+    }
+
+    void expectSeek(const sp<MP3Seeker> &seeker, size_t frame) {
+        int64_t sample = (int64_t)frame * kSamplesPerFrame;
+        int64_t timeUs = (sample + kSamplesPerFrame / 2) * 1000000ll
+            / kSampleRate;
+        off64_t pos;
+        ASSERT_TRUE(seeker->getOffsetForTime(&timeUs, &pos));
+        EXPECT_EQ(mFrameOffsets[frame], pos) << "frame " << frame;
+        EXPECT_EQ(sample * 1000000ll / kSampleRate, timeUs) << "frame " << frame;
+    }
+
+    // Waits for the background scan to replace the fallback's duration.
+    bool waitForDuration(const sp<MP3Seeker> &seeker, int64_t *durationUs) {
+        for (int i = 0; i < 500; ++i) {
+            if (seeker->getDuration(durationUs)
+                    && *durationUs != kFallbackDurationUs) {
+                return true;
+            }
+            usleep(10000);
+        }
+        return false;
+    }
+
+    size_t numCachedIndices() {
+        size_t n = 0;
+        DIR *dir = opendir(mCacheDir.string());
+        if (dir != NULL) {
+            struct dirent *entry;
+            while ((entry = readdir(dir)) != NULL) {
+                if (entry->d_name[0] != '.') {
+                    ++n;
+                }
+            }
+            closedir(dir);
+        }
+        return n;
+    }
+
+    String8 mCacheDir;
+    Vector<off64_t> mFrameOffsets;
+};
+
+TEST_F(MP3FrameIndexSeekerTest, TestResyncPastJunk) {
+    Vector<uint8_t> data;
+    makeFile(&data);
+
+    sp<MP3Seeker> seeker = createSeeker(new MP3DataSourceStub(data));
+    ASSERT_TRUE(seeker != NULL);
+
+    expectSeek(seeker, 10);
+    expectSeek(seeker, kNumFramesPerPart - 1);
+    expectSeek(seeker, kNumFramesPerPart);
+    expectSeek(seeker, kNumFramesPerPart + 50);
+    expectSeek(seeker, 2 * kNumFramesPerPart - 1);
+
+    int64_t durationUs;
+    ASSERT_TRUE(waitForDuration(seeker, &durationUs));
+    EXPECT_EQ(2 * kNumFramesPerPart * kSamplesPerFrame * 1000000ll
+                / kSampleRate, durationUs);
+
+    // The next open finds the complete index in the cache.
+    seeker.clear();
+    EXPECT_EQ(1u, numCachedIndices());
+
+    seeker = createSeeker(new MP3DataSourceStub(data));
+    ASSERT_TRUE(seeker != NULL);
+    int64_t cachedDurationUs;
+    ASSERT_TRUE(seeker->getDuration(&cachedDurationUs));
+    EXPECT_EQ(durationUs, cachedDurationUs);
+    expectSeek(seeker, kNumFramesPerPart + 50);
+}
+
+TEST_F(MP3FrameIndexSeekerTest, TestReadErrorFallsBack) {
+    Vector<uint8_t> data;
+    makeFile(&data);
+
+    size_t failFrame = kNumFramesPerPart + 20;
+    sp<MP3Seeker> seeker = createSeeker(
+            new MP3DataSourceStub(data, mFrameOffsets[failFrame]));
+    ASSERT_TRUE(seeker != NULL);
+
+    // Past the error, the index has nothing to say.
+    int64_t timeUs = (int64_t)(failFrame + 10) * kSamplesPerFrame
+        * 1000000ll / kSampleRate;
+    off64_t pos;
+    ASSERT_TRUE(seeker->getOffsetForTime(&timeUs, &pos));
+    EXPECT_EQ(kFallbackOffset, pos);
+
+    expectSeek(seeker, kNumFramesPerPart + 10);
+
+    int64_t durationUs;
+    ASSERT_TRUE(seeker->getDuration(&durationUs));
+    EXPECT_EQ(kFallbackDurationUs, durationUs);
+
+    seeker.clear();
+    EXPECT_EQ(0u, numCachedIndices());
+}
+
+}  // namespace android
@@ -0,0 +1,475 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "MPEG4Extractor_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MediaSource.h>
+#include <media/stagefright/MetaData.h>
+
+#include "include/MPEG4Extractor.h"
+
+namespace android {
+
+static const size_t kNumSamples = 30;
+static const size_t kNumNALsPerSample = 3;
+static const uint32_t kSampleDuration = 33;  // in the 1kHz media timescale
+static const size_t kCoverArtSize = 4096;
+
+// Lends out its memory through getReadView(), like a mapped FileSource.
+class MP4DataSourceStub : public DataSource {
+public:
+    MP4DataSourceStub(const Vector<uint8_t> &data)
+        : mData(new ABuffer(data.size())),
+          mWatchedOffset(0),
+          mWatchedSize(0),
+          mNumWatchedReads(0) {
+        memcpy(mData->data(), data.array(), data.size());
+    }
+
+    // Counts the reads overlapping the given range.
+    void watchRange(off64_t offset, size_t size) {
+        mWatchedOffset = offset;
+        mWatchedSize = size;
+        mNumWatchedReads = 0;
+    }
+
+    size_t numWatchedReads() const {
+        return mNumWatchedReads;
+    }
+
+    virtual status_t initCheck() const {
+        return OK;
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        if (offset < mWatchedOffset + (off64_t)mWatchedSize
+                && offset + (off64_t)size > mWatchedOffset) {
+            ++mNumWatchedReads;
+        }
+
+        if (offset >= (off64_t)mData->size()) {
+            return 0;
+        }
+
+        if (size > mData->size() - offset) {
+            size = mData->size() - offset;
+        }
+        memcpy(data, mData->data() + offset, size);
+        return size;
+    }
+
+    virtual status_t getReadView(
+            off64_t offset, size_t size, sp<ABuffer> *view) {
+        if (offset < 0 || offset > (off64_t)mData->size()
+                || size > mData->size() - offset) {
+            return ERROR_OUT_OF_RANGE;
+        }
+
+        *view = ABuffer::CreateAsSlice(mData, offset, size);
+        return OK;
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        *size = mData->size();
+        return OK;
+    }
+
+private:
+    sp<ABuffer> mData;
+    off64_t mWatchedOffset;
+    size_t mWatchedSize;
+    size_t mNumWatchedReads;
+};
+
+class MPEG4ExtractorTest : public ::testing::Test {
+protected:
+    static void appendU32(Vector<uint8_t> *data, uint32_t x) {
+        data->push(x >> 24);
+        data->push((x >> 16) & 0xff);
+        data->push((x >> 8) & 0xff);
+        data->push(x & 0xff);
+    }
+
+    static void appendU16(Vector<uint8_t> *data, uint16_t x) {
+        data->push(x >> 8);
+        data->push(x & 0xff);
+    }
+
+    static void appendZeros(Vector<uint8_t> *data, size_t n) {
+        data->insertAt((uint8_t)0, data->size(), n);
+    }
+
+    static void appendBox(
+            Vector<uint8_t> *data, const char *type,
+            const Vector<uint8_t> &payload) {
+        appendU32(data, 8 + payload.size());
+        data->appendArray((const uint8_t *)type, 4);
+        data->appendVector(payload);
+    }
+
+    // Builds a file with a single AVC track of kNumSamples samples, each
+    // holding kNumNALsPerSample NAL units with 4 byte length prefixes.
+    void makeFile(Vector<uint8_t> *mp4) {
+        srand(1);
+
+        Vector<uint8_t> samples;
+        Vector<uint8_t> sizes;
+        for (size_t i = 0; i < kNumSamples; ++i) {
+            size_t sampleSize = 0;
+            for (size_t j = 0; j < kNumNALsPerSample; ++j) {
+                size_t nalSize = 1 + rand() % 2000;
+                Vector<uint8_t> nal;
+                nal.push(j == 0 && i == 0 ? 0x65 : 0x41);
+                for (size_t k = 1; k < nalSize; ++k) {
+                    nal.push(rand() & 0xff);
+                }
+                mNALs.push(nal);
+
+                appendU32(&samples, nalSize);
+                samples.appendVector(nal);
+                sampleSize += 4 + nalSize;
+            }
+            appendU32(&sizes, sampleSize);
+        }
+
+        Vector<uint8_t> ftyp;
+        ftyp.appendArray((const uint8_t *)"isom", 4);
+        appendU32(&ftyp, 0);
+        ftyp.appendArray((const uint8_t *)"isom", 4);
+
+        Vector<uint8_t> mvhd;
+        appendZeros(&mvhd, 12);
+        appendU32(&mvhd, 1000);                          // timescale
+        appendU32(&mvhd, kNumSamples * kSampleDuration);  // duration
+        appendZeros(&mvhd, 80);
+
+        Vector<uint8_t> tkhd;
+        appendU32(&tkhd, 0x00000007);                    // enabled
+        appendZeros(&tkhd, 8);
+        appendU32(&tkhd, 1);                             // track_ID
+        appendZeros(&tkhd, 4);
+        appendU32(&tkhd, kNumSamples * kSampleDuration);
+        appendZeros(&tkhd, 16);
+        static const uint32_t kIdentity[] = {
+            0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000,
+        };
+        for (size_t i = 0; i < 9; ++i) {
+            appendU32(&tkhd, kIdentity[i]);
+        }
+        appendU32(&tkhd, 320 << 16);
+        appendU32(&tkhd, 240 << 16);
+
+        Vector<uint8_t> mdhd;
+        appendZeros(&mdhd, 12);
+        appendU32(&mdhd, 1000);
+        appendU32(&mdhd, kNumSamples * kSampleDuration);
+        appendU16(&mdhd, 0x55c4);                        // "und"
+        appendU16(&mdhd, 0);
+
+        Vector<uint8_t> hdlr;
+        appendZeros(&hdlr, 8);
+        hdlr.appendArray((const uint8_t *)"vide", 4);
+        appendZeros(&hdlr, 13);
+
+        static const uint8_t kAVCC[] = {
+            0x01, 0x42, 0x00, 0x1e, 0xff,
+            0xe1, 0x00, 0x04, 0x67, 0x42, 0x00, 0x1e,    // SPS
+            0x01, 0x00, 0x02, 0x68, 0xce,                // PPS
+        };
+        Vector<uint8_t> avcC;
+        avcC.appendArray(kAVCC, sizeof(kAVCC));
+
+        Vector<uint8_t> avc1;
+        appendZeros(&avc1, 6);
+        appendU16(&avc1, 1);                             // data_reference_index
+        appendZeros(&avc1, 16);
+        appendU16(&avc1, 320);
+        appendU16(&avc1, 240);
+        appendU32(&avc1, 0x00480000);
+        appendU32(&avc1, 0x00480000);
+        appendU32(&avc1, 0);
+        appendU16(&avc1, 1);                             // frame_count
+        appendZeros(&avc1, 32);
+        appendU16(&avc1, 0x18);
+        appendU16(&avc1, 0xffff);
+        appendBox(&avc1, "avcC", avcC);
+
+        Vector<uint8_t> stsd;
+        appendU32(&stsd, 0);
+        appendU32(&stsd, 1);
+        appendBox(&stsd, "avc1", avc1);
+
+        Vector<uint8_t> stts;
+        appendU32(&stts, 0);
+        appendU32(&stts, 1);
+        appendU32(&stts, kNumSamples);
+        appendU32(&stts, kSampleDuration);
+
+        Vector<uint8_t> stsc;
+        appendU32(&stsc, 0);
+        appendU32(&stsc, 1);
+        appendU32(&stsc, 1);
+        appendU32(&stsc, kNumSamples);
+        appendU32(&stsc, 1);
+
+        Vector<uint8_t> stsz;
+        appendU32(&stsz, 0);
+        appendU32(&stsz, 0);
+        appendU32(&stsz, kNumSamples);
+        stsz.appendVector(sizes);
+
+        Vector<uint8_t> stss;
+        appendU32(&stss, 0);
+        appendU32(&stss, 1);
+        appendU32(&stss, 1);
+
+        // iTunes gapless info, which is file level metadata that ends up
+        // on the track.
+        Vector<uint8_t> mean, name, data;
+        appendU32(&mean, 0);
+        mean.appendArray((const uint8_t *)"com.apple.iTunes", 16);
+        appendU32(&name, 0);
+        name.appendArray((const uint8_t *)"iTunSMPB", 8);
+        appendU32(&data, 1);                             // UTF-8
+        appendU32(&data, 0);
+        static const char kSMPB[] = " 00000000 00000840 000001CC 00000000";
+        data.appendArray((const uint8_t *)kSMPB, sizeof(kSMPB) - 1);
+
+        Vector<uint8_t> comment;
+        appendBox(&comment, "mean", mean);
+        appendBox(&comment, "name", name);
+        appendBox(&comment, "data", data);
+
+        // Cover art, which plain track metadata has no use for.
+        Vector<uint8_t> art;
+        appendU32(&art, 13);                             // JPEG
+        appendU32(&art, 0);
+        art.insertAt((uint8_t)0xa5, art.size(), kCoverArtSize);
+
+        Vector<uint8_t> covr;
+        appendBox(&covr, "data", art);
+
+        Vector<uint8_t> ilst;
+        appendBox(&ilst, "covr", covr);
+        appendBox(&ilst, "----", comment);
+
+        Vector<uint8_t> meta;
+        appendU32(&meta, 0);
+        appendBox(&meta, "ilst", ilst);
+
+        Vector<uint8_t> udta;
+        appendBox(&udta, "meta", meta);
+
+        // The chunk offset depends on the size of everything before the
+        // samples, stco itself has a fixed size.
+        for (int pass = 0; pass < 2; ++pass) {
+            Vector<uint8_t> stco;
+            appendU32(&stco, 0);
+            appendU32(&stco, 1);
+            appendU32(&stco, mp4->size() + 8);
+
+            Vector<uint8_t> stbl;
+            appendBox(&stbl, "stsd", stsd);
+            appendBox(&stbl, "stts", stts);
+            appendBox(&stbl, "stsc", stsc);
+            appendBox(&stbl, "stsz", stsz);
+            appendBox(&stbl, "stco", stco);
+            appendBox(&stbl, "stss", stss);
+
+            Vector<uint8_t> minf;
+            appendBox(&minf, "stbl", stbl);
+
+            Vector<uint8_t> mdia;
+            appendBox(&mdia, "mdhd", mdhd);
+            appendBox(&mdia, "hdlr", hdlr);
+            appendBox(&mdia, "minf", minf);
+
+            Vector<uint8_t> trak;
+            appendBox(&trak, "tkhd", tkhd);
+            appendBox(&trak, "mdia", mdia);
+
+            Vector<uint8_t> moov;
+            appendBox(&moov, "mvhd", mvhd);
+            appendBox(&moov, "trak", trak);
+            appendBox(&moov, "udta", udta);
+
+            mp4->clear();
+            appendBox(mp4, "ftyp", ftyp);
+            appendBox(mp4, "moov", moov);
+        }
+
+        // The covr box comes first in the ilst, past the udta, meta and
+        // ilst headers at the end of the moov.
+        mCoverArtOffset = mp4->size() - (8 + udta.size()) + 8 + 12 + 8;
+
+        appendBox(mp4, "mdat", samples);
+    }
+
+    sp<MediaSource> startTrack(const Vector<uint8_t> &mp4, bool nalFragments) {
+        sp<MPEG4Extractor> extractor =
+            new MPEG4Extractor(new MP4DataSourceStub(mp4));
+        if (extractor->countTracks() != 1) {
+            return NULL;
+        }
+
+        sp<MediaSource> track = extractor->getTrack(0);
+        sp<MetaData> params = new MetaData;
+        if (nalFragments) {
+            params->setInt32(kKeyWantsNALFragments, true);
+        }
+        if (track == NULL || track->start(params.get()) != OK) {
+            return NULL;
+        }
+        return track;
+    }
+
+    Vector<Vector<uint8_t> > mNALs;
+    off64_t mCoverArtOffset;
+};
+
+TEST_F(MPEG4ExtractorTest, TestNALFragmentsFromView) {
+    Vector<uint8_t> mp4;
+    makeFile(&mp4);
+
+    sp<MediaSource> track = startTrack(mp4, true /* nalFragments */);
+    ASSERT_TRUE(track != NULL);
+
+    // Fragments are clones of a buffer wrapping a view of the data source,
+    // keep a few of them around past the end of their sample.
+    Vector<MediaBuffer *> held;
+    for (size_t i = 0; i < mNALs.size(); ++i) {
+        MediaBuffer *buffer;
+        ASSERT_EQ(OK, track->read(&buffer));
+
+        ASSERT_EQ(mNALs[i].size(), buffer->range_length()) << "NAL " << i;
+        ASSERT_EQ(0, memcmp(mNALs[i].array(),
+                            (const uint8_t *)buffer->data()
+                                + buffer->range_offset(),
+                            mNALs[i].size())) << "NAL " << i;
+
+        int64_t timeUs;
+        ASSERT_TRUE(buffer->meta_data()->findInt64(kKeyTime, &timeUs));
+        EXPECT_EQ((int64_t)(i / kNumNALsPerSample) * kSampleDuration * 1000,
+                  timeUs);
+
+        held.push(buffer);
+        if (held.size() > kNumNALsPerSample + 1) {
+            held[0]->release();
+            held.removeAt(0);
+        }
+    }
+
+    MediaBuffer *buffer;
+    EXPECT_EQ(ERROR_END_OF_STREAM, track->read(&buffer));
+
+    // Stopping with fragments still out must not affect them.
+    ASSERT_EQ(OK, track->stop());
+    for (size_t i = 0; i < held.size(); ++i) {
+        held[i]->release();
+    }
+}
+
+TEST_F(MPEG4ExtractorTest, TestStartCodesFromView) {
+    Vector<uint8_t> mp4;
+    makeFile(&mp4);
+
+    sp<MediaSource> track = startTrack(mp4, false /* nalFragments */);
+    ASSERT_TRUE(track != NULL);
+
+    for (size_t i = 0; i < kNumSamples; ++i) {
+        MediaBuffer *buffer;
+        ASSERT_EQ(OK, track->read(&buffer));
+
+        Vector<uint8_t> expected;
+        for (size_t j = 0; j < kNumNALsPerSample; ++j) {
+            static const uint8_t kStartCode[] = { 0x00, 0x00, 0x00, 0x01 };
+            expected.appendArray(kStartCode, sizeof(kStartCode));
+            expected.appendVector(mNALs[i * kNumNALsPerSample + j]);
+        }
+
+        ASSERT_EQ(expected.size(), buffer->range_length()) << "sample " << i;
+        ASSERT_EQ(0, memcmp(expected.array(),
+                            (const uint8_t *)buffer->data()
+                                + buffer->range_offset(),
+                            expected.size())) << "sample " << i;
+        buffer->release();
+    }
+
+    ASSERT_EQ(OK, track->stop());
+}
+
+TEST_F(MPEG4ExtractorTest, TestGaplessInfoInTrackMetaData) {
+    Vector<uint8_t> mp4;
+    makeFile(&mp4);
+
+    sp<MPEG4Extractor> extractor =
+        new MPEG4Extractor(new MP4DataSourceStub(mp4));
+    ASSERT_EQ(1u, extractor->countTracks());
+
+    // The udta box is parsed lazily, but plain track metadata must include
+    // what it contributes to the track.
+    sp<MetaData> meta = extractor->getTrackMetaData(0, 0 /* flags */);
+    ASSERT_TRUE(meta != NULL);
+
+    int32_t delay, padding;
+    ASSERT_TRUE(meta->findInt32(kKeyEncoderDelay, &delay));
+    ASSERT_TRUE(meta->findInt32(kKeyEncoderPadding, &padding));
+    EXPECT_EQ(0x840, delay);
+    EXPECT_EQ(0x1cc, padding);
+}
+
+TEST_F(MPEG4ExtractorTest, TestCoverArtOnlyReadForFileMetaData) {
+    Vector<uint8_t> mp4;
+    makeFile(&mp4);
+    ASSERT_EQ(0, memcmp("covr", &mp4[mCoverArtOffset + 4], 4));
+
+    sp<MP4DataSourceStub> source = new MP4DataSourceStub(mp4);
+    source->watchRange(mCoverArtOffset + 8, 16 + kCoverArtSize);
+
+    sp<MPEG4Extractor> extractor = new MPEG4Extractor(source);
+    ASSERT_EQ(1u, extractor->countTracks());
+    ASSERT_TRUE(extractor->getTrackMetaData(0, 0 /* flags */) != NULL);
+    ASSERT_TRUE(extractor->getTrack(0) != NULL);
+    EXPECT_EQ(0u, source->numWatchedReads());
+
+    sp<MetaData> meta = extractor->getMetaData();
+    uint32_t type;
+    const void *data;
+    size_t size;
+    ASSERT_TRUE(meta->findData(kKeyAlbumArt, &type, &data, &size));
+    EXPECT_EQ(kCoverArtSize, size);
+    EXPECT_LT(0u, source->numWatchedReads());
+
+    // The gapless info is still there after the full parse.
+    int32_t delay;
+    ASSERT_TRUE(extractor->getTrackMetaData(0, 0)->findInt32(
+                kKeyEncoderDelay, &delay));
+    EXPECT_EQ(0x840, delay);
+}
+
+}  // namespace android
@@ -0,0 +1,284 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "MediaScanner_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+#include <media/mediascanner.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+static const int kNumArtists = 6;
+static const int kNumAlbums = 3;
+static const int kNumTracks = 5;
+
+// Plus the ".nomedia" file and the one in the hidden directory.
+static const int kNumFiles = kNumArtists * kNumAlbums * kNumTracks + 2;
+
+// Pretends that ".mp3" files carry a title and everything else is no media.
+struct TestScanner : public MediaScanner {
+    TestScanner() : mNumExtractions(0), mThread(pthread_self()) {
+        setLocale("en_US");
+    }
+
+    virtual MediaScanResult processFile(
+            const char *path, const char * /* mimeType */,
+            MediaScannerClient &client) {
+        MediaScanResult result;
+        if (takePrefetchedFile(path, client, &result)) {
+            return result;
+        }
+
+        if (pthread_equal(mThread, pthread_self())) {
+            ++mNumExtractions;
+        }
+
+        client.setLocale(locale());
+        client.beginFile();
+        const char *extension = strrchr(path, '.');
+        if (extension == NULL || strcmp(extension, ".mp3")) {
+            client.endFile();
+            return MEDIA_SCAN_RESULT_SKIPPED;
+        }
+        client.setMimeType("audio/mpeg");
+        client.addStringTag("title", strrchr(path, '/') + 1);
+        client.endFile();
+        return MEDIA_SCAN_RESULT_OK;
+    }
+
+    virtual MediaAlbumArt *extractAlbumArt(int /* fd */) {
+        return NULL;
+    }
+
+    // Files extracted on the scanning thread rather than by a worker.
+    int mNumExtractions;
+
+private:
+    pthread_t mThread;
+};
+
+// Logs every callback and, like the Java client, asks for the tags of
+// every file it is told about.
+struct TestClient : public MediaScannerClient {
+    TestClient(TestScanner *scanner)
+        : mScanner(scanner), mThread(pthread_self()) {}
+
+    virtual status_t scanFile(
+            const char *path, long long /* lastModified */,
+            long long fileSize, bool isDirectory, bool noMedia) {
+        EXPECT_TRUE(pthread_equal(mThread, pthread_self()));
+        mLog.push(String8::format("scan %s %lld %d %d",
+                    path, fileSize, isDirectory, noMedia));
+        if (!isDirectory) {
+            MediaScanResult result = mScanner->processFile(path, NULL, *this);
+            mLog.push(String8::format("result %d", result));
+        }
+        return OK;
+    }
+
+    virtual status_t handleStringTag(const char *name, const char *value) {
+        EXPECT_TRUE(pthread_equal(mThread, pthread_self()));
+        mLog.push(String8::format("tag %s=%s", name, value));
+        return OK;
+    }
+
+    virtual status_t setMimeType(const char *mimeType) {
+        EXPECT_TRUE(pthread_equal(mThread, pthread_self()));
+        mLog.push(String8::format("mime %s", mimeType));
+        return OK;
+    }
+
+    Vector<String8> mLog;
+
+private:
+    TestScanner *mScanner;
+    pthread_t mThread;
+};
+
+class MediaScannerTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        const char *tmp = getenv("TMPDIR");
+        char root[PATH_MAX];
+        snprintf(root, sizeof(root), "%s/MediaScanner_test.XXXXXX",
+                tmp ? tmp : "/data/local/tmp");
+        ASSERT_TRUE(mkdtemp(root) != NULL);
+
+        mRoot.setTo(root);
+        mSkipCache = String8::format("%s/skip-cache", root);
+    }
+
+    virtual void TearDown() {
+        property_set("media.scanner.threads", "");
+        property_set("media.scanner.skip-cache", "");
+        String8 command = String8::format("rm -rf '%s'", mRoot.string());
+        system(command.string());
+    }
+
+    void writeFile(const String8 &path, const char *data) {
+        FILE *file = fopen(path.string(), "w");
+        ASSERT_TRUE(file != NULL);
+        fputs(data, file);
+        fclose(file);
+    }
+
+    // Builds "<mRoot>/<name>/artist*/album*/track*" with a ".nomedia"
+    // album and a hidden directory thrown in.
+    void makeTree(const char *name) {
+        String8 top = String8::format("%s/%s", mRoot.string(), name);
+        ASSERT_EQ(0, mkdir(top.string(), 0755));
+        for (int i = 0; i < kNumArtists; ++i) {
+            String8 artist = String8::format("%s/artist%d", top.string(), i);
+            ASSERT_EQ(0, mkdir(artist.string(), 0755));
+            for (int j = 0; j < kNumAlbums; ++j) {
+                String8 album =
+                    String8::format("%s/album%d", artist.string(), j);
+                ASSERT_EQ(0, mkdir(album.string(), 0755));
+                if (i == 1 && j == 2) {
+                    writeFile(String8::format(
+                                "%s/.nomedia", album.string()), "");
+                }
+                for (int k = 0; k < kNumTracks; ++k) {
+                    writeFile(String8::format("%s/track%d.%s", album.string(),
+                                k, k == 0 ? "jpg" : "mp3"),
+                            String8::format("%d%d%d", i, j, k).string());
+                }
+            }
+        }
+        String8 hidden = String8::format("%s/.hidden", top.string());
+        ASSERT_EQ(0, mkdir(hidden.string(), 0755));
+        writeFile(String8::format("%s/hidden.mp3", hidden.string()), "");
+    }
+
+    void scan(const char *name, const char *threads,
+            Vector<String8> *log, int *numExtractions = NULL) {
+        property_set("media.scanner.threads", threads);
+
+        TestScanner scanner;
+        TestClient client(&scanner);
+        String8 path = String8::format("%s/%s", mRoot.string(), name);
+        EXPECT_EQ(MEDIA_SCAN_RESULT_OK,
+                  scanner.processDirectory(path.string(), client));
+
+        *log = client.mLog;
+        if (numExtractions != NULL) {
+            *numExtractions = scanner.mNumExtractions;
+        }
+    }
+
+    void expectSameLog(
+            const Vector<String8> &expected, const Vector<String8> &actual) {
+        ASSERT_EQ(expected.size(), actual.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_STREQ(expected[i].string(), actual[i].string())
+                << "callback " << i;
+        }
+    }
+
+    String8 mRoot;
+    String8 mSkipCache;
+};
+
+TEST_F(MediaScannerTest, ParallelWalkMatchesSequential) {
+    makeTree("music");
+
+    Vector<String8> sequential, parallel;
+    scan("music", "", &sequential);
+    scan("music", "4", &parallel);
+
+    // A scan and a result for every file, a MIME type and a title for
+    // every ".mp3" and a scan for every directory.
+    int numTagged = kNumArtists * kNumAlbums * (kNumTracks - 1) + 1;
+    int numDirectories = kNumArtists * (kNumAlbums + 1) + 1;
+    EXPECT_EQ((size_t)(2 * kNumFiles + 2 * numTagged + numDirectories),
+              sequential.size());
+    expectSameLog(sequential, parallel);
+}
+
+TEST_F(MediaScannerTest, NoPrefetchWithoutSkipCache) {
+    makeTree("music");
+
+    // Without knowing which files changed, the workers must not extract
+    // anything the client may not even ask for.
+    Vector<String8> log;
+    int numExtractions;
+    scan("music", "4", &log, &numExtractions);
+    EXPECT_EQ(kNumFiles, numExtractions);
+}
+
+TEST_F(MediaScannerTest, SkipCache) {
+    makeTree("music");
+    property_set("media.scanner.skip-cache", mSkipCache.string());
+
+    Vector<String8> sequential, first, second;
+    scan("music", "", &sequential);
+
+    // The first scan only creates the cache, the second one prefetches
+    // the files that changed since.
+    scan("music", "4", &first);
+    expectSameLog(sequential, first);
+    ASSERT_EQ(0, access(mSkipCache.string(), F_OK));
+
+    String8 changed = String8::format(
+            "%s/music/artist2/album0/track3.mp3", mRoot.string());
+    writeFile(changed, "changed");
+
+    scan("music", "", &sequential);
+    scan("music", "4", &second);
+    expectSameLog(sequential, second);
+}
+
+TEST_F(MediaScannerTest, SkipCacheKeepsOtherRoots) {
+    makeTree("music");
+    makeTree("podcasts");
+    property_set("media.scanner.skip-cache", mSkipCache.string());
+
+    Vector<String8> log;
+    scan("music", "4", &log);
+    scan("podcasts", "4", &log);
+
+    FILE *file = fopen(mSkipCache.string(), "r");
+    ASSERT_TRUE(file != NULL);
+    size_t numMusic = 0, numPodcasts = 0;
+    char line[PATH_MAX + 64];
+    while (fgets(line, sizeof(line), file)) {
+        if (strstr(line, "/music/")) {
+            ++numMusic;
+        } else if (strstr(line, "/podcasts/")) {
+            ++numPodcasts;
+        }
+    }
+    fclose(file);
+
+    EXPECT_EQ((size_t)kNumFiles, numMusic);
+    EXPECT_EQ((size_t)kNumFiles, numPodcasts);
+}
+
+}  // namespace android
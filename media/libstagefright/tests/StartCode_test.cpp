@@ -0,0 +1,203 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "StartCode_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include <stdlib.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+
+#include "include/avc_utils.h"
+
+namespace android {
+
+static const uint8_t *ReferenceFindStartCode(
+        const uint8_t *data, size_t size) {
+    for (size_t i = 0; i + 2 < size; ++i) {
+        if (data[i] == 0x00 && data[i + 1] == 0x00 && data[i + 2] == 0x01) {
+            return &data[i];
+        }
+    }
+    return NULL;
+}
+
+static const uint8_t *ReferenceFindSyncWord(
+        const uint8_t *data, size_t size, uint8_t mask) {
+    for (size_t i = 0; i + 1 < size; ++i) {
+        if (data[i] == 0xff && (data[i + 1] & mask) == mask) {
+            return &data[i];
+        }
+    }
+    return NULL;
+}
+
+class StartCodeTest : public ::testing::Test {
+protected:
+    // Random data with plenty of the bytes the scanners look for.
+    void fillRandom(uint8_t *data, size_t size, unsigned seed) {
+        srand(seed);
+        for (size_t i = 0; i < size; ++i) {
+            switch (rand() % 8) {
+                case 0:
+                case 1:
+                    data[i] = 0x00;
+                    break;
+                case 2:
+                    data[i] = 0x01;
+                    break;
+                case 3:
+                    data[i] = 0xff;
+                    break;
+                default:
+                    data[i] = rand() & 0xff;
+                    break;
+            }
+        }
+    }
+};
+
+TEST_F(StartCodeTest, TestFindStartCodeMatchesReference) {
+    static const size_t kSize = 4096;
+    uint8_t data[kSize];
+
+    for (unsigned seed = 0; seed < 64; ++seed) {
+        fillRandom(data, kSize, seed);
+
+        // Every offset and length, so all block/tail splits are covered.
+        for (size_t offset = 0; offset < 40; ++offset) {
+            for (size_t size = 0; offset + size <= kSize; size += 1 + size / 4) {
+                ASSERT_EQ(ReferenceFindStartCode(&data[offset], size),
+                          FindStartCode(&data[offset], size));
+            }
+        }
+    }
+}
+
+TEST_F(StartCodeTest, TestFindStartCodeInZeros) {
+    static const size_t kSize = 256;
+    uint8_t data[kSize];
+    memset(data, 0, kSize);
+
+    ASSERT_TRUE(FindStartCode(data, kSize) == NULL);
+
+    for (size_t i = 2; i < kSize; ++i) {
+        data[i] = 0x01;
+        ASSERT_EQ(&data[i - 2], FindStartCode(data, kSize));
+        ASSERT_TRUE(FindStartCode(data, i) == NULL);
+        data[i] = 0x00;
+    }
+}
+
+TEST_F(StartCodeTest, TestFindSyncWordMatchesReference) {
+    static const size_t kSize = 4096;
+    uint8_t data[kSize];
+
+    for (unsigned seed = 0; seed < 64; ++seed) {
+        fillRandom(data, kSize, seed);
+
+        for (size_t offset = 0; offset < 40; ++offset) {
+            for (size_t size = 0; offset + size <= kSize; size += 1 + size / 4) {
+                ASSERT_EQ(ReferenceFindSyncWord(&data[offset], size, 0xf0),
+                          FindSyncWord(&data[offset], size, 0xf0));
+                ASSERT_EQ(ReferenceFindSyncWord(&data[offset], size, 0xe0),
+                          FindSyncWord(&data[offset], size, 0xe0));
+            }
+        }
+    }
+}
+
+TEST_F(StartCodeTest, TestGetNextNALUnit) {
+    static const uint8_t kData[] = {
+        0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0x00,
+        0x00, 0x00, 0x01, 0x68, 0xce,
+        0x00, 0x00, 0x01, 0x65, 0x88, 0x00, 0x00, 0x00,
+    };
+
+    const uint8_t *data = kData;
+    size_t size = sizeof(kData);
+    const uint8_t *nalStart;
+    size_t nalSize;
+
+    ASSERT_EQ(OK, getNextNALUnit(&data, &size, &nalStart, &nalSize));
+    ASSERT_EQ(&kData[4], nalStart);
+    ASSERT_EQ(2u, nalSize);
+
+    ASSERT_EQ(OK, getNextNALUnit(&data, &size, &nalStart, &nalSize));
+    ASSERT_EQ(&kData[10], nalStart);
+    ASSERT_EQ(2u, nalSize);
+
+    ASSERT_EQ(-EAGAIN, getNextNALUnit(&data, &size, &nalStart, &nalSize));
+
+    ASSERT_EQ(OK, getNextNALUnit(&data, &size, &nalStart, &nalSize, true));
+    ASSERT_EQ(&kData[15], nalStart);
+    ASSERT_EQ(2u, nalSize);
+    ASSERT_TRUE(data == NULL);
+}
+
+TEST_F(StartCodeTest, BenchmarkFindStartCode) {
+    static const size_t kSize = 1 << 20;
+    static const int kIterations = 32;
+
+    // Start codes are rare in coded slice data, emulation prevention
+    // keeps runs of zeros short.
+    uint8_t *data = new uint8_t[kSize];
+    srand(1);
+    for (size_t i = 0; i < kSize; ++i) {
+        data[i] = (rand() % 64 == 0) ? 0x00 : (rand() & 0xff) | 0x02;
+    }
+    for (size_t i = 0; i + 3 < kSize; i += 16384) {
+        data[i] = data[i + 1] = 0x00;
+        data[i + 2] = 0x01;
+    }
+
+    size_t count = 0;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; ++i) {
+        const uint8_t *ptr = data;
+        while ((ptr = ReferenceFindStartCode(ptr, data + kSize - ptr))
+                != NULL) {
+            ++ptr;
+            ++count;
+        }
+    }
+    nsecs_t referenceNs = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; ++i) {
+        const uint8_t *ptr = data;
+        while ((ptr = FindStartCode(ptr, data + kSize - ptr)) != NULL) {
+            ++ptr;
+            --count;
+        }
+    }
+    nsecs_t scanNs = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    delete[] data;
+
+    ASSERT_EQ(0u, count);
+
+    ALOGI("byte-wise: %.2f MB/s, FindStartCode: %.2f MB/s",
+          (double)kSize * kIterations * 1E3 / referenceNs,
+          (double)kSize * kIterations * 1E3 / scanNs);
+}
+
+}  // namespace android
@@ -0,0 +1,291 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "WAVExtractor_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AString.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaSource.h>
+#include <media/stagefright/MetaData.h>
+#include <system/audio.h>
+
+#include "include/WAVExtractor.h"
+
+namespace android {
+
+static const int32_t kSampleRate = 48000;
+static const size_t kNumChannels = 2;
+static const size_t kNumFrames = 12345;  // Not a multiple of any block
+
+class WAVDataSourceStub : public DataSource {
+public:
+    WAVDataSourceStub(const Vector<uint8_t> &data) : mData(data) {}
+
+    virtual status_t initCheck() const {
+        return OK;
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        if (offset >= (off64_t)mData.size()) {
+            return 0;
+        }
+
+        if (size > mData.size() - offset) {
+            size = mData.size() - offset;
+        }
+        memcpy(data, mData.array() + offset, size);
+        return size;
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        *size = mData.size();
+        return OK;
+    }
+
+private:
+    Vector<uint8_t> mData;
+};
+
+class WAVExtractorTest : public ::testing::Test {
+protected:
+    static void appendLE(Vector<uint8_t> *data, uint32_t x, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            data->push((x >> (8 * i)) & 0xff);
+        }
+    }
+
+    // Builds a file with a plain (or, if "extensible", WAVE_FORMAT_EXTENSIBLE)
+    // fmt chunk and returns the sample data in "samples".
+    void makeFile(
+            Vector<uint8_t> *wav, Vector<uint8_t> *samples,
+            uint16_t format, size_t bitsPerSample, bool extensible) {
+        srand(1);
+        size_t bytesPerSample = bitsPerSample / 8;
+        for (size_t i = 0; i < kNumFrames * kNumChannels; ++i) {
+            if (format == 3) {
+                float x;
+                static const float kExtremes[] = {
+                    // Out of range values have to be clipped, NaN becomes 0,
+                    // ties are rounded to even.
+                    1.5f, -1.5f, 1.0f, -1.0f, NAN, -NAN,
+                    0.5f / 32768.0f, 1.5f / 32768.0f, -2.5f / 32768.0f,
+                };
+                if (i < sizeof(kExtremes) / sizeof(kExtremes[0])) {
+                    x = kExtremes[i];
+                } else {
+                    x = (float)(rand() % 65536 - 32768) / 32768.0f
+                        + (float)(rand() % 1000) / 1e8f;
+                }
+                uint32_t bits;
+                memcpy(&bits, &x, 4);
+                appendLE(samples, bits, 4);
+            } else {
+                appendLE(samples, rand(), bytesPerSample);
+            }
+        }
+
+        size_t fmtSize = extensible ? 40 : 16;
+        wav->appendArray((const uint8_t *)"RIFF", 4);
+        appendLE(wav, 4 + 8 + fmtSize + 8 + samples->size(), 4);
+        wav->appendArray((const uint8_t *)"WAVEfmt ", 8);
+        appendLE(wav, fmtSize, 4);
+        appendLE(wav, extensible ? 0xfffe : format, 2);
+        appendLE(wav, kNumChannels, 2);
+        appendLE(wav, kSampleRate, 4);
+        appendLE(wav, kSampleRate * kNumChannels * bytesPerSample, 4);
+        appendLE(wav, kNumChannels * bytesPerSample, 2);
+        appendLE(wav, bitsPerSample, 2);
+        if (extensible) {
+            appendLE(wav, 22, 2);
+            appendLE(wav, bitsPerSample, 2);
+            appendLE(wav, 0x3, 4);  // front left and right
+            appendLE(wav, format, 2);
+            wav->appendArray(
+                    (const uint8_t *)"\x00\x00\x00\x00\x10\x00\x80\x00"
+                                     "\x00\xAA\x00\x38\x9B\x71", 14);
+        }
+        wav->appendArray((const uint8_t *)"data", 4);
+        appendLE(wav, samples->size(), 4);
+        wav->appendVector(*samples);
+    }
+
+    // Reads the whole track, checking that timestamps are contiguous.
+    void readAll(
+            const sp<MediaSource> &source, int32_t encoding,
+            int32_t expectedEncoding, Vector<uint8_t> *output) {
+        sp<MetaData> params = new MetaData;
+        params->setInt32(kKeyPcmEncoding, encoding);
+        ASSERT_EQ(OK, source->start(params.get()));
+
+        int32_t actualEncoding;
+        ASSERT_TRUE(source->getFormat()->findInt32(
+                    kKeyPcmEncoding, &actualEncoding));
+        ASSERT_EQ(expectedEncoding, actualEncoding);
+
+        int32_t maxInputSize;
+        ASSERT_TRUE(source->getFormat()->findInt32(
+                    kKeyMaxInputSize, &maxInputSize));
+
+        size_t frameSize = kNumChannels *
+            (expectedEncoding == AUDIO_FORMAT_PCM_16_BIT ? 2
+             : expectedEncoding == AUDIO_FORMAT_PCM_24_BIT_PACKED ? 3 : 4);
+
+        MediaBuffer *buffer;
+        while (source->read(&buffer) == OK) {
+            int64_t timeUs;
+            ASSERT_TRUE(buffer->meta_data()->findInt64(kKeyTime, &timeUs));
+            EXPECT_EQ(1000000ll * (output->size() / frameSize) / kSampleRate,
+                      timeUs);
+            ASSERT_LE(buffer->range_length(), (size_t)maxInputSize);
+            ASSERT_EQ(0u, buffer->range_length() % frameSize);
+
+            output->appendArray(
+                    (const uint8_t *)buffer->data() + buffer->range_offset(),
+                    buffer->range_length());
+            buffer->release();
+        }
+
+        AString stats;
+        source->dump(&stats);
+        EXPECT_NE(-1, stats.find("MediaBufferGroup"));
+
+        ASSERT_EQ(OK, source->stop());
+        ASSERT_EQ(kNumFrames * frameSize, output->size());
+    }
+
+    void testFormat(
+            uint16_t format, size_t bitsPerSample, bool extensible,
+            int32_t encoding, int32_t expectedEncoding) {
+        Vector<uint8_t> wav, samples;
+        makeFile(&wav, &samples, format, bitsPerSample, extensible);
+
+        sp<WAVExtractor> extractor =
+            new WAVExtractor(new WAVDataSourceStub(wav));
+        ASSERT_EQ(1u, extractor->countTracks());
+
+        Vector<uint8_t> output;
+        readAll(extractor->getTrack(0), encoding, expectedEncoding, &output);
+        if (HasFatalFailure()) {
+            return;
+        }
+
+        const uint8_t *in = samples.array();
+        const uint8_t *out = output.array();
+        for (size_t i = 0; i < kNumFrames * kNumChannels; ++i) {
+            if (format == 3) {
+                float x;
+                memcpy(&x, in + 4 * i, 4);
+                if (expectedEncoding == AUDIO_FORMAT_PCM_FLOAT) {
+                    ASSERT_EQ(0, memcmp(in + 4 * i, out + 4 * i, 4))
+                        << "sample " << i;
+                } else {
+                    int16_t y;
+                    memcpy(&y, out + 2 * i, 2);
+                    long expected = isnan(x) ? 0 : lrintf(x * 32768.0f);
+                    if (expected > 32767) {
+                        expected = 32767;
+                    } else if (expected < -32768) {
+                        expected = -32768;
+                    }
+                    // The SIMD and scalar paths have to agree exactly.
+                    ASSERT_EQ(expected, y) << "sample " << i;
+                }
+            } else if (bitsPerSample == 8) {
+                int16_t y;
+                memcpy(&y, out + 2 * i, 2);
+                ASSERT_EQ(((int)in[i] - 128) * 256, y) << "sample " << i;
+            } else if (bitsPerSample == 16) {
+                ASSERT_EQ(0, memcmp(in + 2 * i, out + 2 * i, 2)) << "sample " << i;
+            } else {
+                const uint8_t *x = in + 3 * i;
+                int32_t y = (int32_t)((uint32_t)x[0] << 8
+                        | (uint32_t)x[1] << 16 | (uint32_t)x[2] << 24);
+                switch (expectedEncoding) {
+                    case AUDIO_FORMAT_PCM_16_BIT:
+                    {
+                        int16_t z;
+                        memcpy(&z, out + 2 * i, 2);
+                        ASSERT_EQ(y >> 16, z) << "sample " << i;
+                        break;
+                    }
+                    case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+                        ASSERT_EQ(0, memcmp(x, out + 3 * i, 3)) << "sample " << i;
+                        break;
+                    case AUDIO_FORMAT_PCM_32_BIT:
+                    {
+                        int32_t z;
+                        memcpy(&z, out + 4 * i, 4);
+                        ASSERT_EQ(y, z) << "sample " << i;
+                        break;
+                    }
+                    case AUDIO_FORMAT_PCM_8_24_BIT:
+                    {
+                        // Q8.23, sign-extended into the upper byte.
+                        int32_t z;
+                        memcpy(&z, out + 4 * i, 4);
+                        ASSERT_EQ(y >> 8, z) << "sample " << i;
+                        break;
+                    }
+                    default:
+                    {
+                        float z;
+                        memcpy(&z, out + 4 * i, 4);
+                        ASSERT_EQ((float)y / 2147483648.0f, z) << "sample " << i;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+};
+
+TEST_F(WAVExtractorTest, Test8Bit) {
+    testFormat(1, 8, false, AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_16_BIT);
+    // Only 24-bit and float samples can be passed on unconverted.
+    testFormat(1, 8, false, AUDIO_FORMAT_PCM_FLOAT, AUDIO_FORMAT_PCM_16_BIT);
+}
+
+TEST_F(WAVExtractorTest, Test16Bit) {
+    testFormat(1, 16, false, AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_16_BIT);
+}
+
+TEST_F(WAVExtractorTest, Test24Bit) {
+    testFormat(1, 24, false, AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_16_BIT);
+    testFormat(1, 24, false,
+               AUDIO_FORMAT_PCM_24_BIT_PACKED, AUDIO_FORMAT_PCM_24_BIT_PACKED);
+    testFormat(1, 24, false,
+               AUDIO_FORMAT_PCM_8_24_BIT, AUDIO_FORMAT_PCM_8_24_BIT);
+    testFormat(1, 24, false,
+               AUDIO_FORMAT_PCM_32_BIT, AUDIO_FORMAT_PCM_32_BIT);
+    testFormat(1, 24, true, AUDIO_FORMAT_PCM_FLOAT, AUDIO_FORMAT_PCM_FLOAT);
+}
+
+TEST_F(WAVExtractorTest, TestFloat) {
+    testFormat(3, 32, false, AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_16_BIT);
+    testFormat(3, 32, true, AUDIO_FORMAT_PCM_FLOAT, AUDIO_FORMAT_PCM_FLOAT);
+}
+
+}  // namespace android